@@ -0,0 +1,51 @@
+#ifndef INCLUDED_ADDRESS_BITMAP_H
+#define INCLUDED_ADDRESS_BITMAP_H
+
+#include <stdint.h>
+#include <string.h>
+
+namespace MOS6510 {
+
+// one bit per address of the 64K space, a lookup is a shift and a mask
+class AddressBitmap {
+private:
+    uint64_t    m_bits[65536 / 64];
+    uint32_t    m_count;
+
+public:
+    AddressBitmap()
+        : m_count(0)
+    {
+        memset(m_bits, 0, sizeof(m_bits));
+    }
+
+    bool test(uint16_t addr) const
+    {
+        return 0 != (m_bits[addr >> 6] & (1ULL << (addr & 63)));
+    }
+
+    void set(uint16_t addr)
+    {
+        if(!test(addr)) {
+            m_bits[addr >> 6] |= (1ULL << (addr & 63));
+            ++m_count;
+        }
+    }
+
+    void clear(uint16_t addr)
+    {
+        if(test(addr)) {
+            m_bits[addr >> 6] &= ~(1ULL << (addr & 63));
+            --m_count;
+        }
+    }
+
+    uint32_t count() const
+    {
+        return m_count;
+    }
+};
+
+}
+
+#endif
@@ -0,0 +1,67 @@
+#include <string.h>
+#include <stdio.h>
+#include <iostream>
+#include "audiooutput.h"
+
+namespace MOS6510 {
+
+AudioOutput::AudioOutput()
+    : m_ring(AUDIO_SAMPLE_RATE / 4)
+    , m_device(0)
+    , m_dropped(0)
+{
+}
+
+AudioOutput::~AudioOutput()
+{
+    if(m_device) {
+        SDL_CloseAudioDevice(m_device);
+        SDL_QuitSubSystem(SDL_INIT_AUDIO);
+        if(m_dropped) {
+            printf("Audio output dropped %u samples\n", m_dropped);
+        }
+    }
+}
+
+bool AudioOutput::open()
+{
+    if(0 > SDL_InitSubSystem(SDL_INIT_AUDIO)) {
+        std::cerr << "Failed to start SDL audio: " << SDL_GetError() << std::endl;
+        return false;
+    }
+
+    SDL_AudioSpec want;
+    SDL_AudioSpec have;
+    memset(&want, 0, sizeof(want));
+    want.freq = AUDIO_SAMPLE_RATE;
+    want.format = AUDIO_S16SYS;
+    want.channels = 1;
+    want.samples = 1024;
+    want.callback = &AudioOutput::callback;
+    want.userdata = this;
+    m_device = SDL_OpenAudioDevice(0, 0, &want, &have, 0);
+    if(!m_device) {
+        std::cerr << "Failed to open audio device: " << SDL_GetError() << std::endl;
+        SDL_QuitSubSystem(SDL_INIT_AUDIO);
+        return false;
+    }
+
+    SDL_PauseAudioDevice(m_device, 0);
+    return true;
+}
+
+void AudioOutput::callback(void *userdata, uint8_t *stream, int len)
+{
+    AudioOutput *self = (AudioOutput*)userdata;
+    int16_t *samples = (int16_t*)stream;
+    size_t count = len / sizeof(int16_t);
+    size_t got = self->m_ring.read(samples, count);
+    memset(samples + got, 0, (count - got) * sizeof(int16_t));
+}
+
+void AudioOutput::onSamples(const int16_t *samples, size_t count)
+{
+    m_dropped += count - m_ring.write(samples, count);
+}
+
+}
@@ -0,0 +1,31 @@
+#ifndef INCLUDED_AUDIO_OUTPUT_H
+#define INCLUDED_AUDIO_OUTPUT_H
+
+#include <SDL2/SDL.h>
+#include "audiosink.h"
+#include "audioring.h"
+
+namespace MOS6510 {
+
+// Plays SID output through SDL. Samples are handed to the audio callback
+// through a lock-free ring; overruns drop samples, underruns play silence.
+class AudioOutput : public AudioSink {
+private:
+    AudioRing           m_ring;
+    SDL_AudioDeviceID   m_device;
+    uint32_t            m_dropped;
+
+    static void callback(void *userdata, uint8_t *stream, int len);
+
+public:
+    AudioOutput();
+    virtual ~AudioOutput();
+
+    bool open();
+
+    virtual void onSamples(const int16_t *samples, size_t count);
+};
+
+}
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef INCLUDED_AUDIO_RING_H
+#define INCLUDED_AUDIO_RING_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <vector>
+
+namespace MOS6510 {
+
+// Lock-free single-producer/single-consumer sample ring. The emulation
+// thread writes, the audio callback reads; neither ever blocks.
+class AudioRing {
+private:
+    std::vector<int16_t>    m_buffer;
+    size_t                  m_mask;
+    std::atomic<size_t>     m_readPos;
+    std::atomic<size_t>     m_writePos;
+
+public:
+    // capacity is rounded up to a power of two
+    AudioRing(size_t capacity)
+        : m_readPos(0)
+        , m_writePos(0)
+    {
+        size_t size = 1;
+        while(size < capacity) {
+            size <<= 1;
+        }
+        m_buffer.resize(size);
+        m_mask = size - 1;
+    }
+
+    // returns the number of samples accepted, the rest are dropped
+    size_t write(const int16_t *samples, size_t count)
+    {
+        const size_t wr = m_writePos.load(std::memory_order_relaxed);
+        const size_t rd = m_readPos.load(std::memory_order_acquire);
+        const size_t space = m_buffer.size() - (wr - rd);
+        if(count > space) {
+            count = space;
+        }
+
+        for(size_t i = 0; i < count; ++i) {
+            m_buffer[(wr + i) & m_mask] = samples[i];
+        }
+        m_writePos.store(wr + count, std::memory_order_release);
+        return count;
+    }
+
+    // returns the number of samples read
+    size_t read(int16_t *samples, size_t count)
+    {
+        const size_t rd = m_readPos.load(std::memory_order_relaxed);
+        const size_t wr = m_writePos.load(std::memory_order_acquire);
+        const size_t avail = wr - rd;
+        if(count > avail) {
+            count = avail;
+        }
+
+        for(size_t i = 0; i < count; ++i) {
+            samples[i] = m_buffer[(rd + i) & m_mask];
+        }
+        m_readPos.store(rd + count, std::memory_order_release);
+        return count;
+    }
+};
+
+}
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef INCLUDED_AUDIO_SINK_H
+#define INCLUDED_AUDIO_SINK_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace MOS6510 {
+
+const int AUDIO_SAMPLE_RATE = 48000;
+
+// Receives blocks of mono signed 16-bit samples at AUDIO_SAMPLE_RATE from the
+// SID, on the emulation thread.
+class AudioSink {
+public:
+    virtual ~AudioSink() {}
+    virtual void onSamples(const int16_t *samples, size_t count) = 0;
+};
+
+}
+
+#endif
@@ -0,0 +1,908 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <new>
+#include <vector>
+#include "batchcpu.h"
+#include "iocontroller.h"
+#include "sid.h"
+#include "vicii.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace MOS6510 {
+
+const uint16_t BRK_VECTOR = 0xFFFE;
+
+static inline LaneBytes splat(uint8_t value)
+{
+    LaneBytes v = {};
+    return v + value;
+}
+
+static inline LaneBytes select(const LaneBytes& mask, const LaneBytes& a, const LaneBytes& b)
+{
+    return (a & mask) | (b & ~mask);
+}
+
+static inline uint32_t laneBits(const LaneBytes& mask)
+{
+#ifdef __SSE2__
+    return _mm_movemask_epi8((__m128i)mask);
+#else
+    uint32_t bits = 0;
+    for(int lane = 0; lane < BATCH_LANES; ++lane) {
+        bits |= (mask[lane] ? 1u : 0u) << lane;
+    }
+    return bits;
+#endif
+}
+
+// every byte of lane memory at addr, memcpy keeps the compiler honest about aliasing
+static inline LaneBytes loadRow(const uint8_t *memory, uint16_t addr)
+{
+    LaneBytes row;
+    memcpy(&row, memory + (size_t)addr * BATCH_LANES, sizeof(row));
+    return row;
+}
+
+static inline void storeRow(uint8_t *memory, uint16_t addr, const LaneBytes& row)
+{
+    memcpy(memory + (size_t)addr * BATCH_LANES, &row, sizeof(row));
+}
+
+BatchCpu::BatchCpu(int lanes)
+    : m_memory(0)
+    , m_lanes(lanes)
+    , m_steps(0)
+    , m_groups(0)
+    , m_groupPc(0)
+    , m_groupBits(0)
+    , m_nextPc(0)
+    , m_pcWritten(false)
+{
+    assert(0 < lanes && lanes <= BATCH_LANES);
+
+    void *memory = 0;
+    if(0 != posix_memalign(&memory, 64, RAM_SIZE * BATCH_LANES)) {
+        throw std::bad_alloc();
+    }
+    m_memory = (uint8_t *)memory;
+    memset(m_memory, 1, RAM_SIZE * BATCH_LANES);
+
+    LaneBytes zero = {};
+    m_live = zero;
+    m_groupMask = zero;
+    CpuRegisters regs = { 0, 0, 0, 0, 0xFF, 0x24 };
+    for(int lane = 0; lane < BATCH_LANES; ++lane) {
+        m_live[lane] = (lane < lanes) ? 0xFF : 0x00;
+        setRegisters(lane, regs);
+    }
+}
+
+BatchCpu::~BatchCpu()
+{
+    free(m_memory);
+}
+
+int BatchCpu::getLanes() const
+{
+    return m_lanes;
+}
+
+void BatchCpu::loadImage(int lane, const uint8_t *ram)
+{
+    for(size_t addr = 0; addr < RAM_SIZE; ++addr) {
+        m_memory[addr * BATCH_LANES + lane] = ram[addr];
+    }
+}
+
+void BatchCpu::saveImage(int lane, uint8_t *ram) const
+{
+    for(size_t addr = 0; addr < RAM_SIZE; ++addr) {
+        ram[addr] = m_memory[addr * BATCH_LANES + lane];
+    }
+}
+
+inline uint8_t BatchCpu::readLane(int lane, uint16_t addr) const
+{
+    return m_memory[(size_t)addr * BATCH_LANES + lane];
+}
+
+inline void BatchCpu::writeLane(int lane, uint16_t addr, uint8_t data)
+{
+    m_memory[(size_t)addr * BATCH_LANES + lane] = data;
+}
+
+uint8_t BatchCpu::read(int lane, uint16_t addr) const
+{
+    return readLane(lane, addr);
+}
+
+void BatchCpu::write(int lane, uint16_t addr, uint8_t data)
+{
+    writeLane(lane, addr, data);
+}
+
+uint8_t BatchCpu::getStatus(int lane) const
+{
+    return (m_status[lane] & 0x3C)
+        | (m_nResult[lane] & 0x80)
+        | (m_overflow[lane] << 6)
+        | ((0 == m_zResult[lane]) << 1)
+        | m_carry[lane];
+}
+
+void BatchCpu::setStatus(int lane, uint8_t status)
+{
+    m_status[lane] = status;
+    m_nResult[lane] = status & 0x80;
+    m_zResult[lane] = (status & 0x02) ? 0 : 1;
+    m_carry[lane] = status & 0x01;
+    m_overflow[lane] = (status >> 6) & 0x01;
+}
+
+inline void BatchCpu::setPc(int lane, uint16_t pc)
+{
+    m_pcLo[lane] = pc & 0xFF;
+    m_pcHi[lane] = pc >> 8;
+}
+
+CpuRegisters BatchCpu::getRegisters(int lane) const
+{
+    CpuRegisters regs;
+    regs.pc = m_pcLo[lane] | (m_pcHi[lane] << 8);
+    regs.a = m_accumulator[lane];
+    regs.x = m_xIndex[lane];
+    regs.y = m_yIndex[lane];
+    regs.sp = m_stackPointer[lane] & 0xFF;
+    regs.p = getStatus(lane);
+    return regs;
+}
+
+void BatchCpu::setRegisters(int lane, const CpuRegisters& regs)
+{
+    setPc(lane, regs.pc);
+    m_accumulator[lane] = regs.a;
+    m_xIndex[lane] = regs.x;
+    m_yIndex[lane] = regs.y;
+    m_stackPointer[lane] = 0x100 | regs.sp;
+    setStatus(lane, regs.p);
+}
+
+uint64_t BatchCpu::getSteps() const
+{
+    return m_steps;
+}
+
+uint64_t BatchCpu::getGroups() const
+{
+    return m_groups;
+}
+
+inline void BatchCpu::assign(LaneBytes& r, const LaneBytes& value)
+{
+    r = select(m_groupMask, value, r);
+}
+
+inline void BatchCpu::setNZ(const LaneBytes& value)
+{
+    assign(m_nResult, value);
+    assign(m_zResult, value);
+}
+
+inline void BatchCpu::setNZ(const LaneBytes& nValue, const LaneBytes& zValue)
+{
+    assign(m_nResult, nValue);
+    assign(m_zResult, zValue);
+}
+
+// Operand bytes are the same in every lane of the group, so anything taken
+// straight from them is one address for the whole group. Indexed and
+// indirect modes get one address per lane, with Cpu's wrapping rules.
+void BatchCpu::computeAddress(const AddrMode mode, LaneAddress& addr)
+{
+    int leader = __builtin_ctz(m_groupBits);
+    uint16_t pc = m_groupPc;
+    uint8_t lo = readLane(leader, pc + 1);
+    uint16_t word = lo | (readLane(leader, pc + 2) << 8);
+
+    addr.uniform = true;
+    addr.addr = 0;
+    switch(mode) {
+        case AddrMode::IMP:
+            m_nextPc = pc + 1;
+            return;
+        case AddrMode::IMM:
+            addr.addr = pc + 1;
+            m_nextPc = pc + 2;
+            return;
+        case AddrMode::REL:
+            addr.addr = pc + 2 + (int8_t)lo;
+            m_nextPc = pc + 2;
+            return;
+        case AddrMode::ZP:
+            addr.addr = lo;
+            m_nextPc = pc + 2;
+            return;
+        case AddrMode::ABS:
+            addr.addr = word;
+            m_nextPc = pc + 3;
+            return;
+        default:
+            break;
+    }
+
+    addr.uniform = false;
+    for(uint32_t bits = m_groupBits; bits; bits &= bits - 1) {
+        int lane = __builtin_ctz(bits);
+        switch(mode) {
+            case AddrMode::ZPX:
+                addr.lane[lane] = lo + m_xIndex[lane];
+                break;
+            case AddrMode::ZPY:
+                addr.lane[lane] = lo + m_yIndex[lane];
+                break;
+            case AddrMode::ABX:
+                addr.lane[lane] = word + m_xIndex[lane];
+                break;
+            case AddrMode::ABY:
+                addr.lane[lane] = word + m_yIndex[lane];
+                break;
+            case AddrMode::IND:
+                addr.lane[lane] = readLane(lane, word) | (readLane(lane, word + 1) << 8);
+                break;
+            case AddrMode::IZX:
+                addr.lane[lane] = (readLane(lane, lo) | (readLane(lane, lo + 1) << 8)) + m_xIndex[lane];
+                break;
+            case AddrMode::IZY:
+                addr.lane[lane] = (readLane(lane, lo) | (readLane(lane, lo + 1) << 8)) + m_yIndex[lane];
+                break;
+            default:
+                break;
+        }
+    }
+
+    m_nextPc = pc + ((AddrMode::ABX == mode || AddrMode::ABY == mode || AddrMode::IND == mode) ? 3 : 2);
+}
+
+LaneBytes BatchCpu::load(const LaneAddress& addr) const
+{
+    if(addr.uniform) {
+        return loadRow(m_memory, addr.addr);
+    }
+
+    LaneBytes value = {};
+    for(uint32_t bits = m_groupBits; bits; bits &= bits - 1) {
+        int lane = __builtin_ctz(bits);
+        value[lane] = readLane(lane, addr.lane[lane]);
+    }
+    return value;
+}
+
+void BatchCpu::store(const LaneAddress& addr, const LaneBytes& value)
+{
+    if(addr.uniform) {
+        storeRow(m_memory, addr.addr, select(m_groupMask, value, loadRow(m_memory, addr.addr)));
+        return;
+    }
+
+    for(uint32_t bits = m_groupBits; bits; bits &= bits - 1) {
+        int lane = __builtin_ctz(bits);
+        writeLane(lane, addr.lane[lane], value[lane]);
+    }
+}
+
+void BatchCpu::run(uint32_t steps)
+{
+    for(uint32_t step = 0; step < steps; ++step) {
+        LaneBytes pending = m_live;
+        uint32_t bits = laneBits(pending);
+        while(bits) {
+            // everyone at the first pending lane's PC with the same three code bytes
+            int leader = __builtin_ctz(bits);
+            uint16_t pc = m_pcLo[leader] | (m_pcHi[leader] << 8);
+            LaneBytes group = pending
+                & (LaneBytes)(m_pcLo == splat(m_pcLo[leader]))
+                & (LaneBytes)(m_pcHi == splat(m_pcHi[leader]));
+            for(uint16_t offset = 0; offset < 3; ++offset) {
+                LaneBytes code = loadRow(m_memory, pc + offset);
+                group &= (LaneBytes)(code == splat(code[leader]));
+            }
+
+            uint32_t groupBits = laneBits(group);
+            executeGroup(pc, group, groupBits);
+            pending &= ~group;
+            bits &= ~groupBits;
+            ++m_groups;
+        }
+    }
+
+    m_steps += steps;
+}
+
+void BatchCpu::executeGroup(uint16_t pc, const LaneBytes& mask, uint32_t bits)
+{
+    m_groupPc = pc;
+    m_groupMask = mask;
+    m_groupBits = bits;
+    m_nextPc = pc; // opcodes Cpu does not implement leave the PC alone
+    m_pcWritten = false;
+
+    LaneBytes zero = {};
+    uint8_t opcode = readLane(__builtin_ctz(bits), pc);
+    switch(opcode) {
+        case ADC_abs: adc(AddrMode::ABS);                break;
+        case ADC_abx: adc(AddrMode::ABX);                break;
+        case ADC_aby: adc(AddrMode::ABY);                break;
+        case ADC_imm: adc(AddrMode::IMM);                break;
+        case ADC_izx: adc(AddrMode::IZX);                break;
+        case ADC_izy: adc(AddrMode::IZY);                break;
+        case ADC_zp:  adc(AddrMode::ZP);                 break;
+        case ADC_zpx: adc(AddrMode::ZPX);                break;
+        case AND_abs: andi(AddrMode::ABS);               break;
+        case AND_abx: andi(AddrMode::ABX);               break;
+        case AND_aby: andi(AddrMode::ABY);               break;
+        case AND_imm: andi(AddrMode::IMM);               break;
+        case AND_izx: andi(AddrMode::IZX);               break;
+        case AND_izy: andi(AddrMode::IZY);               break;
+        case AND_zp:  andi(AddrMode::ZP);                break;
+        case AND_zpx: andi(AddrMode::ZPX);               break;
+        case ASL:     asl(AddrMode::IMP);                break;
+        case ASL_abs: asl(AddrMode::ABS);                break;
+        case ASL_abx: asl(AddrMode::ABX);                break;
+        case ASL_zp:  asl(AddrMode::ZP);                 break;
+        case ASL_zpx: asl(AddrMode::ZPX);                break;
+        case BCC_rel: br((LaneBytes)(m_carry == zero));                 break;
+        case BCS_rel: br((LaneBytes)(m_carry != zero));                 break;
+        case BEQ_rel: br((LaneBytes)(m_zResult == zero));               break;
+        case BIT_abs: bit(AddrMode::ABS);                break;
+        case BIT_zp:  bit(AddrMode::ZP);                 break;
+        case BMI_rel: br((LaneBytes)((m_nResult & 0x80) != zero));      break;
+        case BNE_rel: br((LaneBytes)(m_zResult != zero));               break;
+        case BPL_rel: br((LaneBytes)((m_nResult & 0x80) == zero));      break;
+        case BRK:     brk();                             break;
+        case BVC_rel: br((LaneBytes)(m_overflow == zero));              break;
+        case BVS_rel: br((LaneBytes)(m_overflow != zero));              break;
+        case CLC:     m_nextPc = pc + 1; assign(m_carry, zero);         break;
+        case CLD:     setFlag(0x08, false);              break;
+        case CLI:     setFlag(0x04, false);              break;
+        case CLV:     m_nextPc = pc + 1; assign(m_overflow, zero);      break;
+        case CMP_abs: cmp(m_accumulator, AddrMode::ABS); break;
+        case CMP_abx: cmp(m_accumulator, AddrMode::ABX); break;
+        case CMP_aby: cmp(m_accumulator, AddrMode::ABY); break;
+        case CMP_imm: cmp(m_accumulator, AddrMode::IMM); break;
+        case CMP_izx: cmp(m_accumulator, AddrMode::IZX); break;
+        case CMP_izy: cmp(m_accumulator, AddrMode::IZY); break;
+        case CMP_zp:  cmp(m_accumulator, AddrMode::ZP);  break;
+        case CMP_zpx: cmp(m_accumulator, AddrMode::ZPX); break;
+        case CPX_abs: cmp(m_xIndex, AddrMode::ABS);      break;
+        case CPX_imm: cmp(m_xIndex, AddrMode::IMM);      break;
+        case CPX_zp:  cmp(m_xIndex, AddrMode::ZP);       break;
+        case CPY_abs: cmp(m_yIndex, AddrMode::ABS);      break;
+        case CPY_imm: cmp(m_yIndex, AddrMode::IMM);      break;
+        case CPY_zp:  cmp(m_yIndex, AddrMode::ZP);       break;
+        case DEC_abs: dec(AddrMode::ABS);                break;
+        case DEC_abx: dec(AddrMode::ABX);                break;
+        case DEC_zp:  dec(AddrMode::ZP);                 break;
+        case DEC_zpx: dec(AddrMode::ZPX);                break;
+        case DEX:     der(m_xIndex);                     break;
+        case DEY:     der(m_yIndex);                     break;
+        case EOR_abs: eor(AddrMode::ABS);                break;
+        case EOR_abx: eor(AddrMode::ABX);                break;
+        case EOR_aby: eor(AddrMode::ABY);                break;
+        case EOR_imm: eor(AddrMode::IMM);                break;
+        case EOR_izx: eor(AddrMode::IZX);                break;
+        case EOR_izy: eor(AddrMode::IZY);                break;
+        case EOR_zp:  eor(AddrMode::ZP);                 break;
+        case EOR_zpx: eor(AddrMode::ZPX);                break;
+        case INC_abs: inc(AddrMode::ABS);                break;
+        case INC_abx: inc(AddrMode::ABX);                break;
+        case INC_zp:  inc(AddrMode::ZP);                 break;
+        case INC_zpx: inc(AddrMode::ZPX);                break;
+        case INX:     inr(m_xIndex);                     break;
+        case INY:     inr(m_yIndex);                     break;
+        case JMP_abs: jmp(AddrMode::ABS);                break;
+        case JMP_ind: jmp(AddrMode::IND);                break;
+        case JSR:     jsr();                             break;
+        case LDA_abs: ldr(m_accumulator, AddrMode::ABS); break;
+        case LDA_abx: ldr(m_accumulator, AddrMode::ABX); break;
+        case LDA_aby: ldr(m_accumulator, AddrMode::ABY); break;
+        case LDA_imm: ldr(m_accumulator, AddrMode::IMM); break;
+        case LDA_izx: ldr(m_accumulator, AddrMode::IZX); break;
+        case LDA_izy: ldr(m_accumulator, AddrMode::IZY); break;
+        case LDA_zp:  ldr(m_accumulator, AddrMode::ZP);  break;
+        case LDA_zpx: ldr(m_accumulator, AddrMode::ZPX); break;
+        case LDX_abs: ldr(m_xIndex, AddrMode::ABS);      break;
+        case LDX_aby: ldr(m_xIndex, AddrMode::ABY);      break;
+        case LDX_imm: ldr(m_xIndex, AddrMode::IMM);      break;
+        case LDX_zp:  ldr(m_xIndex, AddrMode::ZP);       break;
+        case LDX_zpy: ldr(m_xIndex, AddrMode::ZPY);      break;
+        case LDY_abs: ldr(m_yIndex, AddrMode::ABS);      break;
+        case LDY_abx: ldr(m_yIndex, AddrMode::ABX);      break;
+        case LDY_imm: ldr(m_yIndex, AddrMode::IMM);      break;
+        case LDY_zp:  ldr(m_yIndex, AddrMode::ZP);       break;
+        case LDY_zpx: ldr(m_yIndex, AddrMode::ZPX);      break;
+        case LSR:     lsr(AddrMode::IMP);                break;
+        case LSR_abs: lsr(AddrMode::ABS);                break;
+        case LSR_abx: lsr(AddrMode::ABX);                break;
+        case LSR_zp:  lsr(AddrMode::ZP);                 break;
+        case LSR_zpx: lsr(AddrMode::ZPX);                break;
+        // every NOP is one byte long in Cpu
+        case NOP1:    case NOP3:    case NOP5:    case NOP7:
+        case NOPD:    case NOPE:    case NOPF:
+        case NOP_ab1: case NOP_ab3: case NOP_ab5: case NOP_ab7:
+        case NOP_abD: case NOP_abF: case NOP_abs:
+        case NOP_im2: case NOP_im3: case NOP_im4: case NOP_im5: case NOP_imm:
+        case NOP_zp0: case NOP_zp1: case NOP_zp3: case NOP_zp4:
+        case NOP_zp5: case NOP_zp6: case NOP_zp7: case NOP_zpD: case NOP_zpF:
+                      m_nextPc = pc + 1;                 break;
+        case ORA_abs: ora(AddrMode::ABS);                break;
+        case ORA_abx: ora(AddrMode::ABX);                break;
+        case ORA_aby: ora(AddrMode::ABY);                break;
+        case ORA_imm: ora(AddrMode::IMM);                break;
+        case ORA_izx: ora(AddrMode::IZX);                break;
+        case ORA_izy: ora(AddrMode::IZY);                break;
+        case ORA_zp:  ora(AddrMode::ZP);                 break;
+        case ORA_zpx: ora(AddrMode::ZPX);                break;
+        case PHA:     pha();                             break;
+        case PHP:     php();                             break;
+        case PLA:     pla();                             break;
+        case PLP:     plp();                             break;
+        case ROL:     rol(AddrMode::IMP);                break;
+        case ROL_abs: rol(AddrMode::ABS);                break;
+        case ROL_abx: rol(AddrMode::ABX);                break;
+        case ROL_zp:  rol(AddrMode::ZP);                 break;
+        case ROL_zpx: rol(AddrMode::ZPX);                break;
+        case ROR:     ror(AddrMode::IMP);                break;
+        case ROR_abs: ror(AddrMode::ABS);                break;
+        case ROR_abx: ror(AddrMode::ABX);                break;
+        case ROR_zp:  ror(AddrMode::ZP);                 break;
+        case ROR_zpx: ror(AddrMode::ZPX);                break;
+        case RTI:     rti();                             break;
+        case RTS:     rts();                             break;
+        case SBC_abs: sbc(AddrMode::ABS);                break;
+        case SBC_abx: sbc(AddrMode::ABX);                break;
+        case SBC_aby: sbc(AddrMode::ABY);                break;
+        case SBC_im2: sbc(AddrMode::IMM);                break;
+        case SBC_imm: sbc(AddrMode::IMM);                break;
+        case SBC_izx: sbc(AddrMode::IZX);                break;
+        case SBC_izy: sbc(AddrMode::IZY);                break;
+        case SBC_zp:  sbc(AddrMode::ZP);                 break;
+        case SBC_zpx: sbc(AddrMode::ZPX);                break;
+        case SEC:     m_nextPc = pc + 1; assign(m_carry, splat(1));     break;
+        case SED:     setFlag(0x08, true);               break;
+        case SEI:     setFlag(0x04, true);               break;
+        case STA_abs: str(m_accumulator, AddrMode::ABS); break;
+        case STA_abx: str(m_accumulator, AddrMode::ABX); break;
+        case STA_aby: str(m_accumulator, AddrMode::ABY); break;
+        case STA_izx: str(m_accumulator, AddrMode::IZX); break;
+        case STA_izy: str(m_accumulator, AddrMode::IZY); break;
+        case STA_zp3: str(m_accumulator, AddrMode::ZP);  break;
+        case STA_zpx: str(m_accumulator, AddrMode::ZPX); break;
+        case STX_abs: str(m_xIndex, AddrMode::ABS);      break;
+        case STX_zp3: str(m_xIndex, AddrMode::ZP);       break;
+        case STX_zpx: str(m_xIndex, AddrMode::ZPX);      break;
+        case STY_abs: str(m_yIndex, AddrMode::ABS);      break;
+        case STY_zp3: str(m_yIndex, AddrMode::ZP);       break;
+        case STY_zpx: str(m_yIndex, AddrMode::ZPX);      break;
+        case TAX:     tsd(m_accumulator, m_xIndex);      break;
+        case TAY:     tsd(m_accumulator, m_yIndex);      break;
+        case TSX:     tsx();                             break;
+        case TXA:     tsd(m_xIndex, m_accumulator);      break;
+        case TXS:     txs();                             break;
+        case TYA:     tsd(m_yIndex, m_accumulator);      break;
+        default: break;
+    }
+
+    if(!m_pcWritten) {
+        assign(m_pcLo, splat(m_nextPc & 0xFF));
+        assign(m_pcHi, splat(m_nextPc >> 8));
+    }
+}
+
+void BatchCpu::adc(const AddrMode mode)
+{
+    LaneAddress addr;
+    computeAddress(mode, addr);
+    LaneBytes op = load(addr);
+    LaneBytes zero = {};
+    LaneBytes sum = m_accumulator + op + m_carry;
+    LaneBytes carry = (LaneBytes)((sum < m_accumulator) | ((sum == m_accumulator) & (m_carry != zero)));
+    assign(m_carry, carry & 1);
+    assign(m_accumulator, sum);
+    setNZ(sum);
+}
+
+void BatchCpu::andi(const AddrMode mode)
+{
+    LaneAddress addr;
+    computeAddress(mode, addr);
+    LaneBytes result = m_accumulator & load(addr);
+    assign(m_accumulator, result);
+    setNZ(result);
+}
+
+void BatchCpu::asl(const AddrMode mode)
+{
+    LaneAddress addr;
+    computeAddress(mode, addr);
+    LaneBytes tmp = (AddrMode::IMP != mode) ? load(addr) : m_accumulator;
+    LaneBytes newCarry = tmp >> 7;
+    tmp <<= 1;
+    setNZ(tmp);
+    assign(m_carry, newCarry);
+    if(AddrMode::IMP != mode) {
+        store(addr, tmp);
+    } else {
+        assign(m_accumulator, tmp);
+    }
+}
+
+void BatchCpu::bit(const AddrMode mode)
+{
+    LaneAddress addr;
+    computeAddress(mode, addr);
+    LaneBytes op = load(addr);
+    setNZ(op, m_accumulator & op);
+    assign(m_overflow, (op >> 6) & 1);
+}
+
+// taken is all ones for lanes that branch
+void BatchCpu::br(LaneBytes taken)
+{
+    LaneAddress addr;
+    computeAddress(AddrMode::REL, addr);
+    taken &= m_groupMask;
+    assign(m_pcLo, select(taken, splat(addr.addr & 0xFF), splat(m_nextPc & 0xFF)));
+    assign(m_pcHi, select(taken, splat(addr.addr >> 8), splat(m_nextPc >> 8)));
+    m_pcWritten = true;
+}
+
+void BatchCpu::brk()
+{
+    uint16_t pc = m_groupPc + 2; // BRK skips a padding byte
+    for(uint32_t bits = m_groupBits; bits; bits &= bits - 1) {
+        int lane = __builtin_ctz(bits);
+        uint16_t& sp = m_stackPointer[lane];
+        writeLane(lane, sp--, pc >> 8);
+        writeLane(lane, sp--, pc & 0xFF);
+        writeLane(lane, sp--, getStatus(lane) | 0x30);
+        m_status[lane] |= 0x04;
+        setPc(lane, readLane(lane, BRK_VECTOR) | (readLane(lane, BRK_VECTOR + 1) << 8));
+    }
+    m_pcWritten = true;
+}
+
+void BatchCpu::cmp(const LaneBytes& r, const AddrMode mode)
+{
+    LaneAddress addr;
+    computeAddress(mode, addr);
+    LaneBytes op = load(addr);
+    assign(m_carry, (LaneBytes)(op <= r) & 1);
+    setNZ(r - op);
+}
+
+void BatchCpu::dec(const AddrMode mode)
+{
+    LaneAddress addr;
+    computeAddress(mode, addr);
+    LaneBytes tmp = load(addr) - 1;
+    setNZ(tmp);
+    store(addr, tmp);
+}
+
+void BatchCpu::der(LaneBytes& r)
+{
+    m_nextPc = m_groupPc + 1;
+    assign(r, r - 1);
+    setNZ(r);
+}
+
+void BatchCpu::eor(const AddrMode mode)
+{
+    LaneAddress addr;
+    computeAddress(mode, addr);
+    LaneBytes result = m_accumulator ^ load(addr);
+    assign(m_accumulator, result);
+    setNZ(result);
+}
+
+void BatchCpu::inc(const AddrMode mode)
+{
+    LaneAddress addr;
+    computeAddress(mode, addr);
+    LaneBytes tmp = load(addr) + 1;
+    setNZ(tmp);
+    store(addr, tmp);
+}
+
+void BatchCpu::inr(LaneBytes& r)
+{
+    m_nextPc = m_groupPc + 1;
+    assign(r, r + 1);
+    setNZ(r);
+}
+
+void BatchCpu::jmp(const AddrMode mode)
+{
+    LaneAddress addr;
+    computeAddress(mode, addr);
+    if(addr.uniform) {
+        m_nextPc = addr.addr;
+        return;
+    }
+
+    for(uint32_t bits = m_groupBits; bits; bits &= bits - 1) {
+        int lane = __builtin_ctz(bits);
+        setPc(lane, addr.lane[lane]);
+    }
+    m_pcWritten = true;
+}
+
+void BatchCpu::jsr()
+{
+    LaneAddress addr;
+    computeAddress(AddrMode::ABS, addr);
+    uint16_t ret = m_groupPc + 2;
+    for(uint32_t bits = m_groupBits; bits; bits &= bits - 1) {
+        int lane = __builtin_ctz(bits);
+        uint16_t& sp = m_stackPointer[lane];
+        writeLane(lane, sp - 1, ret & 0xFF);
+        writeLane(lane, sp, ret >> 8);
+        sp -= 2;
+    }
+    m_nextPc = addr.addr;
+}
+
+void BatchCpu::ldr(LaneBytes& r, const AddrMode mode)
+{
+    LaneAddress addr;
+    computeAddress(mode, addr);
+    assign(r, load(addr));
+    setNZ(r);
+}
+
+void BatchCpu::lsr(const AddrMode mode)
+{
+    LaneAddress addr;
+    computeAddress(mode, addr);
+    LaneBytes tmp = (AddrMode::IMP != mode) ? load(addr) : m_accumulator;
+    LaneBytes newCarry = tmp & 1;
+    tmp >>= 1;
+    setNZ(tmp);
+    assign(m_carry, newCarry);
+    if(AddrMode::IMP != mode) {
+        store(addr, tmp);
+    } else {
+        assign(m_accumulator, tmp);
+    }
+}
+
+void BatchCpu::ora(const AddrMode mode)
+{
+    LaneAddress addr;
+    computeAddress(mode, addr);
+    LaneBytes result = m_accumulator | load(addr);
+    assign(m_accumulator, result);
+    setNZ(result);
+}
+
+void BatchCpu::pha()
+{
+    m_nextPc = m_groupPc + 1;
+    for(uint32_t bits = m_groupBits; bits; bits &= bits - 1) {
+        int lane = __builtin_ctz(bits);
+        writeLane(lane, m_stackPointer[lane]--, m_accumulator[lane]);
+    }
+}
+
+void BatchCpu::php()
+{
+    m_nextPc = m_groupPc + 1;
+    for(uint32_t bits = m_groupBits; bits; bits &= bits - 1) {
+        int lane = __builtin_ctz(bits);
+        writeLane(lane, m_stackPointer[lane]--, getStatus(lane) | 0x30);
+    }
+}
+
+void BatchCpu::pla()
+{
+    m_nextPc = m_groupPc + 1;
+    LaneBytes value = {};
+    for(uint32_t bits = m_groupBits; bits; bits &= bits - 1) {
+        int lane = __builtin_ctz(bits);
+        value[lane] = readLane(lane, ++m_stackPointer[lane]);
+    }
+    assign(m_accumulator, value);
+    setNZ(value);
+}
+
+void BatchCpu::plp()
+{
+    m_nextPc = m_groupPc + 1;
+    for(uint32_t bits = m_groupBits; bits; bits &= bits - 1) {
+        int lane = __builtin_ctz(bits);
+        setStatus(lane, (readLane(lane, ++m_stackPointer[lane]) & ~0x10) | 0x20);
+    }
+}
+
+void BatchCpu::rol(const AddrMode mode)
+{
+    LaneAddress addr;
+    computeAddress(mode, addr);
+    LaneBytes tmp = (AddrMode::IMP != mode) ? load(addr) : m_accumulator;
+    LaneBytes newCarry = tmp >> 7;
+    tmp = (tmp << 1) + m_carry;
+    setNZ(tmp);
+    assign(m_carry, newCarry);
+    if(AddrMode::IMP != mode) {
+        store(addr, tmp);
+    } else {
+        assign(m_accumulator, tmp);
+    }
+}
+
+void BatchCpu::ror(const AddrMode mode)
+{
+    LaneAddress addr;
+    computeAddress(mode, addr);
+    LaneBytes tmp = (AddrMode::IMP != mode) ? load(addr) : m_accumulator;
+    LaneBytes newCarry = tmp & 1;
+    tmp = (tmp >> 1) + (m_carry << 7);
+    setNZ(tmp);
+    assign(m_carry, newCarry);
+    if(AddrMode::IMP != mode) {
+        store(addr, tmp);
+    } else {
+        assign(m_accumulator, tmp);
+    }
+}
+
+void BatchCpu::rti()
+{
+    for(uint32_t bits = m_groupBits; bits; bits &= bits - 1) {
+        int lane = __builtin_ctz(bits);
+        uint16_t& sp = m_stackPointer[lane];
+        setStatus(lane, (readLane(lane, ++sp) & ~0x10) | 0x20);
+        uint16_t pc = readLane(lane, ++sp);
+        pc |= readLane(lane, ++sp) << 8;
+        setPc(lane, pc);
+    }
+    m_pcWritten = true;
+}
+
+void BatchCpu::rts()
+{
+    for(uint32_t bits = m_groupBits; bits; bits &= bits - 1) {
+        int lane = __builtin_ctz(bits);
+        uint16_t& sp = m_stackPointer[lane];
+        sp += 2;
+        uint16_t addr = sp - 1;
+        setPc(lane, (readLane(lane, addr) | (readLane(lane, addr + 1) << 8)) + 1);
+    }
+    m_pcWritten = true;
+}
+
+void BatchCpu::sbc(const AddrMode mode)
+{
+    LaneAddress addr;
+    computeAddress(mode, addr);
+    LaneBytes op = ~load(addr);
+    LaneBytes zero = {};
+    LaneBytes sum = m_accumulator + op + m_carry;
+    LaneBytes carry = (LaneBytes)((sum < m_accumulator) | ((sum == m_accumulator) & (m_carry != zero)));
+    LaneBytes op0 = op + m_carry;
+    assign(m_overflow, ((op0 ^ sum) & (m_accumulator ^ sum)) >> 7);
+    assign(m_carry, carry & 1);
+    assign(m_accumulator, sum);
+    setNZ(sum);
+}
+
+void BatchCpu::setFlag(uint8_t flag, bool set)
+{
+    m_nextPc = m_groupPc + 1;
+    assign(m_status, set ? (m_status | flag) : (m_status & (uint8_t)~flag));
+}
+
+void BatchCpu::str(const LaneBytes& r, const AddrMode mode)
+{
+    LaneAddress addr;
+    computeAddress(mode, addr);
+    store(addr, r);
+}
+
+void BatchCpu::tsd(const LaneBytes& src, LaneBytes& dst)
+{
+    m_nextPc = m_groupPc + 1;
+    assign(dst, src);
+    setNZ(dst);
+}
+
+void BatchCpu::tsx()
+{
+    m_nextPc = m_groupPc + 1;
+    for(uint32_t bits = m_groupBits; bits; bits &= bits - 1) {
+        int lane = __builtin_ctz(bits);
+        m_xIndex[lane] = m_stackPointer[lane] & 0xFF;
+    }
+}
+
+void BatchCpu::txs()
+{
+    m_nextPc = m_groupPc + 1;
+    for(uint32_t bits = m_groupBits; bits; bits &= bits - 1) {
+        int lane = __builtin_ctz(bits);
+        m_stackPointer[lane] = 0x100 | m_xIndex[lane];
+    }
+}
+
+// Each shadow maps its ROM images onto its own RAM, so like the lanes it
+// sees RAM at $A000-$BFFF and $E000-$FFFF whatever $01 says. $D000-$DFFF
+// still reaches chips that are never stepped, idle with their interrupts
+// masked, so a program that strays there shows up as a difference.
+bool BatchCpu::verify(uint32_t steps)
+{
+    std::vector<std::vector<uint8_t> > ram(m_lanes, std::vector<uint8_t>(RAM_SIZE));
+    std::vector<MemoryController*> memories(m_lanes);
+    std::vector<IOController*> ios(m_lanes);
+    std::vector<SID*> sids(m_lanes);
+    std::vector<VICII*> vics(m_lanes);
+    std::vector<Cpu*> cpus(m_lanes);
+    for(int lane = 0; lane < m_lanes; ++lane) {
+        uint8_t *image = &ram[lane][0];
+        memories[lane] = new MemoryController(image + 0xA000, image + 0xE000, image);
+        ios[lane] = new IOController(memories[lane]);
+        sids[lane] = new SID(memories[lane], VIDEO_PAL);
+        vics[lane] = new VICII(memories[lane], image + 0xD000, VIDEO_PAL); // never renders
+        cpus[lane] = new Cpu(*memories[lane]);
+        saveImage(lane, image); // after the Cpu has finished its own reset
+        cpus[lane]->setRegisters(getRegisters(lane));
+        cpus[lane]->setIdleSkip(false);
+    }
+
+    bool ok = true;
+    for(uint32_t step = 0; ok && step < steps; ++step) {
+        run(1);
+        for(int lane = 0; ok && lane < m_lanes; ++lane) {
+            cpus[lane]->execute<PalConfig>(false);
+            CpuRegisters expected = cpus[lane]->getRegisters();
+            CpuRegisters actual = getRegisters(lane);
+            if(expected.pc != actual.pc || expected.a != actual.a || expected.x != actual.x
+                    || expected.y != actual.y || expected.sp != actual.sp || expected.p != actual.p) {
+                fprintf(stderr, "Lane %d differs after step %u: PC %04X/%04X A %02X/%02X X %02X/%02X Y %02X/%02X SP %02X/%02X P %02X/%02X\n",
+                        lane, step, actual.pc, expected.pc, actual.a, expected.a, actual.x, expected.x,
+                        actual.y, expected.y, actual.sp, expected.sp, actual.p, expected.p);
+                ok = false;
+            }
+        }
+    }
+
+    std::vector<uint8_t> image(RAM_SIZE);
+    for(int lane = 0; ok && lane < m_lanes; ++lane) {
+        saveImage(lane, &image[0]);
+        for(size_t addr = 0; addr < RAM_SIZE; ++addr) {
+            if(image[addr] != ram[lane][addr]) {
+                fprintf(stderr, "Lane %d RAM differs at %04zX: %02X, expected %02X\n",
+                        lane, addr, image[addr], ram[lane][addr]);
+                ok = false;
+                break;
+            }
+        }
+    }
+
+    for(int lane = 0; lane < m_lanes; ++lane) {
+        delete cpus[lane];
+        delete vics[lane];
+        delete sids[lane];
+        delete ios[lane];
+        delete memories[lane];
+    }
+
+    return ok;
+}
+
+}
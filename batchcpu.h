@@ -0,0 +1,130 @@
+#ifndef INCLUDED_BATCH_CPU_H
+#define INCLUDED_BATCH_CPU_H
+
+#include <stdint.h>
+#include "mos6510.h"
+
+namespace MOS6510 {
+
+const int BATCH_LANES = 16;
+
+// one byte per lane, SSE2/NEON wide
+typedef uint8_t LaneBytes __attribute__((vector_size(BATCH_LANES)));
+
+// An operand address, shared by the whole group or one per lane
+struct LaneAddress {
+    bool        uniform;
+    uint16_t    addr;
+    uint16_t    lane[BATCH_LANES];
+};
+
+// Experimental lockstep interpreter for up to BATCH_LANES machines running
+// mostly the same code. Registers live in one vector per register and RAM is
+// interleaved by lane, so lanes that share a PC execute each instruction
+// together, and operands at the same address are one vector load. Lanes
+// that diverge are regrouped by PC every step.
+//
+// Each lane is a bare 6510 with a flat 64K of RAM: no ROM banking, I/O or
+// interrupts. Opcodes behave exactly as they do in Cpu, see verify().
+class BatchCpu {
+private:
+    LaneBytes       m_pcLo;
+    LaneBytes       m_pcHi;
+    LaneBytes       m_accumulator;
+    LaneBytes       m_xIndex;
+    LaneBytes       m_yIndex;
+    LaneBytes       m_status;       // I, D, B only, as in Cpu
+    LaneBytes       m_nResult;
+    LaneBytes       m_zResult;
+    LaneBytes       m_carry;
+    LaneBytes       m_overflow;
+    LaneBytes       m_live;         // lanes in use
+    uint16_t        m_stackPointer[BATCH_LANES];
+    uint8_t*        m_memory;       // byte addr of lane l at addr * BATCH_LANES + l
+    int             m_lanes;
+    uint64_t        m_steps;
+    uint64_t        m_groups;
+
+    // the group being executed
+    uint16_t        m_groupPc;
+    LaneBytes       m_groupMask;
+    uint32_t        m_groupBits;
+    uint16_t        m_nextPc;
+    bool            m_pcWritten;    // set by instructions that leave lanes at different PCs
+
+    BatchCpu(const BatchCpu& rhs);
+    BatchCpu& operator=(const BatchCpu& rhs);
+
+    // internal operations, as in Cpu
+    void adc(const AddrMode mode);
+    void andi(const AddrMode mode);
+    void asl(const AddrMode mode);
+    void bit(const AddrMode mode);
+    void br(LaneBytes taken);
+    void brk();
+    void cmp(const LaneBytes& r, const AddrMode mode);
+    void dec(const AddrMode mode);
+    void der(LaneBytes& r);
+    void eor(const AddrMode mode);
+    void inc(const AddrMode mode);
+    void inr(LaneBytes& r);
+    void jmp(const AddrMode mode);
+    void jsr();
+    void ldr(LaneBytes& r, const AddrMode mode);
+    void lsr(const AddrMode mode);
+    void ora(const AddrMode mode);
+    void pha();
+    void php();
+    void pla();
+    void plp();
+    void rol(const AddrMode mode);
+    void ror(const AddrMode mode);
+    void rti();
+    void rts();
+    void sbc(const AddrMode mode);
+    void setFlag(uint8_t flag, bool set);
+    void str(const LaneBytes& r, const AddrMode mode);
+    void tsd(const LaneBytes& src, LaneBytes& dst);
+    void tsx();
+    void txs();
+
+    // utility
+    void setNZ(const LaneBytes& value);
+    void setNZ(const LaneBytes& nValue, const LaneBytes& zValue);
+    void assign(LaneBytes& r, const LaneBytes& value);
+    uint8_t getStatus(int lane) const;
+    void setStatus(int lane, uint8_t status);
+    void setPc(int lane, uint16_t pc);
+    void computeAddress(const AddrMode mode, LaneAddress& addr);
+    LaneBytes load(const LaneAddress& addr) const;
+    void store(const LaneAddress& addr, const LaneBytes& value);
+    uint8_t readLane(int lane, uint16_t addr) const;
+    void writeLane(int lane, uint16_t addr, uint8_t data);
+    void executeGroup(uint16_t pc, const LaneBytes& mask, uint32_t bits);
+
+public:
+    BatchCpu(int lanes);
+    ~BatchCpu();
+
+    int getLanes() const;
+    void loadImage(int lane, const uint8_t *ram);   // RAM_SIZE bytes
+    void saveImage(int lane, uint8_t *ram) const;
+    uint8_t read(int lane, uint16_t addr) const;
+    void write(int lane, uint16_t addr, uint8_t data);
+
+    CpuRegisters getRegisters(int lane) const;
+    void setRegisters(int lane, const CpuRegisters& regs);
+
+    void run(uint32_t steps);       // every lane executes steps instructions
+    uint64_t getSteps() const;
+    uint64_t getGroups() const;     // lane groups dispatched, equal to steps while all lanes agree
+
+    // Runs steps instructions on the lanes and on one Cpu per lane started
+    // from the same state, comparing registers after every step and RAM at
+    // the end. Programs must stay out of $D000-$DFFF, where Cpu finds chips.
+    bool verify(uint32_t steps);
+};
+
+}
+
+#endif
@@ -0,0 +1,448 @@
+#include <chrono>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "machine.h"
+#include "romset.h"
+#include "scaler.h"
+#include "framesink.h"
+#include "profiler.h"
+#include "batchcpu.h"
+#include "drive1541.h"
+
+// Headless throughput benchmark: runs a machine for a number of frames with
+// no window or audio device and reports emulated instructions, ticks and
+// frames per second of host time, plus the cost of any optional stage.
+
+typedef std::chrono::steady_clock BenchClock;
+
+static double secondsSince(BenchClock::time_point start)
+{
+    return std::chrono::duration<double>(BenchClock::now() - start).count();
+}
+
+// A CPU bound loop run from $C000 with interrupts off: 16-bit sums, shifts,
+// compares, a table read, an indexed store and a subroutine call on every
+// pass, so nearly every instruction sets flags and most are tested.
+static const uint16_t BUSY_ADDRESS = 0xC000;
+static const uint8_t BUSY_CODE[] = {
+    0x78,                   // C000 SEI
+    0xA2, 0x00,             // C001 LDX #$00
+    0xBD, 0x00, 0xC1,       // C003 LDA $C100,X
+    0x18,                   // C006 CLC
+    0x65, 0xFB,             // C007 ADC $FB
+    0x85, 0xFB,             // C009 STA $FB
+    0xA5, 0xFC,             // C00B LDA $FC
+    0x69, 0x00,             // C00D ADC #$00
+    0x85, 0xFC,             // C00F STA $FC
+    0x20, 0x1C, 0xC0,       // C011 JSR $C01C
+    0xE8,                   // C014 INX
+    0xD0, 0xEC,             // C015 BNE $C003
+    0xE6, 0xFD,             // C017 INC $FD
+    0x4C, 0x03, 0xC0,       // C019 JMP $C003
+    0xA5, 0xFB,             // C01C LDA $FB
+    0x0A,                   // C01E ASL
+    0x26, 0xFE,             // C01F ROL $FE
+    0x45, 0xFC,             // C021 EOR $FC
+    0xC9, 0x80,             // C023 CMP #$80
+    0x90, 0x02,             // C025 BCC $C029
+    0xE9, 0x40,             // C027 SBC #$40
+    0x9D, 0x00, 0xC2,       // C029 STA $C200,X
+    0x60                    // C02C RTS
+};
+
+// steps checked against Cpu before a --batch run is timed
+static const uint32_t BATCH_VERIFY_STEPS = 100000;
+
+// typed once BASIC is up for --disk, the whole keyboard buffer
+static const char LOAD_DIRECTORY[] = "LOAD\"$\",8\r";
+const uint32_t BOOT_FRAMES = 150;
+const uint16_t VARTAB = 0x2D;   // end of the BASIC program, $0803 while there is none
+const uint16_t STATUS = 0x90;   // KERNAL I/O status
+const uint16_t KEYD = 0x0277;   // keyboard buffer
+const uint16_t NDX = 0xC6;      // characters in it
+
+// all three voices gated with their envelopes at full sustain, through the filter
+static const uint8_t SID_VOICES[][2] = {
+    { 0x00, 0xD6 }, { 0x01, 0x1C }, { 0x02, 0x00 }, { 0x03, 0x08 }, { 0x05, 0x00 }, { 0x06, 0xF0 }, { 0x04, 0x41 },
+    { 0x07, 0x6B }, { 0x08, 0x0E }, { 0x0C, 0x00 }, { 0x0D, 0xF0 }, { 0x0B, 0x21 },
+    { 0x0E, 0x00 }, { 0x0F, 0x30 }, { 0x13, 0x00 }, { 0x14, 0xF0 }, { 0x12, 0x81 },
+    { 0x15, 0x00 }, { 0x16, 0x40 }, { 0x17, 0xF7 }, { 0x18, 0x1F }
+};
+
+// The SID alone for as many ticks as the run took, one tick per step as
+// Machine::execute() hands them out outside idle loops.
+static double timeSid(MOS6510::SID& sid, uint64_t ticks)
+{
+    BenchClock::time_point start = BenchClock::now();
+    for(uint64_t i = 0; i < ticks; ++i) {
+        sid.execute(1);
+    }
+    sid.flush();
+
+    return secondsSince(start);
+}
+
+// scales every frame the way the window would, timing only the scaler
+class ScaleSink : public MOS6510::FrameSink {
+private:
+    MOS6510::Scaler         m_scaler;
+    std::vector<uint32_t>   m_pixels;
+    double                  m_seconds;
+
+public:
+    ScaleSink(int scale)
+        : m_scaler(scale, MOS6510::SCALE_NEAREST)
+        , m_pixels(MOS6510::FRAME_WIDTH * scale * MOS6510::FRAME_HEIGHT * scale)
+        , m_seconds(0)
+    {
+    }
+
+    virtual void onFrame(uint32_t, const uint8_t *indices, const uint32_t *palette)
+    {
+        BenchClock::time_point start = BenchClock::now();
+        m_scaler.scale(indices, MOS6510::FRAME_WIDTH, MOS6510::FRAME_HEIGHT, palette,
+                &m_pixels[0], MOS6510::FRAME_WIDTH * m_scaler.getScale());
+        m_seconds += secondsSince(start);
+    }
+
+    double getSeconds() const
+    {
+        return m_seconds;
+    }
+};
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [options]\n"
+            "  --rom-path <dirs>        colon separated directories to find ROM images in\n"
+            "  --frames <n>             frames to run (default 500)\n"
+            "  --video <pal|ntsc>       video standard (default pal)\n"
+            "  --busy                   run a CPU bound loop at $C000 rather than the ROMs\n"
+            "  --no-idle-skip           always execute idle loops instruction by instruction\n"
+            "  --cpu-only               run the CPU alone for as many ticks as the frames take\n"
+            "  --hooks                  run the configuration with debugger, trace and profiler hooks\n"
+            "  --profile <m>            profile the guest, sample or exact (implies --hooks)\n"
+            "  --profile-interval <n>   ticks between samples (default 1000)\n"
+            "  --scale <1-4>            also scale every frame, as the window would\n"
+            "  --audio                  keep all three SID voices playing and time the SID on its own\n"
+            "  --batch <1-16>           run the CPU bound loop on BatchCpu lanes instead, no ROMs needed\n"
+            "  --disk <file>            boot, LOAD\"$\",8 from a 1541 with this D64 and time the load,\n"
+            "                           giving up after --frames frames\n"
+            "  --drive-rom <file>       1541 DOS ROM (default 1541-II.251968-03.bin)\n", prog);
+}
+
+// returns the instructions run, one Machine::execute() each
+template <class Config>
+static uint64_t run(MOS6510::Machine& machine, uint32_t frames)
+{
+    uint64_t instructions = 0;
+    uint32_t end = machine.getVIC().getFrameCount() + frames;
+    while(machine.getVIC().getFrameCount() != end) {
+        machine.execute<Config>(false);
+        ++instructions;
+    }
+
+    return instructions;
+}
+
+// Types LOAD"$",8 once BASIC is up and runs until BASIC has the directory.
+// Returns the frames the load took, 0 if it had not finished after frames.
+template <class Config>
+static uint32_t loadDirectory(MOS6510::Machine& machine, uint32_t frames)
+{
+    MOS6510::MemoryController& memory = machine.getMemory();
+    for(size_t i = 0; i < sizeof(LOAD_DIRECTORY) - 1; ++i) {
+        memory.write(KEYD + i, LOAD_DIRECTORY[i], 0);
+    }
+    memory.write(NDX, sizeof(LOAD_DIRECTORY) - 1, 0);
+
+    const uint8_t *ram = machine.getRam();
+    for(uint32_t frame = 1; frame <= frames; ++frame) {
+        run<Config>(machine, 1);
+        if(0x0803 < (ram[VARTAB] | (ram[VARTAB + 1] << 8))) {
+            return frame;
+        }
+    }
+
+    return 0;
+}
+
+// boots first, the load is timed on its own
+static int runDisk(MOS6510::Machine& machine, MOS6510::Drive1541& drive, uint32_t frames)
+{
+    MOS6510::Scheduler& scheduler = machine.getMemory().getScheduler();
+    drive.start(scheduler.cycles());
+    machine.getIO().setSerialBus(&drive.getBus());
+
+    bool pal = (MOS6510::VIDEO_PAL == machine.getVideoStandard());
+    if(pal) {
+        run<MOS6510::PalConfig>(machine, BOOT_FRAMES);
+    } else {
+        run<MOS6510::NtscConfig>(machine, BOOT_FRAMES);
+    }
+
+    uint64_t startCycles = scheduler.cycles();
+    BenchClock::time_point start = BenchClock::now();
+    uint32_t used = pal ? loadDirectory<MOS6510::PalConfig>(machine, frames)
+                        : loadDirectory<MOS6510::NtscConfig>(machine, frames);
+    double seconds = secondsSince(start);
+    double emulated = (double)(scheduler.cycles() - startCycles) / MOS6510::systemClock(machine.getVideoStandard());
+
+    machine.getIO().setSerialBus(0);
+    drive.stop();
+
+    const uint8_t *ram = machine.getRam();
+    if(!used) {
+        fprintf(stderr, "No directory after %u frames, %.2f s of C64 time, ST $%02X\n", frames, emulated, ram[STATUS]);
+        return -1;
+    }
+
+    printf("Directory loaded to $0801-$%04X in %u frames, %.2f s of C64 time, %.3f s host, ST $%02X\n",
+            ram[VARTAB] | (ram[VARTAB + 1] << 8), used, emulated, seconds, ram[STATUS]);
+    return 0;
+}
+
+// no VIC, CIA or SID steps, so the CPU core is all that is measured
+template <class Config>
+static uint64_t runCpu(MOS6510::Cpu& cpu, uint32_t frames)
+{
+    uint64_t instructions = 0;
+    uint64_t ticks = (uint64_t)Config::FRAME_TICKS * frames;
+    for(uint64_t done = 0; done < ticks; ++instructions) {
+        done += cpu.execute<Config>(false);
+    }
+
+    return instructions;
+}
+
+// The busy loop on every lane, each summing from a different seed so the
+// BCC in its subroutine splits them now and then. verify() runs the lanes
+// next to Cpu first, the timed steps carry on from where it left them.
+static int runBatch(int lanes, uint32_t frames)
+{
+    MOS6510::BatchCpu batch(lanes);
+    std::vector<uint8_t> image(MOS6510::RAM_SIZE, 0);
+    memcpy(&image[BUSY_ADDRESS], BUSY_CODE, sizeof(BUSY_CODE));
+    for(int i = 0; i < 0x100; ++i) {
+        image[0xC100 + i] = i * 37;
+    }
+    MOS6510::CpuRegisters regs = { BUSY_ADDRESS, 0, 0, 0, 0xFF, 0x24 };
+    for(int lane = 0; lane < lanes; ++lane) {
+        image[0xFB] = lane * 17;
+        batch.loadImage(lane, &image[0]);
+        batch.setRegisters(lane, regs);
+    }
+
+    if(!batch.verify(BATCH_VERIFY_STEPS)) {
+        fprintf(stderr, "%d lanes differ from Cpu\n", lanes);
+        return -1;
+    }
+    printf("%d lanes match Cpu over %u steps\n", lanes, BATCH_VERIFY_STEPS);
+
+    uint32_t steps = MOS6510::PalConfig::FRAME_TICKS * frames;
+    uint64_t groups = batch.getGroups();
+    BenchClock::time_point start = BenchClock::now();
+    batch.run(steps);
+    double seconds = secondsSince(start);
+    groups = batch.getGroups() - groups;
+
+    printf("%u steps on %d lanes, %.2f lane groups per step, in %.3f s\n",
+            steps, lanes, (double)groups / steps, seconds);
+    printf("%.2f M instructions/s over all lanes\n", (double)steps * lanes / seconds / 1e6);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    std::string romPath;
+    uint32_t frames = 500;
+    MOS6510::VideoStandard standard = MOS6510::VIDEO_PAL;
+    bool busy = false;
+    bool idleSkip = true;
+    bool cpuOnly = false;
+    bool hooks = false;
+    bool audio = false;
+    bool profile = false;
+    MOS6510::ProfileMode profileMode = MOS6510::PROFILE_SAMPLE;
+    uint32_t profileInterval = 1000;
+    int scale = 0;
+    int batchLanes = 0;
+    std::string diskPath;
+    std::string driveRom;
+    for(int i = 1; i < argc; ++i) {
+        const char *opt = argv[i];
+        if(0 == strcmp("--busy", opt)) {
+            busy = true;
+            continue;
+        } else if(0 == strcmp("--no-idle-skip", opt)) {
+            idleSkip = false;
+            continue;
+        } else if(0 == strcmp("--cpu-only", opt)) {
+            cpuOnly = true;
+            continue;
+        } else if(0 == strcmp("--hooks", opt)) {
+            hooks = true;
+            continue;
+        } else if(0 == strcmp("--audio", opt)) {
+            audio = true;
+            continue;
+        }
+
+        if(i + 1 >= argc) {
+            usage(argv[0]);
+            return -1;
+        }
+
+        const char *val = argv[++i];
+        if(0 == strcmp("--rom-path", opt)) {
+            romPath = val;
+        } else if(0 == strcmp("--frames", opt)) {
+            frames = strtoul(val, 0, 0);
+        } else if(0 == strcmp("--video", opt)) {
+            if(0 == strcmp("ntsc", val)) {
+                standard = MOS6510::VIDEO_NTSC;
+            } else if(0 != strcmp("pal", val)) {
+                usage(argv[0]);
+                return -1;
+            }
+        } else if(0 == strcmp("--profile", opt)) {
+            if(0 == strcmp("exact", val)) {
+                profileMode = MOS6510::PROFILE_EXACT;
+            } else if(0 != strcmp("sample", val)) {
+                usage(argv[0]);
+                return -1;
+            }
+            profile = true;
+            hooks = true;
+        } else if(0 == strcmp("--profile-interval", opt)) {
+            profileInterval = strtoul(val, 0, 0);
+        } else if(0 == strcmp("--disk", opt)) {
+            diskPath = val;
+        } else if(0 == strcmp("--drive-rom", opt)) {
+            driveRom = val;
+        } else if(0 == strcmp("--batch", opt)) {
+            batchLanes = atoi(val);
+            if(1 > batchLanes || MOS6510::BATCH_LANES < batchLanes) {
+                usage(argv[0]);
+                return -1;
+            }
+        } else if(0 == strcmp("--scale", opt)) {
+            scale = atoi(val);
+            if(1 > scale || 4 < scale) {
+                usage(argv[0]);
+                return -1;
+            }
+        } else {
+            usage(argv[0]);
+            return -1;
+        }
+    }
+
+    if(batchLanes) {
+        return runBatch(batchLanes, frames);
+    }
+
+    MOS6510::RomSet roms;
+    if(!romPath.empty()) {
+        roms.addSearchPath(romPath);
+    }
+    if(!roms.loadMissing()) {
+        fprintf(stderr, "Failed to load ROMs!\n");
+        return -1;
+    }
+    if(!diskPath.empty() && !(driveRom.empty() ? roms.loadStock(MOS6510::ROM_DOS1541)
+                                               : roms.load(MOS6510::ROM_DOS1541, driveRom))) {
+        fprintf(stderr, "Failed to load the 1541 ROM!\n");
+        return -1;
+    }
+
+    MOS6510::Machine *machine = MOS6510::Machine::create(
+            roms.getImage(MOS6510::ROM_BASIC),
+            roms.getImage(MOS6510::ROM_KERNAL),
+            roms.getImage(MOS6510::ROM_CHARGEN),
+            standard);
+    if(!machine) {
+        return -1;
+    }
+    machine->getCpu().setIdleSkip(idleSkip);
+
+    if(!diskPath.empty()) {
+        int result = -1;
+        {
+            MOS6510::Drive1541 drive(roms.getImage(MOS6510::ROM_DOS1541), standard);
+            if(drive.insertDisk(diskPath)) {
+                result = runDisk(*machine, drive, frames);
+            }
+        }
+        MOS6510::Machine::destroy(machine);
+        return result;
+    }
+
+    if(busy) {
+        for(size_t i = 0; i < sizeof(BUSY_CODE); ++i) {
+            machine->getMemory().write(BUSY_ADDRESS + i, BUSY_CODE[i], 0);
+        }
+        for(int i = 0; i < 0x100; ++i) {
+            machine->getMemory().write(0xC100 + i, i * 37, 0);
+        }
+        MOS6510::CpuRegisters regs = machine->getCpu().getRegisters();
+        regs.pc = BUSY_ADDRESS;
+        machine->getCpu().setRegisters(regs);
+    }
+
+    if(audio) {
+        for(size_t i = 0; i < sizeof(SID_VOICES) / sizeof(SID_VOICES[0]); ++i) {
+            machine->getSID().write(SID_VOICES[i][0], SID_VOICES[i][1]);
+        }
+    }
+
+    ScaleSink scaleSink(scale ? scale : 1);
+    if(scale) {
+        machine->getVIC().addFrameSink(&scaleSink);
+    }
+
+    MOS6510::Profiler profiler(profileMode, profileInterval);
+    if(profile) {
+        machine->getCpu().setProfiler(&profiler);
+    }
+
+    uint64_t startTicks = machine->getMemory().getScheduler().now();
+    uint64_t startCycles = machine->getMemory().getScheduler().cycles();
+    BenchClock::time_point start = BenchClock::now();
+    uint64_t instructions;
+    MOS6510::Cpu& cpu = machine->getCpu();
+    if(MOS6510::VIDEO_PAL == standard) {
+        if(cpuOnly) {
+            instructions = hooks ? runCpu<MOS6510::PalDebugConfig>(cpu, frames) : runCpu<MOS6510::PalConfig>(cpu, frames);
+        } else {
+            instructions = hooks ? run<MOS6510::PalDebugConfig>(*machine, frames) : run<MOS6510::PalConfig>(*machine, frames);
+        }
+    } else {
+        if(cpuOnly) {
+            instructions = hooks ? runCpu<MOS6510::NtscDebugConfig>(cpu, frames) : runCpu<MOS6510::NtscConfig>(cpu, frames);
+        } else {
+            instructions = hooks ? run<MOS6510::NtscDebugConfig>(*machine, frames) : run<MOS6510::NtscConfig>(*machine, frames);
+        }
+    }
+    double seconds = secondsSince(start);
+    uint64_t ticks = machine->getMemory().getScheduler().now() - startTicks;
+    uint64_t cycles = machine->getMemory().getScheduler().cycles() - startCycles;
+
+    printf("%u frames, %llu instructions, %llu ticks, %llu cycles in %.3f s\n",
+            frames, (unsigned long long)instructions, (unsigned long long)ticks, (unsigned long long)cycles, seconds);
+    printf("%.2f M instructions/s, %.2f M ticks/s, %.1f frames/s\n",
+            instructions / seconds / 1e6, ticks / seconds / 1e6, frames / seconds);
+    if(scale) {
+        printf("scaler %dx: %.1f us/frame, %.1f%% of the run\n",
+                scale, scaleSink.getSeconds() / frames * 1e6, 100 * scaleSink.getSeconds() / seconds);
+    }
+    if(audio) {
+        double sidSeconds = timeSid(machine->getSID(), ticks);
+        printf("SID: %.3f s for the same ticks, %.1f%% of the run\n", sidSeconds, 100 * sidSeconds / seconds);
+    }
+
+    MOS6510::Machine::destroy(machine);
+    return 0;
+}
@@ -0,0 +1,71 @@
+#ifndef INCLUDED_BOUNDED_QUEUE_H
+#define INCLUDED_BOUNDED_QUEUE_H
+
+#include <stddef.h>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+
+namespace MOS6510 {
+
+// Blocking single-producer/single-consumer hand-off between the emulation
+// thread and a background worker. The producer only waits once the worker
+// has fallen 'capacity' items behind.
+template <typename T>
+class BoundedQueue {
+private:
+    std::mutex                  m_mutex;
+    std::condition_variable     m_notFull;
+    std::condition_variable     m_notEmpty;
+    std::deque<T>               m_items;
+    size_t                      m_capacity;
+    bool                        m_closed;
+
+public:
+    BoundedQueue(size_t capacity)
+        : m_capacity(capacity)
+        , m_closed(false)
+    {
+    }
+
+    // returns true if the producer had to wait for room
+    bool push(T&& item)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        bool stalled = (m_items.size() >= m_capacity);
+        m_notFull.wait(lock, [this]() { return m_items.size() < m_capacity; });
+        m_items.push_back(std::move(item));
+        lock.unlock();
+        m_notEmpty.notify_one();
+        return stalled;
+    }
+
+    // returns false once the queue is closed and drained
+    bool pop(T& item)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_notEmpty.wait(lock, [this]() { return m_closed || !m_items.empty(); });
+        if(m_items.empty()) {
+            return false;
+        }
+
+        item = std::move(m_items.front());
+        m_items.pop_front();
+        lock.unlock();
+        m_notFull.notify_one();
+        return true;
+    }
+
+    void close()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_closed = true;
+        }
+        m_notEmpty.notify_all();
+    }
+};
+
+}
+
+#endif
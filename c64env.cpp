@@ -0,0 +1,76 @@
+#include <stdio.h>
+#include "c64env.h"
+#include "environment.h"
+
+using namespace MOS6510;
+
+static_assert(C64_FRAME_WIDTH == FRAME_WIDTH && C64_FRAME_HEIGHT == FRAME_HEIGHT,
+              "C frame size out of step with the VIC-II");
+static_assert(C64_RAM_SIZE == RAM_SIZE, "C RAM size out of step with the memory controller");
+static_assert(C64_VIDEO_PAL == VIDEO_PAL && C64_VIDEO_NTSC == VIDEO_NTSC, "C video standards out of step");
+static_assert(sizeof(C64Action) == sizeof(EnvAction), "C64Action must match EnvAction");
+static_assert(sizeof(C64Observation) == sizeof(EnvObservation), "C64Observation must match EnvObservation");
+
+struct C64VectorEnv {
+    VectorEnv   env;
+
+    C64VectorEnv(size_t threads)
+        : env(threads)
+    {
+    }
+};
+
+C64VectorEnv* c64_vecenv_create(const char *romDirs, int video, size_t count, size_t threads,
+                                uint32_t bootFrames)
+{
+    if(C64_VIDEO_PAL != video && C64_VIDEO_NTSC != video) {
+        fprintf(stderr, "Unknown video standard %d\n", video);
+        return 0;
+    }
+
+    RomSet roms;
+    if(romDirs) {
+        roms.addSearchPath(romDirs);
+    }
+    if(!roms.loadMissing()) {
+        fprintf(stderr, "Failed to load ROMs!\n");
+        return 0;
+    }
+
+    C64VectorEnv *env = new C64VectorEnv(threads);
+    if(!env->env.open(roms, (VideoStandard)video, count, bootFrames)) {
+        delete env;
+        return 0;
+    }
+    return env;
+}
+
+void c64_vecenv_destroy(C64VectorEnv *env)
+{
+    delete env;
+}
+
+size_t c64_vecenv_size(const C64VectorEnv *env)
+{
+    return env->env.size();
+}
+
+void c64_vecenv_reset(C64VectorEnv *env, size_t index)
+{
+    env->env.reset(index);
+}
+
+void c64_vecenv_reset_all(C64VectorEnv *env)
+{
+    env->env.resetAll();
+}
+
+void c64_vecenv_step(C64VectorEnv *env, const C64Action *actions, uint32_t frames)
+{
+    env->env.step(reinterpret_cast<const EnvAction*>(actions), frames);
+}
+
+void c64_vecenv_observe(const C64VectorEnv *env, C64Observation *obs)
+{
+    env->env.observe(reinterpret_cast<EnvObservation*>(obs));
+}
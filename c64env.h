@@ -0,0 +1,50 @@
+#ifndef INCLUDED_C64ENV_H
+#define INCLUDED_C64ENV_H
+
+/* C binding for MOS6510::VectorEnv, for ctypes/cffi and friends */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define C64_FRAME_WIDTH     412
+#define C64_FRAME_HEIGHT    234
+#define C64_RAM_SIZE        65536
+
+#define C64_VIDEO_PAL       0
+#define C64_VIDEO_NTSC      1
+
+typedef struct C64VectorEnv C64VectorEnv;
+
+/* see EnvAction */
+typedef struct {
+    uint64_t    keys;
+    uint8_t     joystick[2];
+} C64Action;
+
+/* pointers stay valid until the next step or reset */
+typedef struct {
+    const uint8_t*  frame;
+    const uint8_t*  ram;
+    uint32_t        frameCount;
+} C64Observation;
+
+/* romDirs is a colon separated search path, may be 0; video is one of
+   C64_VIDEO_*; returns 0 on failure */
+C64VectorEnv* c64_vecenv_create(const char *romDirs, int video, size_t count, size_t threads,
+                                uint32_t bootFrames);
+void c64_vecenv_destroy(C64VectorEnv *env);
+size_t c64_vecenv_size(const C64VectorEnv *env);
+void c64_vecenv_reset(C64VectorEnv *env, size_t index);
+void c64_vecenv_reset_all(C64VectorEnv *env);
+void c64_vecenv_step(C64VectorEnv *env, const C64Action *actions, uint32_t frames);
+void c64_vecenv_observe(const C64VectorEnv *env, C64Observation *obs);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
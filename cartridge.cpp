@@ -0,0 +1,232 @@
+#include <stdio.h>
+#include <string.h>
+#include "cartridge.h"
+
+namespace MOS6510 {
+
+static const char CRT_SIGNATURE[] = "C64 CARTRIDGE   ";
+static const size_t CRT_HEADER_SIZE = 0x40;
+static const size_t CHIP_HEADER_SIZE = 0x10;
+
+enum EasyFlashControl {
+    EASYFLASH_GAME      = 0x01,
+    EASYFLASH_EXROM     = 0x02,
+    EASYFLASH_MODE      = 0x04  // GAME from bit 0 rather than the boot jumper
+};
+
+static const uint8_t MAGIC_DESK_DISABLE = 0x80;
+
+static uint16_t readBig16(const uint8_t *data)
+{
+    return (data[0] << 8) | data[1];
+}
+
+static uint32_t readBig32(const uint8_t *data)
+{
+    return ((uint32_t)data[0] << 24) | (data[1] << 16) | (data[2] << 8) | data[3];
+}
+
+Cartridge::Cartridge()
+    : m_roml(0)
+    , m_romh(0)
+    , m_exrom(false)
+    , m_game(false)
+    , m_type(CART_NORMAL)
+    , m_headerExrom(false)
+    , m_headerGame(false)
+{
+    memset(&m_state, 0, sizeof(m_state));
+    memset(m_empty, 0xFF, sizeof(m_empty));
+    for(size_t i = 0; i < CART_MAX_BANKS; ++i) {
+        m_lowBanks[i] = m_empty;
+        m_highBanks[i] = m_empty;
+    }
+    m_roml = m_romh = m_empty;
+}
+
+bool Cartridge::load(const std::string& path)
+{
+    FILE *file = fopen(path.c_str(), "rb");
+    if(!file) {
+        fprintf(stderr, "Failed to open cartridge %s\n", path.c_str());
+        return false;
+    }
+
+    m_image.clear();
+    uint8_t buffer[4096];
+    size_t got;
+    while(0 < (got = fread(buffer, 1, sizeof(buffer), file))) {
+        m_image.insert(m_image.end(), buffer, buffer + got);
+    }
+    fclose(file);
+
+    if(!parse()) {
+        fprintf(stderr, "%s is not a supported CRT image\n", path.c_str());
+        m_image.clear();
+        return false;
+    }
+
+    reset();
+    return true;
+}
+
+// the header, then one CHIP packet per ROM bank
+bool Cartridge::parse()
+{
+    if(CRT_HEADER_SIZE > m_image.size() || 0 != memcmp(&m_image[0], CRT_SIGNATURE, 16)) {
+        return false;
+    }
+
+    uint16_t type = readBig16(&m_image[0x16]);
+    if(CART_NORMAL != type && CART_OCEAN != type && CART_MAGIC_DESK != type && CART_EASYFLASH != type) {
+        fprintf(stderr, "Cartridge type %u is not supported\n", type);
+        return false;
+    }
+    m_type = (CartridgeType)type;
+    m_headerExrom = (0 == m_image[0x18]);
+    m_headerGame = (0 == m_image[0x19]);
+    m_name.assign((const char *)&m_image[0x20], strnlen((const char *)&m_image[0x20], 32));
+
+    for(size_t i = 0; i < CART_MAX_BANKS; ++i) {
+        m_lowBanks[i] = m_empty;
+        m_highBanks[i] = m_empty;
+    }
+
+    bool found = false;
+    size_t pos = readBig32(&m_image[0x10]);
+    if(CRT_HEADER_SIZE > pos) {
+        pos = CRT_HEADER_SIZE;
+    }
+    while(pos + CHIP_HEADER_SIZE <= m_image.size()) {
+        const uint8_t *chip = &m_image[pos];
+        uint32_t length = readBig32(chip + 4);
+        uint16_t bank = readBig16(chip + 10);
+        uint16_t address = readBig16(chip + 12);
+        uint16_t size = readBig16(chip + 14);
+        if(0 != memcmp(chip, "CHIP", 4) || CHIP_HEADER_SIZE > length
+           || pos + CHIP_HEADER_SIZE + size > m_image.size()) {
+            return false;
+        }
+
+        // banks smaller than 8K would need mirroring, none of the supported types have them
+        const uint8_t *data = chip + CHIP_HEADER_SIZE;
+        if(CART_MAX_BANKS <= bank) {
+            return false;
+        } else if(0x8000 == address && 2 * CART_BANK_SIZE == size) {
+            m_lowBanks[bank] = data;
+            m_highBanks[bank] = data + CART_BANK_SIZE;
+        } else if(0x8000 == address && CART_BANK_SIZE == size) {
+            m_lowBanks[bank] = data;
+        } else if((0xA000 == address || 0xE000 == address) && CART_BANK_SIZE == size) {
+            m_highBanks[bank] = data;
+        } else {
+            fprintf(stderr, "Cartridge CHIP of 0x%04X bytes at 0x%04X is not supported\n", size, address);
+            return false;
+        }
+
+        found = true;
+        pos += length;
+    }
+
+    return found;
+}
+
+void Cartridge::reset()
+{
+    memset(&m_state, 0, sizeof(m_state));
+    mapBanks();
+}
+
+// points ROML and ROMH at the current bank and sets the lines
+void Cartridge::mapBanks()
+{
+    const uint8_t bank = m_state.bank;
+    m_roml = m_lowBanks[bank];
+    m_romh = m_highBanks[bank];
+    switch(m_type) {
+        case CART_NORMAL:
+            m_exrom = m_headerExrom;
+            m_game = m_headerGame;
+            break;
+        case CART_OCEAN: // the 512K boards only carry ROML banks, mirrored at $A000
+            if(m_empty == m_romh) {
+                m_romh = m_roml;
+            }
+            m_exrom = m_headerExrom;
+            m_game = m_headerGame;
+            break;
+        case CART_MAGIC_DESK:
+            m_exrom = !(MAGIC_DESK_DISABLE & m_state.control);
+            m_game = false;
+            break;
+        case CART_EASYFLASH: // boots in Ultimax mode
+            m_exrom = 0 != (EASYFLASH_EXROM & m_state.control);
+            m_game = (EASYFLASH_MODE & m_state.control) ? 0 != (EASYFLASH_GAME & m_state.control) : true;
+            break;
+    }
+}
+
+uint8_t Cartridge::readIO(uint16_t addr) const
+{
+    if(CART_EASYFLASH == m_type && 0xDF00 <= addr) {
+        return m_state.ram[addr & 0xFF];
+    }
+
+    return 0xFF;
+}
+
+void Cartridge::writeIO(uint16_t addr, uint8_t data)
+{
+    switch(m_type) {
+        case CART_NORMAL:
+            return;
+        case CART_OCEAN:
+            if(0xDF00 <= addr) {
+                return;
+            }
+            m_state.bank = data & 0x3F;
+            break;
+        case CART_MAGIC_DESK:
+            if(0xDF00 <= addr) {
+                return;
+            }
+            m_state.bank = data & 0x3F;
+            m_state.control = data & MAGIC_DESK_DISABLE;
+            break;
+        case CART_EASYFLASH:
+            if(0xDF00 <= addr) {
+                m_state.ram[addr & 0xFF] = data;
+                return;
+            } else if(0xDE00 == (addr & 0xFF02)) {
+                m_state.bank = data & 0x3F;
+            } else {
+                m_state.control = data;
+            }
+            break;
+    }
+
+    mapBanks();
+}
+
+CartridgeType Cartridge::getType() const
+{
+    return m_type;
+}
+
+const std::string& Cartridge::getName() const
+{
+    return m_name;
+}
+
+void Cartridge::saveState(CartridgeState& state) const
+{
+    state = m_state;
+}
+
+void Cartridge::loadState(const CartridgeState& state)
+{
+    m_state = state;
+    mapBanks();
+}
+
+}
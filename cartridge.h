@@ -0,0 +1,94 @@
+#ifndef INCLUDED_CARTRIDGE_H
+#define INCLUDED_CARTRIDGE_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace MOS6510 {
+
+const size_t CART_BANK_SIZE     = 0x2000;
+const size_t CART_MAX_BANKS     = 64;
+const size_t CART_IO_RAM_SIZE   = 0x100;
+
+// hardware types as numbered in the CRT header
+enum CartridgeType {
+    CART_NORMAL     = 0,    // 8K, 16K or Ultimax, by the EXROM and GAME lines
+    CART_OCEAN      = 5,
+    CART_MAGIC_DESK = 19,
+    CART_EASYFLASH  = 32
+};
+
+// the registers, restored with a machine snapshot
+struct CartridgeState {
+    uint8_t     bank;
+    uint8_t     control;        // $DE02 on EasyFlash, $DE00 bit 7 on Magic Desk
+    uint8_t     ram[CART_IO_RAM_SIZE]; // EasyFlash RAM at $DF00
+};
+
+// A cartridge from a .crt file. Every CHIP packet is kept as loaded and
+// ROML ($8000) and ROMH ($A000, or $E000 in Ultimax mode) each point in to
+// one 8K bank of it; a bank switch only moves those two pointers. The
+// EXROM and GAME members are true while the line is pulled low, as the
+// memory map sees them. Flash writes are not emulated.
+class Cartridge {
+private:
+    const uint8_t*          m_roml;         // first, the memory map reads these
+    const uint8_t*          m_romh;
+    bool                    m_exrom;
+    bool                    m_game;
+    CartridgeType           m_type;
+    bool                    m_headerExrom;  // lines after reset
+    bool                    m_headerGame;
+    CartridgeState          m_state;
+    std::vector<uint8_t>    m_image;        // the file, CHIP data is used in place
+    const uint8_t*          m_lowBanks[CART_MAX_BANKS];
+    const uint8_t*          m_highBanks[CART_MAX_BANKS];
+    uint8_t                 m_empty[CART_BANK_SIZE]; // open bus where a bank is missing
+    std::string             m_name;
+
+    Cartridge(const Cartridge& rhs);
+    Cartridge& operator=(const Cartridge& rhs);
+
+    bool parse();
+    void mapBanks();
+
+public:
+    Cartridge();
+
+    bool load(const std::string& path);
+    void reset();
+
+    // the memory map's side
+    const uint8_t* roml() const
+    {
+        return m_roml;
+    }
+
+    const uint8_t* romh() const
+    {
+        return m_romh;
+    }
+
+    bool exrom() const
+    {
+        return m_exrom;
+    }
+
+    bool game() const
+    {
+        return m_game;
+    }
+
+    uint8_t readIO(uint16_t addr) const;        // $DE00-$DFFF
+    void writeIO(uint16_t addr, uint8_t data);
+
+    CartridgeType getType() const;
+    const std::string& getName() const;
+    void saveState(CartridgeState& state) const;
+    void loadState(const CartridgeState& state);
+};
+
+}
+
+#endif
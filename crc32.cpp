@@ -0,0 +1,36 @@
+#include "crc32.h"
+
+namespace MOS6510 {
+
+struct CrcTable {
+    uint32_t entries[256];
+
+    CrcTable()
+    {
+        for(uint32_t n = 0; n < 256; ++n) {
+            uint32_t c = n;
+            for(int k = 0; k < 8; ++k) {
+                c = (c & 1) ? (0xEDB88320 ^ (c >> 1)) : (c >> 1);
+            }
+            entries[n] = c;
+        }
+    }
+};
+
+static const CrcTable crcTable;
+
+uint32_t updateCrc32(uint32_t crc, const uint8_t *data, size_t len)
+{
+    for(size_t i = 0; i < len; ++i) {
+        crc = crcTable.entries[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+
+    return crc;
+}
+
+uint32_t crc32(const uint8_t *data, size_t len)
+{
+    return updateCrc32(0xFFFFFFFF, data, len) ^ 0xFFFFFFFF;
+}
+
+}
@@ -0,0 +1,16 @@
+#ifndef INCLUDED_CRC32_H
+#define INCLUDED_CRC32_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace MOS6510 {
+
+// running CRC-32 (zlib/PNG polynomial); start with 0xFFFFFFFF and invert
+// the result, or use crc32() for a single buffer
+uint32_t updateCrc32(uint32_t crc, const uint8_t *data, size_t len);
+uint32_t crc32(const uint8_t *data, size_t len);
+
+}
+
+#endif
@@ -0,0 +1,261 @@
+#include <stdio.h>
+#include <string.h>
+#include "datasette.h"
+#include "scheduler.h"
+
+namespace MOS6510 {
+
+static const char TAP_SIGNATURE[] = "C64-TAPE-RAW";
+static const size_t TAP_HEADER_SIZE = 0x14;
+static const uint32_t TAP_OVERFLOW = 20000;     // a version 0 zero byte, some pause longer than 255 * 8
+
+// KERNAL pulses are about 0x30, 0x42 and 0x56 times 8 ticks long
+enum TapePulse {
+    PULSE_SHORT,
+    PULSE_MEDIUM,
+    PULSE_LONG,
+    PULSE_OTHER
+};
+
+static const size_t PILOT_MIN = 32;             // short pulses before a block counts as found
+static const size_t SYNC_LENGTH = 9;            // $89 down to $81, or $09 to $01 for the repeat
+
+static TapePulse classify(uint32_t ticks)
+{
+    if(0x24 * 8 > ticks || 0x70 * 8 <= ticks) {
+        return PULSE_OTHER;
+    } else if(0x3A * 8 > ticks) {
+        return PULSE_SHORT;
+    } else if(0x4D * 8 > ticks) {
+        return PULSE_MEDIUM;
+    }
+
+    return PULSE_LONG;
+}
+
+Datasette::Datasette()
+    : m_pos(0)
+    , m_motor(false)
+    , m_nextEdge(NEVER)
+    , m_remaining(0)
+{
+
+}
+
+bool Datasette::load(const std::string& path)
+{
+    FILE *file = fopen(path.c_str(), "rb");
+    if(!file) {
+        fprintf(stderr, "Failed to open tape image %s\n", path.c_str());
+        return false;
+    }
+
+    std::vector<uint8_t> image;
+    uint8_t buffer[4096];
+    size_t got;
+    while(0 < (got = fread(buffer, 1, sizeof(buffer), file))) {
+        image.insert(image.end(), buffer, buffer + got);
+    }
+    fclose(file);
+
+    if(!parse(image)) {
+        fprintf(stderr, "%s is not a valid TAP image\n", path.c_str());
+        m_pulses.clear();
+        return false;
+    }
+
+    rewind();
+    return true;
+}
+
+// version 0 and 1, a zero byte in version 1 is followed by a 24-bit length
+bool Datasette::parse(const std::vector<uint8_t>& image)
+{
+    if(TAP_HEADER_SIZE > image.size() || 0 != memcmp(&image[0], TAP_SIGNATURE, 12) || 1 < image[12]) {
+        return false;
+    }
+
+    uint8_t version = image[12];
+    size_t end = TAP_HEADER_SIZE + (image[16] | (image[17] << 8) | (image[18] << 16) | ((size_t)image[19] << 24));
+    if(end > image.size()) {
+        end = image.size();
+    }
+
+    m_pulses.clear();
+    for(size_t pos = TAP_HEADER_SIZE; pos < end; ++pos) {
+        if(image[pos]) {
+            m_pulses.push_back(image[pos] * 8);
+        } else if(0 == version) {
+            m_pulses.push_back(TAP_OVERFLOW);
+        } else if(pos + 3 < end) {
+            m_pulses.push_back(image[pos + 1] | (image[pos + 2] << 8) | (image[pos + 3] << 16));
+            pos += 3;
+        }
+    }
+
+    return !m_pulses.empty();
+}
+
+bool Datasette::isLoaded() const
+{
+    return !m_pulses.empty();
+}
+
+void Datasette::rewind()
+{
+    m_motor = false;
+    m_nextEdge = NEVER;
+    m_pos = 0;
+    m_remaining = m_pulses.empty() ? 0 : m_pulses[0];
+}
+
+bool Datasette::isMotorOn() const
+{
+    return m_motor;
+}
+
+void Datasette::setMotor(bool on, uint64_t now)
+{
+    if(on == m_motor) {
+        return;
+    }
+
+    m_motor = on;
+    if(!on) {
+        m_remaining = (NEVER == m_nextEdge) ? 0 : m_nextEdge - now;
+        m_nextEdge = NEVER;
+    } else if(m_pos < m_pulses.size()) {
+        m_nextEdge = now + m_remaining;
+    }
+}
+
+uint64_t Datasette::nextEdge() const
+{
+    return m_nextEdge;
+}
+
+bool Datasette::edgeDue(uint64_t now)
+{
+    if(now < m_nextEdge) {
+        return false;
+    }
+
+    if(++m_pos < m_pulses.size()) {
+        m_nextEdge += m_pulses[m_pos];
+    } else {
+        m_nextEdge = NEVER;
+    }
+    return true;
+}
+
+void Datasette::seek(size_t pos, uint64_t now)
+{
+    m_pos = pos;
+    m_remaining = (pos < m_pulses.size()) ? m_pulses[pos] : 0;
+    m_nextEdge = (m_motor && pos < m_pulses.size()) ? now + m_remaining : NEVER;
+}
+
+// A byte is a long/medium marker, eight bits LSB first and an odd parity
+// bit, each bit a short/medium pair for 0 or a medium/short pair for 1.
+// Returns -1 at a long/short end of data marker or anything else.
+int Datasette::decodeByte(size_t& pos) const
+{
+    if(pos + 20 > m_pulses.size() || PULSE_LONG != classify(m_pulses[pos])
+       || PULSE_MEDIUM != classify(m_pulses[pos + 1])) {
+        return -1;
+    }
+
+    int value = 0;
+    int parity = 1;
+    for(int bit = 0; bit < 9; ++bit) {
+        TapePulse first = classify(m_pulses[pos + 2 + 2 * bit]);
+        TapePulse second = classify(m_pulses[pos + 3 + 2 * bit]);
+        int one;
+        if(PULSE_SHORT == first && PULSE_MEDIUM == second) {
+            one = 0;
+        } else if(PULSE_MEDIUM == first && PULSE_SHORT == second) {
+            one = 1;
+        } else {
+            return -1;
+        }
+
+        if(8 > bit) {
+            value |= one << bit;
+            parity ^= one;
+        } else if(one != parity) {
+            return -1;
+        }
+    }
+
+    pos += 20;
+    return value;
+}
+
+// a pilot tone, the sync countdown, the data and an XOR checksum byte
+bool Datasette::decodeBlock(size_t& pos, std::vector<uint8_t>& data, bool& repeat, bool& valid) const
+{
+    size_t shorts = 0;
+    while(pos < m_pulses.size()) {
+        TapePulse pulse = classify(m_pulses[pos]);
+        if(PULSE_LONG == pulse && PILOT_MIN <= shorts) {
+            break;
+        }
+        shorts = (PULSE_SHORT == pulse) ? shorts + 1 : 0;
+        ++pos;
+    }
+
+    data.clear();
+    int value;
+    while(0 <= (value = decodeByte(pos))) {
+        data.push_back(value);
+    }
+    if(SYNC_LENGTH + 1 >= data.size()) {
+        return false;
+    }
+
+    repeat = (0x09 == data[0]);
+    for(size_t i = 0; i < SYNC_LENGTH; ++i) {
+        if((repeat ? 0x09 : 0x89) - i != data[i]) {
+            return false;
+        }
+    }
+
+    uint8_t checksum = 0;
+    for(size_t i = SYNC_LENGTH; i < data.size(); ++i) {
+        checksum ^= data[i];
+    }
+    valid = (0 == checksum);
+    data.pop_back();
+    data.erase(data.begin(), data.begin() + SYNC_LENGTH);
+    return true;
+}
+
+bool Datasette::readBlock(std::vector<uint8_t>& data, uint64_t now)
+{
+    size_t pos = m_pos;
+    bool repeat;
+    bool valid;
+    if(!decodeBlock(pos, data, repeat, valid) || repeat) {
+        return false;
+    }
+
+    // the repeat follows right away, and stands in for a damaged first copy
+    size_t after = pos;
+    std::vector<uint8_t> copy;
+    bool copyValid;
+    if(decodeBlock(after, copy, repeat, copyValid) && repeat) {
+        pos = after;
+        if(!valid && copyValid) {
+            data.swap(copy);
+            valid = true;
+        }
+    }
+    if(!valid) {
+        return false;
+    }
+
+    seek(pos, now);
+    return true;
+}
+
+}
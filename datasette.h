@@ -0,0 +1,52 @@
+#ifndef INCLUDED_DATASETTE_H
+#define INCLUDED_DATASETTE_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace MOS6510 {
+
+// A datasette with a TAP image in it and PLAY held down. The image is the
+// time between falling edges of the read signal, each edge reaches CIA1 as
+// FLAG; the tape only moves while the CPU port runs the motor. TAP counts
+// in CPU cycles / 8, but the pulses are played in instruction ticks, like
+// the CIA timers that measure them, so the two stay consistent with each
+// other. Exact cycle timing is not met: the tape runs faster than real.
+class Datasette {
+private:
+    std::vector<uint32_t>   m_pulses;
+    size_t                  m_pos;          // the pulse under the head
+    bool                    m_motor;
+    uint64_t                m_nextEdge;     // while the motor runs
+    uint32_t                m_remaining;    // of the current pulse, while it is stopped
+
+    Datasette(const Datasette& rhs);
+    Datasette& operator=(const Datasette& rhs);
+
+    bool parse(const std::vector<uint8_t>& image);
+    bool decodeBlock(size_t& pos, std::vector<uint8_t>& data, bool& repeat, bool& valid) const;
+    int  decodeByte(size_t& pos) const;
+    void seek(size_t pos, uint64_t now);
+
+public:
+    Datasette();
+
+    bool load(const std::string& path);
+    bool isLoaded() const;
+    void rewind();
+
+    bool isMotorOn() const;
+    void setMotor(bool on, uint64_t now);
+    uint64_t nextEdge() const;          // NEVER while the motor is off or the tape has run out
+    bool edgeDue(uint64_t now);         // true for, and past, each edge up to now
+
+    // Decodes the next block in KERNAL format, with its repeat, and moves
+    // the tape past both. False, leaving the tape where it was, if there
+    // is no clean block ahead.
+    bool readBlock(std::vector<uint8_t>& data, uint64_t now);
+};
+
+}
+
+#endif
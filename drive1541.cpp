@@ -0,0 +1,288 @@
+#include <assert.h>
+#include <string.h>
+#include "drive1541.h"
+#include "log.h"
+
+namespace MOS6510 {
+
+// VIA1 port B, the serial bus
+enum DriveBusBits {
+    BUS_DATA_IN     = 0x01,
+    BUS_DATA_OUT    = 0x02,
+    BUS_CLK_IN      = 0x04,
+    BUS_CLK_OUT     = 0x08,
+    BUS_ATN_ACK     = 0x10,
+    BUS_ATN_IN      = 0x80
+};
+
+// VIA2 port B, the mechanics
+enum DriveHeadBits {
+    HEAD_STEPPER    = 0x03,
+    HEAD_MOTOR      = 0x04,
+    HEAD_LED        = 0x08,
+    HEAD_WRITABLE   = 0x10,
+    HEAD_DENSITY    = 0x60,
+    HEAD_NO_SYNC    = 0x80
+};
+
+Drive1541::Drive1541(const uint8_t *rom, VideoStandard standard)
+    : m_cpu(*this)
+    , m_rom(rom)
+    , m_clock(systemClock(standard))
+    , m_startCycle(0)
+    , m_cycles(0)
+    , m_busLines(0)
+    , m_running(false)
+    , m_halfTrack(34) // track 18, where DOS expects to be
+    , m_stepperPhase(0)
+    , m_headPos(0)
+    , m_byteCycles(0)
+    , m_lastByte(0)
+    , m_sync(false)
+{
+    assert(m_rom);
+    memset(m_ram, 0, sizeof(m_ram));
+}
+
+Drive1541::~Drive1541()
+{
+    stop();
+    m_disk.eject();
+}
+
+bool Drive1541::insertDisk(const std::string& path)
+{
+    assert(!m_running);
+    return m_disk.load(path);
+}
+
+void Drive1541::ejectDisk()
+{
+    assert(!m_running);
+    m_disk.eject();
+}
+
+IecBus& Drive1541::getBus()
+{
+    return m_bus;
+}
+
+void Drive1541::start(uint64_t cycle)
+{
+    stop();
+    m_bus.reset(cycle);
+    m_startCycle = cycle;
+    m_cycles = 0;
+    m_busLines = 0;
+    m_via1.reset();
+    m_via2.reset();
+    m_cpu.reset();
+    m_stepperPhase = m_via2.getPortB() & HEAD_STEPPER;
+    m_running = true;
+    m_thread = std::thread(&Drive1541::runLoop, this);
+}
+
+void Drive1541::stop()
+{
+    if(!m_running) {
+        return;
+    }
+
+    m_bus.close();
+    m_thread.join();
+    m_running = false;
+}
+
+// The drive runs every instruction that starts before the cycle the C64
+// has published, replaying the C64's line changes as their cycles come up.
+void Drive1541::runLoop()
+{
+    uint64_t now = c64Cycles();
+    for(;;) {
+        uint64_t limit = m_bus.waitForC64(now);
+        if(!limit) {
+            break;
+        }
+
+        while(now < limit) {
+            uint8_t lines;
+            while(m_bus.nextEvent(now, lines)) {
+                setBusLines(lines);
+            }
+            step();
+            now = c64Cycles();
+        }
+        m_bus.publish(now, busPulls());
+    }
+}
+
+void Drive1541::step()
+{
+    uint32_t cycles = m_cpu.execute(m_via1.isIrq() || m_via2.isIrq());
+    m_via1.tick(cycles);
+    m_via2.tick(cycles);
+    rotateDisk(cycles);
+    m_cycles += cycles;
+}
+
+// the drive's 1 MHz cycles on the C64's clock, which is a little slower on
+// PAL and a little faster on NTSC
+uint64_t Drive1541::c64Cycles() const
+{
+    return m_startCycle + m_cycles * m_clock / DRIVE_CLOCK;
+}
+
+// ATN goes to CA1 as well, DOS takes an interrupt when it is pulled
+void Drive1541::setBusLines(uint8_t lines)
+{
+    m_busLines = lines;
+    m_via1.setCA1(0 != (IEC_ATN & lines));
+}
+
+// Besides DATA and CLK out, a gate pulls DATA whenever the ATN acknowledge
+// output differs from ATN, so the drive answers ATN before DOS gets to it.
+uint8_t Drive1541::busPulls() const
+{
+    uint8_t port = m_via1.getPortB();
+    uint8_t pulls = 0;
+    if(BUS_DATA_OUT & port) {
+        pulls |= IEC_DATA;
+    }
+    if(BUS_CLK_OUT & port) {
+        pulls |= IEC_CLK;
+    }
+    if((0 != (IEC_ATN & m_busLines)) != (0 != (BUS_ATN_ACK & port))) {
+        pulls |= IEC_DATA;
+    }
+
+    return pulls;
+}
+
+// the stepper moves half a track per phase, in the direction it turns
+void Drive1541::moveHead()
+{
+    uint8_t phase = m_via2.getPortB() & HEAD_STEPPER;
+    uint8_t delta = (phase - m_stepperPhase) & HEAD_STEPPER;
+    if(1 == delta && HALF_TRACKS - 1 > m_halfTrack) {
+        ++m_halfTrack;
+    } else if(3 == delta && 0 < m_halfTrack) {
+        --m_halfTrack;
+    }
+    if(delta) {
+        C64_LOG(LOG_DRIVE, LOG_DEBUG, "Head on track %d.%d", m_halfTrack / 2 + 1, 5 * (m_halfTrack & 1));
+    }
+    m_stepperPhase = phase;
+}
+
+// A byte passes the head every 26 to 32 cycles, depending on the density
+// DOS selected. In read mode ten or more one bits are a sync mark, which
+// shows on PB7 instead of as bytes; every other byte is latched on port A
+// and signalled on CA1 and, with CA2 high, on the CPU's SO pin. In write
+// mode port A goes on to the disk instead.
+void Drive1541::rotateDisk(uint32_t cycles)
+{
+    uint8_t port = m_via2.getPortB();
+    if(!(HEAD_MOTOR & port)) {
+        return;
+    }
+
+    uint32_t perByte = 32 - 2 * ((port & HEAD_DENSITY) >> 5);
+    m_byteCycles += cycles;
+    while(m_byteCycles >= perByte) {
+        m_byteCycles -= perByte;
+        std::vector<uint8_t>& track = m_disk.getTrack(m_halfTrack);
+        if(track.empty()) {
+            m_sync = false;
+            continue;
+        }
+
+        m_headPos = (m_headPos + 1) % track.size();
+        if(!m_via2.getCB2()) {
+            if(!m_disk.isWriteProtected()) {
+                track[m_headPos] = m_via2.getPortA();
+                m_disk.setDirty();
+            }
+            m_sync = false;
+            m_lastByte = 0;
+        } else {
+            uint8_t data = track[m_headPos];
+            m_sync = (0xFF == data && 0xFF == m_lastByte);
+            m_lastByte = data;
+            if(m_sync) {
+                continue;
+            }
+            m_via2.setPinsA(data);
+        }
+
+        if(m_via2.getCA2()) {
+            m_cpu.setOverflow();
+        }
+        m_via2.setCA1(false);
+        m_via2.setCA1(true);
+    }
+}
+
+// RAM, the VIAs and the ROM are mirrored over the whole address space
+uint8_t Drive1541::read(uint16_t addr)
+{
+    if(0x8000 & addr) {
+        return m_rom[addr & (DRIVE_ROM_SIZE - 1)];
+    }
+
+    uint16_t local = addr & 0x1FFF;
+    if(DRIVE_RAM_SIZE > local) {
+        return m_ram[local];
+    } else if(0x1800 == (local & 0x1C00)) {
+        if(0 == (addr & 0x0F)) {
+            uint8_t low = m_busLines | busPulls();
+            m_via1.setPinsB(((IEC_DATA & low) ? BUS_DATA_IN : 0)
+                          | ((IEC_CLK & low) ? BUS_CLK_IN : 0)
+                          | ((IEC_ATN & low) ? BUS_ATN_IN : 0)
+                          | BUS_DATA_OUT | BUS_CLK_OUT | BUS_ATN_ACK); // device 8
+        }
+        return m_via1.read(addr & 0x0F);
+    } else if(0x1C00 == (local & 0x1C00)) {
+        if(0 == (addr & 0x0F)) {
+            m_via2.setPinsB((m_sync ? 0 : HEAD_NO_SYNC)
+                          | (m_disk.isWriteProtected() ? 0 : HEAD_WRITABLE)
+                          | HEAD_STEPPER | HEAD_MOTOR | HEAD_LED | HEAD_DENSITY);
+        }
+        return m_via2.read(addr & 0x0F);
+    }
+
+    return addr >> 8; // open bus
+}
+
+void Drive1541::write(uint16_t addr, uint8_t data)
+{
+    if(0x8000 & addr) {
+        return;
+    }
+
+    uint16_t local = addr & 0x1FFF;
+    if(DRIVE_RAM_SIZE > local) {
+        m_ram[local] = data;
+    } else if(0x1800 == (local & 0x1C00)) {
+        m_via1.write(addr & 0x0F, data);
+    } else if(0x1C00 == (local & 0x1C00)) {
+        m_via2.write(addr & 0x0F, data);
+        moveHead();
+    }
+}
+
+bool Drive1541::isMotorOn() const
+{
+    return 0 != (HEAD_MOTOR & m_via2.getPortB());
+}
+
+bool Drive1541::isLedOn() const
+{
+    return 0 != (HEAD_LED & m_via2.getPortB());
+}
+
+int Drive1541::getTrack() const
+{
+    return m_halfTrack;
+}
+
+}
@@ -0,0 +1,79 @@
+#ifndef INCLUDED_DRIVE1541_H
+#define INCLUDED_DRIVE1541_H
+
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include "drivecpu.h"
+#include "via6522.h"
+#include "gcrdisk.h"
+#include "iecbus.h"
+#include "machineconfig.h"
+
+namespace MOS6510 {
+
+const uint32_t DRIVE_CLOCK      = 1000000;
+const size_t   DRIVE_RAM_SIZE   = 0x0800;
+const size_t   DRIVE_ROM_SIZE   = 0x4000;
+
+// A 1541 as device 8: its own 6502 running the DOS ROM, VIA1 on the serial
+// bus, VIA2 on the head, stepper and spindle motor, and a GcrDisk under the
+// head. It runs on its own thread, kept in step with the C64 by its IecBus;
+// see there. Disks are only swapped while it is stopped.
+class Drive1541 {
+private:
+    DriveCpu        m_cpu;
+    Via6522         m_via1;
+    Via6522         m_via2;
+    const uint8_t*  m_rom;          // DRIVE_ROM_SIZE bytes, shared
+    uint32_t        m_clock;        // the C64's, to convert between the two clocks
+    uint64_t        m_startCycle;   // C64 cycle of start()
+    uint64_t        m_cycles;       // since start()
+    uint8_t         m_busLines;     // pulled by the C64, as of m_cycles
+    IecBus          m_bus;
+    std::thread     m_thread;
+    bool            m_running;
+
+    // head and disk
+    GcrDisk         m_disk;
+    int             m_halfTrack;
+    uint8_t         m_stepperPhase;
+    size_t          m_headPos;
+    uint32_t        m_byteCycles;   // since the last byte passed the head
+    uint8_t         m_lastByte;
+    bool            m_sync;
+    uint8_t         m_ram[DRIVE_RAM_SIZE];
+
+    Drive1541(const Drive1541& rhs);
+    Drive1541& operator=(const Drive1541& rhs);
+
+    uint64_t c64Cycles() const;
+    uint8_t  busPulls() const;
+    void     setBusLines(uint8_t lines);
+    void     moveHead();
+    void     rotateDisk(uint32_t cycles);
+    void     runLoop();
+
+public:
+    Drive1541(const uint8_t *rom, VideoStandard standard);
+    ~Drive1541();
+
+    bool insertDisk(const std::string& path);
+    void ejectDisk();               // writes changes back to the image
+
+    IecBus& getBus();
+    void start(uint64_t cycle);     // resets the drive at C64 cycle 'cycle'
+    void stop();
+
+    uint8_t read(uint16_t addr);
+    void write(uint16_t addr, uint8_t data);
+    void step();                    // one instruction, on the drive thread once started
+
+    bool isMotorOn() const;
+    bool isLedOn() const;
+    int  getTrack() const;          // in half tracks, 0 is track 1
+};
+
+}
+
+#endif
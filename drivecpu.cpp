@@ -0,0 +1,583 @@
+#include "drivecpu.h"
+#include "drive1541.h"
+
+namespace MOS6510 {
+
+const uint16_t RESET_VECTOR = 0xFFFC;
+const uint16_t IRQ_VECTOR   = 0xFFFE;
+
+enum DriveStatus {
+    STATUS_C    = 0x01,
+    STATUS_Z    = 0x02,
+    STATUS_I    = 0x04,
+    STATUS_D    = 0x08,
+    STATUS_B    = 0x10,
+    STATUS_U    = 0x20,
+    STATUS_V    = 0x40,
+    STATUS_N    = 0x80
+};
+
+// NMOS cycles per opcode, before page crossing and branch penalties
+static const uint8_t CYCLES[256] = {
+    7, 6, 2, 8, 3, 3, 5, 5, 3, 2, 2, 2, 4, 4, 6, 6,
+    2, 5, 2, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7,
+    6, 6, 2, 8, 3, 3, 5, 5, 4, 2, 2, 2, 4, 4, 6, 6,
+    2, 5, 2, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7,
+    6, 6, 2, 8, 3, 3, 5, 5, 3, 2, 2, 2, 3, 4, 6, 6,
+    2, 5, 2, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7,
+    6, 6, 2, 8, 3, 3, 5, 5, 4, 2, 2, 2, 5, 4, 6, 6,
+    2, 5, 2, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7,
+    2, 6, 2, 6, 3, 3, 3, 3, 2, 2, 2, 2, 4, 4, 4, 4,
+    2, 6, 2, 6, 4, 4, 4, 4, 2, 5, 2, 5, 5, 5, 5, 5,
+    2, 6, 2, 6, 3, 3, 3, 3, 2, 2, 2, 2, 4, 4, 4, 4,
+    2, 5, 2, 5, 4, 4, 4, 4, 2, 4, 2, 4, 4, 4, 4, 4,
+    2, 6, 2, 8, 3, 3, 5, 5, 2, 2, 2, 2, 4, 4, 6, 6,
+    2, 5, 2, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7,
+    2, 6, 2, 8, 3, 3, 5, 5, 2, 2, 2, 2, 4, 4, 6, 6,
+    2, 5, 2, 8, 4, 4, 6, 6, 2, 4, 2, 7, 4, 4, 7, 7
+};
+
+// operand bytes of the undocumented opcodes, which all run as NOPs
+static uint8_t illegalOperands(uint8_t opcode)
+{
+    switch(opcode & 0x1F) {
+        case 0x1A:
+            return 0;
+        case 0x0C: case 0x0F: case 0x1B: case 0x1C: case 0x1E: case 0x1F:
+            return 2;
+    }
+
+    return 1;
+}
+
+DriveCpu::DriveCpu(Drive1541& drive)
+    : m_programCounter(0)
+    , m_stackPointer(0xFD)
+    , m_accumulator(0)
+    , m_xIndex(0)
+    , m_yIndex(0)
+    , m_status(STATUS_U | STATUS_I)
+    , m_jammed(false)
+    , m_cycles(0)
+    , m_drive(drive)
+{
+
+}
+
+void DriveCpu::reset()
+{
+    m_stackPointer = 0xFD;
+    m_status = STATUS_U | STATUS_I;
+    m_jammed = false;
+    m_programCounter = readWord(RESET_VECTOR);
+}
+
+void DriveCpu::setOverflow()
+{
+    m_status |= STATUS_V;
+}
+
+CpuRegisters DriveCpu::getRegisters() const
+{
+    CpuRegisters regs;
+    regs.pc = m_programCounter;
+    regs.a = m_accumulator;
+    regs.x = m_xIndex;
+    regs.y = m_yIndex;
+    regs.sp = m_stackPointer;
+    regs.p = m_status;
+    return regs;
+}
+
+// a jammed CPU still lets time pass, so the VIAs and the disk keep going
+uint32_t DriveCpu::execute(bool irq)
+{
+    if(m_jammed) {
+        return 2;
+    }
+
+    if(irq && !(STATUS_I & m_status)) {
+        m_cycles = 7;
+        interrupt(IRQ_VECTOR, false);
+        return m_cycles;
+    }
+
+    uint8_t opcode = fetch();
+    m_cycles = CYCLES[opcode];
+    switch(opcode) {
+        case ADC_abs: adc(readOperand(ABS));                break;
+        case ADC_abx: adc(readOperand(ABX));                break;
+        case ADC_aby: adc(readOperand(ABY));                break;
+        case ADC_imm: adc(readOperand(IMM));                break;
+        case ADC_izx: adc(readOperand(IZX));                break;
+        case ADC_izy: adc(readOperand(IZY));                break;
+        case ADC_zp:  adc(readOperand(ZP));                 break;
+        case ADC_zpx: adc(readOperand(ZPX));                break;
+        case AND_abs: m_accumulator &= readOperand(ABS); setNZ(m_accumulator); break;
+        case AND_abx: m_accumulator &= readOperand(ABX); setNZ(m_accumulator); break;
+        case AND_aby: m_accumulator &= readOperand(ABY); setNZ(m_accumulator); break;
+        case AND_imm: m_accumulator &= readOperand(IMM); setNZ(m_accumulator); break;
+        case AND_izx: m_accumulator &= readOperand(IZX); setNZ(m_accumulator); break;
+        case AND_izy: m_accumulator &= readOperand(IZY); setNZ(m_accumulator); break;
+        case AND_zp:  m_accumulator &= readOperand(ZP);  setNZ(m_accumulator); break;
+        case AND_zpx: m_accumulator &= readOperand(ZPX); setNZ(m_accumulator); break;
+        case ASL:     asl(IMP);                             break;
+        case ASL_abs: asl(ABS);                             break;
+        case ASL_abx: asl(ABX);                             break;
+        case ASL_zp:  asl(ZP);                              break;
+        case ASL_zpx: asl(ZPX);                             break;
+        case BCC_rel: br(!(STATUS_C & m_status));           break;
+        case BCS_rel: br(STATUS_C & m_status);              break;
+        case BEQ_rel: br(STATUS_Z & m_status);              break;
+        case BIT_abs: bit(ABS);                             break;
+        case BIT_zp:  bit(ZP);                              break;
+        case BMI_rel: br(STATUS_N & m_status);              break;
+        case BNE_rel: br(!(STATUS_Z & m_status));           break;
+        case BPL_rel: br(!(STATUS_N & m_status));           break;
+        case BRK:     fetch(); interrupt(IRQ_VECTOR, true); break;
+        case BVC_rel: br(!(STATUS_V & m_status));           break;
+        case BVS_rel: br(STATUS_V & m_status);              break;
+        case CLC:     setFlag(STATUS_C, false);             break;
+        case CLD:     setFlag(STATUS_D, false);             break;
+        case CLI:     setFlag(STATUS_I, false);             break;
+        case CLV:     setFlag(STATUS_V, false);             break;
+        case CMP_abs: cmp(m_accumulator, ABS);              break;
+        case CMP_abx: cmp(m_accumulator, ABX);              break;
+        case CMP_aby: cmp(m_accumulator, ABY);              break;
+        case CMP_imm: cmp(m_accumulator, IMM);              break;
+        case CMP_izx: cmp(m_accumulator, IZX);              break;
+        case CMP_izy: cmp(m_accumulator, IZY);              break;
+        case CMP_zp:  cmp(m_accumulator, ZP);               break;
+        case CMP_zpx: cmp(m_accumulator, ZPX);              break;
+        case CPX_abs: cmp(m_xIndex, ABS);                   break;
+        case CPX_imm: cmp(m_xIndex, IMM);                   break;
+        case CPX_zp:  cmp(m_xIndex, ZP);                    break;
+        case CPY_abs: cmp(m_yIndex, ABS);                   break;
+        case CPY_imm: cmp(m_yIndex, IMM);                   break;
+        case CPY_zp:  cmp(m_yIndex, ZP);                    break;
+        case DEC_abs: dec(ABS);                             break;
+        case DEC_abx: dec(ABX);                             break;
+        case DEC_zp:  dec(ZP);                              break;
+        case DEC_zpx: dec(ZPX);                             break;
+        case DEX:     setNZ(--m_xIndex);                    break;
+        case DEY:     setNZ(--m_yIndex);                    break;
+        case EOR_abs: m_accumulator ^= readOperand(ABS); setNZ(m_accumulator); break;
+        case EOR_abx: m_accumulator ^= readOperand(ABX); setNZ(m_accumulator); break;
+        case EOR_aby: m_accumulator ^= readOperand(ABY); setNZ(m_accumulator); break;
+        case EOR_imm: m_accumulator ^= readOperand(IMM); setNZ(m_accumulator); break;
+        case EOR_izx: m_accumulator ^= readOperand(IZX); setNZ(m_accumulator); break;
+        case EOR_izy: m_accumulator ^= readOperand(IZY); setNZ(m_accumulator); break;
+        case EOR_zp:  m_accumulator ^= readOperand(ZP);  setNZ(m_accumulator); break;
+        case EOR_zpx: m_accumulator ^= readOperand(ZPX); setNZ(m_accumulator); break;
+        case INC_abs: inc(ABS);                             break;
+        case INC_abx: inc(ABX);                             break;
+        case INC_zp:  inc(ZP);                              break;
+        case INC_zpx: inc(ZPX);                             break;
+        case INX:     setNZ(++m_xIndex);                    break;
+        case INY:     setNZ(++m_yIndex);                    break;
+        case JMP_abs: m_programCounter = computeAddress(ABS, false); break;
+        case JMP_ind: m_programCounter = computeAddress(IND, false); break;
+        case JSR: {
+            uint8_t lo = fetch();
+            push(m_programCounter >> 8);
+            push(m_programCounter & 0xFF);
+            m_programCounter = lo | (fetch() << 8);
+        } break;
+        case LDA_abs: ldr(m_accumulator, ABS);              break;
+        case LDA_abx: ldr(m_accumulator, ABX);              break;
+        case LDA_aby: ldr(m_accumulator, ABY);              break;
+        case LDA_imm: ldr(m_accumulator, IMM);              break;
+        case LDA_izx: ldr(m_accumulator, IZX);              break;
+        case LDA_izy: ldr(m_accumulator, IZY);              break;
+        case LDA_zp:  ldr(m_accumulator, ZP);               break;
+        case LDA_zpx: ldr(m_accumulator, ZPX);              break;
+        case LDX_abs: ldr(m_xIndex, ABS);                   break;
+        case LDX_aby: ldr(m_xIndex, ABY);                   break;
+        case LDX_imm: ldr(m_xIndex, IMM);                   break;
+        case LDX_zp:  ldr(m_xIndex, ZP);                    break;
+        case LDX_zpy: ldr(m_xIndex, ZPY);                   break;
+        case LDY_abs: ldr(m_yIndex, ABS);                   break;
+        case LDY_abx: ldr(m_yIndex, ABX);                   break;
+        case LDY_imm: ldr(m_yIndex, IMM);                   break;
+        case LDY_zp:  ldr(m_yIndex, ZP);                    break;
+        case LDY_zpx: ldr(m_yIndex, ZPX);                   break;
+        case LSR:     lsr(IMP);                             break;
+        case LSR_abs: lsr(ABS);                             break;
+        case LSR_abx: lsr(ABX);                             break;
+        case LSR_zp:  lsr(ZP);                              break;
+        case LSR_zpx: lsr(ZPX);                             break;
+        case NOPE:                                          break;
+        case ORA_abs: m_accumulator |= readOperand(ABS); setNZ(m_accumulator); break;
+        case ORA_abx: m_accumulator |= readOperand(ABX); setNZ(m_accumulator); break;
+        case ORA_aby: m_accumulator |= readOperand(ABY); setNZ(m_accumulator); break;
+        case ORA_imm: m_accumulator |= readOperand(IMM); setNZ(m_accumulator); break;
+        case ORA_izx: m_accumulator |= readOperand(IZX); setNZ(m_accumulator); break;
+        case ORA_izy: m_accumulator |= readOperand(IZY); setNZ(m_accumulator); break;
+        case ORA_zp:  m_accumulator |= readOperand(ZP);  setNZ(m_accumulator); break;
+        case ORA_zpx: m_accumulator |= readOperand(ZPX); setNZ(m_accumulator); break;
+        case PHA:     push(m_accumulator);                  break;
+        case PHP:     push(m_status | STATUS_B | STATUS_U); break;
+        case PLA:     pull(m_accumulator); setNZ(m_accumulator); break;
+        case PLP:     pull(m_status); m_status = (m_status & ~STATUS_B) | STATUS_U; break;
+        case ROL:     rol(IMP);                             break;
+        case ROL_abs: rol(ABS);                             break;
+        case ROL_abx: rol(ABX);                             break;
+        case ROL_zp:  rol(ZP);                              break;
+        case ROL_zpx: rol(ZPX);                             break;
+        case ROR:     ror(IMP);                             break;
+        case ROR_abs: ror(ABS);                             break;
+        case ROR_abx: ror(ABX);                             break;
+        case ROR_zp:  ror(ZP);                              break;
+        case ROR_zpx: ror(ZPX);                             break;
+        case RTI: {
+            uint8_t lo, hi;
+            pull(m_status);
+            m_status = (m_status & ~STATUS_B) | STATUS_U;
+            pull(lo);
+            pull(hi);
+            m_programCounter = lo | (hi << 8);
+        } break;
+        case RTS: {
+            uint8_t lo, hi;
+            pull(lo);
+            pull(hi);
+            m_programCounter = (lo | (hi << 8)) + 1;
+        } break;
+        case SBC_abs: sbc(readOperand(ABS));                break;
+        case SBC_abx: sbc(readOperand(ABX));                break;
+        case SBC_aby: sbc(readOperand(ABY));                break;
+        case SBC_im2:
+        case SBC_imm: sbc(readOperand(IMM));                break;
+        case SBC_izx: sbc(readOperand(IZX));                break;
+        case SBC_izy: sbc(readOperand(IZY));                break;
+        case SBC_zp:  sbc(readOperand(ZP));                 break;
+        case SBC_zpx: sbc(readOperand(ZPX));                break;
+        case SEC:     setFlag(STATUS_C, true);              break;
+        case SED:     setFlag(STATUS_D, true);              break;
+        case SEI:     setFlag(STATUS_I, true);              break;
+        case STA_abs: str(m_accumulator, ABS);              break;
+        case STA_abx: str(m_accumulator, ABX);              break;
+        case STA_aby: str(m_accumulator, ABY);              break;
+        case STA_izx: str(m_accumulator, IZX);              break;
+        case STA_izy: str(m_accumulator, IZY);              break;
+        case STA_zp3: str(m_accumulator, ZP);               break;
+        case STA_zpx: str(m_accumulator, ZPX);              break;
+        case STX_abs: str(m_xIndex, ABS);                   break;
+        case STX_zp3: str(m_xIndex, ZP);                    break;
+        case STX_zpx: str(m_xIndex, ZPY);                   break;
+        case STY_abs: str(m_yIndex, ABS);                   break;
+        case STY_zp3: str(m_yIndex, ZP);                    break;
+        case STY_zpx: str(m_yIndex, ZPX);                   break;
+        case TAX:     setNZ(m_xIndex = m_accumulator);      break;
+        case TAY:     setNZ(m_yIndex = m_accumulator);      break;
+        case TSX:     setNZ(m_xIndex = m_stackPointer);     break;
+        case TXA:     setNZ(m_accumulator = m_xIndex);      break;
+        case TXS:     m_stackPointer = m_xIndex;            break;
+        case TYA:     setNZ(m_accumulator = m_yIndex);      break;
+        default:
+            if((0x02 == (opcode & 0x1F) && 0x80 > opcode) || 0x12 == (opcode & 0x1F)) {
+                m_jammed = true;
+            } else {
+                m_programCounter += illegalOperands(opcode);
+            }
+            break;
+    }
+
+    return m_cycles;
+}
+
+void DriveCpu::adc(uint8_t op)
+{
+    uint8_t carry = (STATUS_C & m_status) ? 1 : 0;
+    uint16_t result = m_accumulator + op + carry;
+    if(!(STATUS_D & m_status)) {
+        setFlag(STATUS_V, ~(m_accumulator ^ op) & (m_accumulator ^ result) & 0x80);
+        setFlag(STATUS_C, 0xFF < result);
+        m_accumulator = result & 0xFF;
+        setNZ(m_accumulator);
+        return;
+    }
+
+    // NMOS decimal mode: Z comes from the binary sum, N and V from the
+    // high digit before it is adjusted
+    setFlag(STATUS_Z, 0 == (result & 0xFF));
+    uint16_t lo = (m_accumulator & 0x0F) + (op & 0x0F) + carry;
+    uint16_t hi = (m_accumulator & 0xF0) + (op & 0xF0);
+    if(9 < lo) {
+        lo += 6;
+    }
+    if(0x0F < lo) {
+        hi += 0x10;
+    }
+    setFlag(STATUS_N, hi & 0x80);
+    setFlag(STATUS_V, ~(m_accumulator ^ op) & (m_accumulator ^ hi) & 0x80);
+    if(0x90 < hi) {
+        hi += 0x60;
+    }
+    setFlag(STATUS_C, 0xFF < hi);
+    m_accumulator = (hi & 0xF0) | (lo & 0x0F);
+}
+
+void DriveCpu::sbc(uint8_t op)
+{
+    uint8_t borrow = (STATUS_C & m_status) ? 0 : 1;
+    uint16_t result = m_accumulator - op - borrow;
+    setFlag(STATUS_V, (m_accumulator ^ op) & (m_accumulator ^ result) & 0x80);
+    setFlag(STATUS_C, 0x100 > result);
+    if(!(STATUS_D & m_status)) {
+        m_accumulator = result & 0xFF;
+        setNZ(m_accumulator);
+        return;
+    }
+
+    // flags are those of the binary difference
+    setNZ(result & 0xFF);
+    int lo = (m_accumulator & 0x0F) - (op & 0x0F) - borrow;
+    int hi = (m_accumulator >> 4) - (op >> 4);
+    if(0 > lo) {
+        lo -= 6;
+        --hi;
+    }
+    if(0 > hi) {
+        hi -= 6;
+    }
+    m_accumulator = ((hi << 4) & 0xF0) | (lo & 0x0F);
+}
+
+void DriveCpu::asl(const AddrMode mode)
+{
+    if(IMP == mode) {
+        setFlag(STATUS_C, m_accumulator & 0x80);
+        m_accumulator <<= 1;
+        setNZ(m_accumulator);
+        return;
+    }
+
+    uint16_t addr = computeAddress(mode, false);
+    uint8_t tmp = m_drive.read(addr);
+    setFlag(STATUS_C, tmp & 0x80);
+    tmp <<= 1;
+    setNZ(tmp);
+    m_drive.write(addr, tmp);
+}
+
+void DriveCpu::lsr(const AddrMode mode)
+{
+    if(IMP == mode) {
+        setFlag(STATUS_C, m_accumulator & 0x01);
+        m_accumulator >>= 1;
+        setNZ(m_accumulator);
+        return;
+    }
+
+    uint16_t addr = computeAddress(mode, false);
+    uint8_t tmp = m_drive.read(addr);
+    setFlag(STATUS_C, tmp & 0x01);
+    tmp >>= 1;
+    setNZ(tmp);
+    m_drive.write(addr, tmp);
+}
+
+void DriveCpu::rol(const AddrMode mode)
+{
+    uint8_t carry = (STATUS_C & m_status) ? 0x01 : 0x00;
+    if(IMP == mode) {
+        setFlag(STATUS_C, m_accumulator & 0x80);
+        m_accumulator = (m_accumulator << 1) | carry;
+        setNZ(m_accumulator);
+        return;
+    }
+
+    uint16_t addr = computeAddress(mode, false);
+    uint8_t tmp = m_drive.read(addr);
+    setFlag(STATUS_C, tmp & 0x80);
+    tmp = (tmp << 1) | carry;
+    setNZ(tmp);
+    m_drive.write(addr, tmp);
+}
+
+void DriveCpu::ror(const AddrMode mode)
+{
+    uint8_t carry = (STATUS_C & m_status) ? 0x80 : 0x00;
+    if(IMP == mode) {
+        setFlag(STATUS_C, m_accumulator & 0x01);
+        m_accumulator = (m_accumulator >> 1) | carry;
+        setNZ(m_accumulator);
+        return;
+    }
+
+    uint16_t addr = computeAddress(mode, false);
+    uint8_t tmp = m_drive.read(addr);
+    setFlag(STATUS_C, tmp & 0x01);
+    tmp = (tmp >> 1) | carry;
+    setNZ(tmp);
+    m_drive.write(addr, tmp);
+}
+
+void DriveCpu::bit(const AddrMode mode)
+{
+    uint8_t op = readOperand(mode);
+    setFlag(STATUS_Z, 0 == (m_accumulator & op));
+    setFlag(STATUS_N, op & 0x80);
+    setFlag(STATUS_V, op & 0x40);
+}
+
+// one more cycle when taken, another when the target is on a different page
+void DriveCpu::br(bool condition)
+{
+    int8_t offset = (int8_t)fetch();
+    if(!condition) {
+        return;
+    }
+
+    uint16_t target = m_programCounter + offset;
+    m_cycles += ((target ^ m_programCounter) & 0xFF00) ? 2 : 1;
+    m_programCounter = target;
+}
+
+void DriveCpu::cmp(uint8_t r, const AddrMode mode)
+{
+    uint8_t op = readOperand(mode);
+    setFlag(STATUS_C, op <= r);
+    setNZ(r - op);
+}
+
+void DriveCpu::dec(const AddrMode mode)
+{
+    uint16_t addr = computeAddress(mode, false);
+    uint8_t tmp = m_drive.read(addr) - 1;
+    setNZ(tmp);
+    m_drive.write(addr, tmp);
+}
+
+void DriveCpu::inc(const AddrMode mode)
+{
+    uint16_t addr = computeAddress(mode, false);
+    uint8_t tmp = m_drive.read(addr) + 1;
+    setNZ(tmp);
+    m_drive.write(addr, tmp);
+}
+
+void DriveCpu::interrupt(uint16_t vector, bool software)
+{
+    push(m_programCounter >> 8);
+    push(m_programCounter & 0xFF);
+    push((m_status & ~STATUS_B) | STATUS_U | (software ? STATUS_B : 0));
+    m_status |= STATUS_I;
+    m_programCounter = readWord(vector);
+}
+
+void DriveCpu::ldr(uint8_t& r, const AddrMode mode)
+{
+    r = readOperand(mode);
+    setNZ(r);
+}
+
+void DriveCpu::str(uint8_t r, const AddrMode mode)
+{
+    m_drive.write(computeAddress(mode, false), r);
+}
+
+void DriveCpu::push(uint8_t data)
+{
+    m_drive.write(0x0100 | m_stackPointer--, data);
+}
+
+void DriveCpu::pull(uint8_t& r)
+{
+    r = m_drive.read(0x0100 | ++m_stackPointer);
+}
+
+void DriveCpu::setFlag(uint8_t flag, bool set)
+{
+    if(set) {
+        m_status |= flag;
+    } else {
+        m_status &= ~flag;
+    }
+}
+
+void DriveCpu::setNZ(uint8_t value)
+{
+    setFlag(STATUS_Z, 0 == value);
+    setFlag(STATUS_N, value & 0x80);
+}
+
+uint8_t DriveCpu::fetch()
+{
+    return m_drive.read(m_programCounter++);
+}
+
+uint16_t DriveCpu::readWord(uint16_t addr)
+{
+    return m_drive.read(addr) | (m_drive.read(addr + 1) << 8);
+}
+
+// Zero page indexing wraps within page zero, as does the pointer of the
+// indirect modes, and JMP ($xxFF) takes its high byte from $xx00. Reads
+// pass pagePenalty to be charged a cycle when indexing crosses a page.
+uint16_t DriveCpu::computeAddress(const AddrMode mode, bool pagePenalty)
+{
+    uint16_t base = 0;
+    uint16_t addr = 0;
+    uint8_t zp = 0;
+    switch(mode) {
+        case IMM:
+            addr = m_programCounter++;
+            break;
+        case ZP:
+            addr = fetch();
+            break;
+        case ZPX:
+            addr = (fetch() + m_xIndex) & 0xFF;
+            break;
+        case ZPY:
+            addr = (fetch() + m_yIndex) & 0xFF;
+            break;
+        case ABS:
+            addr = fetch();
+            addr |= fetch() << 8;
+            break;
+        case ABX:
+        case ABY:
+            base = fetch();
+            base |= fetch() << 8;
+            addr = base + ((ABX == mode) ? m_xIndex : m_yIndex);
+            if(pagePenalty && ((base ^ addr) & 0xFF00)) {
+                ++m_cycles;
+            }
+            break;
+        case IND:
+            base = fetch();
+            base |= fetch() << 8;
+            addr = m_drive.read(base);
+            addr |= m_drive.read((base & 0xFF00) | ((base + 1) & 0x00FF)) << 8;
+            break;
+        case IZX:
+            zp = fetch() + m_xIndex;
+            addr = m_drive.read(zp);
+            addr |= m_drive.read((uint8_t)(zp + 1)) << 8;
+            break;
+        case IZY:
+            zp = fetch();
+            base = m_drive.read(zp);
+            base |= m_drive.read((uint8_t)(zp + 1)) << 8;
+            addr = base + m_yIndex;
+            if(pagePenalty && ((base ^ addr) & 0xFF00)) {
+                ++m_cycles;
+            }
+            break;
+        case IMP:
+        case REL:
+            break;
+    }
+
+    return addr;
+}
+
+uint8_t DriveCpu::readOperand(const AddrMode mode)
+{
+    return m_drive.read(computeAddress(mode, true));
+}
+
+}
@@ -0,0 +1,68 @@
+#ifndef INCLUDED_DRIVE_CPU_H
+#define INCLUDED_DRIVE_CPU_H
+
+#include <stdint.h>
+#include "mos6510.h"
+
+namespace MOS6510 {
+
+class Drive1541;
+
+// The 1541's 6502. Unlike Cpu it counts real cycles per instruction,
+// including page crossings and taken branches, does decimal mode and V on
+// ADC/SBC, and has the SO pin the disk controller sets on every byte read,
+// because DOS and fast loaders time themselves with all of these.
+// Undocumented opcodes run as NOPs of the right length; KIL jams the CPU.
+class DriveCpu {
+private:
+    uint16_t    m_programCounter;
+    uint8_t     m_stackPointer;
+    uint8_t     m_accumulator;
+    uint8_t     m_xIndex;
+    uint8_t     m_yIndex;
+    uint8_t     m_status;
+    bool        m_jammed;
+    uint32_t    m_cycles;       // taken by the current instruction
+    Drive1541&  m_drive;
+
+    DriveCpu(const DriveCpu& rhs);
+    DriveCpu& operator=(const DriveCpu& rhs);
+
+    // internal operations
+    void adc(uint8_t op);
+    void asl(const AddrMode mode);
+    void bit(const AddrMode mode);
+    void br(bool condition);
+    void cmp(uint8_t r, const AddrMode mode);
+    void dec(const AddrMode mode);
+    void inc(const AddrMode mode);
+    void interrupt(uint16_t vector, bool software);
+    void ldr(uint8_t& r, const AddrMode mode);
+    void lsr(const AddrMode mode);
+    void pull(uint8_t& r);
+    void push(uint8_t data);
+    void rol(const AddrMode mode);
+    void ror(const AddrMode mode);
+    void sbc(uint8_t op);
+    void str(uint8_t r, const AddrMode mode);
+
+    // utility
+    void setFlag(uint8_t flag, bool set);
+    void setNZ(uint8_t value);
+    uint8_t fetch();
+    uint16_t readWord(uint16_t addr);
+    uint16_t computeAddress(const AddrMode mode, bool pagePenalty);
+    uint8_t readOperand(const AddrMode mode);
+
+public:
+    DriveCpu(Drive1541& drive);
+
+    void reset();
+    void setOverflow();             // the SO pin
+    uint32_t execute(bool irq);     // one instruction or interrupt entry, returns cycles
+    CpuRegisters getRegisters() const;
+};
+
+}
+
+#endif
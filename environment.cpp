@@ -0,0 +1,211 @@
+#include <stdio.h>
+#include <string.h>
+#include "environment.h"
+
+namespace MOS6510 {
+
+Environment::Environment(Machine *machine)
+    : m_machine(machine)
+    , m_snapshot(new MachineState())
+{
+    memset(&m_action, 0, sizeof(m_action));
+    snapshot();
+}
+
+Environment::~Environment()
+{
+    delete m_snapshot;
+    Machine::destroy(m_machine);
+}
+
+void Environment::applyAction(const EnvAction& action)
+{
+    IOController& io = m_machine->getIO();
+    uint64_t changed = action.keys ^ m_action.keys;
+    for(int key = 0; changed; ++key, changed >>= 1) {
+        if(changed & 1) {
+            if(action.keys & (1ULL << key)) {
+                io.setKeyDown(key);
+            } else {
+                io.setKeyUp(key);
+            }
+        }
+    }
+
+    for(int port = 0; port < 2; ++port) {
+        if(action.joystick[port] != m_action.joystick[port]) {
+            io.setJoystick(port + 1, action.joystick[port]);
+        }
+    }
+    m_action = action;
+}
+
+void Environment::snapshot()
+{
+    m_machine->saveState(*m_snapshot);
+    m_snapshotAction = m_action;
+}
+
+void Environment::copySnapshot(const Environment& source)
+{
+    *m_snapshot = *source.m_snapshot;
+    m_snapshotAction = source.m_snapshotAction;
+    reset();
+}
+
+// the matrix and joystick lines are part of the state, so the action that
+// was held at snapshot time comes back with them
+void Environment::reset()
+{
+    m_machine->loadState(*m_snapshot);
+    m_action = m_snapshotAction;
+}
+
+// agents never use the debugger, so environments run uninstrumented
+template <class Config>
+void Environment::runFrames(uint32_t frames)
+{
+    VICII& vic = m_machine->getVIC();
+    const uint32_t target = vic.getFrameCount() + frames;
+    while(vic.getFrameCount() != target) {
+        m_machine->execute<Config>(false);
+    }
+}
+
+void Environment::step(const EnvAction& action, uint32_t frames)
+{
+    applyAction(action);
+    if(VIDEO_PAL == m_machine->getVideoStandard()) {
+        runFrames<PalConfig>(frames);
+    } else {
+        runFrames<NtscConfig>(frames);
+    }
+}
+
+void Environment::observe(EnvObservation& obs) const
+{
+    obs.frame = m_machine->getVIC().getFrameBuffer();
+    obs.ram = m_machine->getRam();
+    obs.frameCount = m_machine->getVIC().getFrameCount();
+}
+
+Machine& Environment::getMachine()
+{
+    return *m_machine;
+}
+
+class StepJob : public ParallelJob {
+private:
+    const std::vector<Environment*>&    m_envs;
+    const EnvAction*                    m_actions;
+    uint32_t                            m_frames;
+
+public:
+    StepJob(const std::vector<Environment*>& envs, const EnvAction *actions, uint32_t frames)
+        : m_envs(envs)
+        , m_actions(actions)
+        , m_frames(frames)
+    {
+    }
+
+    virtual void run(size_t index)
+    {
+        m_envs[index]->step(m_actions[index], m_frames);
+    }
+};
+
+class ResetJob : public ParallelJob {
+private:
+    const std::vector<Environment*>&    m_envs;
+
+public:
+    ResetJob(const std::vector<Environment*>& envs)
+        : m_envs(envs)
+    {
+    }
+
+    virtual void run(size_t index)
+    {
+        m_envs[index]->reset();
+    }
+};
+
+VectorEnv::VectorEnv(size_t threads)
+    : m_pool(threads)
+{
+}
+
+VectorEnv::~VectorEnv()
+{
+    for(size_t i = 0; i < m_envs.size(); ++i) {
+        delete m_envs[i];
+    }
+}
+
+bool VectorEnv::open(const RomSet& roms, VideoStandard standard, size_t count, uint32_t bootFrames)
+{
+    if(!roms.isComplete()) {
+        fprintf(stderr, "Environment needs BASIC, KERNAL and character ROMs\n");
+        return false;
+    }
+
+    for(size_t i = 0; i < count; ++i) {
+        Machine *machine = Machine::create(roms.getImage(ROM_BASIC),
+                                           roms.getImage(ROM_KERNAL),
+                                           roms.getImage(ROM_CHARGEN),
+                                           standard);
+        if(!machine) {
+            return false;
+        }
+        m_envs.push_back(new Environment(machine));
+    }
+
+    if(m_envs.empty()) {
+        return true;
+    }
+
+    EnvAction idle;
+    memset(&idle, 0, sizeof(idle));
+    m_envs[0]->step(idle, bootFrames);
+    m_envs[0]->snapshot();
+    for(size_t i = 1; i < m_envs.size(); ++i) {
+        m_envs[i]->copySnapshot(*m_envs[0]);
+    }
+    return true;
+}
+
+size_t VectorEnv::size() const
+{
+    return m_envs.size();
+}
+
+Environment& VectorEnv::get(size_t index)
+{
+    return *m_envs[index];
+}
+
+void VectorEnv::reset(size_t index)
+{
+    m_envs[index]->reset();
+}
+
+void VectorEnv::resetAll()
+{
+    ResetJob job(m_envs);
+    m_pool.run(job, m_envs.size());
+}
+
+void VectorEnv::step(const EnvAction *actions, uint32_t frames)
+{
+    StepJob job(m_envs, actions, frames);
+    m_pool.run(job, m_envs.size());
+}
+
+void VectorEnv::observe(EnvObservation *obs) const
+{
+    for(size_t i = 0; i < m_envs.size(); ++i) {
+        m_envs[i]->observe(obs[i]);
+    }
+}
+
+}
@@ -0,0 +1,84 @@
+#ifndef INCLUDED_ENVIRONMENT_H
+#define INCLUDED_ENVIRONMENT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include "machine.h"
+#include "romset.h"
+#include "threadpool.h"
+
+namespace MOS6510 {
+
+// Inputs held down for the whole of a step. Bit k of keys is matrix key k,
+// row k / 8 and column k % 8 as in IOController::setKeyDown; joystick holds
+// JoystickBits for ports 1 and 2.
+struct EnvAction {
+    uint64_t    keys;
+    uint8_t     joystick[2];
+};
+
+// Points straight into the machine, valid until its next step or reset
+struct EnvObservation {
+    const uint8_t*  frame;      // FRAME_WIDTH * FRAME_HEIGHT palette indices
+    const uint8_t*  ram;        // RAM_SIZE bytes
+    uint32_t        frameCount;
+};
+
+// One headless machine driven a frame at a time. reset() goes back to the
+// last snapshot instead of rebooting, so episodes can start anywhere.
+class Environment {
+private:
+    Machine*        m_machine;
+    MachineState*   m_snapshot;
+    EnvAction       m_action;           // what the machine currently sees
+    EnvAction       m_snapshotAction;
+
+    Environment(const Environment& rhs);
+    Environment& operator=(const Environment& rhs);
+
+    void applyAction(const EnvAction& action);
+    template <class Config>
+    void runFrames(uint32_t frames);
+
+public:
+    Environment(Machine *machine);      // takes ownership, see Machine::create
+    ~Environment();
+
+    void snapshot();                    // reset() returns here from now on
+    void copySnapshot(const Environment& source); // and resets to it
+    void reset();
+    void step(const EnvAction& action, uint32_t frames);
+    void observe(EnvObservation& obs) const;
+
+    Machine& getMachine();
+};
+
+// A batch of environments started from one booted machine and stepped in
+// lockstep across a thread pool.
+class VectorEnv {
+private:
+    std::vector<Environment*>   m_envs;
+    ThreadPool                  m_pool;
+
+    VectorEnv(const VectorEnv& rhs);
+    VectorEnv& operator=(const VectorEnv& rhs);
+
+public:
+    VectorEnv(size_t threads);          // 0 for one per core
+    ~VectorEnv();
+
+    // boots the first machine for bootFrames frames and clones it count times
+    bool open(const RomSet& roms, VideoStandard standard, size_t count, uint32_t bootFrames);
+
+    size_t size() const;
+    Environment& get(size_t index);
+    void reset(size_t index);
+    void resetAll();
+    void step(const EnvAction *actions, uint32_t frames);  // one action per environment
+    void observe(EnvObservation *obs) const;
+};
+
+}
+
+#endif
@@ -0,0 +1,254 @@
+#include <assert.h>
+#include <stdio.h>
+#include <cstring>
+#include <iostream>
+#include "framedump.h"
+#include "crc32.h"
+#include "palette.h"
+
+namespace MOS6510 {
+
+const size_t MAX_QUEUED_FRAMES = 16;
+
+static inline uint64_t rotl64(uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+uint64_t hashFrame(const uint8_t *indices, size_t count)
+{
+    const uint64_t k1 = 0x87C37B91114253D5ULL;
+    const uint64_t k2 = 0x4CF5AD432745937FULL;
+    uint64_t h = 0x9E3779B97F4A7C15ULL ^ count;
+    size_t idx = 0;
+    for(; idx + 8 <= count; idx += 8) {
+        uint64_t w;
+        memcpy(&w, indices + idx, sizeof(w));
+        h ^= rotl64(w * k1, 31) * k2;
+        h = rotl64(h, 27) * 5 + 0x52DCE729;
+    }
+
+    uint64_t tail = 0;
+    for(; idx < count; ++idx) {
+        tail = (tail << 8) | indices[idx];
+    }
+    h ^= rotl64(tail * k1, 31) * k2;
+
+    // final avalanche
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+static void putBE32(uint8_t *dst, uint32_t value)
+{
+    dst[0] = (value >> 24) & 0xFF;
+    dst[1] = (value >> 16) & 0xFF;
+    dst[2] = (value >> 8) & 0xFF;
+    dst[3] = value & 0xFF;
+}
+
+static bool writeChunk(FILE *file, const char *type, const uint8_t *data, uint32_t len)
+{
+    uint8_t header[8];
+    uint8_t trailer[4];
+    putBE32(header, len);
+    memcpy(header + 4, type, 4);
+    uint32_t crc = updateCrc32(0xFFFFFFFF, header + 4, 4);
+    crc = updateCrc32(crc, data, len) ^ 0xFFFFFFFF;
+    putBE32(trailer, crc);
+    return (1 == fwrite(header, sizeof(header), 1, file))
+        && (0 == len || 1 == fwrite(data, len, 1, file))
+        && (1 == fwrite(trailer, sizeof(trailer), 1, file));
+}
+
+FrameDumper::FrameDumper(int width, int height)
+    : m_width(width)
+    , m_height(height)
+    , m_format(FRAME_PNG)
+    , m_interval(0)
+    , m_hashFile(0)
+    , m_queue(MAX_QUEUED_FRAMES)
+{
+    m_worker = std::thread(&FrameDumper::workerLoop, this);
+}
+
+FrameDumper::~FrameDumper()
+{
+    m_queue.close();
+    m_worker.join();
+
+    if(m_hashFile) {
+        fclose(m_hashFile);
+    }
+}
+
+void FrameDumper::setDumpDirectory(const std::string& dir, FrameFormat format)
+{
+    m_directory = dir;
+    m_format = format;
+}
+
+void FrameDumper::setDumpInterval(uint32_t interval)
+{
+    m_interval = interval;
+}
+
+void FrameDumper::requestDump(uint32_t frame)
+{
+    m_requested.insert(frame);
+}
+
+bool FrameDumper::openHashStream(const std::string& path)
+{
+    m_hashFile = fopen(path.c_str(), "w");
+    if(!m_hashFile) {
+        std::cerr << "Failed to open frame hash stream " << path << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+void FrameDumper::onFrame(uint32_t frame, const uint8_t *indices, const uint32_t *palette)
+{
+    const size_t count = (size_t)m_width * m_height;
+    if(m_hashFile) {
+        fprintf(m_hashFile, "%u %016llx\n", frame,
+                (unsigned long long)hashFrame(indices, count));
+    }
+
+    bool wanted = (m_interval && 0 == (frame % m_interval));
+    if(!m_requested.empty()) {
+        std::set<uint32_t>::iterator it = m_requested.find(frame);
+        if(m_requested.end() != it) {
+            m_requested.erase(it);
+            wanted = true;
+        }
+    }
+
+    if(!wanted || m_directory.empty()) {
+        return;
+    }
+
+    Job job;
+    job.frame = frame;
+    job.indices.assign(indices, indices + count);
+    memcpy(job.palette, palette, sizeof(job.palette));
+    m_queue.push(std::move(job));
+}
+
+void FrameDumper::workerLoop()
+{
+    Job job;
+    while(m_queue.pop(job)) {
+        if(!writeFrame(job)) {
+            std::cerr << "Failed to write frame " << job.frame << std::endl;
+        }
+    }
+}
+
+bool FrameDumper::writeFrame(const Job& job)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "/frame_%06u.%s", job.frame,
+            (FRAME_PNG == m_format) ? "png" : "rgba");
+    std::string path = m_directory + name;
+    FILE *file = fopen(path.c_str(), "wb");
+    if(!file) {
+        return false;
+    }
+
+    // late conversion to RGB, on the writer thread
+    std::vector<uint32_t> pixels(job.indices.size());
+    convertIndexed(job.indices.data(), pixels.data(), pixels.size(), job.palette);
+    bool ok = (FRAME_PNG == m_format) ? writePng(file, pixels)
+                                      : writeRaw(file, pixels);
+    return (0 == fclose(file)) && ok;
+}
+
+bool FrameDumper::writeRaw(FILE *file, const std::vector<uint32_t>& pixels)
+{
+    std::vector<uint8_t> rgba(pixels.size() * 4);
+    for(size_t i = 0; i < pixels.size(); ++i) {
+        rgba[(i * 4) + 0] = (pixels[i] >> 16) & 0xFF;
+        rgba[(i * 4) + 1] = (pixels[i] >> 8) & 0xFF;
+        rgba[(i * 4) + 2] = pixels[i] & 0xFF;
+        rgba[(i * 4) + 3] = 0xFF;
+    }
+
+    return 1 == fwrite(rgba.data(), rgba.size(), 1, file);
+}
+
+bool FrameDumper::writePng(FILE *file, const std::vector<uint32_t>& pixels)
+{
+    static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', 0x0D, 0x0A, 0x1A, 0x0A };
+    if(1 != fwrite(signature, sizeof(signature), 1, file)) {
+        return false;
+    }
+
+    uint8_t ihdr[13];
+    putBE32(ihdr, m_width);
+    putBE32(ihdr + 4, m_height);
+    ihdr[8] = 8;    // bit depth
+    ihdr[9] = 6;    // RGBA
+    ihdr[10] = 0;   // deflate
+    ihdr[11] = 0;   // adaptive filtering
+    ihdr[12] = 0;   // no interlace
+    if(!writeChunk(file, "IHDR", ihdr, sizeof(ihdr))) {
+        return false;
+    }
+
+    // scanlines with a leading "none" filter byte
+    const size_t stride = (m_width * 4) + 1;
+    std::vector<uint8_t> raw(stride * m_height);
+    for(int y = 0; y < m_height; ++y) {
+        uint8_t *row = &raw[y * stride];
+        row[0] = 0;
+        for(int x = 0; x < m_width; ++x) {
+            uint32_t p = pixels[(y * m_width) + x];
+            row[1 + (x * 4)] = (p >> 16) & 0xFF;
+            row[2 + (x * 4)] = (p >> 8) & 0xFF;
+            row[3 + (x * 4)] = p & 0xFF;
+            row[4 + (x * 4)] = 0xFF;
+        }
+    }
+
+    // zlib stream made of stored deflate blocks, cheap to produce and always valid
+    std::vector<uint8_t> zlib;
+    zlib.reserve(raw.size() + ((raw.size() / 65535) + 1) * 5 + 6);
+    zlib.push_back(0x78);
+    zlib.push_back(0x01);
+    size_t offset = 0;
+    do {
+        size_t len = raw.size() - offset;
+        if(65535 < len) {
+            len = 65535;
+        }
+        zlib.push_back((offset + len == raw.size()) ? 1 : 0);
+        zlib.push_back(len & 0xFF);
+        zlib.push_back((len >> 8) & 0xFF);
+        zlib.push_back(~len & 0xFF);
+        zlib.push_back((~len >> 8) & 0xFF);
+        zlib.insert(zlib.end(), raw.begin() + offset, raw.begin() + offset + len);
+        offset += len;
+    } while(offset < raw.size());
+
+    uint32_t a = 1;
+    uint32_t b = 0;
+    for(size_t i = 0; i < raw.size(); ++i) {
+        a = (a + raw[i]) % 65521;
+        b = (b + a) % 65521;
+    }
+    uint8_t adler[4];
+    putBE32(adler, (b << 16) | a);
+    zlib.insert(zlib.end(), adler, adler + 4);
+
+    return writeChunk(file, "IDAT", zlib.data(), zlib.size())
+        && writeChunk(file, "IEND", 0, 0);
+}
+
+}
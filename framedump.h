@@ -0,0 +1,62 @@
+#ifndef INCLUDED_FRAME_DUMP_H
+#define INCLUDED_FRAME_DUMP_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <set>
+#include <thread>
+#include "framesink.h"
+#include "boundedqueue.h"
+
+namespace MOS6510 {
+
+enum FrameFormat {
+    FRAME_PNG,
+    FRAME_RAW
+};
+
+// fast 64-bit hash of an indexed frame, independent of the palette in use
+uint64_t hashFrame(const uint8_t *indices, size_t count);
+
+class FrameDumper : public FrameSink {
+private:
+    struct Job {
+        uint32_t                frame;
+        std::vector<uint8_t>    indices;
+        uint32_t                palette[16];
+    };
+
+    int                         m_width;
+    int                         m_height;
+    std::string                 m_directory;
+    FrameFormat                 m_format;
+    uint32_t                    m_interval;
+    std::set<uint32_t>          m_requested;
+    FILE*                       m_hashFile;
+
+    // writer thread state
+    BoundedQueue<Job>           m_queue;
+    std::thread                 m_worker;
+
+    void workerLoop();
+    bool writeFrame(const Job& job);
+    bool writePng(FILE *file, const std::vector<uint32_t>& pixels);
+    bool writeRaw(FILE *file, const std::vector<uint32_t>& pixels);
+
+public:
+    FrameDumper(int width, int height);
+    virtual ~FrameDumper();
+
+    void setDumpDirectory(const std::string& dir, FrameFormat format);
+    void setDumpInterval(uint32_t interval);
+    void requestDump(uint32_t frame);
+    bool openHashStream(const std::string& path);
+
+    virtual void onFrame(uint32_t frame, const uint8_t *indices, const uint32_t *palette);
+};
+
+}
+
+#endif
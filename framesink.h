@@ -0,0 +1,19 @@
+#ifndef INCLUDED_FRAME_SINK_H
+#define INCLUDED_FRAME_SINK_H
+
+#include <stdint.h>
+
+namespace MOS6510 {
+
+// Receives every completed frame at the VIC-II presentation point. Sinks are
+// called on the emulation thread and must hand heavy work off to a worker.
+// Frames are palette indices; 'palette' maps them to ARGB when needed.
+class FrameSink {
+public:
+    virtual ~FrameSink() {}
+    virtual void onFrame(uint32_t frame, const uint8_t *indices, const uint32_t *palette) = 0;
+};
+
+}
+
+#endif
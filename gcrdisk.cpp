@@ -0,0 +1,441 @@
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include "gcrdisk.h"
+
+namespace MOS6510 {
+
+static const uint8_t GCR_ENCODE[16] = {
+    0x0A, 0x0B, 0x12, 0x13, 0x0E, 0x0F, 0x16, 0x17,
+    0x09, 0x19, 0x1A, 0x1B, 0x0D, 0x1D, 0x1E, 0x15
+};
+
+static const uint8_t GCR_DECODE[32] = {
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0x08, 0x00, 0x01, 0xFF, 0x0C, 0x04, 0x05,
+    0xFF, 0xFF, 0x02, 0x03, 0xFF, 0x0F, 0x06, 0x07,
+    0xFF, 0x09, 0x0A, 0x0B, 0xFF, 0x0D, 0x0E, 0xFF
+};
+
+// bytes per track in each speed zone at 300 rpm
+static const size_t TRACK_SIZE[4] = { 6250, 6666, 7142, 7692 };
+
+static const size_t SYNC_LENGTH     = 5;
+static const size_t HEADER_GAP      = 9;
+static const size_t HEADER_GCR      = 10;   // 8 bytes
+static const size_t DATA_GCR        = 325;  // 260 bytes
+static const size_t SECTOR_GCR      = 2 * SYNC_LENGTH + HEADER_GCR + HEADER_GAP + DATA_GCR;
+static const size_t G64_MAX_TRACK   = 7928;
+
+// D64 error codes, 1 is no error
+enum SectorError {
+    SECTOR_NO_HEADER    = 0x02,
+    SECTOR_NO_SYNC      = 0x03,
+    SECTOR_NO_DATA      = 0x04,
+    SECTOR_DATA_CRC     = 0x05,
+    SECTOR_HEADER_CRC   = 0x09,
+    SECTOR_ID_MISMATCH  = 0x0B
+};
+
+int sectorsPerTrack(int track)
+{
+    if(17 >= track) {
+        return 21;
+    } else if(24 >= track) {
+        return 19;
+    } else if(30 >= track) {
+        return 18;
+    }
+
+    return 17;
+}
+
+int speedZone(int track)
+{
+    if(17 >= track) {
+        return 3;
+    } else if(24 >= track) {
+        return 2;
+    } else if(30 >= track) {
+        return 1;
+    }
+
+    return 0;
+}
+
+static size_t trackOffset(int track)
+{
+    size_t sectors = 0;
+    for(int t = 1; t < track; ++t) {
+        sectors += sectorsPerTrack(t);
+    }
+
+    return sectors * 256;
+}
+
+// four bytes to five
+static void encodeGcr(const uint8_t *in, uint8_t *out)
+{
+    uint64_t bits = 0;
+    for(int i = 0; i < 4; ++i) {
+        bits = (bits << 10) | (GCR_ENCODE[in[i] >> 4] << 5) | GCR_ENCODE[in[i] & 0x0F];
+    }
+    for(int i = 4; 0 <= i; --i) {
+        out[i] = bits & 0xFF;
+        bits >>= 8;
+    }
+}
+
+static void appendGcr(std::vector<uint8_t>& track, const uint8_t *data, size_t length)
+{
+    uint8_t gcr[5];
+    for(size_t i = 0; i < length; i += 4) {
+        encodeGcr(data + i, gcr);
+        track.insert(track.end(), gcr, gcr + 5);
+    }
+}
+
+// 'groups' five byte groups starting at pos, wrapping round the track
+static bool decodeGcr(const std::vector<uint8_t>& track, size_t pos, uint8_t *out, size_t groups)
+{
+    for(size_t g = 0; g < groups; ++g) {
+        uint64_t bits = 0;
+        for(int i = 0; i < 5; ++i) {
+            bits = (bits << 8) | track[(pos + g * 5 + i) % track.size()];
+        }
+        for(int i = 7; 0 <= i; --i) {
+            uint8_t nibble = GCR_DECODE[bits & 0x1F];
+            if(0xFF == nibble) {
+                return false;
+            }
+            if(i & 1) {
+                out[g * 4 + i / 2] = nibble;
+            } else {
+                out[g * 4 + i / 2] |= nibble << 4;
+            }
+            bits >>= 5;
+        }
+    }
+
+    return true;
+}
+
+static void appendSector(std::vector<uint8_t>& track, int trackNo, int sector,
+                         const uint8_t *data, const uint8_t *id, uint8_t error)
+{
+    if(SECTOR_NO_SYNC == error) {
+        track.insert(track.end(), SECTOR_GCR, 0x55);
+        return;
+    }
+
+    uint8_t id1 = id[0];
+    uint8_t id2 = id[1];
+    if(SECTOR_ID_MISMATCH == error) {
+        id1 ^= 0xFF;
+        id2 ^= 0xFF;
+    }
+
+    uint8_t header[8] = { 0x08, 0, (uint8_t)sector, (uint8_t)trackNo, id2, id1, 0x0F, 0x0F };
+    header[1] = header[2] ^ header[3] ^ header[4] ^ header[5];
+    if(SECTOR_NO_HEADER == error) {
+        header[0] = 0x00;
+    } else if(SECTOR_HEADER_CRC == error) {
+        header[1] ^= 0xFF;
+    }
+
+    uint8_t block[260];
+    block[0] = (SECTOR_NO_DATA == error) ? 0x00 : 0x07;
+    memcpy(block + 1, data, 256);
+    block[257] = 0;
+    for(int i = 0; i < 256; ++i) {
+        block[257] ^= data[i];
+    }
+    if(SECTOR_DATA_CRC == error) {
+        block[257] ^= 0xFF;
+    }
+    block[258] = 0;
+    block[259] = 0;
+
+    track.insert(track.end(), SYNC_LENGTH, 0xFF);
+    appendGcr(track, header, sizeof(header));
+    track.insert(track.end(), HEADER_GAP, 0x55);
+    track.insert(track.end(), SYNC_LENGTH, 0xFF);
+    appendGcr(track, block, sizeof(block));
+}
+
+// the first byte after five or more $FF is the start of a block
+static bool isBlockStart(const std::vector<uint8_t>& track, size_t pos)
+{
+    size_t size = track.size();
+    if(0xFF == track[pos % size]) {
+        return false;
+    }
+    for(size_t i = 1; i <= SYNC_LENGTH; ++i) {
+        if(0xFF != track[(pos + size - i) % size]) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void decodeTrack(const std::vector<uint8_t>& track, int trackNo, uint8_t *sectors)
+{
+    size_t size = track.size();
+    int count = sectorsPerTrack(trackNo);
+    for(size_t pos = 0; pos < size; ++pos) {
+        uint8_t header[8];
+        if(!isBlockStart(track, pos) || !decodeGcr(track, pos, header, 2)
+                || 0x08 != header[0] || trackNo != header[3] || count <= header[2]) {
+            continue;
+        }
+
+        // the data block follows the header gap
+        for(size_t data = pos + HEADER_GCR; data < pos + HEADER_GCR + 4 * HEADER_GAP; ++data) {
+            uint8_t block[260];
+            if(isBlockStart(track, data)) {
+                if(decodeGcr(track, data, block, DATA_GCR / 5) && 0x07 == block[0]) {
+                    memcpy(sectors + header[2] * 256, block + 1, 256);
+                }
+                break;
+            }
+        }
+    }
+}
+
+static uint32_t readLe32(const std::vector<uint8_t>& image, size_t pos)
+{
+    return image[pos] | (image[pos + 1] << 8) | (image[pos + 2] << 16) | ((uint32_t)image[pos + 3] << 24);
+}
+
+static void appendLe32(std::vector<uint8_t>& image, uint32_t value)
+{
+    for(int i = 0; i < 4; ++i) {
+        image.push_back((value >> (i * 8)) & 0xFF);
+    }
+}
+
+GcrDisk::GcrDisk()
+    : m_format(DISK_D64)
+    , m_trackCount(0)
+    , m_writeProtected(false)
+    , m_dirty(false)
+{
+
+}
+
+bool GcrDisk::load(const std::string& path)
+{
+    eject();
+
+    FILE *file = fopen(path.c_str(), "rb");
+    if(!file) {
+        fprintf(stderr, "Failed to open disk image %s\n", path.c_str());
+        return false;
+    }
+
+    std::vector<uint8_t> image;
+    uint8_t buffer[4096];
+    size_t got;
+    while(0 < (got = fread(buffer, 1, sizeof(buffer), file))) {
+        image.insert(image.end(), buffer, buffer + got);
+    }
+    fclose(file);
+
+    bool g64 = (4 <= path.size()) && (0 == strcasecmp(path.c_str() + path.size() - 4, ".g64"));
+    if(!(g64 ? loadG64(image) : loadD64(image))) {
+        fprintf(stderr, "%s is not a valid %s image\n", path.c_str(), g64 ? "G64" : "D64");
+        eject();
+        return false;
+    }
+
+    m_path = path;
+    m_format = g64 ? DISK_G64 : DISK_D64;
+    m_writeProtected = (0 != access(path.c_str(), W_OK));
+    m_dirty = false;
+    return true;
+}
+
+// 35, 40 or 42 tracks, each optionally followed by one error byte per sector
+bool GcrDisk::loadD64(const std::vector<uint8_t>& image)
+{
+    static const int TRACK_COUNTS[3] = { 35, 40, 42 };
+    const uint8_t *errors = 0;
+    for(int i = 0; i < 3 && !m_trackCount; ++i) {
+        size_t sectors = trackOffset(TRACK_COUNTS[i] + 1) / 256;
+        if(sectors * 256 == image.size()) {
+            m_trackCount = TRACK_COUNTS[i];
+        } else if(sectors * 257 == image.size()) {
+            m_trackCount = TRACK_COUNTS[i];
+            errors = &image[sectors * 256];
+        }
+    }
+    if(!m_trackCount) {
+        return false;
+    }
+
+    const uint8_t *id = &image[trackOffset(18) + 0xA2]; // from the BAM
+    for(int track = 1; track <= m_trackCount; ++track) {
+        std::vector<uint8_t>& gcr = m_tracks[(track - 1) * 2];
+        size_t length = TRACK_SIZE[speedZone(track)];
+        int count = sectorsPerTrack(track);
+        size_t gap = (length - count * SECTOR_GCR) / count;
+        size_t first = trackOffset(track) / 256;
+        for(int sector = 0; sector < count; ++sector) {
+            uint8_t error = errors ? errors[first + sector] : 1;
+            appendSector(gcr, track, sector, &image[(first + sector) * 256], id, error);
+            gcr.insert(gcr.end(), gap, 0x55);
+        }
+        gcr.resize(length, 0x55);
+    }
+
+    m_image = image;
+    return true;
+}
+
+bool GcrDisk::loadG64(const std::vector<uint8_t>& image)
+{
+    if(12 > image.size() || 0 != memcmp(&image[0], "GCR-1541", 8)) {
+        return false;
+    }
+
+    int count = image[9];
+    if(12 + count * 8 > (int)image.size()) {
+        return false;
+    }
+
+    for(int i = 0; i < count && i < HALF_TRACKS; ++i) {
+        uint32_t offset = readLe32(image, 12 + i * 4);
+        if(!offset) {
+            continue;
+        }
+        if(offset + 2 > image.size()) {
+            return false;
+        }
+        size_t length = image[offset] | (image[offset + 1] << 8);
+        if(offset + 2 + length > image.size()) {
+            return false;
+        }
+        m_tracks[i].assign(image.begin() + offset + 2, image.begin() + offset + 2 + length);
+    }
+
+    return true;
+}
+
+// sectors that no longer decode keep what the image had when it was loaded
+void GcrDisk::saveD64(std::vector<uint8_t>& image) const
+{
+    image.assign(m_image.begin(), m_image.begin() + trackOffset(m_trackCount + 1));
+    for(int track = 1; track <= m_trackCount; ++track) {
+        const std::vector<uint8_t>& gcr = m_tracks[(track - 1) * 2];
+        if(!gcr.empty()) {
+            decodeTrack(gcr, track, &image[trackOffset(track)]);
+        }
+    }
+}
+
+void GcrDisk::saveG64(std::vector<uint8_t>& image) const
+{
+    size_t maxSize = G64_MAX_TRACK;
+    for(int i = 0; i < HALF_TRACKS; ++i) {
+        if(m_tracks[i].size() > maxSize) {
+            maxSize = m_tracks[i].size();
+        }
+    }
+
+    const char *signature = "GCR-1541";
+    image.assign(signature, signature + 8);
+    image.push_back(0);
+    image.push_back(HALF_TRACKS);
+    image.push_back(maxSize & 0xFF);
+    image.push_back(maxSize >> 8);
+
+    uint32_t offset = 12 + HALF_TRACKS * 8;
+    for(int i = 0; i < HALF_TRACKS; ++i) {
+        appendLe32(image, m_tracks[i].empty() ? 0 : offset);
+        if(!m_tracks[i].empty()) {
+            offset += 2 + maxSize;
+        }
+    }
+    for(int i = 0; i < HALF_TRACKS; ++i) {
+        appendLe32(image, m_tracks[i].empty() ? 0 : speedZone(i / 2 + 1));
+    }
+    for(int i = 0; i < HALF_TRACKS; ++i) {
+        if(m_tracks[i].empty()) {
+            continue;
+        }
+        image.push_back(m_tracks[i].size() & 0xFF);
+        image.push_back(m_tracks[i].size() >> 8);
+        image.insert(image.end(), m_tracks[i].begin(), m_tracks[i].end());
+        image.insert(image.end(), maxSize - m_tracks[i].size(), 0x55);
+    }
+}
+
+bool GcrDisk::save()
+{
+    if(!isLoaded() || m_writeProtected) {
+        return false;
+    }
+
+    std::vector<uint8_t> image;
+    if(DISK_G64 == m_format) {
+        saveG64(image);
+    } else {
+        saveD64(image);
+    }
+
+    FILE *file = fopen(m_path.c_str(), "wb");
+    if(!file) {
+        fprintf(stderr, "Failed to write disk image %s\n", m_path.c_str());
+        return false;
+    }
+
+    bool ok = (image.size() == fwrite(&image[0], 1, image.size(), file));
+    ok = (0 == fclose(file)) && ok;
+    if(!ok) {
+        fprintf(stderr, "Failed to write disk image %s\n", m_path.c_str());
+        return false;
+    }
+
+    m_dirty = false;
+    return true;
+}
+
+void GcrDisk::eject()
+{
+    if(m_dirty) {
+        save();
+    }
+
+    for(int i = 0; i < HALF_TRACKS; ++i) {
+        m_tracks[i].clear();
+    }
+    m_image.clear();
+    m_path.clear();
+    m_trackCount = 0;
+    m_writeProtected = false;
+    m_dirty = false;
+}
+
+bool GcrDisk::isLoaded() const
+{
+    return !m_path.empty();
+}
+
+bool GcrDisk::isWriteProtected() const
+{
+    return m_writeProtected;
+}
+
+std::vector<uint8_t>& GcrDisk::getTrack(int halfTrack)
+{
+    return m_tracks[halfTrack];
+}
+
+void GcrDisk::setDirty()
+{
+    m_dirty = true;
+}
+
+}
@@ -0,0 +1,55 @@
+#ifndef INCLUDED_GCR_DISK_H
+#define INCLUDED_GCR_DISK_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace MOS6510 {
+
+const int HALF_TRACKS = 84;     // tracks 1 to 42 in half steps
+
+enum DiskFormat {
+    DISK_D64,
+    DISK_G64
+};
+
+// A disk as the read/write head sees it: one GCR byte stream per half
+// track. D64 images are GCR encoded on load, including the error codes of
+// images that carry them, and decoded again on save; G64 images already
+// are GCR and are kept as they are. Only byte aligned data is understood,
+// which is all the 1541 itself ever writes.
+class GcrDisk {
+private:
+    std::vector<uint8_t>    m_tracks[HALF_TRACKS]; // empty where nothing was ever written
+    std::vector<uint8_t>    m_image;            // the D64 as loaded
+    std::string             m_path;
+    DiskFormat              m_format;
+    int                     m_trackCount;       // whole tracks in a D64
+    bool                    m_writeProtected;
+    bool                    m_dirty;
+
+    bool loadD64(const std::vector<uint8_t>& image);
+    bool loadG64(const std::vector<uint8_t>& image);
+    void saveD64(std::vector<uint8_t>& image) const;
+    void saveG64(std::vector<uint8_t>& image) const;
+
+public:
+    GcrDisk();
+
+    bool load(const std::string& path);     // .g64 by extension, D64 otherwise
+    bool save();                            // back in to the file it came from
+    void eject();                           // saves first if written to
+
+    bool isLoaded() const;
+    bool isWriteProtected() const;
+    std::vector<uint8_t>& getTrack(int halfTrack);  // 0 is track 1
+    void setDirty();
+};
+
+int sectorsPerTrack(int track);
+int speedZone(int track);       // 3 on the outermost tracks, 0 on the innermost
+
+}
+
+#endif
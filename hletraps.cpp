@@ -0,0 +1,480 @@
+#include <stdio.h>
+#include <string.h>
+#include "hletraps.h"
+#include "datasette.h"
+
+namespace MOS6510 {
+
+// Floating point accumulators used by the BASIC ROM
+const uint16_t FAC1     = 0x61; // exponent, 4 mantissa bytes, sign at 0x66
+const uint16_t FAC2     = 0x69; // exponent, 4 mantissa bytes, sign at 0x6E
+const uint16_t FACOV    = 0x70; // rounding byte
+const uint16_t INDEX    = 0x22; // pointer used by the memory moves
+
+const uint8_t FLAG_C = 0x01;
+const uint8_t FLAG_Z = 0x02;
+const uint8_t FLAG_N = 0x80;
+
+static void setNZ(CpuRegisters& regs, uint8_t value)
+{
+    regs.p = (regs.p & ~(FLAG_N | FLAG_Z)) | (value & FLAG_N) | (value ? 0 : FLAG_Z);
+}
+
+// The traps only touch plain RAM, anything with I/O in reach runs as ROM code.
+static bool isPlainRam(uint16_t addr, uint16_t length)
+{
+    return (uint32_t)addr + length <= 0xD000 || addr >= 0xE000;
+}
+
+// LDA (INDEX),Y with Y from count - 1 down to 0 takes a cycle more for
+// every Y that carries in to the next page
+static uint32_t pageCrossings(uint16_t ptr, uint8_t count)
+{
+    uint32_t crossings = 0;
+    for(uint8_t y = 0; y < count; ++y) {
+        if((ptr & 0xFF) + y > 0xFF) {
+            ++crossings;
+        }
+    }
+
+    return crossings;
+}
+
+// JSR ROUND ($BC1B) as far as its early RTS, i.e. when FAC1 is zero or
+// the rounding byte is below 0x80. Returns the ticks used, 0 if the
+// mantissa really needs rounding. Both branches stay in page $BC.
+static uint32_t roundUnchanged(MemoryController& memory, CpuRegisters& regs, uint16_t returnAddr, uint32_t& cycles)
+{
+    uint8_t exponent = memory.read(FAC1);
+    uint8_t overflow = exponent ? memory.read(FACOV) : 0;
+    if(0x80 & overflow) {
+        return 0;
+    }
+
+    memory.write(0x100 | regs.sp, returnAddr >> 8, returnAddr);
+    memory.write(0x100 | (uint8_t)(regs.sp - 1), returnAddr & 0xFF, returnAddr);
+    if(!exponent) {
+        cycles = 6 + 3 + 3 + 6;
+        return 4; // JSR, LDA, BEQ, RTS
+    }
+
+    memory.write(FACOV, overflow << 1, returnAddr);
+    regs.p &= ~FLAG_C;
+    cycles = 6 + 3 + 2 + 5 + 3 + 6;
+    return 6; // JSR, LDA, BEQ, ASL, BCC, RTS
+}
+
+// MOVFM $BBA2: FAC1 = 5 packed bytes at A/Y
+static uint32_t movfm(MemoryController& memory, CpuRegisters& regs, uint32_t& cycles)
+{
+    uint16_t ptr = regs.a | (regs.y << 8);
+    if(!isPlainRam(ptr, 5)) {
+        return 0;
+    }
+
+    memory.write(INDEX, regs.a, 0xBBA2);
+    memory.write(INDEX + 1, regs.y, 0xBBA4);
+    memory.write(FAC1 + 4, memory.read(ptr + 4), 0xBBAA);
+    memory.write(FAC1 + 3, memory.read(ptr + 3), 0xBBAF);
+    memory.write(FAC1 + 2, memory.read(ptr + 2), 0xBBB4);
+    uint8_t sign = memory.read(ptr + 1);
+    memory.write(FAC1 + 5, sign, 0xBBB9);
+    memory.write(FAC1 + 1, sign | 0x80, 0xBBBD);
+    regs.a = memory.read(ptr);
+    memory.write(FAC1, regs.a, 0xBBC2);
+    regs.y = 0;
+    memory.write(FACOV, regs.y, 0xBBC4);
+    setNZ(regs, regs.a);
+    cycles = 70 + pageCrossings(ptr, 5);
+    return 21;
+}
+
+// MOVMF $BBD4: round FAC1 and pack it in to 5 bytes at X/Y
+static uint32_t movmf(MemoryController& memory, CpuRegisters& regs, uint32_t& cycles)
+{
+    uint16_t ptr = regs.x | (regs.y << 8);
+    if(!isPlainRam(ptr, 5)) {
+        return 0;
+    }
+
+    uint32_t ticks = roundUnchanged(memory, regs, 0xBBD6, cycles);
+    if(!ticks) {
+        return 0;
+    }
+
+    memory.write(INDEX, regs.x, 0xBBD7);
+    memory.write(INDEX + 1, regs.y, 0xBBD9);
+    memory.write(ptr + 4, memory.read(FAC1 + 4), 0xBBDF);
+    memory.write(ptr + 3, memory.read(FAC1 + 3), 0xBBE4);
+    memory.write(ptr + 2, memory.read(FAC1 + 2), 0xBBE9);
+    memory.write(ptr + 1, (memory.read(FAC1 + 5) | 0x7F) & memory.read(FAC1 + 1), 0xBBF2);
+    regs.a = memory.read(FAC1);
+    memory.write(ptr, regs.a, 0xBBF7);
+    regs.y = 0;
+    memory.write(FACOV, regs.y, 0xBBF9);
+    setNZ(regs, regs.a);
+    cycles += 75; // STA (INDEX),Y always takes 6
+    return ticks + 21;
+}
+
+// MOVFA $BBFC: FAC1 = FAC2, the loop branch stays in page $BC
+static uint32_t movfa(MemoryController& memory, CpuRegisters& regs, uint32_t& cycles)
+{
+    memory.write(FAC1 + 5, memory.read(FAC2 + 5), 0xBBFE);
+    for(regs.x = 5; regs.x; --regs.x) {
+        regs.a = memory.read(FAC2 - 1 + regs.x);
+        memory.write(FAC1 - 1 + regs.x, regs.a, 0xBC04);
+    }
+    memory.write(FACOV, regs.x, 0xBC09);
+    setNZ(regs, regs.x);
+    cycles = 3 + 3 + 2 + 5 * (4 + 4 + 2 + 3) - 1 + 3 + 6;
+    return 25;
+}
+
+// MOVEF $BC0F: FAC2 = FAC1, the loop branch stays in page $BC
+static uint32_t movef(MemoryController& memory, CpuRegisters& regs, uint32_t& cycles)
+{
+    for(regs.x = 6; regs.x; --regs.x) {
+        regs.a = memory.read(FAC1 - 1 + regs.x);
+        memory.write(FAC2 - 1 + regs.x, regs.a, 0xBC13);
+    }
+    memory.write(FACOV, regs.x, 0xBC18);
+    setNZ(regs, regs.x);
+    cycles = 2 + 6 * (4 + 4 + 2 + 3) - 1 + 3 + 6;
+    return 27;
+}
+
+// MOVAF $BC0C: round FAC1, then FAC2 = FAC1
+static uint32_t movaf(MemoryController& memory, CpuRegisters& regs, uint32_t& cycles)
+{
+    uint32_t roundCycles;
+    uint32_t ticks = roundUnchanged(memory, regs, 0xBC0E, roundCycles);
+    if(!ticks) {
+        return 0;
+    }
+
+    ticks += movef(memory, regs, cycles);
+    cycles += roundCycles;
+    return ticks;
+}
+
+static const uint8_t MOVFM_CODE[] = {
+    0x85, 0x22, 0x84, 0x23, 0xA0, 0x04, 0xB1, 0x22, 0x85, 0x65, 0x88, 0xB1,
+    0x22, 0x85, 0x64, 0x88, 0xB1, 0x22, 0x85, 0x63, 0x88, 0xB1, 0x22, 0x85,
+    0x66, 0x09, 0x80, 0x85, 0x62, 0x88, 0xB1, 0x22, 0x85, 0x61, 0x84, 0x70,
+    0x60 };
+static const uint8_t MOVMF_CODE[] = {
+    0x20, 0x1B, 0xBC, 0x86, 0x22, 0x84, 0x23, 0xA0, 0x04, 0xA5, 0x65, 0x91,
+    0x22, 0x88, 0xA5, 0x64, 0x91, 0x22, 0x88, 0xA5, 0x63, 0x91, 0x22, 0x88,
+    0xA5, 0x66, 0x09, 0x7F, 0x25, 0x62, 0x91, 0x22, 0x88, 0xA5, 0x61, 0x91,
+    0x22, 0x84, 0x70, 0x60 };
+static const uint8_t MOVFA_CODE[] = {
+    0xA5, 0x6E, 0x85, 0x66, 0xA2, 0x05, 0xB5, 0x68, 0x95, 0x60, 0xCA, 0xD0,
+    0xF9, 0x86, 0x70, 0x60 };
+static const uint8_t MOVAF_CODE[] = {
+    0x20, 0x1B, 0xBC, 0xA2, 0x06, 0xB5, 0x60, 0x95, 0x68, 0xCA, 0xD0, 0xF9,
+    0x86, 0x70, 0x60 };
+static const uint8_t ROUND_CODE[] = {
+    0xA5, 0x61, 0xF0, 0xFB, 0x06, 0x70, 0x90, 0xF7 };
+
+// Only the FAC/ARG moves and the no-op exit of ROUND are trapped. FADD,
+// FMULT, FDIV, the string routines and CHROUT are still run from ROM:
+// a trap is only installed over code it matches byte for byte and has
+// to agree with it under --hle-verify, and neither can be done for them
+// without the stock BASIC and KERNAL images to take the spans from.
+static const HleTrap TRAPS[] = {
+    { "MOVFM", 0xBBA2, 21,     movfm, { { 0xBBA2, sizeof(MOVFM_CODE), MOVFM_CODE },
+                                        { 0, 0, 0 } } },
+    { "MOVMF", 0xBBD4, 21 + 6, movmf, { { 0xBBD4, sizeof(MOVMF_CODE), MOVMF_CODE },
+                                        { 0xBC1B, sizeof(ROUND_CODE), ROUND_CODE } } },
+    { "MOVFA", 0xBBFC, 25,     movfa, { { 0xBBFC, sizeof(MOVFA_CODE), MOVFA_CODE },
+                                        { 0, 0, 0 } } },
+    { "MOVAF", 0xBC0C, 27 + 6, movaf, { { 0xBC0C, sizeof(MOVAF_CODE), MOVAF_CODE },
+                                        { 0xBC1B, sizeof(ROUND_CODE), ROUND_CODE } } },
+    { "MOVEF", 0xBC0F, 27,     movef, { { 0xBC0F, sizeof(MOVAF_CODE) - 3, MOVAF_CODE + 3 },
+                                        { 0, 0, 0 } } },
+};
+
+const size_t TRAP_COUNT = sizeof(TRAPS) / sizeof(TRAPS[0]);
+
+// KERNAL tape variables
+const uint16_t STATUS   = 0x90;
+const uint16_t VERCK    = 0x93; // verify rather than load
+const uint16_t SAL      = 0xAC; // the byte being read
+const uint16_t EAL      = 0xAE; // end of the block, exclusive
+const uint16_t TAPE1    = 0xB2; // the tape buffer, for headers
+const uint16_t CAS1     = 0xC0; // motor interlock
+const uint16_t STAL     = 0xC1; // start of the block
+
+const uint16_t TAPE_HEADER_SIZE = 192;
+const uint32_t TAPE_TRAP_TICKS = 12; // JSR and RTS, the tape motion itself is skipped
+const uint32_t TAPE_TRAP_CYCLES = 12;
+
+enum TapeStatus {
+    TAPE_SHORT_BLOCK    = 0x04,
+    TAPE_LONG_BLOCK     = 0x08,
+    TAPE_VERIFY_ERROR   = 0x10
+};
+
+// RBLK reads a header in to the tape buffer, TRD reads STAL..EAL
+static const uint8_t RBLK_CODE[] = { 0xA9, 0x00, 0x85, 0x90, 0x85, 0x93, 0x20, 0xD7, 0xF7 };
+static const uint8_t TRD_CODE[] = { 0x20, 0x17, 0xF8 };
+static const HleTrap TAPE_TRAPS[] = {
+    { "RBLK", 0xF841, TAPE_TRAP_TICKS, 0, { { 0xF841, sizeof(RBLK_CODE), RBLK_CODE },
+                                            { 0, 0, 0 } } },
+    { "TRD",  0xF84A, TAPE_TRAP_TICKS, 0, { { 0xF84A, sizeof(TRD_CODE), TRD_CODE },
+                                            { 0, 0, 0 } } },
+};
+
+static uint16_t readPointer(MemoryController& memory, uint16_t addr)
+{
+    return memory.read(addr) | (memory.read(addr + 1) << 8);
+}
+
+static void writePointer(MemoryController& memory, uint16_t addr, uint16_t value, uint16_t pc)
+{
+    memory.write(addr, value & 0xFF, pc);
+    memory.write(addr + 1, value >> 8, pc);
+}
+
+// The next block off the tape straight in to memory, as RBLK or TRD would
+// after the tape had played through it, motor off and carry clear. Blocks
+// that do not decode cleanly are left to the ROM code and the pulses.
+static uint32_t readTape(Datasette& tape, MemoryController& memory, CpuRegisters& regs, bool header, uint32_t& cycles)
+{
+    std::vector<uint8_t> block;
+    if(!tape.readBlock(block, memory.getScheduler().now())) {
+        return 0;
+    }
+
+    if(header) {
+        uint16_t buffer = readPointer(memory, TAPE1);
+        memory.write(STATUS, 0, regs.pc);
+        memory.write(VERCK, 0, regs.pc);
+        writePointer(memory, STAL, buffer, regs.pc);
+        writePointer(memory, EAL, buffer + TAPE_HEADER_SIZE, regs.pc);
+    }
+
+    uint16_t start = readPointer(memory, STAL);
+    uint16_t end = readPointer(memory, EAL);
+    bool verify = 0 != memory.read(VERCK);
+    uint8_t status = 0;
+    size_t length = (uint16_t)(end - start);
+    if(block.size() < length) {
+        status |= TAPE_SHORT_BLOCK;
+        length = block.size();
+    } else if(block.size() > length) {
+        status |= TAPE_LONG_BLOCK;
+    }
+    for(size_t i = 0; i < length; ++i) {
+        uint16_t addr = start + i;
+        if(!verify) {
+            memory.write(addr, block[i], regs.pc);
+        } else if(memory.read(addr) != block[i]) {
+            status |= TAPE_VERIFY_ERROR;
+        }
+    }
+
+    writePointer(memory, SAL, start + length, regs.pc);
+    memory.write(STATUS, memory.read(STATUS) | status, regs.pc);
+    memory.write(CAS1, 0, regs.pc);
+    memory.write(0x0001, memory.read(0x0001) | 0x20, regs.pc); // motor off
+    regs.p &= ~FLAG_C;
+    cycles = TAPE_TRAP_CYCLES;
+    return TAPE_TRAP_TICKS;
+}
+
+HleTraps::HleTraps(MemoryController& memory)
+    : m_memory(memory)
+    , m_verify(false)
+    , m_tape(0)
+    , m_pending(0)
+    , m_started(0)
+    , m_startedCycles(0)
+    , m_expectedTicks(0)
+    , m_expectedCycles(0)
+    , m_verified(0)
+    , m_mismatches(0)
+{
+    memset(&m_expected, 0, sizeof(m_expected));
+}
+
+HleTraps::~HleTraps()
+{
+
+}
+
+const HleTrap* HleTraps::find(uint16_t addr) const
+{
+    for(size_t i = 0; i < TRAP_COUNT; ++i) {
+        if(addr == TRAPS[i].address) {
+            return &TRAPS[i];
+        }
+    }
+
+    return 0;
+}
+
+bool HleTraps::matchesRom(const HleTrap& trap) const
+{
+    for(size_t s = 0; s < 2; ++s) {
+        const RomSpan& span = trap.spans[s];
+        for(size_t i = 0; i < span.length; ++i) {
+            if(span.bytes[i] != m_memory.readRom(span.address + i)) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+// Only routines whose ROM code is byte for byte what the trap was written
+// against are trapped, so a patched or foreign ROM just runs as is.
+size_t HleTraps::install()
+{
+    size_t installed = 0;
+    for(size_t i = 0; i < TRAP_COUNT; ++i) {
+        if(matchesRom(TRAPS[i])) {
+            m_active.set(TRAPS[i].address);
+            ++installed;
+        } else {
+            printf("HLE trap %s at 0x%04X not installed, ROM differs\n", TRAPS[i].name, TRAPS[i].address);
+        }
+    }
+
+    printf("Installed %zu of %zu HLE traps\n", installed, TRAP_COUNT);
+    return installed;
+}
+
+bool HleTraps::installTape(Datasette *tape)
+{
+    for(size_t i = 0; i < 2; ++i) {
+        if(!matchesRom(TAPE_TRAPS[i])) {
+            printf("Tape trap %s at 0x%04X not installed, ROM differs\n", TAPE_TRAPS[i].name, TAPE_TRAPS[i].address);
+            return false;
+        }
+    }
+
+    m_tape = tape;
+    for(size_t i = 0; i < 2; ++i) {
+        m_active.set(TAPE_TRAPS[i].address);
+    }
+    return true;
+}
+
+void HleTraps::setVerify(bool enabled)
+{
+    m_verify = enabled;
+    if(enabled) {
+        m_before.resize(0x10000);
+        m_native.resize(0x10000);
+    }
+}
+
+// Called with the PC at a trapped address and the ROM mapped in.
+uint32_t HleTraps::run(uint16_t addr, CpuRegisters& regs, uint32_t& cycles)
+{
+    if(m_tape && (TAPE_TRAPS[0].address == addr || TAPE_TRAPS[1].address == addr)) {
+        return m_pending ? 0 : readTape(*m_tape, m_memory, regs, TAPE_TRAPS[0].address == addr, cycles);
+    }
+
+    const HleTrap* trap = find(addr);
+    if(!trap || m_pending) {
+        return 0;
+    }
+
+    // an interrupt due in the middle of the routine must land where it would
+    if(trap->maxTicks >= m_memory.getScheduler().ticksUntilNextEvent()) {
+        return 0;
+    }
+
+    if(m_verify) {
+        return startVerify(*trap, regs, cycles);
+    }
+
+    return trap->func(m_memory, regs, cycles);
+}
+
+// Runs the trap, remembers what it did, then puts RAM back so the
+// interpreter can run the ROM code for comparison in finishVerify().
+uint32_t HleTraps::startVerify(const HleTrap& trap, const CpuRegisters& regs, uint32_t& cycles)
+{
+    m_memory.saveRam(&m_before[0]);
+    m_expected = regs;
+    m_expectedTicks = trap.func(m_memory, m_expected, m_expectedCycles);
+    if(!m_expectedTicks) {
+        return 0;
+    }
+
+    m_expected.sp += 2;
+    m_expected.pc = m_memory.readWord(0x100 | (uint8_t)(m_expected.sp - 1)) + 1;
+    m_memory.saveRam(&m_native[0]);
+    m_memory.loadRam(&m_before[0]);
+    m_pending = &trap;
+    m_started = m_memory.getScheduler().now();
+    m_startedCycles = m_memory.getScheduler().cycles();
+    cycles = 0;
+    return 0;
+}
+
+bool HleTraps::verifyPending() const
+{
+    return 0 != m_pending;
+}
+
+uint16_t HleTraps::verifyReturn() const
+{
+    return m_expected.pc;
+}
+
+// Called once the interpreter is back at the trapped routine's return address.
+void HleTraps::finishVerify(const CpuRegisters& regs)
+{
+    if(!m_pending || regs.sp != m_expected.sp) {
+        return;
+    }
+
+    bool match = true;
+    uint32_t ticks = m_memory.getScheduler().now() - m_started;
+    if(ticks != m_expectedTicks) {
+        printf("HLE trap %s: took %u ticks, ROM code took %u\n", m_pending->name, m_expectedTicks, ticks);
+        match = false;
+    }
+
+    uint32_t cycles = m_memory.getScheduler().cycles() - m_startedCycles;
+    if(cycles != m_expectedCycles) {
+        printf("HLE trap %s: took %u cycles, ROM code took %u\n", m_pending->name, m_expectedCycles, cycles);
+        match = false;
+    }
+
+    if(regs.a != m_expected.a || regs.x != m_expected.x || regs.y != m_expected.y || regs.p != m_expected.p) {
+        printf("HLE trap %s: A=%02X X=%02X Y=%02X P=%02X, ROM code A=%02X X=%02X Y=%02X P=%02X\n",
+                m_pending->name, m_expected.a, m_expected.x, m_expected.y, m_expected.p,
+                regs.a, regs.x, regs.y, regs.p);
+        match = false;
+    }
+
+    m_memory.saveRam(&m_before[0]);
+    for(uint32_t addr = 0; addr < 0x10000; ++addr) {
+        if(m_before[addr] != m_native[addr]) {
+            printf("HLE trap %s: 0x%04X=%02X, ROM code wrote %02X\n",
+                    m_pending->name, addr, m_native[addr], m_before[addr]);
+            match = false;
+        }
+    }
+
+    if(match) {
+        ++m_verified;
+    } else {
+        ++m_mismatches;
+    }
+    m_pending = 0;
+}
+
+void HleTraps::printStats() const
+{
+    printf("HLE traps verified %u calls, %u mismatches\n", m_verified, m_mismatches);
+}
+
+}
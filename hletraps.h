@@ -0,0 +1,80 @@
+#ifndef INCLUDED_HLE_TRAPS_H
+#define INCLUDED_HLE_TRAPS_H
+
+#include <stdint.h>
+#include <vector>
+#include "mos6510.h"
+
+namespace MOS6510 {
+
+class Datasette;
+
+// Native stand-ins for hot ROM routines. A trap runs when the PC reaches the
+// routine's entry with the ROM mapped in, has the same RAM side effects,
+// tick and 6510 cycle count as the interpreted code, and leaves the
+// registers as they would be just before the routine's RTS. It returns the
+// ticks it used and sets cycles, or returns 0 to decline and let the ROM
+// code run instead.
+typedef uint32_t (*TrapFunc)(MemoryController& memory, CpuRegisters& regs, uint32_t& cycles);
+
+struct RomSpan {
+    uint16_t        address;
+    uint8_t         length;
+    const uint8_t*  bytes;
+};
+
+struct HleTrap {
+    const char*     name;
+    uint16_t        address;
+    uint32_t        maxTicks;   // including the final RTS
+    TrapFunc        func;
+    RomSpan         spans[2];   // code the trap stands in for, length 0 if unused
+};
+
+class HleTraps {
+private:
+    MemoryController&           m_memory;
+    AddressBitmap               m_active;
+    bool                        m_verify;
+    Datasette*                  m_tape;         // KERNAL tape reads, when installed
+
+    // verification of one trap call against the interpreter
+    const HleTrap*              m_pending;
+    CpuRegisters                m_expected;
+    uint64_t                    m_started;
+    uint64_t                    m_startedCycles;
+    uint32_t                    m_expectedTicks;
+    uint32_t                    m_expectedCycles;
+    std::vector<uint8_t>        m_before;
+    std::vector<uint8_t>        m_native;
+    uint32_t                    m_verified;
+    uint32_t                    m_mismatches;
+
+    const HleTrap* find(uint16_t addr) const;
+    bool matchesRom(const HleTrap& trap) const;
+    uint32_t startVerify(const HleTrap& trap, const CpuRegisters& regs, uint32_t& cycles);
+
+public:
+    HleTraps(MemoryController& memory);
+    ~HleTraps();
+
+    size_t install();
+    bool installTape(Datasette *tape);  // RBLK and TRD, whole blocks straight off the tape
+    void setVerify(bool enabled);
+
+    bool test(uint16_t addr) const
+    {
+        return m_active.test(addr);
+    }
+
+    uint32_t run(uint16_t addr, CpuRegisters& regs, uint32_t& cycles);
+
+    bool verifyPending() const;
+    uint16_t verifyReturn() const;
+    void finishVerify(const CpuRegisters& regs);
+    void printStats() const;
+};
+
+}
+
+#endif
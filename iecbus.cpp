@@ -0,0 +1,143 @@
+#include <chrono>
+#include <thread>
+#include "iecbus.h"
+
+namespace MOS6510 {
+
+// spins before either thread sleeps; a missed wake-up costs at most IEC_NAP
+static const int IEC_SPINS = 1000;
+static const std::chrono::milliseconds IEC_NAP(1);
+
+IecBus::IecBus()
+    : m_eventHead(0)
+    , m_eventTail(0)
+    , m_c64Cycle(0)
+    , m_driveCycle(0)
+    , m_driveLines(0)
+    , m_driveWaiting(false)
+    , m_c64Waiting(false)
+    , m_closed(false)
+    , m_c64Lines(0)
+{
+
+}
+
+void IecBus::reset(uint64_t cycle)
+{
+    m_eventHead.store(0);
+    m_eventTail.store(0);
+    m_c64Cycle.store(cycle);
+    m_driveCycle.store(cycle);
+    m_driveLines.store(0);
+    m_closed.store(false);
+}
+
+void IecBus::setLines(uint64_t cycle, uint8_t lines)
+{
+    m_c64Lines = lines;
+    uint64_t head = m_eventHead.load(std::memory_order_relaxed);
+    while(IEC_EVENT_QUEUE <= head - m_eventTail.load(std::memory_order_acquire)) {
+        advance(cycle); // let the drive get to the queued changes
+        std::this_thread::yield();
+    }
+
+    IecEvent& event = m_events[head % IEC_EVENT_QUEUE];
+    event.cycle = cycle;
+    event.lines = lines;
+    m_eventHead.store(head + 1, std::memory_order_release);
+}
+
+uint8_t IecBus::sample(uint64_t cycle)
+{
+    advance(cycle);
+    for(int i = 0; i < IEC_SPINS; ++i) {
+        if(m_driveCycle.load(std::memory_order_acquire) >= cycle) {
+            return m_c64Lines | m_driveLines.load(std::memory_order_relaxed);
+        }
+        if(m_closed.load(std::memory_order_relaxed)) {
+            return m_c64Lines;
+        }
+        std::this_thread::yield();
+    }
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_c64Waiting.store(true);
+    while(m_driveCycle.load(std::memory_order_acquire) < cycle && !m_closed.load()) {
+        m_caughtUp.wait_for(lock, IEC_NAP);
+    }
+    m_c64Waiting.store(false);
+    if(m_driveCycle.load(std::memory_order_acquire) < cycle) {
+        return m_c64Lines; // closed
+    }
+
+    return m_c64Lines | m_driveLines.load(std::memory_order_relaxed);
+}
+
+void IecBus::advance(uint64_t cycle)
+{
+    m_c64Cycle.store(cycle, std::memory_order_release);
+    if(m_driveWaiting.load(std::memory_order_relaxed)) {
+        m_wake.notify_one();
+    }
+}
+
+void IecBus::close()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_closed.store(true);
+    }
+    m_wake.notify_all();
+}
+
+uint64_t IecBus::waitForC64(uint64_t cycle)
+{
+    for(int i = 0; i < IEC_SPINS; ++i) {
+        uint64_t published = m_c64Cycle.load(std::memory_order_acquire);
+        if(published > cycle) {
+            return published;
+        }
+        if(m_closed.load(std::memory_order_relaxed)) {
+            return 0;
+        }
+        std::this_thread::yield();
+    }
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_driveWaiting.store(true);
+    uint64_t published = m_c64Cycle.load(std::memory_order_acquire);
+    while(published <= cycle && !m_closed.load()) {
+        m_wake.wait_for(lock, IEC_NAP);
+        published = m_c64Cycle.load(std::memory_order_acquire);
+    }
+    m_driveWaiting.store(false);
+    return m_closed.load() ? 0 : published;
+}
+
+bool IecBus::nextEvent(uint64_t cycle, uint8_t& lines)
+{
+    uint64_t tail = m_eventTail.load(std::memory_order_relaxed);
+    if(tail == m_eventHead.load(std::memory_order_acquire)) {
+        return false;
+    }
+
+    const IecEvent& event = m_events[tail % IEC_EVENT_QUEUE];
+    if(event.cycle > cycle) {
+        return false;
+    }
+
+    lines = event.lines;
+    m_eventTail.store(tail + 1, std::memory_order_release);
+    return true;
+}
+
+void IecBus::publish(uint64_t cycle, uint8_t lines)
+{
+    m_driveLines.store(lines, std::memory_order_relaxed);
+    m_driveCycle.store(cycle, std::memory_order_release);
+    if(m_c64Waiting.load(std::memory_order_relaxed)) {
+        m_caughtUp.notify_one();
+    }
+}
+
+}
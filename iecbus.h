@@ -0,0 +1,75 @@
+#ifndef INCLUDED_IEC_BUS_H
+#define INCLUDED_IEC_BUS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+
+namespace MOS6510 {
+
+// a set bit pulls the line low, the bus is the wired OR of both sides
+enum IecLines {
+    IEC_ATN     = 0x01,
+    IEC_CLK     = 0x02,
+    IEC_DATA    = 0x04
+};
+
+// a change of the lines the C64 pulls, stamped with the C64 cycle it was made on
+struct IecEvent {
+    uint64_t    cycle;
+    uint8_t     lines;
+};
+
+const size_t IEC_EVENT_QUEUE = 256;
+
+// The serial bus between the C64 on the emulation thread and a drive on its
+// own thread, with time in real C64 cycles on both sides (Scheduler::cycles(),
+// not the one tick per instruction the VIC and CIAs run on).
+//
+// The drive never runs ahead of the C64: it may execute up to the last cycle
+// the C64 published with advance(), and every line change the C64 made
+// before that cycle is already queued with its stamp, so the drive sees each
+// one at exactly the right moment. The C64 only waits when it samples the
+// bus, until the drive has caught up to the sampling cycle. Between bus
+// accesses both sides run in parallel, and the result does not depend on
+// how the threads were scheduled.
+class IecBus {
+private:
+    IecEvent                    m_events[IEC_EVENT_QUEUE];
+    std::atomic<uint64_t>       m_eventHead;    // next slot the C64 fills
+    std::atomic<uint64_t>       m_eventTail;    // next slot the drive takes
+    std::atomic<uint64_t>       m_c64Cycle;     // the drive may run up to here
+    std::atomic<uint64_t>       m_driveCycle;   // the drive has got this far
+    std::atomic<uint8_t>        m_driveLines;   // pulled by the drive, as of m_driveCycle
+    std::atomic<bool>           m_driveWaiting;
+    std::atomic<bool>           m_c64Waiting;
+    std::atomic<bool>           m_closed;
+    uint8_t                     m_c64Lines;     // emulation thread only
+    std::mutex                  m_mutex;
+    std::condition_variable     m_wake;         // the drive, when the C64 advances
+    std::condition_variable     m_caughtUp;     // the C64, when the drive publishes
+
+    IecBus(const IecBus& rhs);
+    IecBus& operator=(const IecBus& rhs);
+
+public:
+    IecBus();
+
+    // emulation thread
+    void    reset(uint64_t cycle);              // before the drive starts
+    void    setLines(uint64_t cycle, uint8_t lines);
+    uint8_t sample(uint64_t cycle);             // lines low on the bus as of cycle
+    void    advance(uint64_t cycle);            // every C64 change before cycle is queued
+    void    close();                            // lets the drive thread finish
+
+    // drive thread
+    uint64_t waitForC64(uint64_t cycle);        // the published cycle once past cycle, 0 once closed
+    bool    nextEvent(uint64_t cycle, uint8_t& lines); // the next C64 change at or before cycle
+    void    publish(uint64_t cycle, uint8_t lines);
+};
+
+}
+
+#endif
@@ -0,0 +1,78 @@
+#ifndef INCLUDED_INTERRUPTS_H
+#define INCLUDED_INTERRUPTS_H
+
+#include <stdint.h>
+
+namespace MOS6510 {
+
+// every source drives its own bit of the shared IRQ or NMI line
+enum InterruptSource {
+    IRQ_CIA1    = 0x0001,
+    IRQ_VIC     = 0x0002,
+    IRQ_CART    = 0x0004,
+    IRQ_DEBUG   = 0x0008,
+    NMI_CIA2    = 0x0100,
+    NMI_RESTORE = 0x0200,
+    NMI_CART    = 0x0400
+};
+
+const uint16_t IRQ_SOURCES = 0x00FF;
+const uint16_t NMI_SOURCES = 0xFF00;
+
+// what the CPU sees at an instruction boundary
+enum InterruptPending {
+    PENDING_IRQ = 0x01, // level, held while any IRQ source is asserted
+    PENDING_NMI = 0x02  // edge, latched until the CPU takes it
+};
+
+class InterruptLines {
+private:
+    uint16_t    m_sources;
+    uint8_t     m_pending;
+
+public:
+    InterruptLines()
+        : m_sources(0)
+        , m_pending(0)
+    {
+    }
+
+    void raise(uint16_t source)
+    {
+        if((source & NMI_SOURCES) && 0 == (m_sources & NMI_SOURCES)) {
+            m_pending |= PENDING_NMI;
+        }
+
+        m_sources |= source;
+        if(m_sources & IRQ_SOURCES) {
+            m_pending |= PENDING_IRQ;
+        }
+    }
+
+    void release(uint16_t source)
+    {
+        m_sources &= ~source;
+        if(0 == (m_sources & IRQ_SOURCES)) {
+            m_pending &= ~PENDING_IRQ;
+        }
+    }
+
+    void acknowledgeNmi()
+    {
+        m_pending &= ~PENDING_NMI;
+    }
+
+    uint8_t pending() const
+    {
+        return m_pending;
+    }
+
+    uint16_t sources() const
+    {
+        return m_sources;
+    }
+};
+
+}
+
+#endif
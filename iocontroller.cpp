@@ -1,13 +1,19 @@
 #include <assert.h>
 #include <stdio.h>
+#include <string.h>
 #include <iostream>
 #include "iocontroller.h"
 #include "memorycontroller.h"
+#include "iecbus.h"
+#include "datasette.h"
+#include "log.h"
 
 namespace MOS6510 {
 
 IOController::IOController(MemoryController *memPtr)
     : m_memory(memPtr)
+    , m_bus(0)
+    , m_tape(0)
 {
     assert(m_memory);
     init();
@@ -19,19 +25,69 @@ IOController::~IOController()
 
 }
 
+enum CiaRegisters {
+    CIA_TALO    = 0x04,
+    CIA_TAHI    = 0x05,
+    CIA_TBLO    = 0x06,
+    CIA_TBHI    = 0x07,
+    CIA_ICR     = 0x0D,
+    CIA_CRA     = 0x0E,
+    CIA_CRB     = 0x0F
+};
+
+enum CiaInterrupts {
+    ICR_FLAG    = 0x10
+};
+
+// the CPU port bits wired to the cassette port
+enum CassetteBits {
+    CASSETTE_SENSE  = 0x10, // low while a button is held down
+    CASSETTE_MOTOR  = 0x20  // the motor runs while this is low
+};
+
+enum CiaControl {
+    CR_START    = 0x01,
+    CR_ONESHOT  = 0x08,
+    CR_LOAD     = 0x10
+};
+
+static const uint16_t CIA_INTERRUPT[2] = { IRQ_CIA1, NMI_CIA2 };
+static const SchedulerEvent CIA_EVENT[2] = { EVENT_CIA1_TIMER, EVENT_CIA2_TIMER };
+
 uint8_t IOController::read(uint16_t addr)
+{
+    uint8_t reg = addr & 0x0F;
+    if(CIA_ICR == reg) { // reading acknowledges everything and releases the line
+        int cia = (0xFF < addr) ? 1 : 0;
+        uint8_t data = ciaRegister(cia, reg);
+        m_icrData[cia] = 0;
+        updateInterrupt(cia);
+        return data;
+    } else if(0x0100 == (addr & 0x010F) && m_bus) { // CLK and DATA read back from the bus
+        return serialPort(m_bus->sample(m_memory->getScheduler().cycles()));
+    }
+
+    return peek(addr);
+}
+
+uint8_t IOController::peek(uint16_t addr) const
 {
     uint8_t data = 0xFF;
-    if(0xFF < addr) { // first CIA chip
+    uint8_t reg = addr & 0x0F;
+    if(CIA_TALO <= reg) { // timers and interrupt control, both chips
+        data = ciaRegister((0xFF < addr) ? 1 : 0, reg);
+    } else if(0x0100 == (addr & 0x010F)) { // CIA2 port A
+        data = serialPort(serialLines());
+    } else if(0xFF < addr) { // first CIA chip
         data = m_CIA2Registers.all[(addr % 0x10)];
+    } else if(0x0000 == addr) {
+        uint8_t driveB = (m_CIA1Registers.reg.dataPortB | ~m_CIA1Registers.reg.dataDirB) & m_joystick[0];
+        uint8_t driveA = m_CIA1Registers.reg.dataPortA | ~m_CIA1Registers.reg.dataDirA;
+        data = driveA & m_rowTable[driveB] & m_joystick[1];
     } else if(0x0001 == addr) {
-        uint8_t mask = 0x01;
-        for(size_t i = 0; i < 8; ++i) {
-            if(mask != (m_CIA1Registers.reg.dataPortA & mask)) {
-                data &= m_matrix[i];
-            }
-            mask <<= 1;
-        }
+        uint8_t driveA = (m_CIA1Registers.reg.dataPortA | ~m_CIA1Registers.reg.dataDirA) & m_joystick[1];
+        uint8_t driveB = m_CIA1Registers.reg.dataPortB | ~m_CIA1Registers.reg.dataDirB;
+        data = driveB & m_columnTable[driveA] & m_joystick[0];
     } else {
         data = m_CIA1Registers.all[(addr % 0x10)];
     }
@@ -39,10 +95,106 @@ uint8_t IOController::read(uint16_t addr)
     return data;
 }
 
+// CIA2 port A with the given serial lines pulled low
+uint8_t IOController::serialPort(uint8_t low) const
+{
+    uint8_t levels = ((IEC_CLK & low) ? 0x00 : 0x40) | ((IEC_DATA & low) ? 0x00 : 0x80);
+    uint8_t inputs = ~m_CIA2Registers.reg.dataDirA & 0xC0;
+    return (m_CIA2Registers.reg.dataPortA & ~inputs) | (levels & inputs);
+}
+
+uint8_t IOController::ciaRegister(int cia, uint8_t reg) const
+{
+    const IOControllerRegisterFile& regs = cia ? m_CIA2Registers : m_CIA1Registers;
+    switch(reg) {
+        case CIA_TALO: return m_timers[cia][0].counter & 0xFF;
+        case CIA_TAHI: return m_timers[cia][0].counter >> 8;
+        case CIA_TBLO: return m_timers[cia][1].counter & 0xFF;
+        case CIA_TBHI: return m_timers[cia][1].counter >> 8;
+        case CIA_ICR:  return m_icrData[cia] | ((m_icrData[cia] & m_icrMask[cia]) ? 0x80 : 0);
+        case CIA_CRA:  return m_timers[cia][0].control;
+        case CIA_CRB:  return m_timers[cia][1].control;
+    }
+
+    return regs.all[reg];
+}
+
+bool IOController::writeCiaRegister(int cia, uint8_t reg, uint8_t data)
+{
+    CiaTimer *timer = &m_timers[cia][(CIA_TBLO <= reg && CIA_TBHI >= reg) ? 1 : 0];
+    switch(reg) {
+        case CIA_TALO:
+        case CIA_TBLO:
+            timer->latch = (timer->latch & 0xFF00) | data;
+            break;
+        case CIA_TAHI:
+        case CIA_TBHI:
+            timer->latch = (timer->latch & 0x00FF) | (data << 8);
+            if(0 == (CR_START & timer->control)) {
+                timer->counter = timer->latch;
+            }
+            break;
+        case CIA_ICR:
+            if(0x80 & data) {
+                m_icrMask[cia] |= (data & 0x1F);
+            } else {
+                m_icrMask[cia] &= ~data;
+            }
+            updateInterrupt(cia);
+            return true;
+        case CIA_CRB:
+            timer = &m_timers[cia][1];
+            // fall through
+        case CIA_CRA:
+            if(CR_LOAD & data) {
+                timer->counter = timer->latch;
+            }
+            timer->control = data & ~CR_LOAD;
+            break;
+        default:
+            return false;
+    }
+
+    scheduleTimers(cia);
+    return true;
+}
+
+void IOController::updateInterrupt(int cia)
+{
+    if(m_icrData[cia] & m_icrMask[cia]) {
+        m_memory->getInterrupts().raise(CIA_INTERRUPT[cia]);
+    } else {
+        m_memory->getInterrupts().release(CIA_INTERRUPT[cia]);
+    }
+}
+
+// the next underflow of either timer is the next time this chip can interrupt
+void IOController::scheduleTimers(int cia)
+{
+    uint64_t next = NEVER;
+    for(size_t t = 0; t < 2; ++t) {
+        const CiaTimer& timer = m_timers[cia][t];
+        if((CR_START & timer.control) && (timer.counter + 1u) < next) {
+            next = timer.counter + 1u;
+        }
+    }
+
+    if(NEVER == next) {
+        m_memory->getScheduler().cancel(CIA_EVENT[cia]);
+    } else {
+        m_memory->getScheduler().schedule(CIA_EVENT[cia], next);
+    }
+}
+
 void IOController::write(uint16_t addr, uint8_t data, uint16_t pc)
 {
     uint8_t tmp;
     uint8_t changed = 0;
+    uint8_t lines = serialLines(); // port A and its direction both decide what we pull
+    if(writeCiaRegister((0xFF < addr) ? 1 : 0, addr & 0x0F, data)) {
+        return;
+    }
+
     switch(addr) {
         case 0x00:
             tmp = (data & m_CIA1Registers.reg.dataDirA);
@@ -65,9 +217,9 @@ void IOController::write(uint16_t addr, uint8_t data, uint16_t pc)
             tmp |= (m_CIA2Registers.reg.dataPortA & ~m_CIA2Registers.reg.dataDirA);
             changed = m_CIA2Registers.reg.dataPortA ^ tmp;
             m_CIA2Registers.reg.dataPortA = tmp;
-            //printf("Data Port A = 0x%02X, changed = 0x%02X at PC = 0x%04X\n", tmp, changed, pc);
-            if(0 != (changed & 0x38)) {
-                serialEvent(changed);
+            C64_LOG(LOG_IEC, LOG_TRACE, "Data Port A = 0x%02X, changed = 0x%02X at PC = 0x%04X", tmp, changed, pc);
+            if(m_bus && lines != serialLines()) {
+                m_bus->setLines(m_memory->getScheduler().cycles(), serialLines());
             }
             break;
         case 0x101:
@@ -75,253 +227,260 @@ void IOController::write(uint16_t addr, uint8_t data, uint16_t pc)
             tmp |= (m_CIA2Registers.reg.dataPortB & ~m_CIA2Registers.reg.dataDirB);
             changed = m_CIA2Registers.reg.dataPortB ^ tmp;
             m_CIA2Registers.reg.dataPortB = tmp;
-            printf("Data Port B = 0x%02X, changed = 0x%02X at PC = 0x%04X\n", tmp, changed, pc);
+            C64_LOG(LOG_IO, LOG_DEBUG, "Data Port B = 0x%02X, changed = 0x%02X at PC = 0x%04X", tmp, changed, pc);
             break;
         case 0x102:
             m_CIA2Registers.reg.dataDirA = data;
-            printf("Data Dir  A = 0x%02X at PC = 0x%04X\n", data, pc);
+            C64_LOG(LOG_IO, LOG_DEBUG, "Data Dir  A = 0x%02X at PC = 0x%04X", data, pc);
+            if(m_bus && lines != serialLines()) {
+                m_bus->setLines(m_memory->getScheduler().cycles(), serialLines());
+            }
             break;
         case 0x103:
             m_CIA2Registers.reg.dataDirB = data;
-            printf("Data Dir  B = 0x%02X at PC = 0x%04X\n", data, pc);
+            C64_LOG(LOG_IO, LOG_DEBUG, "Data Dir  B = 0x%02X at PC = 0x%04X", data, pc);
             break;
     };
 }
 
 void IOController::execute()
 {
-    if(SerialState::EOI == m_serialState) {
-        if(9 < m_serialBitOut) {
-            --m_serialBitOut;
-        } else if(9 == m_serialBitOut) {
-            if(0x80 & m_CIA2Registers.reg.dataPortA) {
-                printf("Changing data port A2 from 0x%02X to 0x%02X\n",
-                        m_CIA2Registers.reg.dataPortA, (m_CIA2Registers.reg.dataPortA & 0x7F));
-                m_CIA2Registers.reg.dataPortA &= 0x7F;
-                m_serialBitOut = 14;
-            } else {
-                printf("Changing data port A2 from 0x%02X to 0x%02X\n",
-                        m_CIA2Registers.reg.dataPortA, (m_CIA2Registers.reg.dataPortA | 0x80));
-                m_CIA2Registers.reg.dataPortA |= 0x80;
-                m_serialBitOut = 0;
-                m_serialState = SerialState::LISTEN;
+    // timer B only counts clock ticks, the cascade and CNT input modes are not emulated
+    for(int cia = 0; cia < 2; ++cia) {
+        for(int t = 0; t < 2; ++t) {
+            CiaTimer& timer = m_timers[cia][t];
+            if(0 == (CR_START & timer.control)) {
+                continue;
+            }
+
+            if(timer.counter) {
+                --timer.counter;
+                continue;
             }
+
+            timer.counter = timer.latch;
+            if(CR_ONESHOT & timer.control) {
+                timer.control &= ~CR_START;
+            }
+            m_icrData[cia] |= (1 << t);
+            updateInterrupt(cia);
+            scheduleTimers(cia);
         }
     }
 }
 
+// the machine lives in uninitialised memory, nothing may be left to the heap
 void IOController::init()
 {
+    memset(&m_CIA1Registers, 0, sizeof(m_CIA1Registers));
+    memset(&m_CIA2Registers, 0, sizeof(m_CIA2Registers));
     for(size_t i = 0; i < 8; ++i) {
         m_matrix[i] = 0xFF;
     }
-    
-    m_serialBitOut = 0;
-    m_serialByteOut = 0;
-    m_serialState = SerialState::IDLE;
+    m_joystick[0] = 0xFF;
+    m_joystick[1] = 0xFF;
+    for(int cia = 0; cia < 2; ++cia) {
+        for(int t = 0; t < 2; ++t) {
+            m_timers[cia][t].latch = 0xFFFF;
+            m_timers[cia][t].counter = 0xFFFF;
+            m_timers[cia][t].control = 0;
+        }
+        m_icrMask[cia] = 0;
+        m_icrData[cia] = 0;
+    }
+    rebuildKeyTables();
+}
+
+void IOController::saveState(IOControllerState& state) const
+{
+    state.cia1Registers = m_CIA1Registers;
+    state.cia2Registers = m_CIA2Registers;
+    memcpy(state.matrix, m_matrix, sizeof(m_matrix));
+    memcpy(state.joystick, m_joystick, sizeof(m_joystick));
+    memcpy(state.timers, m_timers, sizeof(m_timers));
+    memcpy(state.icrMask, m_icrMask, sizeof(m_icrMask));
+    memcpy(state.icrData, m_icrData, sizeof(m_icrData));
+}
+
+// scheduler deadlines and interrupt lines are restored with the memory controller
+void IOController::loadState(const IOControllerState& state)
+{
+    m_CIA1Registers = state.cia1Registers;
+    m_CIA2Registers = state.cia2Registers;
+    memcpy(m_matrix, state.matrix, sizeof(m_matrix));
+    memcpy(m_joystick, state.joystick, sizeof(m_joystick));
+    memcpy(m_timers, state.timers, sizeof(m_timers));
+    memcpy(m_icrMask, state.icrMask, sizeof(m_icrMask));
+    memcpy(m_icrData, state.icrData, sizeof(m_icrData));
+    rebuildKeyTables();
 }
 
 void IOController::setKeyDown(int key)
 {
     m_matrix[(key / 8)] &= ~(1 << (key % 8));
+    rebuildKeyTables();
 }
 
 void IOController::setKeyUp(int key)
 {
     m_matrix[(key / 8)] |= (1 << (key % 8));
+    rebuildKeyTables();
 }
 
-static const char* getState(const SerialState state)
+void IOController::setJoystick(int port, uint8_t state)
 {
-    switch(state) {
-        case SerialState::IDLE:                     return "IDLE";
-        case SerialState::WAIT_FOR_COMMAND:         return "WAIT_FOR_COMMAND";
-        case SerialState::WAIT_FOR_SECONDARY_ADDR:  return "WAIT_FOR_SECONDARY_ADDR";
-        case SerialState::EOI:                      return "EOI";
-        case SerialState::LISTEN:                   return "LISTEN";
-        case SerialState::TALK:                     return "TALK";
-    }
-
-    return "Unknown";
+    assert(1 == port || 2 == port);
+    m_joystick[port - 1] = ~state | 0xE0;
 }
 
-void IOController::serialEvent(uint8_t changed)
+// Resolves every possible port A/port B output to what the other port reads
+// back, so a scan is a single lookup. Pressed keys short their row and column
+// together; rows sharing a pressed column are shorted as well, which gives
+// the real matrix's ghosting.
+void IOController::rebuildKeyTables()
 {
-    bool atn = (m_CIA2Registers.reg.dataPortA & 0x08);
-    bool clk = (m_CIA2Registers.reg.dataPortA & 0x10);
-    bool din = (m_CIA2Registers.reg.dataPortA & 0x80);
-    bool dot = (m_CIA2Registers.reg.dataPortA & 0x20);
-    SerialState oldState = m_serialState;
-
-    switch(m_serialState) {
-        case SerialState::IDLE: {
-            if(atn && !clk) {
-                m_CIA2Registers.reg.dataPortA |= 0x80;
-                din = true;
-                printf("0 Bus ack.\n");
-                m_serialState = SerialState::WAIT_FOR_COMMAND;
-            }
-        } break;
-
-        case SerialState::WAIT_FOR_COMMAND: {
-            if((0x10 & changed) && !clk) {
-                printf("Clock up, bit = %d\n", dot);
-                m_serialByteOut >>= 1;
-                m_serialByteOut |= dot ? 0x00: 0x80;
-                ++m_serialBitOut;
-                if(8 == m_serialBitOut) {
-                    printf("Byte: 0x%02X\n", m_serialByteOut);
-                    if(0x20 & m_serialByteOut) { // listen
-                        m_serialState = SerialState::WAIT_FOR_SECONDARY_ADDR;
-                        m_CIA2Registers.reg.dataPortA &= 0x7F;
-                        din = false;
-                    }
-
-                    m_primaryAddress = m_serialByteOut & 0x1F;
-                }
-            }
-        } break;
-
-        case SerialState::WAIT_FOR_SECONDARY_ADDR: {
-            if((0x10 & changed) && !clk) {
-                if(8 == m_serialBitOut) {
-                    m_CIA2Registers.reg.dataPortA |= 0x80;
-                    din = true;
-                    printf("1 Bus ack.\n");
-                    m_serialBitOut = 0;
-                } else {
-                    printf("Clock up, bit = %d\n", !dot);
-                    m_serialByteOut >>= 1;
-                    m_serialByteOut |= dot ? 0x00: 0x80;
-                    ++m_serialBitOut;
-                    if(8 == m_serialBitOut) {
-                        printf("Byte: 0x%02X\n", m_serialByteOut);
-                        m_secondaryAddress = m_serialByteOut;
-                        m_serialState = SerialState::EOI;
-                        m_CIA2Registers.reg.dataPortA &= 0x7F;
-                        din = false;
-                    }
+    uint8_t rowKeys[8]; // pressed columns per row, active high
+    for(size_t i = 0; i < 8; ++i) {
+        rowKeys[i] = ~m_matrix[i];
+    }
+
+    uint8_t rowReach[8]; // columns pulled low by driving a row
+    uint8_t colReach[8]; // rows pulled low by driving a column
+    for(size_t i = 0; i < 8; ++i) {
+        rowReach[i] = 0;
+        colReach[i] = 0;
+    }
+
+    for(size_t i = 0; i < 8; ++i) {
+        uint8_t rows = (1 << i);
+        uint8_t cols = 0;
+        uint8_t prev;
+        do {
+            prev = rows;
+            for(size_t r = 0; r < 8; ++r) {
+                if(rows & (1 << r)) {
+                    cols |= rowKeys[r];
                 }
             }
-        } break;
-
-        case SerialState::EOI: {
-            if((0x10 & changed) && !clk) {
-                if(8 == m_serialBitOut) {
-                    m_CIA2Registers.reg.dataPortA |= 0x80;
-                    din = true;
-                    printf("2 Bus ack.\n");
-                    m_serialBitOut = 14;
+            for(size_t r = 0; r < 8; ++r) {
+                if(rowKeys[r] & cols) {
+                    rows |= (1 << r);
                 }
             }
-        } break;
-
-        case SerialState::LISTEN: {
-            if((0x10 & changed) && !clk) {
-                if(8 == m_serialBitOut) {
-                    m_CIA2Registers.reg.dataPortA |= 0x80;
-                    din = true;
-                    printf("3 Bus ack.\n");
-                    m_serialBitOut = 0;
-                } else {
-                    m_CIA2Registers.reg.dataPortA |= 0x80;
-                    din = true;
-                    printf("Clock up, bit = %d\n", !dot);
-                    m_serialByteOut >>= 1;
-                    m_serialByteOut |= dot ? 0x00: 0x80;
-                    ++m_serialBitOut;
-                    if(8 == m_serialBitOut) {
-                        printf("Byte: 0x%02X\n", m_serialByteOut);
-                        m_CIA2Registers.reg.dataPortA &= 0x7F;
-                        din = false;
-                        if(atn) { // cmd
-                            if(0x3F == m_serialByteOut) { // UNLISTEN
-                                m_serialBitOut = 0;
-                                m_serialState = SerialState::IDLE;
-                                if(0xF0 == m_secondaryAddress) {
-                                    char *filename = (char*)calloc(
-                                            m_serialQueue.size() + 1,
-                                            sizeof(char));
-                                    uint8_t idx = 0;
-                                    while(m_serialQueue.size()) {
-                                        filename[idx++] = m_serialQueue.front();
-                                        m_serialQueue.pop_front();
-                                    }
-
-                                    printf("Device %d requested to open file '%s'\n",
-                                            m_primaryAddress,
-                                            filename);
-                                    free(filename);
-                                }
-                            }
-                        } else {
-                            m_serialQueue.push_back(m_serialByteOut);
-                        }
-                    }
-                }
+        } while(rows != prev);
+
+        rowReach[i] = cols;
+        for(size_t c = 0; c < 8; ++c) {
+            if(cols & (1 << c)) {
+                colReach[c] |= rows;
             }
-        } break;
+        }
+    }
 
-        case SerialState::TALK: {
-        } break;
+    // index by the set of driven lines, each entry extends one with a lower bit cleared
+    uint8_t colsLow[256];
+    uint8_t rowsLow[256];
+    colsLow[0] = 0;
+    rowsLow[0] = 0;
+    for(size_t driven = 1; driven < 256; ++driven) {
+        size_t bit = 0;
+        while(0 == (driven & (1 << bit))) {
+            ++bit;
+        }
+        colsLow[driven] = colsLow[driven & (driven - 1)] | rowReach[bit];
+        rowsLow[driven] = rowsLow[driven & (driven - 1)] | colReach[bit];
+    }
 
+    for(size_t value = 0; value < 256; ++value) {
+        m_columnTable[value] = ~colsLow[~value & 0xFF];
+        m_rowTable[value] = ~rowsLow[~value & 0xFF];
     }
+}
 
+// CIA2 port A bits 3-5 pull ATN, CLK and DATA through inverters, so a
+// high output or an input pin pulls its line low
+uint8_t IOController::serialLines() const
+{
+    uint8_t out = m_CIA2Registers.reg.dataPortA | ~m_CIA2Registers.reg.dataDirA;
+    uint8_t lines = 0;
+    if(0x08 & out) {
+        lines |= IEC_ATN;
+    }
+    if(0x10 & out) {
+        lines |= IEC_CLK;
+    }
+    if(0x20 & out) {
+        lines |= IEC_DATA;
+    }
 
-    printf("ATN is %s, ", atn ? "low" : "high");
-    printf("CLK is %s, ", clk ? "low" : "high");
-    printf("DIN is %s, ", din ? "low" : "high");
-    printf("DOT is %s, ", dot ? "low" : "high");
-    printf("STATE is %s", getState(m_serialState));
-    if(oldState != m_serialState) {
-        printf(" (was %s)", getState(oldState));
+    return lines;
+}
+
+void IOController::setSerialBus(IecBus *bus)
+{
+    m_bus = bus;
+    if(m_bus) {
+        m_bus->setLines(m_memory->getScheduler().cycles(), serialLines());
     }
-    printf("\n-----------------------\n");
 }
 
-#if 0
-void IOController::serialEvent(uint8_t changed)
+void IOController::advanceBus()
 {
-    bool atn = (m_CIA2Registers.reg.dataPortA & 0x08);
+    if(m_bus) {
+        m_bus->advance(m_memory->getScheduler().cycles());
+    }
+}
 
-    if(0x08 & changed) {
-        m_ackPending = atn;
-        if(!atn) {
-            m_CIA2Registers.reg.dataPortA |= 0x80;
-        }
+void IOController::setTape(Datasette *tape)
+{
+    m_tape = tape;
+    m_memory->write(0x0001, m_memory->getRam()[0x0001], 0); // sense and motor as of now
+    scheduleTape();
+}
+
+// FLAG is CIA1's only edge triggered input, every falling edge sets its bit
+void IOController::advanceTape()
+{
+    if(!m_tape) {
+        return;
     }
 
-    bool clk = (m_CIA2Registers.reg.dataPortA & 0x10);
-    bool din = (m_CIA2Registers.reg.dataPortA & 0x80);
-    bool dot = (m_CIA2Registers.reg.dataPortA & 0x20);
-
-    printf("ATN is %s, ", atn ? "low" : "high");
-    printf("CLK is %s, ", clk ? "low" : "high");
-    printf("DIN is %s, ", din ? "low" : "high");
-    printf("DOT is %s\n", dot ? "low" : "high");
-
-    if((0x10 & changed) && !clk) { // rising edge
-        if(!din && m_ackPending) {
-            m_CIA2Registers.reg.dataPortA |= 0x80;
-            m_ackPending = false;
-            printf("Bus ack.\n");
-        } else {
-            printf("Got bit %d: %d\n", m_serialBitOut++, !dot);
-            m_serialByteOut >>= 1;
-            if(!dot) {
-                m_serialByteOut |= 0x80;
-            }
+    uint64_t now = m_memory->getScheduler().now();
+    bool edge = false;
+    while(m_tape->edgeDue(now)) {
+        edge = true; // several edges due within one tick are merged in to one FLAG
+    }
 
-            if(8 == m_serialBitOut) {
-                printf("Received byte: 0x%02X\n", m_serialByteOut);
-                m_CIA2Registers.reg.dataPortA &= 0x7F;
-                m_ackPending = true;
-                m_serialBitOut = 0;
-            }
-        }
+    if(edge) {
+        m_icrData[0] |= ICR_FLAG;
+        updateInterrupt(0);
+        scheduleTape();
     }
-    printf("-----------------------\n");
 }
-#endif
+
+void IOController::scheduleTape()
+{
+    uint64_t now = m_memory->getScheduler().now();
+    if(!m_tape || NEVER == m_tape->nextEdge()) {
+        m_memory->getScheduler().cancel(EVENT_TAPE);
+    } else {
+        m_memory->getScheduler().schedule(EVENT_TAPE, (m_tape->nextEdge() > now) ? m_tape->nextEdge() - now : 0);
+    }
+}
+
+uint8_t IOController::writeCpuPort(uint8_t data)
+{
+    if(!m_tape) {
+        return data;
+    }
+
+    bool motor = !(CASSETTE_MOTOR & data);
+    if(motor != m_tape->isMotorOn()) {
+        m_tape->setMotor(motor, m_memory->getScheduler().now());
+        scheduleTape();
+    }
+
+    return (data & ~CASSETTE_SENSE) | (m_tape->isLoaded() ? 0 : CASSETTE_SENSE);
+}
 
 }
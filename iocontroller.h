@@ -2,11 +2,12 @@
 #define INCLUDED_IO_CONTROLLER_H
 
 #include <stdint.h>
-#include <deque>
 
 namespace MOS6510 {
 
 class MemoryController;
+class IecBus;
+class Datasette;
 
 struct IOControllerRegisterFile {
     union {
@@ -32,13 +33,29 @@ struct IOControllerRegisterFile {
     };
 };
 
-enum SerialState {
-    IDLE,
-    WAIT_FOR_COMMAND,
-    WAIT_FOR_SECONDARY_ADDR,
-    EOI,
-    LISTEN,
-    TALK
+enum JoystickBits {
+    JOY_UP      = 0x01,
+    JOY_DOWN    = 0x02,
+    JOY_LEFT    = 0x04,
+    JOY_RIGHT   = 0x08,
+    JOY_FIRE    = 0x10
+};
+
+struct CiaTimer {
+    uint16_t    latch;
+    uint16_t    counter;
+    uint8_t     control;
+};
+
+// everything needed to put both CIAs back as they were, see Machine::saveState
+struct IOControllerState {
+    IOControllerRegisterFile    cia1Registers;
+    IOControllerRegisterFile    cia2Registers;
+    uint8_t                     matrix[8];
+    uint8_t                     joystick[2];
+    CiaTimer                    timers[2][2];
+    uint8_t                     icrMask[2];
+    uint8_t                     icrData[2];
 };
 
 class IOController {
@@ -46,25 +63,44 @@ private:
     IOControllerRegisterFile    m_CIA1Registers;
     IOControllerRegisterFile    m_CIA2Registers;
     MemoryController*           m_memory;
-    uint8_t                     m_matrix[8];
-    uint8_t                     m_serialByteOut;
-    uint8_t                     m_serialBitOut;
-    bool                        m_ackPending;
-    SerialState                 m_serialState;
-    uint8_t                     m_primaryAddress;
-    uint8_t                     m_secondaryAddress;
-    std::deque<uint8_t>         m_serialQueue;
+    uint8_t                     m_matrix[8];        // per row, a clear bit is a pressed key
+    uint8_t                     m_columnTable[256]; // port B as seen for each port A output
+    uint8_t                     m_rowTable[256];    // port A as seen for each port B output
+    uint8_t                     m_joystick[2];      // active low, port 1 on B, port 2 on A
+    CiaTimer                    m_timers[2][2];     // per CIA, timer A and B
+    uint8_t                     m_icrMask[2];
+    uint8_t                     m_icrData[2];
+    IecBus*                     m_bus;              // 0 while nothing is plugged in
+    Datasette*                  m_tape;
+
+    void    rebuildKeyTables();
+    uint8_t ciaRegister(int cia, uint8_t reg) const;
+    uint8_t serialPort(uint8_t low) const;
+    bool    writeCiaRegister(int cia, uint8_t reg, uint8_t data);
+    void    updateInterrupt(int cia);
+    void    scheduleTimers(int cia);
+    uint8_t serialLines() const;
+    void    scheduleTape();
 
 public:
     IOController(MemoryController *memPtr);
     ~IOController();
     
     uint8_t read(uint16_t addr);
+    uint8_t peek(uint16_t addr) const;  // no acknowledge, $DD00 with our own lines only
     void    write(uint16_t addr, uint8_t data, uint16_t pc);
 
     void    setKeyDown(int key);
     void    setKeyUp(int key);
-    void    serialEvent(uint8_t changed);
+    void    setJoystick(int port, uint8_t state);
+    void    setSerialBus(IecBus *bus);
+    void    advanceBus();   // after each instruction, see IecBus::advance
+    void    setTape(Datasette *tape);
+    void    advanceTape();  // after each instruction, FLAG for every edge that has passed
+    uint8_t writeCpuPort(uint8_t data); // $0001 as it reads back, with the cassette sense
+
+    void    saveState(IOControllerState& state) const;
+    void    loadState(const IOControllerState& state);
 
     void    init();
     void    execute();
@@ -0,0 +1,242 @@
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include "log.h"
+
+namespace MOS6510 {
+
+uint8_t logThreshold[LOG_SUBSYSTEMS] = { LOG_INFO, LOG_INFO, LOG_INFO, LOG_INFO, LOG_INFO };
+
+static const char *SUBSYSTEM_NAMES[LOG_SUBSYSTEMS] = { "cpu", "io", "iec", "drive", "video" };
+static const char *LEVEL_NAMES[] = { "off", "error", "warn", "info", "debug", "trace" };
+static const size_t LEVEL_COUNT = sizeof(LEVEL_NAMES) / sizeof(LEVEL_NAMES[0]);
+
+// how long the drain thread sleeps once it has printed everything
+static const std::chrono::milliseconds LOG_NAP(5);
+
+// A slot is free for record n when its sequence is n, and holds record n
+// once its sequence is n + 1; any thread may write, one thread drains.
+struct LogRecord {
+    std::atomic<uint64_t>   sequence;
+    const char*             format;
+    uint8_t                 subsystem;
+    uint8_t                 level;
+    uint32_t                args[LOG_MAX_ARGS];
+};
+
+class LogRing {
+private:
+    LogRecord                   m_records[LOG_RING_SIZE];
+    std::atomic<uint64_t>       m_head;         // next record to claim
+    std::atomic<uint64_t>       m_tail;         // next record to print
+    std::atomic<uint64_t>       m_dropped;
+    std::atomic<bool>           m_stopping;
+    std::once_flag              m_started;
+    std::thread                 m_thread;
+    std::mutex                  m_mutex;
+    std::condition_variable     m_wake;
+
+    LogRing(const LogRing& rhs);
+    LogRing& operator=(const LogRing& rhs);
+
+    void start();
+    void drainLoop();
+    bool printNext();
+
+public:
+    LogRing();
+    ~LogRing();
+
+    LogRecord* claim();
+    void publish(LogRecord* record);
+    void flush();
+};
+
+static LogRing logRing;
+
+LogRing::LogRing()
+    : m_head(0)
+    , m_tail(0)
+    , m_dropped(0)
+    , m_stopping(false)
+{
+    for(size_t i = 0; i < LOG_RING_SIZE; ++i) {
+        m_records[i].sequence.store(i, std::memory_order_relaxed);
+    }
+}
+
+LogRing::~LogRing()
+{
+    if(!m_thread.joinable()) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping.store(true);
+    }
+    m_wake.notify_one();
+    m_thread.join();
+}
+
+void LogRing::start()
+{
+    m_thread = std::thread(&LogRing::drainLoop, this);
+}
+
+// null when the ring is full
+LogRecord* LogRing::claim()
+{
+    std::call_once(m_started, &LogRing::start, this);
+
+    uint64_t head = m_head.load(std::memory_order_relaxed);
+    for(;;) {
+        LogRecord& record = m_records[head % LOG_RING_SIZE];
+        int64_t lag = (int64_t)(record.sequence.load(std::memory_order_acquire) - head);
+        if(0 > lag) {
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+            return 0;
+        }
+        if(0 == lag && m_head.compare_exchange_weak(head, head + 1, std::memory_order_relaxed)) {
+            return &record;
+        }
+        if(0 < lag) {
+            head = m_head.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+void LogRing::publish(LogRecord* record)
+{
+    record->sequence.fetch_add(1, std::memory_order_release);
+}
+
+bool LogRing::printNext()
+{
+    uint64_t tail = m_tail.load(std::memory_order_relaxed);
+    LogRecord& record = m_records[tail % LOG_RING_SIZE];
+    if(record.sequence.load(std::memory_order_acquire) != tail + 1) {
+        return false;
+    }
+
+    char text[256];
+    snprintf(text, sizeof(text), record.format, record.args[0], record.args[1], record.args[2],
+                                                record.args[3], record.args[4], record.args[5]);
+    fprintf(stderr, "[%s %s] %s\n", SUBSYSTEM_NAMES[record.subsystem], LEVEL_NAMES[record.level], text);
+
+    record.sequence.store(tail + LOG_RING_SIZE, std::memory_order_release);
+    m_tail.store(tail + 1, std::memory_order_release);
+    return true;
+}
+
+void LogRing::drainLoop()
+{
+    for(;;) {
+        while(printNext()) {
+        }
+
+        uint64_t dropped = m_dropped.exchange(0, std::memory_order_relaxed);
+        if(dropped) {
+            fprintf(stderr, "[log] dropped %llu messages\n", (unsigned long long)dropped);
+        }
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if(m_stopping.load() && m_tail.load() == m_head.load()) {
+            break;
+        }
+        m_wake.wait_for(lock, LOG_NAP);
+    }
+}
+
+void LogRing::flush()
+{
+    if(!m_thread.joinable()) {
+        return;
+    }
+
+    uint64_t head = m_head.load(std::memory_order_acquire);
+    m_wake.notify_one();
+    while(m_tail.load(std::memory_order_acquire) < head) {
+        std::this_thread::yield();
+    }
+}
+
+bool logConfigure(const std::string& spec)
+{
+    size_t start = 0;
+    while(start < spec.size()) {
+        size_t end = spec.find(',', start);
+        if(std::string::npos == end) {
+            end = spec.size();
+        }
+
+        std::string item = spec.substr(start, end - start);
+        size_t equals = item.find('=');
+        if(std::string::npos == equals) {
+            return false;
+        }
+
+        std::string name = item.substr(0, equals);
+        std::string levelName = item.substr(equals + 1);
+        size_t level = 0;
+        while(level < LEVEL_COUNT && levelName != LEVEL_NAMES[level]) {
+            ++level;
+        }
+        if(LEVEL_COUNT == level) {
+            return false;
+        }
+
+        bool found = false;
+        for(int subsystem = 0; subsystem < LOG_SUBSYSTEMS; ++subsystem) {
+            if("all" == name || name == SUBSYSTEM_NAMES[subsystem]) {
+                logThreshold[subsystem] = level;
+                found = true;
+            }
+        }
+        if(!found) {
+            return false;
+        }
+        start = end + 1;
+    }
+
+    return true;
+}
+
+void logWrite(LogSubsystem subsystem, LogLevel level, const char *format, ...)
+{
+    LogRecord* record = logRing.claim();
+    if(!record) {
+        return;
+    }
+
+    record->format = format;
+    record->subsystem = subsystem;
+    record->level = level;
+
+    // one argument per conversion, "%%" takes none
+    va_list args;
+    va_start(args, format);
+    size_t count = 0;
+    for(const char *c = strchr(format, '%'); c && LOG_MAX_ARGS > count; c = strchr(c + 1, '%')) {
+        if('%' == c[1]) {
+            ++c;
+            continue;
+        }
+        record->args[count++] = va_arg(args, unsigned int);
+    }
+    va_end(args);
+
+    logRing.publish(record);
+}
+
+void logFlush()
+{
+    logRing.flush();
+}
+
+}
@@ -0,0 +1,61 @@
+#ifndef INCLUDED_LOG_H
+#define INCLUDED_LOG_H
+
+#include <stdint.h>
+#include <string>
+
+namespace MOS6510 {
+
+enum LogSubsystem {
+    LOG_CPU,
+    LOG_IO,
+    LOG_IEC,
+    LOG_DRIVE,
+    LOG_VIDEO,
+    LOG_SUBSYSTEMS
+};
+
+enum LogLevel {
+    LOG_OFF,
+    LOG_ERROR,
+    LOG_WARN,
+    LOG_INFO,
+    LOG_DEBUG,
+    LOG_TRACE
+};
+
+const size_t LOG_MAX_ARGS   = 6;
+const size_t LOG_RING_SIZE  = 4096; // records, a power of two
+
+// the most detailed level printed for each subsystem, LOG_INFO to start with
+extern uint8_t logThreshold[LOG_SUBSYSTEMS];
+
+inline bool logEnabled(LogSubsystem subsystem, LogLevel level)
+{
+    return level <= logThreshold[subsystem];
+}
+
+// "iec=trace,io=debug" or "all=warn", false on an unknown name
+bool logConfigure(const std::string& spec);
+
+// Queues the format and up to LOG_MAX_ARGS integer arguments as one fixed
+// size record, without formatting anything; a background thread prints it
+// to stderr later. The format is kept by pointer, so it must be a literal,
+// and only takes integer conversions of at most 32 bits. When the ring is
+// full the record is dropped and counted rather than waited for.
+void logWrite(LogSubsystem subsystem, LogLevel level, const char *format, ...)
+    __attribute__((format(printf, 3, 4)));
+
+void logFlush(); // waits until everything queued so far is printed
+
+}
+
+// a disabled statement costs one load and a well predicted branch
+#define C64_LOG(subsystem, level, ...) \
+    do { \
+        if(MOS6510::logEnabled(subsystem, level)) { \
+            MOS6510::logWrite(subsystem, level, __VA_ARGS__); \
+        } \
+    } while(0)
+
+#endif
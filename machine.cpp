@@ -0,0 +1,125 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <new>
+#include "machine.h"
+
+namespace MOS6510 {
+
+Machine::Machine(const uint8_t *basic, const uint8_t *kernal, const uint8_t *chargen, VideoStandard standard)
+    : m_memory(basic, kernal, m_ram)
+    , m_cpu(m_memory)
+    , m_io(&m_memory)
+    , m_sid(&m_memory, standard)
+    , m_vic(&m_memory, chargen, standard)
+    , m_standard(standard)
+{
+
+}
+
+Machine::~Machine()
+{
+
+}
+
+// plain new does not honour the cache line alignment before C++17
+Machine* Machine::create(const uint8_t *basic, const uint8_t *kernal, const uint8_t *chargen,
+                         VideoStandard standard)
+{
+    void *storage = 0;
+    if(0 != posix_memalign(&storage, CACHE_LINE, sizeof(Machine))) {
+        fprintf(stderr, "Failed to allocate %zu bytes for a machine\n", sizeof(Machine));
+        return 0;
+    }
+
+    return new(storage) Machine(basic, kernal, chargen, standard);
+}
+
+void Machine::destroy(Machine *machine)
+{
+    if(machine) {
+        machine->~Machine();
+        free(machine);
+    }
+}
+
+MemoryController& Machine::getMemory()
+{
+    return m_memory;
+}
+
+Cpu& Machine::getCpu()
+{
+    return m_cpu;
+}
+
+IOController& Machine::getIO()
+{
+    return m_io;
+}
+
+SID& Machine::getSID()
+{
+    return m_sid;
+}
+
+VICII& Machine::getVIC()
+{
+    return m_vic;
+}
+
+VideoStandard Machine::getVideoStandard() const
+{
+    return m_standard;
+}
+
+const uint8_t* Machine::getRam() const
+{
+    return m_ram;
+}
+
+void Machine::attachCartridge(Cartridge *cart)
+{
+    m_memory.attachCartridge(cart);
+    CpuRegisters regs = m_cpu.getRegisters();
+    regs.pc = m_memory.readWord(0xFFFC);
+    m_cpu.setRegisters(regs);
+}
+
+void Machine::saveState(MachineState& state) const
+{
+    state.cpu = m_cpu.getRegisters();
+    m_memory.saveState(state.memory);
+    m_io.saveState(state.io);
+    m_sid.saveState(state.sid);
+    m_vic.saveState(state.vic);
+}
+
+void Machine::loadState(const MachineState& state)
+{
+    m_memory.loadState(state.memory);
+    m_cpu.setRegisters(state.cpu);
+    m_io.loadState(state.io);
+    m_sid.loadState(state.sid);
+    m_vic.loadState(state.vic);
+}
+
+template <class Config>
+uint32_t Machine::execute(bool debugBreak)
+{
+    uint32_t ticks = m_cpu.execute<Config>(debugBreak); // more than one after skipping an idle loop
+    for(uint32_t i = 0; i < ticks; ++i) {
+        m_vic.execute<Config>();
+        m_io.execute();
+    }
+    m_sid.execute(ticks);
+    m_io.advanceBus();
+    m_io.advanceTape();
+    return ticks;
+}
+
+template uint32_t Machine::execute<PalConfig>(bool debugBreak);
+template uint32_t Machine::execute<PalDebugConfig>(bool debugBreak);
+template uint32_t Machine::execute<NtscConfig>(bool debugBreak);
+template uint32_t Machine::execute<NtscDebugConfig>(bool debugBreak);
+
+}
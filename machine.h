@@ -0,0 +1,68 @@
+#ifndef INCLUDED_MACHINE_H
+#define INCLUDED_MACHINE_H
+
+#include <stdint.h>
+#include "memorycontroller.h"
+#include "mos6510.h"
+#include "iocontroller.h"
+#include "sid.h"
+#include "vicii.h"
+#include "machineconfig.h"
+
+namespace MOS6510 {
+
+const size_t CACHE_LINE = 64;
+
+// a complete snapshot, restoring it replays the machine exactly
+struct MachineState {
+    CpuRegisters            cpu;
+    MemoryControllerState   memory;
+    IOControllerState       io;
+    SIDState                sid;
+    VICIIState              vic;
+};
+
+// One C64 in a single cache line aligned allocation. The CPU registers,
+// scheduler, interrupt lines and chip register files come first, RAM and
+// the frame buffer follow, and debugger state lives out of line until it
+// is needed, so a host running many machines touches few lines per step.
+class Machine {
+private:
+    MemoryController    m_memory;
+    Cpu                 m_cpu;
+    IOController        m_io;
+    SID                 m_sid;
+    VICII               m_vic;
+    VideoStandard       m_standard;
+    alignas(CACHE_LINE) uint8_t m_ram[RAM_SIZE];
+
+    Machine(const uint8_t *basic, const uint8_t *kernal, const uint8_t *chargen, VideoStandard standard);
+    ~Machine();
+    Machine(const Machine& rhs);
+    Machine& operator=(const Machine& rhs);
+
+public:
+    static Machine* create(const uint8_t *basic, const uint8_t *kernal, const uint8_t *chargen,
+                           VideoStandard standard);
+    static void destroy(Machine *machine);
+
+    MemoryController& getMemory();
+    Cpu& getCpu();
+    IOController& getIO();
+    SID& getSID();
+    VICII& getVIC();
+    VideoStandard getVideoStandard() const;
+    const uint8_t* getRam() const;  // RAM_SIZE bytes, live
+    void attachCartridge(Cartridge *cart); // and start from its reset vector, 0 to remove it
+
+    void saveState(MachineState& state) const;
+    void loadState(const MachineState& state);
+
+    // returns the number of ticks run, Config::STANDARD must match create()
+    template <class Config>
+    uint32_t execute(bool debugBreak);
+};
+
+}
+
+#endif
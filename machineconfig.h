@@ -0,0 +1,52 @@
+#ifndef INCLUDED_MACHINE_CONFIG_H
+#define INCLUDED_MACHINE_CONFIG_H
+
+#include <stdint.h>
+
+namespace MOS6510 {
+
+enum VideoStandard {
+    VIDEO_PAL,
+    VIDEO_NTSC
+};
+
+// Compile time machine configuration. The hot loops (Machine::execute and
+// the Cpu and VICII steps below it) are templates on one of these, so line
+// and frame lengths are constants and disabled hooks are not even tested.
+// Only the typedefs below are instantiated, pick one with the video
+// standard and whether breakpoints, watchpoints, tracing and the profiler
+// are wanted.
+template <VideoStandard Standard, bool Instrumented>
+struct MachineConfig {
+    static constexpr VideoStandard STANDARD = Standard;
+    static constexpr int LINE_TICKS     = (VIDEO_PAL == Standard) ? 63 : 65;
+    static constexpr int LINES          = (VIDEO_PAL == Standard) ? 312 : 263;
+    static constexpr int FRAME_TICKS    = LINE_TICKS * LINES;
+    static constexpr uint32_t CLOCK     = (VIDEO_PAL == Standard) ? 985248 : 1022727;
+    static constexpr bool INSTRUMENTED  = Instrumented;
+};
+
+typedef MachineConfig<VIDEO_PAL, false>     PalConfig;
+typedef MachineConfig<VIDEO_PAL, true>      PalDebugConfig;
+typedef MachineConfig<VIDEO_NTSC, false>    NtscConfig;
+typedef MachineConfig<VIDEO_NTSC, true>     NtscDebugConfig;
+
+// the same numbers for code that only knows the standard at run time
+inline int lineTicks(VideoStandard standard)
+{
+    return (VIDEO_PAL == standard) ? PalConfig::LINE_TICKS : NtscConfig::LINE_TICKS;
+}
+
+inline int frameLines(VideoStandard standard)
+{
+    return (VIDEO_PAL == standard) ? PalConfig::LINES : NtscConfig::LINES;
+}
+
+inline uint32_t systemClock(VideoStandard standard)
+{
+    return (VIDEO_PAL == standard) ? PalConfig::CLOCK : NtscConfig::CLOCK;
+}
+
+}
+
+#endif
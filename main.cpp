@@ -1,12 +1,26 @@
 #include <iostream>
-#include <fstream>
+#include <memory>
 #include <signal.h>
 #include <SDL2/SDL.h>
-#include "mos6510.h"
-#include "memorycontroller.h"
-#include "vicii.h"
-#include "iocontroller.h"
+#include "machine.h"
+#include "framedump.h"
+#include "videoencoder.h"
+#include "palette.h"
+#include "sid.h"
+#include "audiooutput.h"
+#include "sdlwindow.h"
+#include "wavwriter.h"
+#include "monitorserver.h"
+#include "hletraps.h"
+#include "romset.h"
+#include "drive1541.h"
+#include "cartridge.h"
+#include "reu.h"
+#include "datasette.h"
+#include "log.h"
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 bool g_setDebug = false;
 void sig_callback(int signum)
@@ -16,11 +30,241 @@ void sig_callback(int signum)
     }
 }
 
+static void usage(const char *prog)
+{
+    std::cerr << "Usage: " << prog << " <ROM filename> [options]" << std::endl
+              << "  --rom-path <dirs>        colon separated directories to find ROM images in" << std::endl
+              << "  --dump-dir <dir>         write dumped frames in to <dir>" << std::endl
+              << "  --dump-format <png|raw>  frame dump format (default png)" << std::endl
+              << "  --dump-every <n>         dump every n-th frame" << std::endl
+              << "  --dump-frame <n>         dump frame n (may be repeated)" << std::endl
+              << "  --frame-hashes <file>    write a 64-bit hash of every frame to <file>" << std::endl
+              << "  --record <file>          capture all frames losslessly to a .c64v file" << std::endl
+              << "  --palette <name>         colour palette: " << MOS6510::paletteNames() << std::endl
+              << "  --scale <1-4>            integer window scale (default 3)" << std::endl
+              << "  --scanlines              darken every scaled line's last row" << std::endl
+              << "  --sid <6581|8580>        SID chip model (default 6581)" << std::endl
+              << "  --wav <file>             write audio to <file> instead of the audio device" << std::endl
+              << "  --no-audio               disable audio output" << std::endl
+              << "  --monitor <port>         accept monitor connections on 127.0.0.1:<port>" << std::endl
+              << "  --profile <file>         write folded guest call stacks to <file> on exit" << std::endl
+              << "  --profile-mode <m>       sample (default) or exact" << std::endl
+              << "  --profile-interval <n>   ticks between samples (default 1000)" << std::endl
+              << "  --symbols <file>         VICE .lbl or ca65 .dbg labels for the profiler" << std::endl
+              << "  --hle                    move BASIC floating point values natively (MOVFM, MOVMF, MOVFA, MOVAF, MOVEF)" << std::endl
+              << "  --hle-verify             run trapped routines both ways and compare" << std::endl
+              << "  --no-idle-skip           always execute idle loops instruction by instruction" << std::endl
+              << "  --video <pal|ntsc>       video standard and system clock (default pal)" << std::endl
+              << "  --fast                   leave out debugger, trace and profiler hooks" << std::endl
+              << "  --cart <file>            plug in a .crt cartridge (8K, 16K, Ultimax, Ocean, Magic Desk, EasyFlash)" << std::endl
+              << "  --reu <kb>               RAM expansion at $DF00, 128 to 16384 KB in powers of two" << std::endl
+              << "  --disk <file>            attach a 1541 as device 8 with a D64 or G64 image" << std::endl
+              << "  --drive-rom <file>       1541 DOS ROM (default 1541-II.251968-03.bin)" << std::endl
+              << "  --tape <file>            put a TAP image in the datasette, PLAY pressed" << std::endl
+              << "  --no-tape-trap           load tapes pulse by pulse rather than block by block" << std::endl
+              << "  --log <name=level,...>   log levels for cpu, io, iec, drive, video or all:" << std::endl
+              << "                           off, error, warn, info (default), debug or trace" << std::endl;
+}
+
+// SDL_Quit() on the way out of main, after the window and audio device
+// declared below it have closed, whichever return is taken
+struct SdlShutdown {
+    ~SdlShutdown()
+    {
+        SDL_Quit();
+    }
+};
+
+// frames rendered while the tape motor runs, the rest are skipped
+static const uint32_t TAPE_WARP_FRAMES = 16;
+
+// the emulation loop, built once per machine configuration
+template <class Config>
+static void run(MOS6510::Machine& machine, MOS6510::SdlWindow& window, const MOS6510::Datasette& tape)
+{
+    bool setDebug = false;
+    bool warp = false;
+    while(!window.isQuitRequested()) {
+        if(warp != tape.isMotorOn()) {
+            warp = !warp;
+            machine.getVIC().setFrameSkip(warp ? TAPE_WARP_FRAMES : 1);
+        }
+        machine.execute<Config>(setDebug);
+        if(setDebug) {
+            g_setDebug = false;
+        }
+        setDebug = g_setDebug;
+    }
+}
+
 int main(int argc, char **argv)
 {
-    if (2 != argc) {
+    if (2 > argc) {
         std::cerr << "Need ROM filename!"
                   << std::endl;
+        usage(argv[0]);
+        return -1;
+    }
+
+    MOS6510::FrameDumper frameDumper(MOS6510::FRAME_WIDTH, MOS6510::FRAME_HEIGHT);
+    std::string dumpDir;
+    MOS6510::FrameFormat dumpFormat = MOS6510::FRAME_PNG;
+    bool hashFrames = false;
+    std::string recordPath;
+    const uint32_t *palette = MOS6510::defaultPalette();
+    int scale = 3;
+    MOS6510::ScaleFilter scaleFilter = MOS6510::SCALE_NEAREST;
+    MOS6510::SidModel sidModel = MOS6510::SID_6581;
+    std::string wavPath;
+    bool audio = true;
+    bool idleSkip = true;
+    bool hle = false;
+    bool hleVerify = false;
+    bool tapeTrap = true;
+    int monitorPort = 0;
+    std::string profilePath;
+    MOS6510::ProfileMode profileMode = MOS6510::PROFILE_SAMPLE;
+    uint32_t profileInterval = 1000;
+    std::string symbolPath;
+    std::string romPath;
+    MOS6510::VideoStandard standard = MOS6510::VIDEO_PAL;
+    bool instrumented = true;
+    std::string diskPath;
+    std::string driveRom;
+    std::string cartPath;
+    size_t reuSize = 0;
+    std::string tapePath;
+    for(int i = 2; i < argc; ++i) {
+        const char *opt = argv[i];
+        if(0 == strcmp("--scanlines", opt)) {
+            scaleFilter = MOS6510::SCALE_SCANLINES;
+            continue;
+        } else if(0 == strcmp("--no-audio", opt)) {
+            audio = false;
+            continue;
+        } else if(0 == strcmp("--no-idle-skip", opt)) {
+            idleSkip = false;
+            continue;
+        } else if(0 == strcmp("--hle", opt)) {
+            hle = true;
+            continue;
+        } else if(0 == strcmp("--hle-verify", opt)) {
+            hle = true;
+            hleVerify = true;
+            continue;
+        } else if(0 == strcmp("--no-tape-trap", opt)) {
+            tapeTrap = false;
+            continue;
+        } else if(0 == strcmp("--fast", opt)) {
+            instrumented = false;
+            continue;
+        }
+
+        if(i + 1 >= argc) {
+            usage(argv[0]);
+            return -1;
+        }
+
+        const char *val = argv[++i];
+        if(0 == strcmp("--dump-dir", opt)) {
+            dumpDir = val;
+        } else if(0 == strcmp("--dump-format", opt)) {
+            if(0 == strcmp("raw", val)) {
+                dumpFormat = MOS6510::FRAME_RAW;
+            } else if(0 != strcmp("png", val)) {
+                usage(argv[0]);
+                return -1;
+            }
+        } else if(0 == strcmp("--dump-every", opt)) {
+            frameDumper.setDumpInterval(strtoul(val, 0, 0));
+        } else if(0 == strcmp("--dump-frame", opt)) {
+            frameDumper.requestDump(strtoul(val, 0, 0));
+        } else if(0 == strcmp("--frame-hashes", opt)) {
+            if(!frameDumper.openHashStream(val)) {
+                return -1;
+            }
+            hashFrames = true;
+        } else if(0 == strcmp("--record", opt)) {
+            recordPath = val;
+        } else if(0 == strcmp("--scale", opt)) {
+            scale = strtol(val, 0, 0);
+            if(1 > scale || 4 < scale) {
+                usage(argv[0]);
+                return -1;
+            }
+        } else if(0 == strcmp("--sid", opt)) {
+            if(0 == strcmp("8580", val)) {
+                sidModel = MOS6510::SID_8580;
+            } else if(0 != strcmp("6581", val)) {
+                usage(argv[0]);
+                return -1;
+            }
+        } else if(0 == strcmp("--monitor", opt)) {
+            monitorPort = strtol(val, 0, 0);
+            if(1 > monitorPort || 65535 < monitorPort) {
+                usage(argv[0]);
+                return -1;
+            }
+        } else if(0 == strcmp("--rom-path", opt)) {
+            romPath = val;
+        } else if(0 == strcmp("--profile", opt)) {
+            profilePath = val;
+        } else if(0 == strcmp("--profile-mode", opt)) {
+            if(0 == strcmp("exact", val)) {
+                profileMode = MOS6510::PROFILE_EXACT;
+            } else if(0 != strcmp("sample", val)) {
+                usage(argv[0]);
+                return -1;
+            }
+        } else if(0 == strcmp("--profile-interval", opt)) {
+            profileInterval = strtoul(val, 0, 0);
+        } else if(0 == strcmp("--symbols", opt)) {
+            symbolPath = val;
+        } else if(0 == strcmp("--video", opt)) {
+            if(0 == strcmp("ntsc", val)) {
+                standard = MOS6510::VIDEO_NTSC;
+            } else if(0 != strcmp("pal", val)) {
+                usage(argv[0]);
+                return -1;
+            }
+        } else if(0 == strcmp("--cart", opt)) {
+            cartPath = val;
+        } else if(0 == strcmp("--reu", opt)) {
+            reuSize = strtoul(val, 0, 10) * 1024;
+            if(MOS6510::REU_MIN_SIZE > reuSize || MOS6510::REU_MAX_SIZE < reuSize || (reuSize & (reuSize - 1))) {
+                std::cerr << "Invalid REU size " << val << std::endl;
+                usage(argv[0]);
+                return -1;
+            }
+        } else if(0 == strcmp("--disk", opt)) {
+            diskPath = val;
+        } else if(0 == strcmp("--drive-rom", opt)) {
+            driveRom = val;
+        } else if(0 == strcmp("--tape", opt)) {
+            tapePath = val;
+        } else if(0 == strcmp("--log", opt)) {
+            if(!MOS6510::logConfigure(val)) {
+                std::cerr << "Invalid log levels " << val << std::endl;
+                usage(argv[0]);
+                return -1;
+            }
+        } else if(0 == strcmp("--wav", opt)) {
+            wavPath = val;
+        } else if(0 == strcmp("--palette", opt)) {
+            palette = MOS6510::findPalette(val);
+            if(!palette) {
+                std::cerr << "Unknown palette " << val << std::endl;
+                usage(argv[0]);
+                return -1;
+            }
+        } else {
+            usage(argv[0]);
+            return -1;
+        }
+    }
+
+    if(!instrumented && (monitorPort || !profilePath.empty())) {
+        std::cerr << "--monitor and --profile need the hooks --fast leaves out" << std::endl;
         return -1;
     }
 
@@ -31,51 +275,168 @@ int main(int argc, char **argv)
               << argv[1]
               << std::endl;
 
-    std::ifstream romFile(
-            argv[1],
-            std::ifstream::binary);
+    MOS6510::RomSet roms;
+    if(!romPath.empty()) {
+        roms.addSearchPath(romPath);
+    }
+    if(!roms.loadCombined(argv[1]) || !roms.loadMissing()) {
+        std::cerr << "Failed to load ROMs!" << std::endl;
+        return -1;
+    }
+    bool drive = !diskPath.empty() || !driveRom.empty();
+    if(drive && !(driveRom.empty() ? roms.loadStock(MOS6510::ROM_DOS1541)
+                                   : roms.load(MOS6510::ROM_DOS1541, driveRom))) {
+        std::cerr << "Failed to load the 1541 ROM!" << std::endl;
+        return -1;
+    }
 
-    uint8_t rom[16384];
-    romFile.read((char *)rom, 0x4000); // Read BASIC/KERNAL in to buffer
-    if(0x4000 != romFile.gcount()) {
-        std::cerr << "Failed to read full ROM! Only got "
-                  << romFile.gcount()
-                  << " bytes!"
-                  << std::endl;
+    printf("ROM[0xA000] = 0x%02X\n", roms.getImage(MOS6510::ROM_BASIC)[0]);
+    printf("ROM[0xA001] = 0x%02X\n", roms.getImage(MOS6510::ROM_BASIC)[1]);
+
+    if(instrumented) {
+        signal(SIGTSTP, sig_callback);
     }
 
-    printf("ROM[0xA000] = 0x%02X\n", rom[0]);
-    printf("ROM[0xA001] = 0x%02X\n", rom[1]);
-    std::ifstream cgromFile(
-            "characters.901225-01.bin",
-            std::ifstream::binary);
+    MOS6510::Cartridge cartridge;
+    if(!cartPath.empty() && !cartridge.load(cartPath)) {
+        return -1;
+    }
+    MOS6510::Datasette datasette;
+    if(!tapePath.empty() && !datasette.load(tapePath)) {
+        return -1;
+    }
 
-    uint8_t cgrom[4096];
-    cgromFile.read((char *)cgrom, 0x1000); // Read CGROM in to buffer
-    if(0x1000 != cgromFile.gcount()) {
-        std::cerr << "Failed to read full CGROM! Only got "
-                  << romFile.gcount()
-                  << " bytes!"
-                  << std::endl;
+    std::unique_ptr<MOS6510::Machine, void (*)(MOS6510::Machine *)> machine(
+            MOS6510::Machine::create(
+                roms.getImage(MOS6510::ROM_BASIC),
+                roms.getImage(MOS6510::ROM_KERNAL),
+                roms.getImage(MOS6510::ROM_CHARGEN),
+                standard),
+            MOS6510::Machine::destroy);
+    if(!machine) {
+        return -1;
+    }
+    if(!cartPath.empty()) {
+        machine->attachCartridge(&cartridge);
+    }
+    std::unique_ptr<MOS6510::Reu> reu;
+    if(reuSize) {
+        reu.reset(new MOS6510::Reu(reuSize));
+        machine->getMemory().attachReu(reu.get());
+    }
+    if(!tapePath.empty()) {
+        machine->getIO().setTape(&datasette);
     }
 
-    signal(SIGTSTP, sig_callback);
+    MOS6510::MemoryController& memoryController = machine->getMemory();
+    MOS6510::Cpu& mos6510 = machine->getCpu();
+    MOS6510::VICII& vicii = machine->getVIC();
+    MOS6510::SID& sid = machine->getSID();
+    mos6510.setIdleSkip(idleSkip);
+    vicii.setPalette(palette);
+    vicii.startRenderThread();
 
-    MOS6510::MemoryController memoryController(rom);
-    MOS6510::Cpu mos6510(memoryController);
-    MOS6510::VICII vicii(&memoryController, cgrom);
-    MOS6510::IOController io(&memoryController);
-    bool setDebug = false;
-    while(1) {
-        mos6510.execute(setDebug);
-        vicii.execute();
-        io.execute();
-        if(setDebug) {
-            g_setDebug = false;
+    SdlShutdown sdlShutdown;
+    MOS6510::SdlWindow window(memoryController);
+    if(!window.open()) {
+        return -1;
+    }
+    window.setScale(scale, scaleFilter);
+    vicii.addFrameSink(&window);
+
+    if(!dumpDir.empty() || hashFrames) {
+        frameDumper.setDumpDirectory(dumpDir, dumpFormat);
+        vicii.addFrameSink(&frameDumper);
+    }
+
+    MOS6510::VideoEncoder videoEncoder(
+            MOS6510::FRAME_WIDTH,
+            MOS6510::FRAME_HEIGHT,
+            vicii.getPalette());
+    if(!recordPath.empty()) {
+        if(!videoEncoder.open(recordPath)) {
+            return -1;
         }
-        setDebug = g_setDebug;
+        vicii.addFrameSink(&videoEncoder);
+    }
+
+    sid.setModel(sidModel);
+    MOS6510::WavWriter wavWriter;
+    MOS6510::AudioOutput audioOutput;
+    if(!wavPath.empty()) {
+        if(!wavWriter.open(wavPath)) {
+            return -1;
+        }
+        sid.addAudioSink(&wavWriter);
+    } else if(audio && audioOutput.open()) {
+        sid.addAudioSink(&audioOutput);
+    }
+
+    MOS6510::MonitorServer monitor(mos6510, memoryController);
+    if(monitorPort) {
+        if(!monitor.open(monitorPort)) {
+            return -1;
+        }
+        mos6510.setBreakHandler(&monitor);
+        vicii.addFrameSink(&monitor);
+    }
+
+    MOS6510::Profiler profiler(profileMode, profileInterval);
+    if(!profilePath.empty()) {
+        if(!symbolPath.empty() && !profiler.loadSymbols(symbolPath)) {
+            return -1;
+        }
+        mos6510.setProfiler(&profiler);
+    }
+
+    std::unique_ptr<MOS6510::Drive1541> drive1541;
+    if(drive) {
+        drive1541.reset(new MOS6510::Drive1541(roms.getImage(MOS6510::ROM_DOS1541), standard));
+        if(!diskPath.empty() && !drive1541->insertDisk(diskPath)) {
+            return -1;
+        }
+        drive1541->start(memoryController.getScheduler().cycles());
+        machine->getIO().setSerialBus(&drive1541->getBus());
+    }
+
+    MOS6510::HleTraps traps(memoryController);
+    if(hle && traps.install()) {
+        traps.setVerify(hleVerify);
+        mos6510.setTraps(&traps);
+    }
+    if(!tapePath.empty() && tapeTrap && traps.installTape(&datasette)) {
+        mos6510.setTraps(&traps);
+    }
+
+    if(MOS6510::VIDEO_PAL == standard) {
+        if(instrumented) {
+            run<MOS6510::PalDebugConfig>(*machine, window, datasette);
+        } else {
+            run<MOS6510::PalConfig>(*machine, window, datasette);
+        }
+    } else {
+        if(instrumented) {
+            run<MOS6510::NtscDebugConfig>(*machine, window, datasette);
+        } else {
+            run<MOS6510::NtscConfig>(*machine, window, datasette);
+        }
+    }
+
+    sid.flush();
+    if(drive1541) {
+        drive1541->stop();
+        machine->getIO().setSerialBus(0);
+    }
+    if(!tapePath.empty()) {
+        machine->getIO().setTape(0);
+    }
+    if(!profilePath.empty()) {
+        profiler.writeFolded(profilePath);
+    }
+    if(hleVerify) {
+        traps.printStats();
     }
+    MOS6510::logFlush();
 
-    SDL_Quit();
     return 0;
 }
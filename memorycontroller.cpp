@@ -4,42 +4,87 @@
 #include "memorycontroller.h"
 
 namespace MOS6510 {
-MemoryController::MemoryController(uint8_t *rom)
+MemoryController::MemoryController(const uint8_t *basic, const uint8_t *kernal, uint8_t *ram)
+    : m_sram(ram)
+    , m_basic(basic)
+    , m_kernal(kernal)
+    , m_vicPtr(0)
+    , m_ioPtr(0)
+    , m_sidPtr(0)
+    , m_cart(0)
+    , m_cartMapping(MAP_NO_CART)
+    , m_reu(0)
+    , m_stateChanged(true)
+    , m_watching(false)
+    , m_watchHit(0)
+    , m_watchAddr(0)
+    , m_watchpoints(0)
 {
-    assert(0 != rom);
-    memcpy(&m_rom, rom, 16384);
-    for(size_t i = 0; i < 65536; ++i) {
-        m_sram[i] = 1;
-    }
+    assert(0 != basic && 0 != kernal && 0 != ram);
+    memset(m_sram, 1, RAM_SIZE);
+}
+
+MemoryController::~MemoryController()
+{
+    delete m_watchpoints;
 }
 
-bool MemoryController::checkMask(uint8_t mask, uint8_t value)
+bool MemoryController::checkMask(uint8_t mask, uint8_t value) const
 {
     return (value & mask) == mask;
 }
 
+void MemoryController::updateCartridgeMapping()
+{
+    if(!m_cart || (!m_cart->exrom() && !m_cart->game())) {
+        m_cartMapping = MAP_NO_CART;
+    } else if(!m_cart->exrom()) {
+        m_cartMapping = MAP_ULTIMAX;
+    } else {
+        m_cartMapping = m_cart->game() ? MAP_16K : MAP_8K;
+    }
+}
+
 uint8_t MemoryController::read(uint16_t addr)
 {
+    if(m_watching && m_watchpoints->read.test(addr)) {
+        m_watchHit = WATCH_READ;
+        m_watchAddr = addr;
+    }
+
     uint8_t page = addr / 256;
     uint8_t modeFlags = m_sram[0x0001];
     if(page <= 15) {
         return m_sram[addr];
     } else if(page > 15 && page <= 127) {
-        return m_sram[addr];
+        return (MAP_ULTIMAX == m_cartMapping) ? 0xFF : m_sram[addr];
     } else if(page > 127 && page <= 159) {
+        if(MAP_ULTIMAX == m_cartMapping || (MAP_NO_CART != m_cartMapping
+                                            && checkMask((LORAM | HIRAM), modeFlags))) {
+            return m_cart->roml()[addr - 0x8000];
+        }
         return m_sram[addr];
     } else if(page > 159 && page <= 191) {
-        if(checkMask((BankControlSignals::LORAM | BankControlSignals::HIRAM), modeFlags)) {
-            return m_rom[addr - 0xA000];
+        if(MAP_ULTIMAX == m_cartMapping) {
+            return 0xFF;
+        } else if(MAP_16K == m_cartMapping) {
+            return checkMask(HIRAM, modeFlags) ? m_cart->romh()[addr - 0xA000] : m_sram[addr];
+        } else if(checkMask((BankControlSignals::LORAM | BankControlSignals::HIRAM), modeFlags)) {
+            return m_basic[addr - 0xA000];
         } else {
             return m_sram[addr];
         }
     } else if(page > 191 && page <= 207) {
-        return m_sram[addr];
+        return (MAP_ULTIMAX == m_cartMapping) ? 0xFF : m_sram[addr];
     } else if(page > 207 && page <= 223) {
-        if(0 == modeFlags || BankControlSignals::CHAREN == modeFlags) {
+        bool ultimax = (MAP_ULTIMAX == m_cartMapping); // I/O is always there
+        if(!ultimax && (0 == modeFlags || BankControlSignals::CHAREN == modeFlags)) {
             return m_sram[addr];
-        } else if(checkMask(BankControlSignals::CHAREN, modeFlags)) {
+        } else if(ultimax || checkMask(BankControlSignals::CHAREN, modeFlags)) {
+            if(page > 207 && page <= 215) { // raster and oscillator values change every cycle
+                m_stateChanged = true;
+            }
+
             if(page > 207 && page <= 211) { // VIC registers
                 if(addr <= 0xD02E) {
                     return m_vicPtr->read(addr - 0xD000);
@@ -48,8 +93,17 @@ uint8_t MemoryController::read(uint16_t addr)
                 } else if(addr < 0xD3FF) {
                     return m_vicPtr->read(addr - 0xD400);
                 }
+            } else if(page > 211 && page <= 215) { // SID, mirrored every 32 bytes
+                return m_sidPtr ? m_sidPtr->read(addr & 0x1F) : 0xFF;
             } else if((220 == page) || (221 == page)) {
+                if(0x04 <= (addr & 0x0F) || 0xDD00 == (addr & 0xFF0F)) { // timers count down, the drive moves the bus
+                    m_stateChanged = true;
+                }
                 return m_ioPtr->read(addr - 0xDC00);
+            } else if(223 == page && m_reu) { // registers mirrored every 32 bytes
+                return m_reu->read(*this, addr & 0x1F);
+            } else if(page > 221 && m_cart) { // I/O 1 and 2
+                return m_cart->readIO(addr);
             }
 
             return m_sram[addr]; // <-- this should be I/O devices, TODO!!!
@@ -57,8 +111,10 @@ uint8_t MemoryController::read(uint16_t addr)
             return 0xFF; // <-- this is totally bogus but I'm tired, should be CHAR ROM
         }
     } else if(page > 223 && page <= 255) {
-        if(checkMask(BankControlSignals::HIRAM, modeFlags)) {
-            return m_rom[(addr - 0xE000) + 0x2000];
+        if(MAP_ULTIMAX == m_cartMapping) {
+            return m_cart->romh()[addr - 0xE000];
+        } else if(checkMask(BankControlSignals::HIRAM, modeFlags)) {
+            return m_kernal[addr - 0xE000];
         } else {
             return m_sram[addr];
         }
@@ -69,6 +125,50 @@ uint8_t MemoryController::read(uint16_t addr)
     return 0;
 }
 
+// the same banking as read() for the debugger and monitor: no watchpoints,
+// no acknowledged interrupts and no wait for the drive on the serial bus
+uint8_t MemoryController::peek(uint16_t addr) const
+{
+    uint8_t page = addr / 256;
+    const uint8_t *ram = readablePage(page);
+    if(ram) {
+        return ram[addr & 0xFF];
+    } else if(page <= 127 || (page > 191 && page <= 207)) { // open with an Ultimax cartridge
+        return 0xFF;
+    } else if(page <= 159) {
+        return m_cart->roml()[addr - 0x8000];
+    } else if(page <= 191) {
+        if(MAP_ULTIMAX == m_cartMapping) {
+            return 0xFF;
+        }
+        return (MAP_16K == m_cartMapping) ? m_cart->romh()[addr - 0xA000] : m_basic[addr - 0xA000];
+    } else if(page > 223) {
+        return (MAP_ULTIMAX == m_cartMapping) ? m_cart->romh()[addr - 0xE000] : m_kernal[addr - 0xE000];
+    } else if(MAP_ULTIMAX != m_cartMapping && !checkMask(BankControlSignals::CHAREN, m_sram[0x0001])) {
+        return 0xFF; // character rom, as read()
+    }
+
+    if(page <= 211) {
+        if(addr <= 0xD02E) {
+            return m_vicPtr->read(addr - 0xD000);
+        } else if(addr > 0xD02E && addr < 0xD040) {
+            return 0xFF;
+        } else if(addr < 0xD3FF) {
+            return m_vicPtr->read(addr - 0xD400);
+        }
+    } else if(page <= 215) {
+        return m_sidPtr ? m_sidPtr->peek(addr & 0x1F) : 0xFF;
+    } else if((220 == page) || (221 == page)) {
+        return m_ioPtr->peek(addr - 0xDC00);
+    } else if(223 == page && m_reu) {
+        return m_reu->peek(addr & 0x1F);
+    } else if(page > 221 && m_cart) {
+        return m_cart->readIO(addr);
+    }
+
+    return m_sram[addr];
+}
+
 uint16_t MemoryController::readWord(uint16_t addr)
 {
     uint16_t word = read(addr + 1) << 8;
@@ -78,13 +178,29 @@ uint16_t MemoryController::readWord(uint16_t addr)
 
 void MemoryController::write(uint16_t addr, uint8_t data, uint16_t pc)
 {
+    if(m_watching && m_watchpoints->write.test(addr)) {
+        m_watchHit = WATCH_WRITE;
+        m_watchAddr = addr;
+    }
+
     uint8_t page = addr / 256;
     uint8_t modeFlags = m_sram[0x0001];
+    if(page > 207 && page <= 223) { // any I/O access may have side effects
+        m_stateChanged = true;
+    }
+
     if((page > 211 && page <= 215) || (page > 221 && page <= 223)) {
-        if(0 == modeFlags || BankControlSignals::CHAREN == modeFlags) {
+        bool ultimax = (MAP_ULTIMAX == m_cartMapping);
+        if(!ultimax && (0 == modeFlags || BankControlSignals::CHAREN == modeFlags)) {
             m_sram[addr] = data;
-        } else if(checkMask(BankControlSignals::CHAREN, modeFlags)) {
-            if(0xDC00 == addr) {
+        } else if(ultimax || checkMask(BankControlSignals::CHAREN, modeFlags)) {
+            if(page <= 215 && m_sidPtr) {
+                m_sidPtr->write(addr & 0x1F, data);
+            } else if(223 == page && m_reu) {
+                m_reu->write(*this, addr & 0x1F, data);
+            } else if(page > 221 && m_cart) { // bank switching only moves the ROML and ROMH pointers
+                m_cart->writeIO(addr, data);
+                updateCartridgeMapping();
             }
         } else { // character rom
             m_sram[addr] = data;
@@ -100,7 +216,16 @@ void MemoryController::write(uint16_t addr, uint8_t data, uint16_t pc)
     } else if((220 == page) || (221 == page)) {
         m_ioPtr->write(addr - 0xDC00, data, pc);
     } else {
+        if(0x0001 == addr && m_ioPtr) { // the cassette port hangs off the CPU port
+            data = m_ioPtr->writeCpuPort(data);
+        }
+        m_stateChanged |= (m_sram[addr] != data);
         m_sram[addr] = data;
+        if(isVideoRam(addr) && m_vicPtr) { // the renderer replays these
+            m_vicPtr->logWrite(addr, data);
+        } else if(0xFF00 == addr && m_reu) { // the REU may wait for exactly this write
+            m_reu->trigger(*this);
+        }
     }
 }
 
@@ -130,4 +255,191 @@ void MemoryController::registerIO(IOController *ioPtr)
     m_ioPtr = ioPtr;
 }
 
+void MemoryController::registerSID(SID *sidPtr)
+{
+    m_sidPtr = sidPtr;
+}
+
+void MemoryController::attachCartridge(Cartridge *cart)
+{
+    m_cart = cart;
+    if(m_cart) {
+        m_cart->reset();
+    }
+    updateCartridgeMapping();
+    m_stateChanged = true;
+}
+
+void MemoryController::attachReu(Reu *reu)
+{
+    m_reu = reu;
+    if(m_reu) {
+        m_reu->reset();
+    }
+    m_stateChanged = true;
+}
+
+Scheduler& MemoryController::getScheduler()
+{
+    return m_scheduler;
+}
+
+InterruptLines& MemoryController::getInterrupts()
+{
+    return m_interrupts;
+}
+
+bool MemoryController::consumeStateChanged()
+{
+    bool changed = m_stateChanged;
+    m_stateChanged = false;
+    return changed;
+}
+
+void MemoryController::addWatchpoint(uint16_t addr, uint8_t type)
+{
+    if(!m_watchpoints) {
+        m_watchpoints = new Watchpoints();
+    }
+
+    if(WATCH_READ & type) {
+        m_watchpoints->read.set(addr);
+    }
+    if(WATCH_WRITE & type) {
+        m_watchpoints->write.set(addr);
+    }
+    m_watching = hasWatchpoints();
+}
+
+void MemoryController::removeWatchpoint(uint16_t addr, uint8_t type)
+{
+    if(!m_watchpoints) {
+        return;
+    }
+
+    if(WATCH_READ & type) {
+        m_watchpoints->read.clear(addr);
+    }
+    if(WATCH_WRITE & type) {
+        m_watchpoints->write.clear(addr);
+    }
+    m_watching = hasWatchpoints();
+}
+
+uint8_t MemoryController::getWatchpoint(uint16_t addr) const
+{
+    if(!m_watchpoints) {
+        return 0;
+    }
+
+    return (m_watchpoints->read.test(addr) ? WATCH_READ : 0)
+         | (m_watchpoints->write.test(addr) ? WATCH_WRITE : 0);
+}
+
+bool MemoryController::hasWatchpoints() const
+{
+    return m_watchpoints && 0 != (m_watchpoints->read.count() + m_watchpoints->write.count());
+}
+
+uint8_t MemoryController::consumeWatchHit(uint16_t& addr)
+{
+    uint8_t hit = m_watchHit;
+    addr = m_watchAddr;
+    m_watchHit = 0;
+    return hit;
+}
+
+bool MemoryController::isRomMapped(uint16_t addr) const
+{
+    uint8_t modeFlags = m_sram[0x0001];
+    if(addr >= 0xA000 && addr <= 0xBFFF) {
+        return (MAP_NO_CART == m_cartMapping || MAP_8K == m_cartMapping)
+            && (LORAM | HIRAM) == (modeFlags & (LORAM | HIRAM));
+    } else if(addr >= 0xE000) {
+        return MAP_ULTIMAX != m_cartMapping && HIRAM == (modeFlags & HIRAM);
+    }
+
+    return false;
+}
+
+uint8_t MemoryController::readRom(uint16_t addr) const
+{
+    if(addr >= 0xA000 && addr <= 0xBFFF) {
+        return m_basic[addr - 0xA000];
+    } else if(addr >= 0xE000) {
+        return m_kernal[addr - 0xE000];
+    }
+
+    return 0xFF;
+}
+
+const uint8_t* MemoryController::getRam() const
+{
+    return m_sram;
+}
+
+// follows read(): ROM, cartridge, open and I/O pages are not plain RAM
+const uint8_t* MemoryController::readablePage(uint8_t page) const
+{
+    uint8_t modeFlags = m_sram[0x0001];
+    bool ram = true;
+    if(MAP_ULTIMAX == m_cartMapping) {
+        ram = (page <= 15);
+    } else if(page > 127 && page <= 159) {
+        ram = (MAP_NO_CART == m_cartMapping) || !checkMask(LORAM | HIRAM, modeFlags);
+    } else if(page > 159 && page <= 191) {
+        ram = !checkMask((MAP_16K == m_cartMapping) ? HIRAM : (LORAM | HIRAM), modeFlags);
+    } else if(page > 207 && page <= 223) {
+        ram = (0 == modeFlags || CHAREN == modeFlags);
+    } else if(page > 223) {
+        ram = !checkMask(HIRAM, modeFlags);
+    }
+
+    return ram ? m_sram + page * 256 : 0;
+}
+
+// follows write(): the zero page holds the CPU port, video RAM is logged
+// for the renderer and anything at $D000-$DFFF may be I/O
+uint8_t* MemoryController::writablePage(uint8_t page)
+{
+    if(0 == page || SCREEN_RAM == ((page << 8) & 0xFC00) || (page > 207 && page <= 223)) {
+        return 0;
+    }
+
+    m_stateChanged = true;
+    return m_sram + page * 256;
+}
+
+void MemoryController::saveRam(uint8_t *ram) const
+{
+    memcpy(ram, m_sram, RAM_SIZE);
+}
+
+void MemoryController::loadRam(const uint8_t *ram)
+{
+    memcpy(m_sram, ram, RAM_SIZE);
+    m_stateChanged = true;
+}
+
+void MemoryController::saveState(MemoryControllerState& state) const
+{
+    saveRam(state.ram);
+    state.scheduler = m_scheduler;
+    state.interrupts = m_interrupts;
+    if(m_cart) {
+        m_cart->saveState(state.cartridge);
+    }
+}
+
+void MemoryController::loadState(const MemoryControllerState& state)
+{
+    loadRam(state.ram);
+    m_scheduler = state.scheduler;
+    m_interrupts = state.interrupts;
+    if(m_cart) {
+        m_cart->loadState(state.cartridge);
+        updateCartridgeMapping();
+    }
+}
+
 } // namespace MOS6510
@@ -3,26 +3,75 @@
 #include <stdint.h>
 #include "vicii.h"
 #include "iocontroller.h"
+#include "sid.h"
+#include "scheduler.h"
+#include "interrupts.h"
+#include "addressbitmap.h"
+#include "cartridge.h"
+#include "reu.h"
 
 namespace MOS6510 {
+enum WatchType {
+    WATCH_READ  = 0x01,
+    WATCH_WRITE = 0x02
+};
+
 enum BankControlSignals {
     LORAM   = 0x01,
     HIRAM   = 0x02,
     CHAREN  = 0x04
 };
 
+// what the EXROM and GAME lines of an attached cartridge select
+enum CartridgeMapping {
+    MAP_NO_CART,
+    MAP_8K,         // ROML at $8000
+    MAP_16K,        // ROML at $8000, ROMH at $A000
+    MAP_ULTIMAX     // ROML at $8000, ROMH at $E000, nothing but I/O and the first 4K otherwise
+};
+
+// watchpoint bitmaps, only allocated once the first one is set
+struct Watchpoints {
+    AddressBitmap   read;
+    AddressBitmap   write;
+};
+
+const size_t RAM_SIZE = 65536;
+
+struct MemoryControllerState {
+    uint8_t         ram[RAM_SIZE];
+    Scheduler       scheduler;
+    InterruptLines  interrupts;
+    CartridgeState  cartridge;
+};
+
 class MemoryController {
 private:
-    uint8_t         m_sram[65536];
-    uint8_t         m_rom[16384];
-    uint8_t         m_scanIdx;
+    // everything touched on each access comes first
+    uint8_t*        m_sram;         // RAM_SIZE bytes, owned by whoever built us
+    const uint8_t*  m_basic;        // ROM images are shared, never copied
+    const uint8_t*  m_kernal;
     VICII*          m_vicPtr;
     IOController*   m_ioPtr;
+    SID*            m_sidPtr;
+    Cartridge*      m_cart;
+    CartridgeMapping m_cartMapping;
+    Reu*            m_reu;
+    bool            m_stateChanged; // a write or volatile read since the last check
+    bool            m_watching;
+    uint8_t         m_watchHit;     // WatchType of the last hit, 0 if none
+    uint16_t        m_watchAddr;
+    uint8_t         m_scanIdx;
+    InterruptLines  m_interrupts;
+    Scheduler       m_scheduler;
+    Watchpoints*    m_watchpoints;  // cold, 0 until needed
 
-    bool            checkMask(uint8_t mask, uint8_t value);
+    bool            checkMask(uint8_t mask, uint8_t value) const;
+    void            updateCartridgeMapping();
 public:
     uint8_t         read(uint16_t addr);
     uint16_t        readWord(uint16_t addr);
+    uint8_t         peek(uint16_t addr) const;  // what read() would return, without side effects
 
     void            setKeyDown(int key);
     void            setKeyUp(int key);
@@ -31,8 +80,32 @@ public:
     void            writeWord(uint16_t addr, uint16_t word, uint16_t pc);
     void            registerVIC(VICII *vicPtr);
     void            registerIO(IOController *ioPtr);
+    void            registerSID(SID *sidPtr);
+    void            attachCartridge(Cartridge *cart); // 0 to remove it
+    void            attachReu(Reu *reu);              // at $DF00, ahead of the cartridge
+
+    Scheduler&      getScheduler();
+    InterruptLines& getInterrupts();
+    bool            consumeStateChanged();
+
+    void            addWatchpoint(uint16_t addr, uint8_t type);
+    void            removeWatchpoint(uint16_t addr, uint8_t type);
+    uint8_t         getWatchpoint(uint16_t addr) const;
+    bool            hasWatchpoints() const;
+    uint8_t         consumeWatchHit(uint16_t& addr);
+
+    bool            isRomMapped(uint16_t addr) const;
+    uint8_t         readRom(uint16_t addr) const;    // BASIC or KERNAL byte, even if banked out
+    const uint8_t*  getRam() const;
+    const uint8_t*  readablePage(uint8_t page) const; // the RAM of a page reads see unchanged, else 0
+    uint8_t*        writablePage(uint8_t page);       // the RAM of a page writes only store to, else 0
+    void            saveRam(uint8_t *ram) const;
+    void            loadRam(const uint8_t *ram);
+    void            saveState(MemoryControllerState& state) const;
+    void            loadState(const MemoryControllerState& state);
 
-    MemoryController(uint8_t *rom);
+    MemoryController(const uint8_t *basic, const uint8_t *kernal, uint8_t *ram);
+    ~MemoryController();
 };
 } // namespace MOS6510
 
@@ -0,0 +1,375 @@
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <iostream>
+#include <sstream>
+#include "monitorserver.h"
+
+namespace MOS6510 {
+
+const uint32_t MAX_DUMP_BYTES = 4096;
+const int HALTED_POLL_MS = 100;
+const int SEND_STALLED_POLLS = 20;  // a client that reads nothing for this long is dropped
+
+static uint16_t parseNumber(const std::string& str)
+{
+    // VICE style $hex, 0x hex, or plain hex like the VICE monitor defaults to
+    const char *s = str.c_str();
+    if('$' == s[0]) {
+        ++s;
+    } else if('0' == s[0] && ('x' == s[1] || 'X' == s[1])) {
+        s += 2;
+    }
+
+    return (uint16_t)strtoul(s, 0, 16);
+}
+
+static void setNonBlocking(int fd)
+{
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+}
+
+MonitorServer::MonitorServer(Cpu& cpu, MemoryController& memory)
+    : m_cpu(cpu)
+    , m_memory(memory)
+    , m_listenFd(-1)
+    , m_clientFd(-1)
+    , m_halted(false)
+    , m_haltRequested(false)
+{
+}
+
+MonitorServer::~MonitorServer()
+{
+    closeClient();
+    if(0 <= m_listenFd) {
+        close(m_listenFd);
+    }
+}
+
+bool MonitorServer::open(uint16_t port)
+{
+    m_listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    if(0 > m_listenFd) {
+        std::cerr << "Failed to create monitor socket: " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    int reuse = 1;
+    setsockopt(m_listenFd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    if(0 > bind(m_listenFd, (struct sockaddr*)&addr, sizeof(addr)) || 0 > listen(m_listenFd, 1)) {
+        std::cerr << "Failed to listen on monitor port " << port << ": " << strerror(errno) << std::endl;
+        close(m_listenFd);
+        m_listenFd = -1;
+        return false;
+    }
+
+    setNonBlocking(m_listenFd);
+    printf("Monitor listening on 127.0.0.1:%u\n", port);
+    return true;
+}
+
+void MonitorServer::poll()
+{
+    if(0 > m_clientFd) {
+        acceptClient();
+    }
+
+    if(0 <= m_clientFd) {
+        readClient();
+    }
+}
+
+void MonitorServer::onFrame(uint32_t, const uint8_t *, const uint32_t *)
+{
+    poll();
+}
+
+void MonitorServer::onBreak(BreakReason reason, uint16_t addr)
+{
+    if(0 > m_clientFd) {
+        poll(); // a client may have connected since the last frame
+        if(0 > m_clientFd) {
+            return; // nobody to hand control to, keep running
+        }
+    }
+
+    static const char *reasons[] = { "halt", "exec", "step", "load", "store" };
+    char msg[64];
+    if(m_haltRequested && BREAK_STEP == reason) {
+        reason = BREAK_PAUSE;
+    }
+    snprintf(msg, sizeof(msg), "#stop (Stop on %s %04x)\n", reasons[reason], addr);
+    m_haltRequested = false;
+    send(msg);
+    prompt();
+
+    m_halted = true;
+    while(m_halted && 0 <= m_clientFd) {
+        struct pollfd pfd;
+        pfd.fd = m_clientFd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        ::poll(&pfd, 1, HALTED_POLL_MS);
+        readClient();
+    }
+    m_halted = false;
+}
+
+void MonitorServer::acceptClient()
+{
+    if(0 > m_listenFd) {
+        return;
+    }
+
+    int fd = accept(m_listenFd, 0, 0);
+    if(0 > fd) {
+        return;
+    }
+
+    m_clientFd = fd;
+    setNonBlocking(m_clientFd);
+    m_input.clear();
+    prompt();
+}
+
+void MonitorServer::readClient()
+{
+    char buf[512];
+    for(;;) {
+        ssize_t len = recv(m_clientFd, buf, sizeof(buf), 0);
+        if(0 < len) {
+            m_input.append(buf, len);
+        } else if(0 == len || (EAGAIN != errno && EWOULDBLOCK != errno && EINTR != errno)) {
+            closeClient();
+            return;
+        } else {
+            break;
+        }
+    }
+
+    size_t pos;
+    while(0 <= m_clientFd && std::string::npos != (pos = m_input.find('\n'))) {
+        std::string line = m_input.substr(0, pos);
+        m_input.erase(0, pos + 1);
+        if(!line.empty() && '\r' == line[line.size() - 1]) {
+            line.erase(line.size() - 1);
+        }
+        handleLine(line);
+    }
+}
+
+void MonitorServer::closeClient()
+{
+    if(0 <= m_clientFd) {
+        close(m_clientFd);
+        m_clientFd = -1;
+    }
+    m_halted = false;
+}
+
+void MonitorServer::send(const std::string& text)
+{
+    size_t offset = 0;
+    int stalled = 0;
+    while(0 <= m_clientFd && offset < text.size()) {
+        ssize_t len = ::send(m_clientFd, text.data() + offset, text.size() - offset, MSG_NOSIGNAL);
+        if(0 < len) {
+            offset += len;
+            stalled = 0;
+        } else if(0 > len && (EAGAIN == errno || EWOULDBLOCK == errno) && SEND_STALLED_POLLS > stalled++) {
+            struct pollfd pfd;
+            pfd.fd = m_clientFd;
+            pfd.events = POLLOUT;
+            pfd.revents = 0;
+            ::poll(&pfd, 1, HALTED_POLL_MS);
+        } else {
+            closeClient();
+        }
+    }
+}
+
+void MonitorServer::prompt()
+{
+    char buf[16];
+    snprintf(buf, sizeof(buf), "(C:$%04x) ", m_cpu.getRegisters().pc);
+    send(buf);
+}
+
+void MonitorServer::printRegisters()
+{
+    CpuRegisters regs = m_cpu.getRegisters();
+    char buf[96];
+    snprintf(buf, sizeof(buf),
+            "  ADDR A  X  Y  SP NV-BDIZC\n.;%04x %02x %02x %02x %02x %c%c%c%c%c%c%c%c\n",
+            regs.pc, regs.a, regs.x, regs.y, regs.sp,
+            (regs.p & 0x80) ? '1' : '0', (regs.p & 0x40) ? '1' : '0',
+            (regs.p & 0x20) ? '1' : '0', (regs.p & 0x10) ? '1' : '0',
+            (regs.p & 0x08) ? '1' : '0', (regs.p & 0x04) ? '1' : '0',
+            (regs.p & 0x02) ? '1' : '0', (regs.p & 0x01) ? '1' : '0');
+    send(buf);
+}
+
+// r PC=e000 A=01 ...
+bool MonitorServer::setRegisters(const std::vector<std::string>& args)
+{
+    CpuRegisters regs = m_cpu.getRegisters();
+    for(size_t i = 1; i < args.size(); ++i) {
+        size_t eq = args[i].find('=');
+        if(std::string::npos == eq) {
+            return false;
+        }
+
+        std::string reg = args[i].substr(0, eq);
+        uint16_t value = parseNumber(args[i].substr(eq + 1));
+        if("PC" == reg || "pc" == reg) {
+            regs.pc = value;
+        } else if("A" == reg || "a" == reg) {
+            regs.a = value;
+        } else if("X" == reg || "x" == reg) {
+            regs.x = value;
+        } else if("Y" == reg || "y" == reg) {
+            regs.y = value;
+        } else if("SP" == reg || "sp" == reg) {
+            regs.sp = value;
+        } else if("P" == reg || "p" == reg) {
+            regs.p = value;
+        } else {
+            return false;
+        }
+    }
+
+    m_cpu.setRegisters(regs);
+    return true;
+}
+
+void MonitorServer::dumpMemory(uint16_t start, uint16_t end)
+{
+    uint32_t last = (end < start) ? start : end;
+    if(last - start >= MAX_DUMP_BYTES) {
+        last = start + MAX_DUMP_BYTES - 1;
+    }
+
+    std::string out;
+    char buf[16];
+    for(uint32_t addr = start; addr <= last; ++addr) {
+        if(addr == start || 0 == ((addr - start) % 16)) {
+            if(addr != start) {
+                out += "\n";
+            }
+            snprintf(buf, sizeof(buf), ">C:%04x ", addr & 0xFFFF);
+            out += buf;
+        }
+        snprintf(buf, sizeof(buf), " %02x", m_memory.peek(addr & 0xFFFF));
+        out += buf;
+    }
+
+    out += "\n";
+    send(out);
+}
+
+void MonitorServer::handleLine(const std::string& line)
+{
+    std::stringstream ss(line);
+    std::vector<std::string> args;
+    std::string token;
+    while(ss >> token) {
+        args.push_back(token);
+    }
+
+    if(args.empty()) {
+        prompt();
+        return;
+    }
+
+    const std::string& cmd = args[0];
+    bool ok = true;
+    if("r" == cmd || "registers" == cmd) {
+        ok = (1 == args.size()) || setRegisters(args);
+        if(ok) {
+            printRegisters();
+        }
+    } else if("m" == cmd || "mem" == cmd) {
+        if(2 > args.size()) {
+            ok = false;
+        } else {
+            uint16_t start = parseNumber(args[1]);
+            dumpMemory(start, (2 < args.size()) ? parseNumber(args[2]) : start + 0x3F);
+        }
+    } else if(">" == cmd) {
+        if(3 > args.size()) {
+            ok = false;
+        } else {
+            uint16_t addr = parseNumber(args[1]);
+            for(size_t i = 2; i < args.size(); ++i) {
+                m_memory.write(addr++, parseNumber(args[i]) & 0xFF, 0);
+            }
+        }
+    } else if("break" == cmd || "bk" == cmd) {
+        if(2 > args.size()) {
+            ok = false;
+        } else if(6 == args.size() && "if" == args[2]) {
+            BreakCondition cond;
+            ok = parseBreakCondition(args, 3, cond);
+            if(ok) {
+                m_cpu.addBreakpoint(parseNumber(args[1]), cond);
+            }
+        } else {
+            m_cpu.addBreakpoint(parseNumber(args[1]));
+        }
+    } else if("delete" == cmd || "del" == cmd) {
+        ok = (2 <= args.size());
+        if(ok) {
+            uint16_t addr = parseNumber(args[1]);
+            m_cpu.removeBreakpoint(addr);
+            m_cpu.removeWatchpoint(addr, WATCH_READ | WATCH_WRITE);
+        }
+    } else if("watch" == cmd || "w" == cmd) {
+        ok = (3 <= args.size()) && ("load" == args[1] || "store" == args[1]);
+        if(ok) {
+            m_cpu.addWatchpoint(parseNumber(args[2]), ("load" == args[1]) ? WATCH_READ : WATCH_WRITE);
+        }
+    } else if("z" == cmd || "step" == cmd) {
+        m_cpu.step((2 <= args.size()) ? parseNumber(args[1]) : 1);
+        m_halted = false;
+        return; // the prompt follows the stop message
+    } else if("halt" == cmd) {
+        if(!m_halted) {
+            m_haltRequested = true;
+            m_cpu.step(1);
+            return;
+        }
+    } else if("g" == cmd || "goto" == cmd || "x" == cmd) {
+        if("x" != cmd && 2 <= args.size()) {
+            CpuRegisters regs = m_cpu.getRegisters();
+            regs.pc = parseNumber(args[1]);
+            m_cpu.setRegisters(regs);
+        }
+        m_halted = false;
+        return;
+    } else if("quit" == cmd) {
+        closeClient();
+        return;
+    } else {
+        ok = false;
+    }
+
+    if(!ok) {
+        send("error: bad command\n");
+    }
+    prompt();
+}
+
+}
@@ -0,0 +1,49 @@
+#ifndef INCLUDED_MONITOR_SERVER_H
+#define INCLUDED_MONITOR_SERVER_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "framesink.h"
+#include "mos6510.h"
+
+namespace MOS6510 {
+
+// Remote monitor on a loopback TCP port, speaking a line based subset of
+// the VICE text monitor (r, m, >, break, delete, watch, z, g, x). While the
+// machine runs, input is only looked at once per frame; once stopped, the
+// emulation thread waits here for commands until told to continue.
+class MonitorServer : public FrameSink, public BreakHandler {
+private:
+    Cpu&                m_cpu;
+    MemoryController&   m_memory;
+    int                 m_listenFd;
+    int                 m_clientFd;
+    std::string         m_input;
+    bool                m_halted;
+    bool                m_haltRequested;
+
+    void acceptClient();
+    void readClient();
+    void closeClient();
+    void send(const std::string& text);
+    void prompt();
+    void handleLine(const std::string& line);
+    void dumpMemory(uint16_t start, uint16_t end);
+    void printRegisters();
+    bool setRegisters(const std::vector<std::string>& args);
+
+public:
+    MonitorServer(Cpu& cpu, MemoryController& memory);
+    virtual ~MonitorServer();
+
+    bool open(uint16_t port);
+    void poll();
+
+    virtual void onFrame(uint32_t frame, const uint8_t *indices, const uint32_t *palette);
+    virtual void onBreak(BreakReason reason, uint16_t addr);
+};
+
+}
+
+#endif
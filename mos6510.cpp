@@ -5,8 +5,9 @@
 #include <iomanip>
 #include <assert.h>
 #include <stdio.h>
-#include <SDL2/SDL.h>
+#include <string.h>
 #include "mos6510.h"
+#include "hletraps.h"
 
 namespace MOS6510 {
 
@@ -23,6 +24,97 @@ const char cgromLookup[] =
       '~', '~', '~', '~', '~', '~', '~', '~', '~', '~', '~', '~',
       '~', '~', '~', '~', '~', '~', '~', '~' };
 
+// N, Z, C and V are evaluated lazily: instructions only record the result
+// byte and the carry/overflow bits, P is assembled when something reads it.
+const uint8_t LAZY_FLAG_MASK = 0xC3;
+
+const uint16_t NMI_VECTOR = 0xFFFA;
+const uint16_t IRQ_VECTOR = 0xFFFE;
+
+// backward jumps no longer than this are checked for idle loops
+const uint16_t IDLE_LOOP_SPAN = 32;
+
+// NMOS cycles per opcode in the low nibble, PAGE_PENALTY set on the reads
+// that take one more when indexing crosses a page; taken branches are
+// counted in br()
+const uint8_t PAGE_PENALTY = 0x10;
+static const uint8_t CYCLES[256] = {
+       7,    6,    2,    8,    3,    3,    5,    5,    3,    2,    2,    2,    4,    4,    6,    6,
+       2, 0x15,    2,    8,    4,    4,    6,    6,    2, 0x14,    2,    7, 0x14, 0x14,    7,    7,
+       6,    6,    2,    8,    3,    3,    5,    5,    4,    2,    2,    2,    4,    4,    6,    6,
+       2, 0x15,    2,    8,    4,    4,    6,    6,    2, 0x14,    2,    7, 0x14, 0x14,    7,    7,
+       6,    6,    2,    8,    3,    3,    5,    5,    3,    2,    2,    2,    3,    4,    6,    6,
+       2, 0x15,    2,    8,    4,    4,    6,    6,    2, 0x14,    2,    7, 0x14, 0x14,    7,    7,
+       6,    6,    2,    8,    3,    3,    5,    5,    4,    2,    2,    2,    5,    4,    6,    6,
+       2, 0x15,    2,    8,    4,    4,    6,    6,    2, 0x14,    2,    7, 0x14, 0x14,    7,    7,
+       2,    6,    2,    6,    3,    3,    3,    3,    2,    2,    2,    2,    4,    4,    4,    4,
+       2,    6,    2,    6,    4,    4,    4,    4,    2,    5,    2,    5,    5,    5,    5,    5,
+       2,    6,    2,    6,    3,    3,    3,    3,    2,    2,    2,    2,    4,    4,    4,    4,
+       2, 0x15,    2, 0x15,    4,    4,    4,    4,    2, 0x14,    2, 0x14, 0x14, 0x14, 0x14, 0x14,
+       2,    6,    2,    8,    3,    3,    5,    5,    2,    2,    2,    2,    4,    4,    6,    6,
+       2, 0x15,    2,    8,    4,    4,    6,    6,    2, 0x14,    2,    7, 0x14, 0x14,    7,    7,
+       2,    6,    2,    8,    3,    3,    5,    5,    2,    2,    2,    2,    4,    4,    6,    6,
+       2, 0x15,    2,    8,    4,    4,    6,    6,    2, 0x14,    2,    7, 0x14, 0x14,    7,    7
+};
+const uint32_t INTERRUPT_CYCLES = 7;
+
+inline void Cpu::setNZ(uint8_t value)
+{
+    m_nResult = value;
+    m_zResult = value;
+#ifdef MOS6510_LOCKSTEP_FLAGS
+    m_eagerStatus.bits.negativeFlag = (value & 0x80) > 0;
+    m_eagerStatus.bits.zeroFlag = (0 == value);
+#endif
+}
+
+inline void Cpu::setNZ(uint8_t nValue, uint8_t zValue)
+{
+    m_nResult = nValue;
+    m_zResult = zValue;
+#ifdef MOS6510_LOCKSTEP_FLAGS
+    m_eagerStatus.bits.negativeFlag = (nValue & 0x80) > 0;
+    m_eagerStatus.bits.zeroFlag = (0 == zValue);
+#endif
+}
+
+inline void Cpu::setCarry(uint8_t carry)
+{
+    m_carry = carry;
+#ifdef MOS6510_LOCKSTEP_FLAGS
+    m_eagerStatus.bits.carryFlag = carry;
+#endif
+}
+
+inline void Cpu::setOverflow(uint8_t overflow)
+{
+    m_overflow = overflow;
+#ifdef MOS6510_LOCKSTEP_FLAGS
+    m_eagerStatus.bits.overflowFlag = overflow;
+#endif
+}
+
+uint8_t Cpu::getStatus() const
+{
+    return (m_status.all & ~LAZY_FLAG_MASK)
+        | (m_nResult & 0x80)
+        | (m_overflow << 6)
+        | ((0 == m_zResult) << 1)
+        | m_carry;
+}
+
+void Cpu::setStatus(uint8_t status)
+{
+    m_status.all = status;
+    m_nResult = status & 0x80;
+    m_zResult = (status & 0x02) ? 0 : 1;
+    m_carry = status & 0x01;
+    m_overflow = (status >> 6) & 0x01;
+#ifdef MOS6510_LOCKSTEP_FLAGS
+    m_eagerStatus.all = status;
+#endif
+}
+
 void Cpu::debugPrompt()
 {
     bool promptActive = true;
@@ -46,8 +138,8 @@ void Cpu::debugPrompt()
                 return;
             }
 
-            std::map<std::string, Cpu::cmdFunc>::iterator it = m_cmdMap.find(args[0]);
-            if(m_cmdMap.cend() != it) {
+            CommandMap::const_iterator it = commands().find(args[0]);
+            if(commands().end() != it) {
                 cmdFunc fn = it->second;
                 promptActive = (this->*fn)(args);
             } else {
@@ -144,16 +236,60 @@ bool Cpu::dbgStep(const std::vector<std::string>& args)
     return false;
 }
 
+static const char* conditionOps[] = { "==", "!=", "<", ">", "<=", ">=", "&" };
+static const char* conditionRegs[] = { "A", "X", "Y", "SP", "P" };
+
+bool parseBreakCondition(const std::vector<std::string>& args, size_t first, BreakCondition& cond)
+{
+    const std::string& lhs = args[first];
+    cond.address = 0;
+    if(2 < lhs.size() && '[' == lhs[0] && ']' == lhs[lhs.size() - 1]) {
+        cond.operand = COND_MEMORY;
+        cond.address = parseString(lhs.substr(1, lhs.size() - 2));
+    } else {
+        size_t idx = 0;
+        while(idx < 5 && lhs != conditionRegs[idx]) {
+            ++idx;
+        }
+        if(5 == idx) {
+            return false;
+        }
+        cond.operand = (ConditionOperand)idx;
+    }
+
+    size_t op = 0;
+    while(op < 7 && args[first + 1] != conditionOps[op]) {
+        ++op;
+    }
+    if(7 == op) {
+        return false;
+    }
+
+    cond.op = (ConditionOp)op;
+    cond.value = parseString(args[first + 2]);
+    return true;
+}
+
 bool Cpu::dbgBrka(const std::vector<std::string>& args)
 {
     uint16_t addr = 0;
     if(2 > args.size()) {
-        std::cout << "brka <address>" << std::endl;
+        std::cout << "brka <address> [<A|X|Y|SP|P|[address]> <==|!=|<|>|<=|>=|&> <value>]" << std::endl;
+        return true;
     } else {
         addr = parseString(args[1]);
     }
 
-    addBreakpoint(addr);
+    if(5 == args.size()) {
+        BreakCondition cond;
+        if(!parseBreakCondition(args, 2, cond)) {
+            std::cout << "Invalid condition." << std::endl;
+            return true;
+        }
+        addBreakpoint(addr, cond);
+    } else {
+        addBreakpoint(addr);
+    }
 
     return true; // stay in debug
 }
@@ -174,9 +310,101 @@ bool Cpu::dbgBrkd(const std::vector<std::string>& args)
 
 bool Cpu::dbgLsbp(const std::vector<std::string>& args)
 {
-    std::set<uint16_t>::const_iterator it = m_breakpointSet.cbegin();
-    for(int idx = 0; it != m_breakpointSet.cend(); ++it, ++idx) {
-        printf("%d: 0x%04X\n", idx, *it);
+    int idx = 0;
+    for(uint32_t addr = 0; addr < 0x10000 && m_breakpoints && m_breakpoints->addresses.count(); ++addr) {
+        if(!m_breakpoints->addresses.test(addr)) {
+            continue;
+        }
+
+        std::map<uint16_t, BreakCondition>::const_iterator it = m_breakpoints->conditions.find(addr);
+        if(m_breakpoints->conditions.end() == it) {
+            printf("%d: 0x%04X\n", idx++, addr);
+        } else if(COND_MEMORY == it->second.operand) {
+            printf("%d: 0x%04X if [0x%04X] %s 0x%02X\n", idx++, addr, it->second.address,
+                    conditionOps[it->second.op], it->second.value);
+        } else {
+            printf("%d: 0x%04X if %s %s 0x%02X\n", idx++, addr, conditionRegs[it->second.operand],
+                    conditionOps[it->second.op], it->second.value);
+        }
+    }
+
+    return true; // stay in debug
+}
+
+bool Cpu::dbgWatr(const std::vector<std::string>& args)
+{
+    if(2 > args.size()) {
+        std::cout << args[0] << " <address>" << std::endl;
+    } else {
+        addWatchpoint(parseString(args[1]), WATCH_READ);
+    }
+
+    return true; // stay in debug
+}
+
+bool Cpu::dbgWatw(const std::vector<std::string>& args)
+{
+    if(2 > args.size()) {
+        std::cout << args[0] << " <address>" << std::endl;
+    } else {
+        addWatchpoint(parseString(args[1]), WATCH_WRITE);
+    }
+
+    return true; // stay in debug
+}
+
+bool Cpu::dbgWatd(const std::vector<std::string>& args)
+{
+    if(2 > args.size()) {
+        std::cout << args[0] << " <address>" << std::endl;
+    } else {
+        removeWatchpoint(parseString(args[1]), WATCH_READ | WATCH_WRITE);
+    }
+
+    return true; // stay in debug
+}
+
+bool Cpu::dbgLswp(const std::vector<std::string>& args)
+{
+    int idx = 0;
+    for(uint32_t addr = 0; addr < 0x10000 && m_memory.hasWatchpoints(); ++addr) {
+        uint8_t type = m_memory.getWatchpoint(addr);
+        if(type) {
+            printf("%d: 0x%04X %c%c\n", idx++, addr,
+                    (WATCH_READ & type) ? 'R' : '.',
+                    (WATCH_WRITE & type) ? 'W' : '.');
+        }
+    }
+
+    return true; // stay in debug
+}
+
+bool Cpu::dbgTrac(const std::vector<std::string>& args)
+{
+    if(2 > args.size()) {
+        setTrace(!m_trace);
+    } else {
+        setTrace("on" == args[1]);
+    }
+
+    printf("Trace %s\n", m_trace ? "on" : "off");
+    return true; // stay in debug
+}
+
+bool Cpu::dbgProf(const std::vector<std::string>& args)
+{
+    if(!m_profiler) {
+        std::cout << "Profiler not enabled, start with --profile <file>." << std::endl;
+    } else if(2 <= args.size() && "reset" == args[1]) {
+        m_profiler->reset();
+    } else if(2 <= args.size() && "dump" == args[1]) {
+        if(3 > args.size()) {
+            std::cout << "prof dump <file>" << std::endl;
+        } else {
+            m_profiler->writeFolded(args[2]);
+        }
+    } else {
+        m_profiler->printTop((2 <= args.size()) ? parseString(args[1]) : 20);
     }
 
     return true; // stay in debug
@@ -184,13 +412,13 @@ bool Cpu::dbgLsbp(const std::vector<std::string>& args)
 
 bool Cpu::dbgSeti(const std::vector<std::string>& args)
 {
-    m_pendingIrq = true;
+    m_interrupts.raise(IRQ_DEBUG);
     return true; // stay in debug
 }
 
 bool Cpu::dbgClri(const std::vector<std::string>& args)
 {
-    m_pendingIrq = false;
+    m_interrupts.release(IRQ_DEBUG);
     return true; // stay in debug
 }
 
@@ -219,46 +447,73 @@ bool Cpu::dbgSreg(const std::vector<std::string>& args)
         return true;
     }
 
-    m_status.bits.negativeFlag = (value & 0x80) > 0;
-    m_status.bits.zeroFlag = (0 == value);
-    *regptr = value;
+    if(&m_status.all == regptr) {
+        setStatus(value);
+    } else {
+        setNZ(value);
+        *regptr = value;
+    }
 
     return true; // stay in debug
 }
 
-void Cpu::execute(bool debugBreak)
+template <class Config>
+uint32_t Cpu::execute(bool debugBreak)
 {
-    if (0 == m_status.bits.interruptDisableFlag && m_pendingIrq) {
-        isr();
+    m_cycles = 0;
+    if(m_interrupts.pending()) {
+        if(PENDING_NMI & m_interrupts.pending()) {
+            m_interrupts.acknowledgeNmi();
+            interrupt(NMI_VECTOR, false);
+            m_cycles = INTERRUPT_CYCLES;
+        } else if(0 == m_status.bits.interruptDisableFlag) {
+            interrupt(IRQ_VECTOR, false);
+            m_cycles = INTERRUPT_CYCLES;
+        }
     }
 
     uint16_t programCounter = m_programCounter;
     uint8_t opcode = m_memory.read(programCounter);
 
-    if(m_debugMode || debugBreak || m_stepping) {
+    if(Config::INSTRUMENTED && (m_debugMode || debugBreak || m_stepping)) {
         if(m_stepCount) {
             --m_stepCount;
         }
 
         if(debugBreak) { 
-            printf(">>>>>>>>>> CPU paused at 0x%04X <<<<<<<<<<\n", programCounter);
-            debugPrompt();
-        } else if(m_breakpointSet.end() != m_breakpointSet.find(programCounter)) {
-            printf(">>>>>>>>>> Hit breakpoint at 0x%04X <<<<<<<<<<\n", programCounter);
-            debugPrompt();
+            enterDebugger(BREAK_PAUSE, programCounter);
+        } else if(m_breakpoints && m_breakpoints->addresses.test(programCounter) && checkCondition(programCounter)) {
+            enterDebugger(BREAK_BREAKPOINT, programCounter);
         } else if(m_stepping) {
             if(!m_stepCount) {
-                printf(">>>>>>>>>> Finished step count at 0x%04X <<<<<<<<<<\n", programCounter);
-                debugPrompt();
+                enterDebugger(BREAK_STEP, programCounter);
             }
         }
 
         if(m_stepping && !m_stepCount) {
             m_stepping = false; // we clear this late in case of coincident breakpoint and step count end
         }
+
+        // the debugger may have changed the PC or the code under it
+        programCounter = m_programCounter;
+        opcode = m_memory.read(programCounter);
+
+        uint16_t watchAddr;
+        m_memory.consumeWatchHit(watchAddr); // forget accesses made by other chips
+    }
+
+    if(m_traps && m_traps->test(programCounter)) {
+        uint32_t ticks = runTrap(programCounter);
+        if(ticks) {
+            if(Config::INSTRUMENTED && m_profiler) {
+                m_profiler->account(ticks);
+            }
+            m_memory.getScheduler().tick(ticks, m_cycles);
+            return ticks;
+        }
     }
 
-    std::string ocs = "";
+    const char *ocs = "";
     switch (opcode) {
         case ADC_abs: ocs = "ADC_abs"; adc(AddrMode::ABS);                break;
         case ADC_abx: ocs = "ADC_abx"; adc(AddrMode::ABX);                break;
@@ -288,17 +543,17 @@ void Cpu::execute(bool debugBreak)
         case ASL_zp:  ocs = "ASL_zp";  asl(AddrMode::ZP);                 break;
         case ASL_zpx: ocs = "ASL_zpx"; asl(AddrMode::ZPX);                break;
         case AXS_imm: ocs = "AXS_imm"; break;
-        case BCC_rel: ocs = "BCC_rel"; br(m_status.bits.carryFlag, 0);    break;
-        case BCS_rel: ocs = "BCS_rel"; br(m_status.bits.carryFlag, 1);    break;
-        case BEQ_rel: ocs = "BEQ_rel"; br(m_status.bits.zeroFlag, 1);     break;
+        case BCC_rel: ocs = "BCC_rel"; br(m_carry, 0);                    break;
+        case BCS_rel: ocs = "BCS_rel"; br(m_carry, 1);                    break;
+        case BEQ_rel: ocs = "BEQ_rel"; br(0 == m_zResult, 1);             break;
         case BIT_abs: ocs = "BIT_abs"; bit(AddrMode::ABS);                break;
         case BIT_zp:  ocs = "BIT_zp";  bit(AddrMode::ZP);                 break;
-        case BMI_rel: ocs = "BMI_rel"; br(m_status.bits.negativeFlag, 1); break;
-        case BNE_rel: ocs = "BNE_rel"; br(m_status.bits.zeroFlag, 0);     break;
-        case BPL_rel: ocs = "BPL_rel"; br(m_status.bits.negativeFlag, 0); break;
-        case BRK:     ocs = "BRK"; break;
-        case BVC_rel: ocs = "BVC_rel"; br(m_status.bits.overflowFlag, 0); break;
-        case BVS_rel: ocs = "BVS_rel"; br(m_status.bits.overflowFlag, 1); break;
+        case BMI_rel: ocs = "BMI_rel"; br(m_nResult >> 7, 1);             break;
+        case BNE_rel: ocs = "BNE_rel"; br(0 == m_zResult, 0);             break;
+        case BPL_rel: ocs = "BPL_rel"; br(m_nResult >> 7, 0);             break;
+        case BRK:     ocs = "BRK";     brk();                             break;
+        case BVC_rel: ocs = "BVC_rel"; br(m_overflow, 0);                 break;
+        case BVS_rel: ocs = "BVS_rel"; br(m_overflow, 1);                 break;
         case CLC:     ocs = "CLC";     clc();                             break;
         case CLD:     ocs = "CLD";     cld();                             break;
         case CLI:     ocs = "CLI";     cli();                             break;
@@ -519,21 +774,27 @@ void Cpu::execute(bool debugBreak)
         default: ocs = "unknown"; break;
     }
 
-    if(m_debugMode || debugBreak || m_stepping) {
+#ifdef MOS6510_LOCKSTEP_FLAGS
+    assert(0 == ((getStatus() ^ m_eagerStatus.all) & LAZY_FLAG_MASK));
+#endif
+
+    if(Config::INSTRUMENTED && (m_trace || m_stepping || debugBreak)) {
+        StatusRegister p;
+        p.all = getStatus();
         char status[11];
         snprintf(status, sizeof(status), "S:%c%c%c%c%c%c%c%c",
-                m_status.bits.carryFlag             ? 'C' : '.',
-                m_status.bits.zeroFlag              ? 'Z' : '.',
-                m_status.bits.interruptDisableFlag  ? 'I' : '.',
-                m_status.bits.decimalModeFlag       ? 'D' : '.',
-                m_status.bits.breakFlag             ? 'B' : '.',
-                m_status.bits.unusedFlag            ? '.' : '.',
-                m_status.bits.overflowFlag          ? 'O' : '.',
-                m_status.bits.negativeFlag          ? 'N' : '.');
+                p.bits.carryFlag             ? 'C' : '.',
+                p.bits.zeroFlag              ? 'Z' : '.',
+                p.bits.interruptDisableFlag  ? 'I' : '.',
+                p.bits.decimalModeFlag       ? 'D' : '.',
+                p.bits.breakFlag             ? 'B' : '.',
+                p.bits.unusedFlag            ? '.' : '.',
+                p.bits.overflowFlag          ? 'O' : '.',
+                p.bits.negativeFlag          ? 'N' : '.');
 
         printf("PC:0x%04X, OP:%7s, NEW PC:0x%04X, A:0x%02X, X:0x%02X, Y:0x%02X, %s, SP:0x%03X\n",
                 programCounter,
-                ocs.c_str(),
+                ocs,
                 m_programCounter,
                 m_accumulator,
                 m_xIndex,
@@ -544,28 +805,115 @@ void Cpu::execute(bool debugBreak)
         assert(programCounter != m_programCounter); // if these are equal we did nothing
     }
 
-    ++m_videoTimer;
-    if(34100 < m_videoTimer) { // roughly the ratio of system clock to framerate
-        m_videoTimer = 0;
-        m_pendingIrq = true;
+    if(Config::INSTRUMENTED && m_debugMode) {
+        uint16_t watchAddr;
+        uint8_t hit = m_memory.consumeWatchHit(watchAddr);
+        if(hit) {
+            enterDebugger((WATCH_WRITE == hit) ? BREAK_WRITE_WATCH : BREAK_READ_WATCH, watchAddr);
+        }
+    }
+
+    m_cycles += CYCLES[opcode] & 0x0F;
+    if(PAGE_PENALTY & CYCLES[opcode]) {
+        m_cycles += m_pageCrossed;
     }
+
+    uint32_t ticks = 1;
+    ++m_idleCount;
+    m_idleCycleCount += m_cycles;
+    if(m_programCounter <= programCounter && IDLE_LOOP_SPAN >= (programCounter - m_programCounter)
+            && m_idleSkip && !(Config::INSTRUMENTED && (m_debugMode || debugBreak || m_stepping))) {
+        ticks += skipIdleLoop();
+    }
+    uint32_t stall = m_memory.getScheduler().consumeStall(); // halted while a DMA transfer ran
+    ticks += stall;
+    m_cycles += stall;
+
+    if(Config::INSTRUMENTED && m_profiler) {
+        m_profiler->account(ticks);
+    }
+
+    m_memory.getScheduler().tick(ticks, m_cycles);
+    if(m_traps && m_traps->verifyPending() && m_programCounter == m_traps->verifyReturn()) {
+        m_traps->finishVerify(getRegisters());
+    }
+    return ticks;
+}
+
+template uint32_t Cpu::execute<PalConfig>(bool debugBreak);
+template uint32_t Cpu::execute<PalDebugConfig>(bool debugBreak);
+template uint32_t Cpu::execute<NtscConfig>(bool debugBreak);
+template uint32_t Cpu::execute<NtscDebugConfig>(bool debugBreak);
+
+// Runs a native replacement of the ROM routine at addr, including its RTS.
+// Returns 0 if the trap declined and the routine has to be interpreted.
+uint32_t Cpu::runTrap(uint16_t addr)
+{
+    if(m_stepping || !m_memory.isRomMapped(addr)) {
+        return 0;
+    }
+
+    CpuRegisters regs = getRegisters();
+    uint32_t cycles = 0;
+    uint32_t ticks = m_traps->run(addr, regs, cycles);
+    if(ticks) {
+        setRegisters(regs);
+        rts();
+        m_cycles += cycles;
+    }
+
+    return ticks;
+}
+
+// Called whenever a short backward jump lands on m_programCounter. If the
+// previous pass through the loop left registers and memory exactly as they
+// were, nothing but an external event can make the next pass differ, so
+// whole passes are skipped up to just before the next scheduled event.
+uint32_t Cpu::skipIdleLoop()
+{
+    uint8_t state[6] = { m_accumulator, m_xIndex, m_yIndex,
+                         (uint8_t)(m_stackPointer & 0xFF), getStatus(),
+                         m_interrupts.pending() };
+    bool changed = m_memory.consumeStateChanged();
+    if(changed || m_programCounter != m_idleHead || 0 == m_idleLength
+            || 0 != memcmp(state, m_idleState, sizeof(state))) {
+        m_idleHead = m_programCounter;
+        m_idleLength = m_idleCount;
+        m_idleCount = 0;
+        m_idleCycleCount = 0;
+        memcpy(m_idleState, state, sizeof(state));
+        return 0;
+    }
+
+    m_idleLength = m_idleCount;
+    m_idleCount = 0;
+    m_idleCycles = m_idleCycleCount;
+    m_idleCycleCount = 0;
+
+    // leave a tick of slack so the event itself is seen by normal execution
+    uint64_t budget = m_memory.getScheduler().ticksUntilNextEvent();
+    if(2 >= budget) {
+        return 0;
+    }
+
+    uint64_t passes = (budget - 2) / m_idleLength;
+    m_cycles += (uint32_t)(passes * m_idleCycles);
+    return (uint32_t)(passes * m_idleLength);
 }
 
 void Cpu::adc(const AddrMode mode)
 {
     uint8_t op = m_memory.read(computeAddress(mode));
-    uint16_t result = ((uint16_t)m_accumulator) + op + m_status.bits.carryFlag;
-    m_status.bits.carryFlag = (result > 0xFF);
+    uint16_t result = ((uint16_t)m_accumulator) + op + m_carry;
+    setCarry(result > 0xFF);
     m_accumulator = result & 0xFF;
-    m_status.bits.negativeFlag = (m_accumulator & 0x80) > 0;
-    m_status.bits.zeroFlag = (0 == m_accumulator);
+    setNZ(m_accumulator);
 }
 
 void Cpu::andi(const AddrMode mode)
 {
     m_accumulator &= m_memory.read(computeAddress(mode));
-    m_status.bits.negativeFlag = (m_accumulator & 0x80) > 0;
-    m_status.bits.zeroFlag = (0 == m_accumulator);
+    setNZ(m_accumulator);
 }
 
 void Cpu::asl(const AddrMode mode)
@@ -581,9 +929,8 @@ void Cpu::asl(const AddrMode mode)
     
     bool newCarry = (tmp & 0x80) > 0;
     tmp <<= 1;
-    m_status.bits.negativeFlag = (tmp & 0x80) > 0;
-    m_status.bits.zeroFlag = (0 == tmp);
-    m_status.bits.carryFlag = newCarry;
+    setNZ(tmp);
+    setCarry(newCarry);
     if(AddrMode::IMP != mode) {
         m_memory.write(addr, tmp, m_programCounter);
     } else {
@@ -594,24 +941,31 @@ void Cpu::asl(const AddrMode mode)
 void Cpu::bit(const AddrMode mode)
 {
     uint8_t op = m_memory.read(computeAddress(mode));
-    m_status.bits.negativeFlag = (op & 0x80) > 0;
-    m_status.bits.overflowFlag = (op & 0x40) > 0;
-    m_status.bits.zeroFlag = (0 == (m_accumulator & op));
+    setNZ(op, m_accumulator & op);
+    setOverflow((op & 0x40) > 0);
 }
 
 void Cpu::br(uint8_t flag, uint8_t condition)
 {
     if(flag == condition) {
-        m_programCounter = computeAddress(AddrMode::REL);
+        uint16_t target = computeAddress(AddrMode::REL);
+        m_cycles += ((target ^ m_programCounter) & 0xFF00) ? 2 : 1; // taken, and to another page
+        m_programCounter = target;
     } else {
         m_programCounter += 2;
     }
 }
 
+void Cpu::brk()
+{
+    m_programCounter += 2; // BRK skips a padding byte
+    interrupt(IRQ_VECTOR, true);
+}
+
 void Cpu::clc()
 {
     ++m_programCounter;
-    m_status.bits.carryFlag = 0;
+    setCarry(0);
 }
 
 void Cpu::cld()
@@ -629,15 +983,14 @@ void Cpu::cli()
 void Cpu::clv()
 {
     ++m_programCounter;
-    m_status.bits.overflowFlag = 0;
+    setOverflow(0);
 }
 
 void Cpu::cmp(uint8_t r, const AddrMode mode)
 {
     uint8_t op = m_memory.read(computeAddress(mode));
-    m_status.bits.carryFlag = (op <= r);
-    m_status.bits.negativeFlag = ((r - op) & 0x80) > 0;
-    m_status.bits.zeroFlag = (op == r);
+    setCarry(op <= r);
+    setNZ(r - op);
 }
 
 void Cpu::dec(const AddrMode mode)
@@ -652,16 +1005,14 @@ void Cpu::dec(const AddrMode mode)
 void Cpu::der(uint8_t& r)
 {
     --r;
-    m_status.bits.negativeFlag = (r & 0x80) > 0;
-    m_status.bits.zeroFlag = (0 == r);
+    setNZ(r);
     ++m_programCounter;
 }
 
 void Cpu::eor(const AddrMode mode)
 {
     m_accumulator ^= m_memory.read(computeAddress(mode));
-    m_status.bits.negativeFlag = (m_accumulator & 0x80) > 0;
-    m_status.bits.zeroFlag = (0 == m_accumulator);
+    setNZ(m_accumulator);
 }
 
 void Cpu::inc(const AddrMode mode)
@@ -676,18 +1027,23 @@ void Cpu::inc(const AddrMode mode)
 void Cpu::inr(uint8_t& r)
 {
     ++r;
-    m_status.bits.negativeFlag = (r & 0x80) > 0;
-    m_status.bits.zeroFlag = (0 == r);
+    setNZ(r);
     ++m_programCounter;
 }
 
-void Cpu::isr()
+// B only exists in the copy of P pushed by BRK/PHP, it tells the IRQ handler
+// whether it was entered by hardware or software
+void Cpu::interrupt(uint16_t vector, bool software)
 {
-    m_pendingIrq = false;
+    m_idleLength = 0;
     m_memory.write(m_stackPointer--, ((m_programCounter >> 8) & 0xFF), m_programCounter);
     m_memory.write(m_stackPointer--, (m_programCounter & 0xFF), m_programCounter);
-    m_memory.write(m_stackPointer--, m_status.all, m_programCounter);
-    m_programCounter = m_memory.readWord(0xFFFE); // read the location of the main ISR from ROM
+    m_memory.write(m_stackPointer--, (getStatus() & ~0x10) | (software ? 0x30 : 0x20), m_programCounter);
+    m_status.bits.interruptDisableFlag = 1;
+    m_programCounter = m_memory.readWord(vector);
+    if(m_profiler) {
+        m_profiler->enter(m_programCounter, (m_stackPointer + 3) & 0xFF);
+    }
 }
 
 void Cpu::jmp(const AddrMode mode)
@@ -700,13 +1056,15 @@ void Cpu::jsr()
     m_memory.writeWord(m_stackPointer - 1, m_programCounter + 2, m_programCounter);
     m_stackPointer -= 2;
     m_programCounter = m_memory.readWord(++m_programCounter);
+    if(m_profiler) {
+        m_profiler->enter(m_programCounter, (m_stackPointer + 2) & 0xFF);
+    }
 }
 
 void Cpu::ldr(uint8_t &r, const AddrMode mode)
 {
     r = m_memory.read(computeAddress(mode));
-    m_status.bits.negativeFlag = (r & 0x80) > 0;
-    m_status.bits.zeroFlag = (0 == r);
+    setNZ(r);
 }
 
 void Cpu::lsr(const AddrMode mode)
@@ -722,9 +1080,8 @@ void Cpu::lsr(const AddrMode mode)
     
     bool newCarry = (tmp & 0x01) > 0;
     tmp >>= 1;
-    m_status.bits.negativeFlag = (tmp & 0x80) > 0;
-    m_status.bits.zeroFlag = (0 == tmp);
-    m_status.bits.carryFlag = newCarry;
+    setNZ(tmp);
+    setCarry(newCarry);
     if(AddrMode::IMP != mode) {
         m_memory.write(addr, tmp, m_programCounter);
     } else {
@@ -740,8 +1097,7 @@ void Cpu::nop()
 void Cpu::ora(const AddrMode mode)
 {
     m_accumulator |= m_memory.read(computeAddress(mode));
-    m_status.bits.negativeFlag = (m_accumulator & 0x80) > 0;
-    m_status.bits.zeroFlag = (0 == m_accumulator);
+    setNZ(m_accumulator);
 }
 
 void Cpu::pha()
@@ -752,21 +1108,20 @@ void Cpu::pha()
 
 void Cpu::php()
 {
-    m_memory.write(m_stackPointer--, m_status.all, m_programCounter);
+    m_memory.write(m_stackPointer--, getStatus() | 0x30, m_programCounter);
     ++m_programCounter;
 }
 
 void Cpu::pla()
 {
     m_accumulator = m_memory.read(++m_stackPointer);
-    m_status.bits.negativeFlag = (m_accumulator & 0x80) > 0;
-    m_status.bits.zeroFlag = (0 == m_accumulator);
+    setNZ(m_accumulator);
     ++m_programCounter;
 }
 
 void Cpu::plp()
 {
-    m_status.all = m_memory.read(++m_stackPointer);
+    setStatus((m_memory.read(++m_stackPointer) & ~0x10) | 0x20);
     ++m_programCounter;
 }
 
@@ -783,10 +1138,9 @@ void Cpu::rol(const AddrMode mode)
     
     bool newCarry = (tmp & 0x80) > 0;
     tmp <<= 1;
-    tmp += m_status.bits.carryFlag;
-    m_status.bits.negativeFlag = (tmp & 0x80) > 0;
-    m_status.bits.zeroFlag = (0 == tmp);
-    m_status.bits.carryFlag = newCarry;
+    tmp += m_carry;
+    setNZ(tmp);
+    setCarry(newCarry);
     if(AddrMode::IMP != mode) {
         m_memory.write(addr, tmp, m_programCounter);
     } else {
@@ -807,10 +1161,9 @@ void Cpu::ror(const AddrMode mode)
     
     bool newCarry = (tmp & 0x01) > 0;
     tmp >>= 1;
-    tmp += m_status.bits.carryFlag ? 0x80 : 0x00;
-    m_status.bits.negativeFlag = (tmp & 0x80) > 0;
-    m_status.bits.zeroFlag = (0 == tmp);
-    m_status.bits.carryFlag = newCarry;
+    tmp += m_carry ? 0x80 : 0x00;
+    setNZ(tmp);
+    setCarry(newCarry);
     if(AddrMode::IMP != mode) {
         m_memory.write(addr, tmp, m_programCounter);
     } else {
@@ -820,15 +1173,21 @@ void Cpu::ror(const AddrMode mode)
 
 void Cpu::rti()
 {
-    m_status.all = m_memory.read(++m_stackPointer);
+    setStatus((m_memory.read(++m_stackPointer) & ~0x10) | 0x20);
     m_programCounter = m_memory.read(++m_stackPointer);
     m_programCounter |= (m_memory.read(++m_stackPointer) << 8);
+    if(m_profiler) {
+        m_profiler->unwind(m_stackPointer & 0xFF);
+    }
 }
 
 void Cpu::rts()
 {
     m_stackPointer += 2;
     m_programCounter = m_memory.readWord(m_stackPointer - 1) + 1;
+    if(m_profiler) {
+        m_profiler->unwind(m_stackPointer & 0xFF);
+    }
 }
 
 void Cpu::sbc(const AddrMode mode)
@@ -837,21 +1196,20 @@ void Cpu::sbc(const AddrMode mode)
     uint16_t op1 = m_accumulator;
     uint16_t tmp = 0;
 
-    op0 = (~op0 & 0xFF) + m_status.bits.carryFlag;
+    op0 = (~op0 & 0xFF) + m_carry;
     tmp = op0 + op1;
 
-    m_status.bits.carryFlag = ((tmp & 0x100) == 0x100);
-    m_status.bits.overflowFlag = (((op0 ^ tmp) & (op1 ^ tmp) & 0x80) == 0x80);
+    setCarry((tmp & 0x100) == 0x100);
+    setOverflow(((op0 ^ tmp) & (op1 ^ tmp) & 0x80) == 0x80);
 
     m_accumulator = tmp & 0xFF;
-    m_status.bits.negativeFlag = (m_accumulator & 0x80) > 0;
-    m_status.bits.zeroFlag = (0 == m_accumulator);
+    setNZ(m_accumulator);
 }
 
 void Cpu::sec()
 {
     ++m_programCounter;
-    m_status.bits.carryFlag = 1;
+    setCarry(1);
 }
 
 void Cpu::sed()
@@ -875,8 +1233,7 @@ void Cpu::tsd(const uint8_t &src, uint8_t &dst)
 {
     ++m_programCounter;
     dst = src;
-    m_status.bits.negativeFlag = (dst & 0x80) > 0;
-    m_status.bits.zeroFlag = (0 == dst);
+    setNZ(dst);
 }
 
 void Cpu::tsx()
@@ -889,6 +1246,42 @@ void Cpu::txs()
 {
     ++m_programCounter;
     m_stackPointer = 0x100 | m_xIndex;
+    if(m_profiler) {
+        m_profiler->unwind(m_xIndex);
+    }
+}
+
+Cpu::CommandMap Cpu::buildCommands()
+{
+    CommandMap commands;
+    commands["read"] = &Cpu::dbgRead;
+    commands["rd"]   = &Cpu::dbgRead;
+    commands["r"]    = &Cpu::dbgRead;
+    commands["writ"] = &Cpu::dbgWrit;
+    commands["wr"]   = &Cpu::dbgWrit;
+    commands["w"]    = &Cpu::dbgWrit;
+    commands["sdmp"] = &Cpu::dbgSdmp;
+    commands["step"] = &Cpu::dbgStep;
+    commands["brka"] = &Cpu::dbgBrka;
+    commands["brkd"] = &Cpu::dbgBrkd;
+    commands["lsbp"] = &Cpu::dbgLsbp;
+    commands["seti"] = &Cpu::dbgSeti;
+    commands["clri"] = &Cpu::dbgClri;
+    commands["sreg"] = &Cpu::dbgSreg;
+    commands["watr"] = &Cpu::dbgWatr;
+    commands["watw"] = &Cpu::dbgWatw;
+    commands["watd"] = &Cpu::dbgWatd;
+    commands["lswp"] = &Cpu::dbgLswp;
+    commands["trac"] = &Cpu::dbgTrac;
+    commands["prof"] = &Cpu::dbgProf;
+    return commands;
+}
+
+// shared by every Cpu
+const Cpu::CommandMap& Cpu::commands()
+{
+    static const CommandMap commands = buildCommands();
+    return commands;
 }
 
 void Cpu::init()
@@ -897,21 +1290,10 @@ void Cpu::init()
     m_memory.write(0x0001, 0x07, 0);
     m_programCounter = m_memory.readWord(0xFFFC);
     m_stackPointer = 0x1FF;
-
-    m_cmdMap["read"] = &Cpu::dbgRead;
-    m_cmdMap["rd"]   = &Cpu::dbgRead;
-    m_cmdMap["r"]    = &Cpu::dbgRead;
-    m_cmdMap["writ"] = &Cpu::dbgWrit;
-    m_cmdMap["wr"]   = &Cpu::dbgWrit;
-    m_cmdMap["w"]    = &Cpu::dbgWrit;
-    m_cmdMap["sdmp"] = &Cpu::dbgSdmp;
-    m_cmdMap["step"] = &Cpu::dbgStep;
-    m_cmdMap["brka"] = &Cpu::dbgBrka;
-    m_cmdMap["brkd"] = &Cpu::dbgBrkd;
-    m_cmdMap["lsbp"] = &Cpu::dbgLsbp;
-    m_cmdMap["seti"] = &Cpu::dbgSeti;
-    m_cmdMap["clri"] = &Cpu::dbgClri;
-    m_cmdMap["sreg"] = &Cpu::dbgSreg;
+    m_accumulator = 0; // undefined on real hardware, but runs must be repeatable
+    m_xIndex = 0;
+    m_yIndex = 0;
+    setStatus(0x24);
 }
 
 uint16_t Cpu::computeAddress(const AddrMode mode)
@@ -943,11 +1325,15 @@ uint16_t Cpu::computeAddress(const AddrMode mode)
             m_programCounter += 2;
             break;
         case AddrMode::ABX:
-            addr = m_memory.readWord(m_programCounter) + m_xIndex;
+            ptr = m_memory.readWord(m_programCounter);
+            addr = ptr + m_xIndex;
+            m_pageCrossed = ((addr ^ ptr) >> 8) ? 1 : 0;
             m_programCounter += 2;
             break;
         case AddrMode::ABY:
-            addr = m_memory.readWord(m_programCounter) + m_yIndex;
+            ptr = m_memory.readWord(m_programCounter);
+            addr = ptr + m_yIndex;
+            m_pageCrossed = ((addr ^ ptr) >> 8) ? 1 : 0;
             m_programCounter += 2;
             break;
         case AddrMode::IND:
@@ -960,7 +1346,9 @@ uint16_t Cpu::computeAddress(const AddrMode mode)
             m_programCounter++;
             break;
         case AddrMode::IZY:
-            addr = m_memory.readWord(m_memory.read(m_programCounter)) + m_yIndex;
+            ptr = m_memory.readWord(m_memory.read(m_programCounter));
+            addr = ptr + m_yIndex;
+            m_pageCrossed = ((addr ^ ptr) >> 8) ? 1 : 0;
             m_programCounter++;
             break;
     };
@@ -972,35 +1360,197 @@ uint16_t Cpu::computeAddress(const AddrMode mode)
 
 Cpu::Cpu(MemoryController& memory)
     : m_memory(memory)
-    , m_videoTimer(0)
-    , m_pendingIrq(false)
+    , m_interrupts(memory.getInterrupts())
+    , m_idleSkip(true)
+    , m_idleHead(0)
+    , m_idleCount(0)
+    , m_idleLength(0)
+    , m_idleCycleCount(0)
+    , m_idleCycles(0)
+    , m_cycles(0)
+    , m_pageCrossed(0)
     , m_debugMode(false)
+    , m_trace(false)
     , m_stepping(false)
+    , m_stepCount(0)
+    , m_breakpoints(0)
+    , m_breakHandler(0)
+    , m_profiler(0)
+    , m_traps(0)
 {
     init();
 }
 
 Cpu::~Cpu()
 {
-
+    delete m_breakpoints;
 }
 
 int Cpu::addBreakpoint(uint16_t bpAddr)
 {
-    m_debugMode = true;
-    m_breakpointSet.insert(bpAddr);
-    return m_breakpointSet.size();
+    if(!m_breakpoints) {
+        m_breakpoints = new Breakpoints();
+    }
+
+    m_breakpoints->addresses.set(bpAddr);
+    m_breakpoints->conditions.erase(bpAddr);
+    updateDebugMode();
+    return m_breakpoints->addresses.count();
+}
+
+int Cpu::addBreakpoint(uint16_t bpAddr, const BreakCondition& condition)
+{
+    addBreakpoint(bpAddr);
+    m_breakpoints->conditions[bpAddr] = condition;
+    return m_breakpoints->addresses.count();
 }
 
 int Cpu::removeBreakpoint(uint16_t bpAddr)
 {
-    m_breakpointSet.erase(bpAddr);
-    return m_breakpointSet.size();
+    if(!m_breakpoints) {
+        return 0;
+    }
+
+    m_breakpoints->addresses.clear(bpAddr);
+    m_breakpoints->conditions.erase(bpAddr);
+    updateDebugMode();
+    return m_breakpoints->addresses.count();
+}
+
+void Cpu::enterDebugger(BreakReason reason, uint16_t addr)
+{
+    if(m_breakHandler) {
+        m_breakHandler->onBreak(reason, addr);
+        return;
+    }
+
+    switch(reason) {
+        case BREAK_PAUSE:
+            printf(">>>>>>>>>> CPU paused at 0x%04X <<<<<<<<<<\n", addr);
+            break;
+        case BREAK_BREAKPOINT:
+            printf(">>>>>>>>>> Hit breakpoint at 0x%04X <<<<<<<<<<\n", addr);
+            break;
+        case BREAK_STEP:
+            printf(">>>>>>>>>> Finished step count at 0x%04X <<<<<<<<<<\n", addr);
+            break;
+        case BREAK_READ_WATCH:
+        case BREAK_WRITE_WATCH:
+            printf(">>>>>>>>>> %s watchpoint 0x%04X hit at 0x%04X <<<<<<<<<<\n",
+                    (BREAK_WRITE_WATCH == reason) ? "Write" : "Read", addr, m_programCounter);
+            break;
+    }
+
+    debugPrompt();
+}
+
+void Cpu::setBreakHandler(BreakHandler *handler)
+{
+    m_breakHandler = handler;
+}
+
+void Cpu::setProfiler(Profiler *profiler)
+{
+    m_profiler = profiler;
+}
+
+void Cpu::setTraps(HleTraps *traps)
+{
+    m_traps = traps;
+}
+
+void Cpu::step(uint16_t count)
+{
+    m_stepCount = count;
+    m_stepping = (0 != count);
+}
+
+CpuRegisters Cpu::getRegisters() const
+{
+    CpuRegisters regs;
+    regs.pc = m_programCounter;
+    regs.a = m_accumulator;
+    regs.x = m_xIndex;
+    regs.y = m_yIndex;
+    regs.sp = m_stackPointer & 0xFF;
+    regs.p = getStatus();
+    return regs;
+}
+
+void Cpu::setRegisters(const CpuRegisters& regs)
+{
+    m_programCounter = regs.pc;
+    m_accumulator = regs.a;
+    m_xIndex = regs.x;
+    m_yIndex = regs.y;
+    m_stackPointer = 0x100 | regs.sp;
+    setStatus(regs.p);
+    m_idleLength = 0;
+}
+
+void Cpu::addWatchpoint(uint16_t addr, uint8_t type)
+{
+    m_memory.addWatchpoint(addr, type);
+    updateDebugMode();
+}
+
+void Cpu::removeWatchpoint(uint16_t addr, uint8_t type)
+{
+    m_memory.removeWatchpoint(addr, type);
+    updateDebugMode();
+}
+
+bool Cpu::checkCondition(uint16_t addr)
+{
+    std::map<uint16_t, BreakCondition>::const_iterator it = m_breakpoints->conditions.find(addr);
+    if(m_breakpoints->conditions.end() == it) {
+        return true;
+    }
+
+    const BreakCondition& cond = it->second;
+    uint16_t lhs = 0;
+    switch(cond.operand) {
+        case COND_A:      lhs = m_accumulator;              break;
+        case COND_X:      lhs = m_xIndex;                   break;
+        case COND_Y:      lhs = m_yIndex;                   break;
+        case COND_SP:     lhs = m_stackPointer & 0xFF;      break;
+        case COND_P:      lhs = getStatus();                break;
+        case COND_MEMORY: lhs = m_memory.peek(cond.address); break;
+    }
+
+    switch(cond.op) {
+        case COND_EQ:  return lhs == cond.value;
+        case COND_NE:  return lhs != cond.value;
+        case COND_LT:  return lhs < cond.value;
+        case COND_GT:  return lhs > cond.value;
+        case COND_LE:  return lhs <= cond.value;
+        case COND_GE:  return lhs >= cond.value;
+        case COND_AND: return 0 != (lhs & cond.value);
+    }
+
+    return true;
+}
+
+void Cpu::updateDebugMode()
+{
+    m_debugMode = m_trace || (m_breakpoints && m_breakpoints->addresses.count()) || m_memory.hasWatchpoints();
+}
+
+void Cpu::setTrace(bool enabled)
+{
+    m_trace = enabled;
+    updateDebugMode();
+}
+
+void Cpu::setIdleSkip(bool enabled)
+{
+    m_idleSkip = enabled;
+    m_idleLength = 0;
 }
 
 void Cpu::setDebugState(bool mode)
 {
-    m_debugMode = mode;
+    setTrace(mode);
 }
 
 MemoryController& Cpu::getMemory()
@@ -2,9 +2,10 @@
 #define INCLUDED_MOS6510_H
 
 #include <map>
-#include <set>
 #include <vector>
 #include "memorycontroller.h"
+#include "profiler.h"
+#include "machineconfig.h"
 
 namespace MOS6510 {
 
@@ -139,6 +140,69 @@ enum Instructions
     NOP_abF = 0xFC, SBC_abx = 0xFD, INC_abx = 0xFE, ISC_abx = 0xFF,
 };
 
+enum ConditionOperand {
+    COND_A,
+    COND_X,
+    COND_Y,
+    COND_SP,
+    COND_P,
+    COND_MEMORY
+};
+
+enum ConditionOp {
+    COND_EQ,
+    COND_NE,
+    COND_LT,
+    COND_GT,
+    COND_LE,
+    COND_GE,
+    COND_AND
+};
+
+// only evaluated once the breakpoint bitmap says the PC is interesting
+struct BreakCondition {
+    ConditionOperand    operand;
+    uint16_t            address;    // for COND_MEMORY
+    ConditionOp         op;
+    uint16_t            value;
+};
+
+// debugger state, only allocated once the first breakpoint is set
+struct Breakpoints {
+    AddressBitmap                       addresses;
+    std::map<uint16_t, BreakCondition>  conditions;
+};
+
+bool parseBreakCondition(const std::vector<std::string>& args, size_t first, BreakCondition& cond);
+
+struct CpuRegisters {
+    uint16_t    pc;
+    uint8_t     a;
+    uint8_t     x;
+    uint8_t     y;
+    uint8_t     sp;
+    uint8_t     p;
+};
+
+enum BreakReason {
+    BREAK_PAUSE,
+    BREAK_BREAKPOINT,
+    BREAK_STEP,
+    BREAK_READ_WATCH,
+    BREAK_WRITE_WATCH
+};
+
+// Receives control whenever the CPU stops, instead of the console prompt.
+// The CPU resumes when onBreak returns; addr is the PC, or the watched
+// address for watchpoints.
+class BreakHandler {
+public:
+    virtual ~BreakHandler() {}
+    virtual void onBreak(BreakReason reason, uint16_t addr) = 0;
+};
+
+class HleTraps;
+
 enum CpuState {
     // TODO: fill these in!
     // Read next instruction from memory at the PC (program counter)
@@ -155,19 +219,41 @@ private:
     uint8_t                         m_accumulator;
     uint8_t                         m_xIndex;
     uint8_t                         m_yIndex;
-    StatusRegister                  m_status;
+    StatusRegister                  m_status;       // I, D, B only, see getStatus()
+    uint8_t                         m_nResult;      // N is bit 7 of this
+    uint8_t                         m_zResult;      // Z is set when this is 0
+    uint8_t                         m_carry;
+    uint8_t                         m_overflow;
+#ifdef MOS6510_LOCKSTEP_FLAGS
+    StatusRegister                  m_eagerStatus;  // reference copy of P
+#endif
     MemoryController&               m_memory;
-    uint16_t                        m_videoTimer;
-    uint16_t                        m_sysTimer;
-    bool                            m_pendingIrq;
+    InterruptLines&                 m_interrupts;
+
+    // idle loop detection
+    bool                            m_idleSkip;
+    uint16_t                        m_idleHead;     // target of the last short backward jump
+    uint32_t                        m_idleCount;    // instructions since reaching m_idleHead
+    uint32_t                        m_idleLength;   // instructions per loop iteration, 0 if none
+    uint8_t                         m_idleState[6]; // registers and interrupts seen at m_idleHead
+    uint32_t                        m_idleCycleCount; // cycles since reaching m_idleHead
+    uint32_t                        m_idleCycles;   // cycles per loop iteration
+
+    // real cycles of the current execute(), for Scheduler::cycles()
+    uint32_t                        m_cycles;
+    uint8_t                         m_pageCrossed;  // by the last ABX, ABY or IZY operand
 
     // debug state
     typedef bool (MOS6510::Cpu::* cmdFunc)(const std::vector<std::string>&);
-    bool                            m_debugMode;
-    std::set<uint16_t>              m_breakpointSet;
-    std::map<std::string, cmdFunc>  m_cmdMap;
-    uint16_t                        m_stepCount;
+    typedef std::map<std::string, cmdFunc> CommandMap;
+    bool                            m_debugMode;    // any breakpoint, watchpoint or trace active
+    bool                            m_trace;
     bool                            m_stepping;
+    uint16_t                        m_stepCount;
+    Breakpoints*                    m_breakpoints;  // cold, 0 until needed
+    BreakHandler*                   m_breakHandler;
+    Profiler*                       m_profiler;
+    HleTraps*                       m_traps;
 
     // internal operations 
     void adc(const AddrMode mode);
@@ -175,6 +261,7 @@ private:
     void asl(const AddrMode mode);
     void bit(const AddrMode mode);
     void br(uint8_t flag, uint8_t condition);
+    void brk();
     void clc();
     void cld();
     void cli();
@@ -185,7 +272,7 @@ private:
     void eor(const AddrMode mode);
     void inc(const AddrMode mode);
     void inr(uint8_t& r);
-    void isr();
+    void interrupt(uint16_t vector, bool software);
     void jmp(const AddrMode mode);
     void jsr();
     void ldr(uint8_t & r, const AddrMode mode);
@@ -209,9 +296,24 @@ private:
     void tsx();
     void txs();
 
+    // flags
+    void setNZ(uint8_t value);
+    void setNZ(uint8_t nValue, uint8_t zValue);
+    void setCarry(uint8_t carry);
+    void setOverflow(uint8_t overflow);
+    uint8_t getStatus() const;
+    void setStatus(uint8_t status);
+
     // utility
+    static CommandMap buildCommands();
+    static const CommandMap& commands();
     void init();
     uint16_t computeAddress(const AddrMode mode);
+    uint32_t skipIdleLoop();
+    uint32_t runTrap(uint16_t addr);
+    bool checkCondition(uint16_t addr);
+    void enterDebugger(BreakReason reason, uint16_t addr);
+    void updateDebugMode();
     void redrawScreen();
 
     // debug functions
@@ -226,6 +328,12 @@ private:
     bool dbgSeti(const std::vector<std::string>& args);
     bool dbgClri(const std::vector<std::string>& args);
     bool dbgSreg(const std::vector<std::string>& args);
+    bool dbgWatr(const std::vector<std::string>& args);
+    bool dbgWatw(const std::vector<std::string>& args);
+    bool dbgWatd(const std::vector<std::string>& args);
+    bool dbgLswp(const std::vector<std::string>& args);
+    bool dbgTrac(const std::vector<std::string>& args);
+    bool dbgProf(const std::vector<std::string>& args);
 
 public:
     Cpu(const Cpu& rhs);
@@ -233,10 +341,25 @@ public:
     ~Cpu();
 
     int addBreakpoint(uint16_t bpAddr);
+    int addBreakpoint(uint16_t bpAddr, const BreakCondition& condition);
     int removeBreakpoint(uint16_t bpAddr);
+    void addWatchpoint(uint16_t addr, uint8_t type);
+    void removeWatchpoint(uint16_t addr, uint8_t type);
     void setDebugState(bool mode);
+    void setTrace(bool enabled);
+    void setBreakHandler(BreakHandler *handler);
+    void setProfiler(Profiler *profiler);
+    void setTraps(HleTraps *traps);
+    void step(uint16_t count);
+
+    CpuRegisters getRegisters() const;
+    void setRegisters(const CpuRegisters& regs);
+    void setIdleSkip(bool enabled);
 
-    void execute(bool debugBreak);
+    // returns the number of ticks consumed; debugger, trace and profiler
+    // hooks only exist in Config::INSTRUMENTED builds of this
+    template <class Config>
+    uint32_t execute(bool debugBreak);
     MemoryController& getMemory();
 };
 }
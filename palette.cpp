@@ -0,0 +1,119 @@
+#include <string.h>
+#include "palette.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define PALETTE_HAVE_SSSE3
+#endif
+
+namespace MOS6510 {
+
+struct NamedPalette {
+    const char* name;
+    uint32_t    colors[PALETTE_SIZE];
+};
+
+static const NamedPalette palettes[] = {
+    { "default",
+      { 0xFF000000, 0xFFFFFFFF, 0xFF880000, 0xFFAAFFEE,
+        0xFFCC44CC, 0xFF00CC55, 0xFF0000AA, 0xFFEEEE77,
+        0xFFDD88EE, 0xFF664400, 0xFFFF7777, 0xFF333333,
+        0xFF777777, 0xFFAAFF66, 0xFF0088FF, 0xFFBBBBBB } },
+    { "pepto",
+      { 0xFF000000, 0xFFFFFFFF, 0xFF68372B, 0xFF70A4B2,
+        0xFF6F3D86, 0xFF588D43, 0xFF352879, 0xFFB8C76F,
+        0xFF6F4F25, 0xFF433900, 0xFF9A6759, 0xFF444444,
+        0xFF6C6C6C, 0xFF9AD284, 0xFF6C5EB5, 0xFF959595 } },
+    { "colodore",
+      { 0xFF000000, 0xFFFFFFFF, 0xFF813338, 0xFF75CEC8,
+        0xFF8E3C97, 0xFF56AC4D, 0xFF2E2C9B, 0xFFEDF171,
+        0xFF8E5029, 0xFF553800, 0xFFC46C71, 0xFF4A4A4A,
+        0xFF7B7B7B, 0xFFA9FF9F, 0xFF706DEB, 0xFFB2B2B2 } },
+    { "vice",
+      { 0xFF000000, 0xFFFDFEFC, 0xFFBE1A24, 0xFF30E6C6,
+        0xFFB41AE2, 0xFF1FD21E, 0xFF211BAE, 0xFFDFF60A,
+        0xFFB84104, 0xFF6A3304, 0xFFFE4A57, 0xFF424540,
+        0xFF70746F, 0xFF59FE59, 0xFF5F53FE, 0xFFA4A7A2 } },
+};
+
+const uint32_t* findPalette(const char *name)
+{
+    for(size_t i = 0; i < sizeof(palettes) / sizeof(palettes[0]); ++i) {
+        if(0 == strcmp(name, palettes[i].name)) {
+            return palettes[i].colors;
+        }
+    }
+
+    return 0;
+}
+
+const char* paletteNames()
+{
+    return "default, pepto, colodore, vice";
+}
+
+const uint32_t* defaultPalette()
+{
+    return palettes[0].colors;
+}
+
+static void convertScalar(const uint8_t *src, uint32_t *dst, size_t count, const uint32_t *palette)
+{
+    for(size_t i = 0; i < count; ++i) {
+        dst[i] = palette[src[i] & 0x0F];
+    }
+}
+
+#ifdef PALETTE_HAVE_SSSE3
+// 16 pixels per step: each byte plane of the palette is a 16 entry pshufb table
+__attribute__((target("ssse3")))
+static void convertSsse3(const uint8_t *src, uint32_t *dst, size_t count, const uint32_t *palette)
+{
+    uint8_t planes[4][16];
+    for(int c = 0; c < PALETTE_SIZE; ++c) {
+        planes[0][c] = palette[c] & 0xFF;
+        planes[1][c] = (palette[c] >> 8) & 0xFF;
+        planes[2][c] = (palette[c] >> 16) & 0xFF;
+        planes[3][c] = (palette[c] >> 24) & 0xFF;
+    }
+
+    const __m128i p0 = _mm_loadu_si128((const __m128i*)planes[0]);
+    const __m128i p1 = _mm_loadu_si128((const __m128i*)planes[1]);
+    const __m128i p2 = _mm_loadu_si128((const __m128i*)planes[2]);
+    const __m128i p3 = _mm_loadu_si128((const __m128i*)planes[3]);
+    const __m128i mask = _mm_set1_epi8(0x0F);
+
+    size_t i = 0;
+    for(; i + 16 <= count; i += 16) {
+        __m128i idx = _mm_and_si128(_mm_loadu_si128((const __m128i*)(src + i)), mask);
+        __m128i b0 = _mm_shuffle_epi8(p0, idx);
+        __m128i b1 = _mm_shuffle_epi8(p1, idx);
+        __m128i b2 = _mm_shuffle_epi8(p2, idx);
+        __m128i b3 = _mm_shuffle_epi8(p3, idx);
+        __m128i lo01 = _mm_unpacklo_epi8(b0, b1);
+        __m128i hi01 = _mm_unpackhi_epi8(b0, b1);
+        __m128i lo23 = _mm_unpacklo_epi8(b2, b3);
+        __m128i hi23 = _mm_unpackhi_epi8(b2, b3);
+        _mm_storeu_si128((__m128i*)(dst + i),      _mm_unpacklo_epi16(lo01, lo23));
+        _mm_storeu_si128((__m128i*)(dst + i + 4),  _mm_unpackhi_epi16(lo01, lo23));
+        _mm_storeu_si128((__m128i*)(dst + i + 8),  _mm_unpacklo_epi16(hi01, hi23));
+        _mm_storeu_si128((__m128i*)(dst + i + 12), _mm_unpackhi_epi16(hi01, hi23));
+    }
+
+    convertScalar(src + i, dst + i, count - i, palette);
+}
+#endif
+
+void convertIndexed(const uint8_t *src, uint32_t *dst, size_t count, const uint32_t *palette)
+{
+#ifdef PALETTE_HAVE_SSSE3
+    static const bool haveSsse3 = __builtin_cpu_supports("ssse3");
+    if(haveSsse3) {
+        convertSsse3(src, dst, count, palette);
+        return;
+    }
+#endif
+    convertScalar(src, dst, count, palette);
+}
+
+}
@@ -0,0 +1,21 @@
+#ifndef INCLUDED_PALETTE_H
+#define INCLUDED_PALETTE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace MOS6510 {
+
+const int PALETTE_SIZE = 16;
+
+// ARGB (0xAARRGGBB) colour tables indexed by VIC-II colour number
+const uint32_t* findPalette(const char *name);
+const char* paletteNames();
+const uint32_t* defaultPalette();
+
+// expand palette indices to ARGB, one pass over the whole buffer
+void convertIndexed(const uint8_t *src, uint32_t *dst, size_t count, const uint32_t *palette);
+
+}
+
+#endif
@@ -0,0 +1,243 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include "profiler.h"
+
+namespace MOS6510 {
+
+// the 6510 stack only has room for 128 return addresses
+const size_t MAX_CALL_DEPTH = 128;
+
+Profiler::Profiler(ProfileMode mode, uint32_t interval)
+    : m_mode(mode)
+    , m_interval(interval ? interval : 1)
+    , m_countdown(m_interval)
+    , m_current(0)
+    , m_resolved(0)
+{
+    m_frames.reserve(MAX_CALL_DEPTH);
+    reset();
+}
+
+// Accepts VICE label files ("al C:080d .start") and ca65 debug files
+// ("sym id=0,name="start",...,val=0x80D,...").
+bool Profiler::loadSymbols(const std::string& path)
+{
+    std::ifstream file(path.c_str());
+    if(!file) {
+        fprintf(stderr, "Failed to open symbol file %s\n", path.c_str());
+        return false;
+    }
+
+    std::string line;
+    size_t loaded = 0;
+    while(std::getline(file, line)) {
+        if(0 == line.compare(0, 3, "al ")) {
+            std::stringstream ss(line.substr(3));
+            std::string addr;
+            std::string name;
+            ss >> addr >> name;
+            if(0 == addr.compare(0, 2, "C:")) {
+                addr = addr.substr(2);
+            }
+            if(addr.empty() || name.empty()) {
+                continue;
+            }
+            if('.' == name[0]) {
+                name = name.substr(1);
+            }
+            m_symbols[strtoul(addr.c_str(), 0, 16)] = name;
+            ++loaded;
+        } else if(0 == line.compare(0, 4, "sym\t")) {
+            size_t name = line.find("name=\"");
+            size_t val = line.find("val=");
+            if(std::string::npos == name || std::string::npos == val) {
+                continue;
+            }
+            name += 6;
+            size_t end = line.find('"', name);
+            if(std::string::npos == end) {
+                continue;
+            }
+            m_symbols[strtoul(line.c_str() + val + 4, 0, 0)] = line.substr(name, end - name);
+            ++loaded;
+        }
+    }
+
+    printf("Loaded %zu symbols from %s\n", loaded, path.c_str());
+    return true;
+}
+
+// Throws away everything counted so far but keeps the current call stack.
+void Profiler::reset()
+{
+    Node root = { 0, 0, 0 };
+    m_nodes.clear();
+    m_nodes.push_back(root);
+    m_children.clear();
+    m_resolved = 0;
+    m_current = 0;
+    m_countdown = m_interval;
+}
+
+void Profiler::enter(uint16_t routine, uint8_t returnSp)
+{
+    if(MAX_CALL_DEPTH <= m_frames.size()) {
+        return; // runaway recursion, keep charging the deepest known frame
+    }
+
+    Frame frame = { routine, returnSp, 0 };
+    m_frames.push_back(frame);
+}
+
+// Pops every frame the stack pointer has moved past. Code that drops its
+// return address and jumps elsewhere is resynchronised by the next unwind.
+void Profiler::unwind(uint8_t sp)
+{
+    while(!m_frames.empty() && m_frames.back().returnSp <= sp) {
+        m_frames.pop_back();
+    }
+
+    if(m_resolved > m_frames.size()) {
+        m_resolved = m_frames.size();
+        m_current = m_resolved ? m_frames[m_resolved - 1].node : 0;
+    }
+}
+
+// Finds or adds the tree nodes of the frames entered since the last charge
+// and returns the innermost one.
+uint32_t Profiler::resolve()
+{
+    for(; m_resolved < m_frames.size(); ++m_resolved) {
+        Frame& frame = m_frames[m_resolved];
+        uint64_t key = ((uint64_t)m_current << 16) | frame.routine;
+        std::unordered_map<uint64_t, uint32_t>::const_iterator it = m_children.find(key);
+        if(m_children.end() == it) {
+            Node child = { m_current, frame.routine, 0 };
+            frame.node = m_nodes.size();
+            m_nodes.push_back(child);
+            m_children[key] = frame.node;
+        } else {
+            frame.node = it->second;
+        }
+        m_current = frame.node;
+    }
+
+    return m_current;
+}
+
+// An idle skip can cover several intervals in one go.
+void Profiler::sample(uint32_t ticks)
+{
+    uint32_t late = ticks - m_countdown;
+    m_nodes[resolve()].count += 1 + late / m_interval;
+    m_countdown = m_interval - late % m_interval;
+}
+
+std::string Profiler::routineName(uint32_t node) const
+{
+    if(0 == node) {
+        return "<top>";
+    }
+
+    uint16_t routine = m_nodes[node].routine;
+    std::map<uint16_t, std::string>::const_iterator it = m_symbols.find(routine);
+    if(m_symbols.end() != it) {
+        return it->second;
+    }
+
+    char name[8];
+    snprintf(name, sizeof(name), "$%04X", routine);
+    return name;
+}
+
+struct Totals {
+    uint32_t    node;       // any node of the routine, for its name
+    uint64_t    self;
+    uint64_t    inclusive;
+};
+
+static bool bySelf(const Totals& lhs, const Totals& rhs)
+{
+    return lhs.self > rhs.self;
+}
+
+void Profiler::printTop(size_t count) const
+{
+    // children always come after their parents
+    std::vector<uint64_t> subtree(m_nodes.size());
+    for(size_t i = 0; i < m_nodes.size(); ++i) {
+        subtree[i] = m_nodes[i].count;
+    }
+    for(size_t i = m_nodes.size() - 1; 0 < i; --i) {
+        subtree[m_nodes[i].parent] += subtree[i];
+    }
+
+    // key 0x10000 is the root, so it can't collide with a routine address
+    std::map<uint32_t, Totals> routines;
+    Totals top = { 0, m_nodes[0].count, subtree[0] };
+    routines[0x10000] = top;
+    for(size_t i = 1; i < m_nodes.size(); ++i) {
+        uint16_t routine = m_nodes[i].routine;
+        Totals& totals = routines[routine];
+        totals.node = i;
+        totals.self += m_nodes[i].count;
+
+        // recursive calls are already included in the outermost one
+        bool nested = false;
+        for(uint32_t p = m_nodes[i].parent; 0 != p && !nested; p = m_nodes[p].parent) {
+            nested = (routine == m_nodes[p].routine);
+        }
+        if(!nested) {
+            totals.inclusive += subtree[i];
+        }
+    }
+
+    std::vector<Totals> sorted;
+    for(std::map<uint32_t, Totals>::const_iterator it = routines.begin(); it != routines.end(); ++it) {
+        sorted.push_back(it->second);
+    }
+    std::sort(sorted.begin(), sorted.end(), bySelf);
+
+    double total = subtree[0] ? (double)subtree[0] : 1.0;
+    printf("%12s %6s %12s %6s  routine (%s)\n", "self", "%", "inclusive", "%",
+            (PROFILE_EXACT == m_mode) ? "ticks" : "samples");
+    for(size_t i = 0; i < sorted.size() && i < count; ++i) {
+        const Totals& totals = sorted[i];
+        printf("%12llu %6.2f %12llu %6.2f  %s\n",
+                (unsigned long long)totals.self, 100.0 * totals.self / total,
+                (unsigned long long)totals.inclusive, 100.0 * totals.inclusive / total,
+                routineName(totals.node).c_str());
+    }
+}
+
+// One "outer;inner count" line per call stack, as read by flamegraph.pl.
+bool Profiler::writeFolded(const std::string& path) const
+{
+    FILE *file = fopen(path.c_str(), "w");
+    if(!file) {
+        fprintf(stderr, "Failed to open %s: %s\n", path.c_str(), strerror(errno));
+        return false;
+    }
+
+    for(size_t i = 0; i < m_nodes.size(); ++i) {
+        if(0 == m_nodes[i].count) {
+            continue;
+        }
+
+        std::string stack = routineName(i);
+        for(uint32_t p = m_nodes[i].parent; 0 != i && 0 != p; p = m_nodes[p].parent) {
+            stack = routineName(p) + ";" + stack;
+        }
+        fprintf(file, "%s %llu\n", stack.c_str(), (unsigned long long)m_nodes[i].count);
+    }
+
+    fclose(file);
+    return true;
+}
+
+}
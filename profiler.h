@@ -0,0 +1,76 @@
+#ifndef INCLUDED_PROFILER_H
+#define INCLUDED_PROFILER_H
+
+#include <stdint.h>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace MOS6510 {
+
+enum ProfileMode {
+    PROFILE_SAMPLE, // charge the current call stack once every interval ticks
+    PROFILE_EXACT   // charge the current call stack with every tick
+};
+
+// Guest code profiler. The CPU reports subroutine and interrupt entry plus
+// every stack unwind (RTS, RTI, TXS); the profiler keeps the resulting call
+// stacks as a tree and charges ticks to whichever node is current. Entering
+// a routine only pushes a frame, its tree node is looked up the first time
+// something is charged to it, so calls that return between two samples
+// cost no lookup at all.
+class Profiler {
+private:
+    struct Node {
+        uint32_t    parent;
+        uint16_t    routine;    // call or interrupt target
+        uint64_t    count;      // samples or ticks spent in this node itself
+    };
+
+    struct Frame {
+        uint16_t    routine;
+        uint8_t     returnSp;   // SP once this call has returned
+        uint32_t    node;       // only valid in the first m_resolved frames
+    };
+
+    ProfileMode                         m_mode;
+    uint32_t                            m_interval;
+    uint32_t                            m_countdown;
+    uint32_t                            m_current;  // node of the last resolved frame
+    std::vector<Node>                   m_nodes;    // parents always precede children
+    std::unordered_map<uint64_t, uint32_t> m_children;
+    std::vector<Frame>                  m_frames;
+    size_t                              m_resolved;
+    std::map<uint16_t, std::string>     m_symbols;
+
+    uint32_t resolve();
+    void sample(uint32_t ticks);
+    std::string routineName(uint32_t node) const;
+
+public:
+    Profiler(ProfileMode mode, uint32_t interval);
+
+    bool loadSymbols(const std::string& path);
+    void reset();
+
+    void enter(uint16_t routine, uint8_t returnSp);
+    void unwind(uint8_t sp);
+    void account(uint32_t ticks)
+    {
+        if(PROFILE_EXACT == m_mode) {
+            m_nodes[(m_frames.size() == m_resolved) ? m_current : resolve()].count += ticks;
+        } else if(m_countdown > ticks) {
+            m_countdown -= ticks;
+        } else {
+            sample(ticks);
+        }
+    }
+
+    void printTop(size_t count) const;
+    bool writeFolded(const std::string& path) const;
+};
+
+}
+
+#endif
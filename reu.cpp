@@ -0,0 +1,242 @@
+#include <assert.h>
+#include <string.h>
+#include "reu.h"
+#include "memorycontroller.h"
+
+namespace MOS6510 {
+
+enum ReuStatus {
+    STATUS_SIZE         = 0x10, // 256K chips rather than 64K ones
+    STATUS_VERIFY_ERROR = 0x20,
+    STATUS_END_OF_BLOCK = 0x40,
+    STATUS_IRQ          = 0x80
+};
+
+enum ReuCommand {
+    COMMAND_TYPE        = 0x03,
+    COMMAND_NO_FF00     = 0x10, // start at once rather than on a write to $FF00
+    COMMAND_AUTOLOAD    = 0x20,
+    COMMAND_EXECUTE     = 0x80
+};
+
+enum ReuTransfer {
+    TRANSFER_STASH,     // C64 to REU
+    TRANSFER_FETCH,     // REU to C64
+    TRANSFER_SWAP,
+    TRANSFER_VERIFY
+};
+
+enum ReuIrqMask {
+    IRQ_MASK_VERIFY     = 0x20,
+    IRQ_MASK_END        = 0x40,
+    IRQ_MASK_ENABLE     = 0x80
+};
+
+enum ReuControl {
+    CONTROL_FIX_REU     = 0x40,
+    CONTROL_FIX_C64     = 0x80
+};
+
+// a span of C64 addresses within one page, plain RAM copied directly
+static void readC64(MemoryController& memory, uint16_t addr, uint8_t *dst, uint32_t count)
+{
+    const uint8_t *page = memory.readablePage(addr >> 8);
+    if(page) {
+        memcpy(dst, page + (addr & 0xFF), count);
+        return;
+    }
+
+    for(uint32_t i = 0; i < count; ++i) {
+        dst[i] = memory.read(addr + i);
+    }
+}
+
+static void writeC64(MemoryController& memory, uint16_t addr, const uint8_t *src, uint32_t count)
+{
+    uint8_t *page = memory.writablePage(addr >> 8);
+    if(page) {
+        memcpy(page + (addr & 0xFF), src, count);
+        return;
+    }
+
+    for(uint32_t i = 0; i < count; ++i) {
+        memory.write(addr + i, src[i], 0);
+    }
+}
+
+Reu::Reu(size_t size)
+    : m_ram(size, 0)
+    , m_mask(size - 1)
+    , m_busy(false)
+{
+    assert(REU_MIN_SIZE <= size && REU_MAX_SIZE >= size && 0 == (size & (size - 1)));
+    reset();
+}
+
+void Reu::reset()
+{
+    memset(m_registers, 0, sizeof(m_registers));
+    m_registers[REU_COMMAND] = COMMAND_NO_FF00;
+    m_registers[REU_LENGTH_LO] = 0xFF;
+    m_registers[REU_LENGTH_HI] = 0xFF;
+    memcpy(m_shadow, m_registers, sizeof(m_shadow));
+}
+
+uint8_t Reu::read(MemoryController& memory, uint8_t reg)
+{
+    uint8_t data = peek(reg);
+    if(!m_busy && REU_STATUS == reg) { // reading acknowledges the interrupt
+        m_registers[REU_STATUS] = 0;
+        memory.getInterrupts().release(IRQ_CART);
+    }
+
+    return data;
+}
+
+uint8_t Reu::peek(uint8_t reg) const
+{
+    if(m_busy) {
+        return 0xFF;
+    }
+
+    switch(reg) {
+        case REU_STATUS:
+            return m_registers[REU_STATUS] | ((REU_MIN_SIZE < m_ram.size()) ? STATUS_SIZE : 0);
+        case REU_IRQ_MASK:
+            return m_registers[reg] | 0x1F;
+        case REU_CONTROL:
+            return m_registers[reg] | 0x3F;
+    }
+
+    return (REU_REGISTERS > reg) ? m_registers[reg] : 0xFF;
+}
+
+void Reu::write(MemoryController& memory, uint8_t reg, uint8_t data)
+{
+    if(m_busy || REU_STATUS == reg || REU_REGISTERS <= reg) {
+        return;
+    }
+
+    m_registers[reg] = data;
+    if(REU_C64_LO <= reg && REU_LENGTH_HI >= reg) { // writes load the autoload copy too
+        m_shadow[reg] = data;
+    } else if(REU_COMMAND == reg && (COMMAND_EXECUTE & data) && (COMMAND_NO_FF00 & data)) {
+        memory.getScheduler().stall(transfer(memory));
+    }
+}
+
+bool Reu::isArmed() const
+{
+    return COMMAND_EXECUTE == (m_registers[REU_COMMAND] & (COMMAND_EXECUTE | COMMAND_NO_FF00));
+}
+
+void Reu::trigger(MemoryController& memory)
+{
+    if(isArmed() && !m_busy) {
+        memory.getScheduler().stall(transfer(memory));
+    }
+}
+
+size_t Reu::getSize() const
+{
+    return m_ram.size();
+}
+
+// Runs the whole transfer in spans that stay within one C64 page and do
+// not wrap in the REU, and returns the ticks it holds the bus for: one per
+// byte, two per byte for a swap.
+uint32_t Reu::transfer(MemoryController& memory)
+{
+    uint8_t type = m_registers[REU_COMMAND] & COMMAND_TYPE;
+    bool fixC64 = 0 != (CONTROL_FIX_C64 & m_registers[REU_CONTROL]);
+    bool fixReu = 0 != (CONTROL_FIX_REU & m_registers[REU_CONTROL]);
+    uint16_t c64 = m_registers[REU_C64_LO] | (m_registers[REU_C64_HI] << 8);
+    uint32_t reu = (m_registers[REU_REU_LO] | (m_registers[REU_REU_HI] << 8) | (m_registers[REU_BANK] << 16)) & m_mask;
+    uint32_t length = m_registers[REU_LENGTH_LO] | (m_registers[REU_LENGTH_HI] << 8);
+    if(0 == length) {
+        length = 0x10000;
+    }
+
+    m_busy = true;
+    uint32_t done = 0;
+    bool mismatch = false;
+    while(done < length && !mismatch) {
+        uint32_t chunk = 1; // a fixed address repeats one byte
+        if(!fixC64 && !fixReu) {
+            chunk = length - done;
+            if(chunk > 0x100u - (c64 & 0xFF)) {
+                chunk = 0x100u - (c64 & 0xFF);
+            }
+            if(chunk > m_mask + 1 - reu) {
+                chunk = m_mask + 1 - reu;
+            }
+        }
+
+        uint8_t *ext = &m_ram[reu];
+        uint8_t buffer[0x100];
+        switch(type) {
+            case TRANSFER_STASH:
+                readC64(memory, c64, ext, chunk);
+                break;
+            case TRANSFER_FETCH:
+                writeC64(memory, c64, ext, chunk);
+                break;
+            case TRANSFER_SWAP:
+                readC64(memory, c64, buffer, chunk);
+                writeC64(memory, c64, ext, chunk);
+                memcpy(ext, buffer, chunk);
+                break;
+            case TRANSFER_VERIFY: // stops after the first byte that differs
+                readC64(memory, c64, buffer, chunk);
+                if(0 != memcmp(buffer, ext, chunk)) {
+                    uint32_t i = 0;
+                    while(buffer[i] == ext[i]) {
+                        ++i;
+                    }
+                    chunk = i + 1;
+                    mismatch = true;
+                }
+                break;
+        }
+
+        done += chunk;
+        if(!fixC64) {
+            c64 += chunk;
+        }
+        if(!fixReu) {
+            reu = (reu + chunk) & m_mask;
+        }
+    }
+    m_busy = false;
+
+    uint8_t& status = m_registers[REU_STATUS];
+    if(length == done) {
+        status |= STATUS_END_OF_BLOCK;
+    }
+    if(mismatch) {
+        status |= STATUS_VERIFY_ERROR;
+    }
+    uint8_t mask = m_registers[REU_IRQ_MASK];
+    if((IRQ_MASK_ENABLE & mask) && (mask & status & (IRQ_MASK_END | IRQ_MASK_VERIFY))) {
+        status |= STATUS_IRQ;
+        memory.getInterrupts().raise(IRQ_CART);
+    }
+
+    if(COMMAND_AUTOLOAD & m_registers[REU_COMMAND]) {
+        memcpy(&m_registers[REU_C64_LO], &m_shadow[REU_C64_LO], REU_LENGTH_HI - REU_C64_LO + 1);
+    } else { // the length counts down to 1, not 0
+        uint32_t left = (length == done) ? 1 : length - done;
+        m_registers[REU_C64_LO] = c64 & 0xFF;
+        m_registers[REU_C64_HI] = c64 >> 8;
+        m_registers[REU_REU_LO] = reu & 0xFF;
+        m_registers[REU_REU_HI] = (reu >> 8) & 0xFF;
+        m_registers[REU_BANK] = reu >> 16;
+        m_registers[REU_LENGTH_LO] = left & 0xFF;
+        m_registers[REU_LENGTH_HI] = left >> 8;
+    }
+    m_registers[REU_COMMAND] = (m_registers[REU_COMMAND] & ~COMMAND_EXECUTE) | COMMAND_NO_FF00;
+
+    return (TRANSFER_SWAP == type) ? 2 * done : done;
+}
+
+}
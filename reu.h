@@ -0,0 +1,62 @@
+#ifndef INCLUDED_REU_H
+#define INCLUDED_REU_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+namespace MOS6510 {
+
+class MemoryController;
+
+const size_t REU_MIN_SIZE = 128 * 1024;         // 1700
+const size_t REU_MAX_SIZE = 16 * 1024 * 1024;
+
+enum ReuRegisters {
+    REU_STATUS,
+    REU_COMMAND,
+    REU_C64_LO,
+    REU_C64_HI,
+    REU_REU_LO,
+    REU_REU_HI,
+    REU_BANK,
+    REU_LENGTH_LO,
+    REU_LENGTH_HI,
+    REU_IRQ_MASK,
+    REU_CONTROL,
+    REU_REGISTERS
+};
+
+// A 17xx RAM Expansion Unit at $DF00. A transfer runs the moment it is
+// triggered, as memcpy/memcmp over whatever part of it is plain RAM on the
+// C64 side and byte by byte through the memory map elsewhere, so I/O and
+// video RAM see every access. The CPU is then held for the ticks the
+// transfer took on the real bus, through the scheduler.
+class Reu {
+private:
+    std::vector<uint8_t>    m_ram;
+    uint32_t                m_mask;         // size - 1
+    uint8_t                 m_registers[REU_REGISTERS];
+    uint8_t                 m_shadow[REU_REGISTERS]; // addresses and length for autoload
+    bool                    m_busy;         // the transfer's own I/O accesses do not reach us
+
+    Reu(const Reu& rhs);
+    Reu& operator=(const Reu& rhs);
+
+    uint32_t transfer(MemoryController& memory);
+
+public:
+    Reu(size_t size);       // a power of two from REU_MIN_SIZE to REU_MAX_SIZE
+
+    void reset();
+    uint8_t read(MemoryController& memory, uint8_t reg);
+    uint8_t peek(uint8_t reg) const;    // leaves the status and interrupt alone
+    void write(MemoryController& memory, uint8_t reg, uint8_t data);
+    bool isArmed() const;   // waiting for a write to $FF00
+    void trigger(MemoryController& memory);
+    size_t getSize() const;
+};
+
+}
+
+#endif
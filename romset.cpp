@@ -0,0 +1,202 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <map>
+#include <mutex>
+#include "romset.h"
+#include "crc32.h"
+
+namespace MOS6510 {
+
+struct RomInfo {
+    const char* name;
+    const char* file;       // stock image name
+    size_t      size;
+    uint32_t    crc;
+    bool        required;   // by every machine
+};
+
+static const RomInfo ROMS[ROM_COUNT] = {
+    { "BASIC",   "basic.901226-01.bin",      0x2000, 0xF833D117, true },
+    { "KERNAL",  "kernal.901227-03.bin",     0x2000, 0xDBE3E7C7, true },
+    { "CHARGEN", "characters.901225-01.bin", 0x1000, 0xEC4272EE, true },
+    { "1541",    "1541-II.251968-03.bin",    0x4000, 0x899FA3C5, false },
+};
+
+struct MappedFile {
+    const uint8_t*  data;
+    size_t          size;
+};
+
+// mappings live until the process exits, keyed by device and inode so
+// different paths to the same file share one mapping
+static std::mutex mappedLock;
+static std::map<std::pair<dev_t, ino_t>, MappedFile> mappedFiles;
+
+static const uint8_t* mapFile(const std::string& path, size_t size)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if(0 > fd) {
+        fprintf(stderr, "Failed to open %s: %s\n", path.c_str(), strerror(errno));
+        return 0;
+    }
+
+    struct stat st;
+    if(0 != fstat(fd, &st)) {
+        fprintf(stderr, "Failed to stat %s: %s\n", path.c_str(), strerror(errno));
+        close(fd);
+        return 0;
+    }
+
+    if((size_t)st.st_size != size) {
+        fprintf(stderr, "%s is %lld bytes, expected %zu\n", path.c_str(), (long long)st.st_size, size);
+        close(fd);
+        return 0;
+    }
+
+    std::lock_guard<std::mutex> lock(mappedLock);
+    std::pair<dev_t, ino_t> key(st.st_dev, st.st_ino);
+    std::map<std::pair<dev_t, ino_t>, MappedFile>::const_iterator it = mappedFiles.find(key);
+    if(mappedFiles.end() != it) {
+        close(fd);
+        return it->second.data;
+    }
+
+    void *data = mmap(0, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(MAP_FAILED == data) {
+        fprintf(stderr, "Failed to map %s: %s\n", path.c_str(), strerror(errno));
+        return 0;
+    }
+
+    MappedFile file = { (const uint8_t *)data, size };
+    mappedFiles[key] = file;
+    return file.data;
+}
+
+// custom ROMs are allowed, but worth a warning
+static void checkCrc(RomId id, const uint8_t *data, const std::string& path)
+{
+    uint32_t crc = crc32(data, ROMS[id].size);
+    if(crc != ROMS[id].crc) {
+        fprintf(stderr, "Warning: %s ROM %s has CRC 0x%08X, expected 0x%08X\n",
+                ROMS[id].name, path.c_str(), crc, ROMS[id].crc);
+    }
+}
+
+static void splitPath(const std::string& dirs, std::vector<std::string>& out)
+{
+    size_t start = 0;
+    while(start <= dirs.size()) {
+        size_t end = dirs.find(':', start);
+        if(std::string::npos == end) {
+            end = dirs.size();
+        }
+        if(end > start) {
+            out.push_back(dirs.substr(start, end - start));
+        }
+        start = end + 1;
+    }
+}
+
+RomSet::RomSet()
+{
+    memset(m_images, 0, sizeof(m_images));
+}
+
+void RomSet::addSearchPath(const std::string& dirs)
+{
+    splitPath(dirs, m_searchPath);
+}
+
+// Names with a slash are used as given. Others are looked for in the
+// directories added here, then in $C64EMU_ROM_PATH, then the working directory.
+std::string RomSet::findFile(const std::string& name) const
+{
+    if(std::string::npos != name.find('/')) {
+        return name;
+    }
+
+    std::vector<std::string> dirs(m_searchPath);
+    const char *env = getenv("C64EMU_ROM_PATH");
+    if(env) {
+        splitPath(env, dirs);
+    }
+    dirs.push_back(".");
+
+    for(size_t i = 0; i < dirs.size(); ++i) {
+        std::string path = dirs[i] + "/" + name;
+        if(0 == access(path.c_str(), R_OK)) {
+            return path;
+        }
+    }
+
+    return name;
+}
+
+bool RomSet::load(RomId id, const std::string& name)
+{
+    std::string path = findFile(name);
+    const uint8_t *data = mapFile(path, ROMS[id].size);
+    if(!data) {
+        return false;
+    }
+
+    checkCrc(id, data, path);
+    m_images[id] = data;
+    return true;
+}
+
+bool RomSet::loadStock(RomId id)
+{
+    return load(id, ROMS[id].file);
+}
+
+bool RomSet::loadCombined(const std::string& name)
+{
+    std::string path = findFile(name);
+    const uint8_t *data = mapFile(path, ROMS[ROM_BASIC].size + ROMS[ROM_KERNAL].size);
+    if(!data) {
+        return false;
+    }
+
+    checkCrc(ROM_BASIC, data, path);
+    checkCrc(ROM_KERNAL, data + ROMS[ROM_BASIC].size, path);
+    m_images[ROM_BASIC] = data;
+    m_images[ROM_KERNAL] = data + ROMS[ROM_BASIC].size;
+    return true;
+}
+
+bool RomSet::loadMissing()
+{
+    for(int id = 0; id < ROM_COUNT; ++id) {
+        if(ROMS[id].required && !m_images[id] && !loadStock((RomId)id)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+const uint8_t* RomSet::getImage(RomId id) const
+{
+    return m_images[id];
+}
+
+bool RomSet::isComplete() const
+{
+    for(int id = 0; id < ROM_COUNT; ++id) {
+        if(ROMS[id].required && !m_images[id]) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+}
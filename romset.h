@@ -0,0 +1,43 @@
+#ifndef INCLUDED_ROMSET_H
+#define INCLUDED_ROMSET_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace MOS6510 {
+
+enum RomId {
+    ROM_BASIC,
+    ROM_KERNAL,
+    ROM_CHARGEN,
+    ROM_DOS1541,    // only needed with a drive attached, see loadMissing()
+    ROM_COUNT
+};
+
+// Finds, maps and checks the BASIC, KERNAL, character and 1541 ROM images. Every
+// file is mapped read-only once per process, however many RomSets or
+// machines use it, so extra instances cost no ROM memory or file I/O.
+class RomSet {
+private:
+    std::vector<std::string>    m_searchPath;
+    const uint8_t*              m_images[ROM_COUNT];
+
+    std::string findFile(const std::string& name) const;
+
+public:
+    RomSet();
+
+    void addSearchPath(const std::string& dirs); // colon separated, before $C64EMU_ROM_PATH and .
+    bool load(RomId id, const std::string& name);
+    bool loadStock(RomId id);                    // by its stock image name
+    bool loadCombined(const std::string& name);  // 16K BASIC followed by KERNAL
+    bool loadMissing();                          // the stock image names for any C64 ROM not loaded yet
+
+    const uint8_t* getImage(RomId id) const;
+    bool isComplete() const;
+};
+
+}
+
+#endif
@@ -0,0 +1,167 @@
+#include <assert.h>
+#include <string.h>
+#include "scaler.h"
+#include "palette.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define SCALER_HAVE_SSE2
+#endif
+
+namespace MOS6510 {
+
+static void replicateScalar(const uint32_t *src, uint32_t *dst, int width, int scale)
+{
+    for(int x = 0; x < width; ++x) {
+        for(int s = 0; s < scale; ++s) {
+            *dst++ = src[x];
+        }
+    }
+}
+
+#ifdef SCALER_HAVE_SSE2
+static void replicateSse2(const uint32_t *src, uint32_t *dst, int width, int scale)
+{
+    int x = 0;
+    switch(scale) {
+        case 2:
+            for(; x + 4 <= width; x += 4, dst += 8) {
+                __m128i v = _mm_loadu_si128((const __m128i*)(src + x));
+                _mm_storeu_si128((__m128i*)dst,       _mm_unpacklo_epi32(v, v));
+                _mm_storeu_si128((__m128i*)(dst + 4), _mm_unpackhi_epi32(v, v));
+            }
+            break;
+        case 3:
+            for(; x + 4 <= width; x += 4, dst += 12) {
+                __m128i v = _mm_loadu_si128((const __m128i*)(src + x));
+                _mm_storeu_si128((__m128i*)dst,       _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 0, 0)));
+                _mm_storeu_si128((__m128i*)(dst + 4), _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 2, 1, 1)));
+                _mm_storeu_si128((__m128i*)(dst + 8), _mm_shuffle_epi32(v, _MM_SHUFFLE(3, 3, 3, 2)));
+            }
+            break;
+        case 4:
+            for(; x + 4 <= width; x += 4, dst += 16) {
+                __m128i v = _mm_loadu_si128((const __m128i*)(src + x));
+                _mm_storeu_si128((__m128i*)dst,        _mm_shuffle_epi32(v, _MM_SHUFFLE(0, 0, 0, 0)));
+                _mm_storeu_si128((__m128i*)(dst + 4),  _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 1, 1, 1)));
+                _mm_storeu_si128((__m128i*)(dst + 8),  _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 2, 2, 2)));
+                _mm_storeu_si128((__m128i*)(dst + 12), _mm_shuffle_epi32(v, _MM_SHUFFLE(3, 3, 3, 3)));
+            }
+            break;
+    }
+
+    replicateScalar(src + x, dst, width - x, scale);
+}
+
+// 8 source pixels per step for the even factors
+__attribute__((target("avx2")))
+static void replicateAvx2(const uint32_t *src, uint32_t *dst, int width, int scale)
+{
+    int x = 0;
+    if(2 == scale) {
+        const __m256i lo = _mm256_setr_epi32(0, 0, 1, 1, 2, 2, 3, 3);
+        const __m256i hi = _mm256_setr_epi32(4, 4, 5, 5, 6, 6, 7, 7);
+        for(; x + 8 <= width; x += 8, dst += 16) {
+            __m256i v = _mm256_loadu_si256((const __m256i*)(src + x));
+            _mm256_storeu_si256((__m256i*)dst,       _mm256_permutevar8x32_epi32(v, lo));
+            _mm256_storeu_si256((__m256i*)(dst + 8), _mm256_permutevar8x32_epi32(v, hi));
+        }
+    } else if(4 == scale) {
+        for(; x + 8 <= width; x += 8, dst += 32) {
+            __m256i v = _mm256_loadu_si256((const __m256i*)(src + x));
+            for(int k = 0; k < 4; ++k) {
+                __m256i sel = _mm256_setr_epi32(2 * k, 2 * k, 2 * k, 2 * k,
+                        2 * k + 1, 2 * k + 1, 2 * k + 1, 2 * k + 1);
+                _mm256_storeu_si256((__m256i*)(dst + (8 * k)), _mm256_permutevar8x32_epi32(v, sel));
+            }
+        }
+    }
+
+    replicateSse2(src + x, dst, width - x, scale);
+}
+
+static void darkenSse2(const uint32_t *src, uint32_t *dst, size_t count)
+{
+    const __m128i mask = _mm_set1_epi32(0x007F7F7F);
+    const __m128i alpha = _mm_set1_epi32(0xFF000000);
+    size_t i = 0;
+    for(; i + 4 <= count; i += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+        v = _mm_or_si128(_mm_and_si128(_mm_srli_epi32(v, 1), mask), alpha);
+        _mm_storeu_si128((__m128i*)(dst + i), v);
+    }
+
+    for(; i < count; ++i) {
+        dst[i] = ((src[i] >> 1) & 0x007F7F7F) | 0xFF000000;
+    }
+}
+#endif
+
+static void replicate(const uint32_t *src, uint32_t *dst, int width, int scale)
+{
+#ifdef SCALER_HAVE_SSE2
+    static const bool haveAvx2 = __builtin_cpu_supports("avx2");
+    if(haveAvx2) {
+        replicateAvx2(src, dst, width, scale);
+    } else {
+        replicateSse2(src, dst, width, scale);
+    }
+#else
+    replicateScalar(src, dst, width, scale);
+#endif
+}
+
+static void darken(const uint32_t *src, uint32_t *dst, size_t count)
+{
+#ifdef SCALER_HAVE_SSE2
+    darkenSse2(src, dst, count);
+#else
+    for(size_t i = 0; i < count; ++i) {
+        dst[i] = ((src[i] >> 1) & 0x007F7F7F) | 0xFF000000;
+    }
+#endif
+}
+
+Scaler::Scaler(int scale, ScaleFilter filter)
+    : m_scale(scale)
+    , m_filter(filter)
+{
+    assert(1 <= scale && 4 >= scale);
+}
+
+int Scaler::getScale() const
+{
+    return m_scale;
+}
+
+ScaleFilter Scaler::getFilter() const
+{
+    return m_filter;
+}
+
+void Scaler::scale(const uint8_t *src, int width, int height, const uint32_t *palette,
+        uint32_t *dst, size_t dstPitch)
+{
+    m_row.resize(width);
+    const size_t rowPixels = (size_t)width * m_scale;
+    for(int y = 0; y < height; ++y) {
+        convertIndexed(src + ((size_t)y * width), m_row.data(), width, palette);
+        uint32_t *first = dst + ((size_t)y * m_scale * dstPitch);
+        if(1 == m_scale) {
+            memcpy(first, m_row.data(), rowPixels * sizeof(uint32_t));
+            continue;
+        }
+
+        replicate(m_row.data(), first, width, m_scale);
+        for(int s = 1; s < m_scale; ++s) {
+            uint32_t *row = first + (s * dstPitch);
+            if(SCALE_SCANLINES == m_filter && (m_scale - 1) == s) {
+                darken(first, row, rowPixels);
+            } else {
+                memcpy(row, first, rowPixels * sizeof(uint32_t));
+            }
+        }
+    }
+}
+
+}
@@ -0,0 +1,37 @@
+#ifndef INCLUDED_SCALER_H
+#define INCLUDED_SCALER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+namespace MOS6510 {
+
+enum ScaleFilter {
+    SCALE_NEAREST,
+    SCALE_SCANLINES     // last row of every scaled line at half brightness
+};
+
+// Integer nearest-neighbour scaler working straight from the indexed
+// framebuffer: each source row is expanded through the palette once,
+// replicated horizontally with SIMD, then copied down 'scale' rows.
+class Scaler {
+private:
+    int                     m_scale;
+    ScaleFilter             m_filter;
+    std::vector<uint32_t>   m_row;
+
+public:
+    Scaler(int scale, ScaleFilter filter);
+
+    int getScale() const;
+    ScaleFilter getFilter() const;
+
+    // dstPitch is in pixels; dst must hold (width * scale) x (height * scale)
+    void scale(const uint8_t *src, int width, int height, const uint32_t *palette,
+            uint32_t *dst, size_t dstPitch);
+};
+
+}
+
+#endif
@@ -0,0 +1,65 @@
+#include "scheduler.h"
+
+namespace MOS6510 {
+
+Scheduler::Scheduler()
+    : m_now(0)
+    , m_cycles(0)
+    , m_stall(0)
+{
+    for(int i = 0; i < EVENT_COUNT; ++i) {
+        m_deadline[i] = NEVER;
+    }
+}
+
+uint64_t Scheduler::now() const
+{
+    return m_now;
+}
+
+void Scheduler::tick(uint32_t ticks, uint32_t cycles)
+{
+    m_now += ticks;
+    m_cycles += cycles;
+}
+
+uint64_t Scheduler::cycles() const
+{
+    return m_cycles;
+}
+
+void Scheduler::schedule(SchedulerEvent event, uint64_t ticksFromNow)
+{
+    m_deadline[event] = m_now + ticksFromNow;
+}
+
+void Scheduler::cancel(SchedulerEvent event)
+{
+    m_deadline[event] = NEVER;
+}
+
+uint64_t Scheduler::ticksUntilNextEvent() const
+{
+    uint64_t next = NEVER;
+    for(int i = 0; i < EVENT_COUNT; ++i) {
+        if(m_deadline[i] < next) {
+            next = m_deadline[i];
+        }
+    }
+
+    return (next > m_now) ? (next - m_now) : 0;
+}
+
+void Scheduler::stall(uint32_t ticks)
+{
+    m_stall += ticks;
+}
+
+uint32_t Scheduler::consumeStall()
+{
+    uint32_t ticks = m_stall;
+    m_stall = 0;
+    return ticks;
+}
+
+}
@@ -0,0 +1,45 @@
+#ifndef INCLUDED_SCHEDULER_H
+#define INCLUDED_SCHEDULER_H
+
+#include <stdint.h>
+
+namespace MOS6510 {
+
+// Anything that changes machine state on its own, without the CPU doing
+// something first, keeps a deadline here so idle time can be skipped safely.
+enum SchedulerEvent {
+    EVENT_CIA1_TIMER,
+    EVENT_CIA2_TIMER,
+    EVENT_VIC_RASTER,
+    EVENT_VIC_FRAME,
+    EVENT_TAPE,
+    EVENT_COUNT
+};
+
+const uint64_t NEVER = UINT64_MAX;
+
+class Scheduler {
+private:
+    uint64_t    m_now;
+    uint64_t    m_cycles;       // real 6510 cycles, a tick is one instruction
+    uint64_t    m_deadline[EVENT_COUNT];
+    uint32_t    m_stall;        // ticks the CPU owes to DMA
+
+public:
+    Scheduler();
+
+    uint64_t now() const;
+    void tick(uint32_t ticks, uint32_t cycles);
+    uint64_t cycles() const;        // the clock devices with their own timing keep to
+
+    void schedule(SchedulerEvent event, uint64_t ticksFromNow);
+    void cancel(SchedulerEvent event);
+    uint64_t ticksUntilNextEvent() const;
+
+    void stall(uint32_t ticks);     // the CPU is held for ticks after this instruction
+    uint32_t consumeStall();
+};
+
+}
+
+#endif
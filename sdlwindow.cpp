@@ -0,0 +1,201 @@
+#include <stdio.h>
+#include <iostream>
+#include "sdlwindow.h"
+#include "memorycontroller.h"
+#include "palette.h"
+
+namespace MOS6510 {
+
+static int mapKeyToC64(SDL_Keycode key)
+{
+    switch(key) {
+        case SDLK_BACKSPACE     : return 0;
+        case SDLK_RETURN        : return 1;
+        case SDLK_RIGHT         : return 2;
+        case SDLK_F7            : return 3;
+        case SDLK_F1            : return 4;
+        case SDLK_F3            : return 5;
+        case SDLK_F5            : return 6;
+        case SDLK_DOWN          : return 7;
+        case SDLK_3             : return 8;
+        case SDLK_w             : return 9;
+        case SDLK_a             : return 10;
+        case SDLK_4             : return 11;
+        case SDLK_z             : return 12;
+        case SDLK_s             : return 13;
+        case SDLK_e             : return 14;
+        case SDLK_LSHIFT        : return 15;
+        case SDLK_5             : return 16;
+        case SDLK_r             : return 17;
+        case SDLK_d             : return 18;
+        case SDLK_6             : return 19;
+        case SDLK_c             : return 20;
+        case SDLK_f             : return 21;
+        case SDLK_t             : return 22;
+        case SDLK_x             : return 23;
+        case SDLK_7             : return 24;
+        case SDLK_y             : return 25;
+        case SDLK_g             : return 26;
+        case SDLK_8             : return 27;
+        case SDLK_b             : return 28;
+        case SDLK_h             : return 29;
+        case SDLK_u             : return 30;
+        case SDLK_v             : return 31;
+        case SDLK_9             : return 32;
+        case SDLK_i             : return 33;
+        case SDLK_j             : return 34;
+        case SDLK_0             : return 35;
+        case SDLK_m             : return 36;
+        case SDLK_k             : return 37;
+        case SDLK_o             : return 38;
+        case SDLK_n             : return 39;
+        case SDLK_LEFTBRACKET   : return 40;
+        case SDLK_p             : return 41;
+        case SDLK_l             : return 42;
+        case SDLK_MINUS         : return 43;
+        case SDLK_PERIOD        : return 44;
+        case SDLK_QUOTE         : return 45;
+        case SDLK_AT            : return 46;
+        case SDLK_COMMA         : return 47;
+        case SDLK_BACKSLASH     : return 48;
+        case SDLK_RIGHTBRACKET  : return 49;
+        case SDLK_SEMICOLON     : return 50;
+        case SDLK_HOME          : return 51;
+        case SDLK_RSHIFT        : return 52;
+        case SDLK_EQUALS        : return 53;
+        case SDLK_CARET         : return 54;
+        case SDLK_SLASH         : return 55;
+        case SDLK_1             : return 56;
+        case SDLK_LEFT          : return 57;
+        case SDLK_LCTRL         : return 58;
+        case SDLK_2             : return 59;
+        case SDLK_SPACE         : return 60;
+        case SDLK_RCTRL         : return 61;
+        case SDLK_q             : return 62;
+        case SDLK_TAB           : return 63;
+    };
+
+    return -1;
+}
+
+SdlWindow::SdlWindow(MemoryController& memory)
+    : m_memory(memory)
+    , m_window(0)
+    , m_surface(0)
+    , m_scaler(3, SCALE_NEAREST)
+    , m_quitRequested(false)
+{
+
+}
+
+SdlWindow::~SdlWindow()
+{
+    if(m_surface) {
+        SDL_FreeSurface(m_surface);
+    }
+    if(m_window) {
+        SDL_DestroyWindow(m_window);
+    }
+}
+
+bool SdlWindow::open()
+{
+    int rc = SDL_Init(SDL_INIT_VIDEO);
+    if (0 > rc) {
+        std::cerr << "Failed to start SDL, rc = " << rc << std::endl;
+        std::cerr << "SDL_Error = " << SDL_GetError() << std::endl;
+        return false;
+    }
+
+    if(SDL_IsTextInputActive()) {
+        printf("Stopping text input for performance reasons!\n");
+        SDL_StopTextInput();
+    }
+
+    m_window = SDL_CreateWindow("C64",
+            SDL_WINDOWPOS_UNDEFINED,
+            SDL_WINDOWPOS_UNDEFINED,
+            FRAME_WIDTH * m_scaler.getScale(),
+            FRAME_HEIGHT * m_scaler.getScale(),
+            SDL_WINDOW_SHOWN);
+    m_surface = SDL_CreateRGBSurface(0, FRAME_WIDTH, FRAME_HEIGHT, 32, 0, 0, 0, 0);
+    if(!m_window || !m_surface) {
+        std::cerr << "Failed to create window: " << SDL_GetError() << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+void SdlWindow::setScale(int scale, ScaleFilter filter)
+{
+    m_scaler = Scaler(scale, filter);
+    if(m_window) {
+        SDL_SetWindowSize(m_window, FRAME_WIDTH * scale, FRAME_HEIGHT * scale);
+    }
+}
+
+bool SdlWindow::isQuitRequested() const
+{
+    return m_quitRequested;
+}
+
+void SdlWindow::pollEvents()
+{
+    SDL_Event evt;
+    while(SDL_PollEvent(&evt)) {
+        if(SDL_KEYDOWN == evt.type || SDL_KEYUP == evt.type) {
+            SDL_Keycode keycode = evt.key.keysym.sym;
+            int ckey = mapKeyToC64(keycode);
+            if(SDLK_ESCAPE == keycode) {
+                m_quitRequested = true;
+            } else if(SDLK_PAGEUP == keycode) { // RESTORE is wired straight to NMI
+                if(SDL_KEYDOWN == evt.type) {
+                    m_memory.getInterrupts().raise(NMI_RESTORE);
+                } else {
+                    m_memory.getInterrupts().release(NMI_RESTORE);
+                }
+            } else if(-1 != ckey) {
+                if(SDL_KEYDOWN == evt.type) {
+                    m_memory.setKeyDown(ckey);
+                } else {
+                    m_memory.setKeyUp(ckey);
+                }
+            }
+        }
+    }
+}
+
+void SdlWindow::present(const uint8_t *indices, const uint32_t *palette)
+{
+    SDL_Surface *target = SDL_GetWindowSurface(m_window);
+    const int width = FRAME_WIDTH * m_scaler.getScale();
+    const int height = FRAME_HEIGHT * m_scaler.getScale();
+    if(4 == target->format->BytesPerPixel && 0x00FF0000 == target->format->Rmask
+            && width <= target->w && height <= target->h) {
+        // palette lookup and scaling straight in to the window, no intermediate copy
+        SDL_LockSurface(target);
+        m_scaler.scale(indices, FRAME_WIDTH, FRAME_HEIGHT, palette,
+                (uint32_t*)target->pixels, target->pitch / 4);
+        SDL_UnlockSurface(target);
+    } else {
+        convertIndexed(indices, (uint32_t*)m_surface->pixels,
+                FRAME_WIDTH * FRAME_HEIGHT, palette);
+        SDL_Rect tgt; tgt.x = 0; tgt.y = 0; tgt.w = width, tgt.h = height;
+        SDL_BlitScaled(m_surface, 0, target, &tgt);
+    }
+
+    SDL_UpdateWindowSurface(m_window);
+}
+
+void SdlWindow::onFrame(uint32_t, const uint8_t *indices, const uint32_t *palette)
+{
+    if(!m_window) {
+        return;
+    }
+
+    pollEvents();
+    present(indices, palette);
+}
+
+}
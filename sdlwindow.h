@@ -0,0 +1,39 @@
+#ifndef INCLUDED_SDL_WINDOW_H
+#define INCLUDED_SDL_WINDOW_H
+
+#include <SDL2/SDL.h>
+#include "framesink.h"
+#include "scaler.h"
+
+namespace MOS6510 {
+
+class MemoryController;
+
+// The SDL frontend: shows every frame in a window and feeds key presses to
+// the keyboard matrix. Register it as the first frame sink so input reaches
+// the machine before anything else sees the frame.
+class SdlWindow : public FrameSink {
+private:
+    MemoryController&   m_memory;
+    SDL_Window *        m_window;
+    SDL_Surface *       m_surface;
+    Scaler              m_scaler;
+    bool                m_quitRequested;
+
+    void pollEvents();
+    void present(const uint8_t *indices, const uint32_t *palette);
+
+public:
+    SdlWindow(MemoryController& memory);
+    virtual ~SdlWindow();
+
+    bool open();
+    void setScale(int scale, ScaleFilter filter);
+    bool isQuitRequested() const;
+
+    virtual void onFrame(uint32_t frame, const uint8_t *indices, const uint32_t *palette);
+};
+
+}
+
+#endif
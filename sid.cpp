@@ -0,0 +1,399 @@
+#include <assert.h>
+#include <string.h>
+#include <math.h>
+#include "sid.h"
+#include "memorycontroller.h"
+
+namespace MOS6510 {
+
+const uint32_t BLOCK_CYCLES = 20000;    // ~20ms of audio per synthesis pass
+
+// cycles per envelope step for each of the 16 attack/decay/release rates
+static const uint32_t ratePeriods[16] = {
+    9, 32, 63, 95, 149, 220, 267, 310,
+    392, 977, 1954, 3126, 3907, 11720, 19532, 31251
+};
+
+static uint8_t exponentialPeriod(uint8_t level)
+{
+    if(93 <= level) {
+        return 1;
+    } else if(54 <= level) {
+        return 2;
+    } else if(26 <= level) {
+        return 4;
+    } else if(14 <= level) {
+        return 8;
+    } else if(6 <= level) {
+        return 16;
+    }
+
+    return 30;
+}
+
+static inline uint32_t clockNoise(uint32_t lfsr)
+{
+    uint32_t bit = ((lfsr >> 22) ^ (lfsr >> 17)) & 1;
+    return ((lfsr << 1) | bit) & 0x7FFFFF;
+}
+
+SID::SID(MemoryController *memPtr, VideoStandard standard)
+    : m_memory(memPtr)
+    , m_model(SID_6581)
+    , m_clock(systemClock(standard))
+{
+    assert(m_memory);
+    init();
+    m_memory->registerSID(this);
+}
+
+SID::~SID()
+{
+
+}
+
+uint8_t SID::read(uint8_t addr)
+{
+    switch(addr & 0x1F) {
+        case 0x19: // POTX
+        case 0x1A: // POTY
+            return 0xFF;
+        case 0x1B: // OSC3
+            synthesize(m_cycle);
+            return (waveform(2) >> 4) & 0xFF;
+        case 0x1C: // ENV3
+            synthesize(m_cycle);
+            return m_voices[2].envelope;
+    }
+
+    return 0; // write-only registers
+}
+
+uint8_t SID::peek(uint8_t addr) const
+{
+    switch(addr & 0x1F) {
+        case 0x19: // POTX
+        case 0x1A: // POTY
+            return 0xFF;
+        case 0x1B: // OSC3
+            return (waveform(2) >> 4) & 0xFF;
+        case 0x1C: // ENV3
+            return m_voices[2].envelope;
+    }
+
+    return 0;
+}
+
+void SID::write(uint8_t addr, uint8_t data)
+{
+    SidRegisterWrite w;
+    w.cycle = m_cycle;
+    w.reg = addr & 0x1F;
+    w.data = data;
+    m_writes.push_back(w);
+}
+
+void SID::setModel(SidModel model)
+{
+    m_model = model;
+    updateFilter();
+}
+
+void SID::addAudioSink(AudioSink *sink)
+{
+    m_audioSinks.push_back(sink);
+}
+
+void SID::execute(uint32_t cycles)
+{
+    m_cycle += cycles;
+    if(BLOCK_CYCLES <= (m_cycle - m_clockedCycle)) {
+        synthesize(m_cycle);
+    }
+}
+
+void SID::flush()
+{
+    synthesize(m_cycle);
+}
+
+void SID::applyWrite(uint8_t reg, uint8_t data)
+{
+    m_registers[reg] = data;
+    if(0x15 <= reg) {
+        updateFilter();
+        return;
+    }
+
+    const int idx = reg / 7;
+    if(3 <= idx) {
+        return;
+    }
+
+    SidVoice& v = m_voices[idx];
+    switch(reg % 7) {
+        case 0: v.frequency = (v.frequency & 0xFF00) | data;                   break;
+        case 1: v.frequency = (v.frequency & 0x00FF) | (data << 8);            break;
+        case 2: v.pulseWidth = (v.pulseWidth & 0x0F00) | data;                 break;
+        case 3: v.pulseWidth = (v.pulseWidth & 0x00FF) | ((data & 0x0F) << 8); break;
+        case 4:
+            if((data & 0x01) && !(v.control & 0x01)) {
+                v.envState = ENV_ATTACK;
+            } else if(!(data & 0x01) && (v.control & 0x01)) {
+                v.envState = ENV_RELEASE;
+            }
+            if(data & 0x08) {
+                v.accumulator = 0;
+                v.noise = 0x7FFFF8;
+            }
+            v.control = data;
+            break;
+        case 5: v.attackDecay = data;                                          break;
+        case 6: v.sustainRelease = data;                                       break;
+    }
+}
+
+void SID::updateFilter()
+{
+    const uint16_t cutoff = (m_registers[0x16] << 3) | (m_registers[0x15] & 0x07);
+    const uint8_t resonance = m_registers[0x17] >> 4;
+    float fc;
+    if(SID_6581 == m_model) {
+        fc = 200.0f + (cutoff * 5.0f);      // rough fit of the 6581 curve
+    } else {
+        fc = 30.0f + (cutoff * 5.8f);       // the 8580 is close to linear
+    }
+
+    if(fc > AUDIO_SAMPLE_RATE * 0.45f) {
+        fc = AUDIO_SAMPLE_RATE * 0.45f;
+    }
+
+    m_filterF = 2.0f * sinf(3.14159265f * fc / AUDIO_SAMPLE_RATE);
+    m_filterQ = 1.4f - (resonance * (1.0f / 15.0f));
+}
+
+void SID::clockVoices(uint32_t cycles)
+{
+    if(0 == cycles) {
+        return;
+    }
+
+    for(int i = 0; i < 3; ++i) {
+        SidVoice& v = m_voices[i];
+        v.msbRising = false;
+        if(0 == (v.control & 0x08)) {
+            const uint64_t prev = v.accumulator;
+            const uint64_t next = prev + ((uint64_t)v.frequency * cycles);
+            uint64_t edges = ((next + 0x80000) >> 20) - ((prev + 0x80000) >> 20);
+            for(edges = (23 < edges) ? 23 : edges; edges; --edges) {
+                v.noise = clockNoise(v.noise);
+            }
+            v.msbRising = ((next + 0x800000) >> 24) != ((prev + 0x800000) >> 24);
+            v.accumulator = next & 0xFFFFFF;
+        }
+        clockEnvelope(v, cycles);
+    }
+
+    for(int i = 0; i < 3; ++i) {
+        if((m_voices[i].control & 0x02) && m_voices[(i + 2) % 3].msbRising) {
+            m_voices[i].accumulator = 0;
+        }
+    }
+}
+
+void SID::clockEnvelope(SidVoice& v, uint32_t cycles)
+{
+    uint32_t period;
+    switch(v.envState) {
+        case ENV_ATTACK:        period = ratePeriods[v.attackDecay >> 4];       break;
+        case ENV_DECAY_SUSTAIN: period = ratePeriods[v.attackDecay & 0x0F];     break;
+        default:                period = ratePeriods[v.sustainRelease & 0x0F];  break;
+    }
+
+    v.envCounter += cycles;
+    while(v.envCounter >= period) {
+        v.envCounter -= period;
+        if(ENV_ATTACK == v.envState) {
+            if(0xFF == v.envelope || 0xFF == ++v.envelope) {
+                v.envState = ENV_DECAY_SUSTAIN;
+                period = ratePeriods[v.attackDecay & 0x0F];
+            }
+            continue;
+        }
+
+        const uint8_t floor = (ENV_DECAY_SUSTAIN == v.envState) ? ((v.sustainRelease >> 4) * 0x11) : 0;
+        if(v.envelope <= floor) {
+            v.envCounter = 0; // holding, nothing more to do this block
+            break;
+        }
+
+        if(++v.expCounter >= exponentialPeriod(v.envelope)) {
+            v.expCounter = 0;
+            --v.envelope;
+        }
+    }
+}
+
+uint16_t SID::waveform(int idx) const
+{
+    const SidVoice& v = m_voices[idx];
+    const uint32_t acc = v.accumulator;
+    uint16_t out = 0xFFF;
+    bool selected = false;
+
+    if(v.control & 0x10) { // triangle, optionally ring modulated
+        uint32_t msb = acc & 0x800000;
+        if(v.control & 0x04) {
+            msb ^= m_voices[(idx + 2) % 3].accumulator & 0x800000;
+        }
+        out &= ((msb ? ~acc : acc) >> 11) & 0xFFF;
+        selected = true;
+    }
+
+    if(v.control & 0x20) { // sawtooth
+        out &= acc >> 12;
+        selected = true;
+    }
+
+    if(v.control & 0x40) { // pulse
+        out &= ((v.control & 0x08) || (acc >> 12) >= v.pulseWidth) ? 0xFFF : 0x000;
+        selected = true;
+    }
+
+    if(v.control & 0x80) { // noise
+        const uint32_t n = v.noise;
+        out &= ((n >> 9) & 0x800) | ((n >> 8) & 0x400) | ((n >> 5) & 0x200)
+             | ((n >> 3) & 0x100) | ((n >> 2) & 0x080) | ((n << 1) & 0x040)
+             | ((n << 3) & 0x020) | ((n << 4) & 0x010);
+        selected = true;
+    }
+
+    return selected ? out : 0;
+}
+
+int16_t SID::mix()
+{
+    const uint8_t routing = m_registers[0x17];
+    const uint8_t mode = m_registers[0x18];
+    int32_t direct = 0;
+    int32_t filtered = 0;
+    for(int i = 0; i < 3; ++i) {
+        int32_t sample = ((int32_t)waveform(i) - 0x800) * m_voices[i].envelope;
+        if(routing & (1 << i)) {
+            filtered += sample;
+        } else if(!(2 == i && (mode & 0x80))) { // voice 3 can be disconnected
+            direct += sample;
+        }
+    }
+
+    const float in = (float)filtered;
+    m_filterLow += m_filterF * m_filterBand;
+    const float high = in - m_filterLow - (m_filterQ * m_filterBand);
+    m_filterBand += m_filterF * high;
+
+    float out = (float)direct;
+    if(mode & 0x10) {
+        out += m_filterLow;
+    }
+    if(mode & 0x20) {
+        out += m_filterBand;
+    }
+    if(mode & 0x40) {
+        out += high;
+    }
+
+    // three full scale voices peak at ~1.57M before the master volume
+    out *= (mode & 0x0F) * (1.0f / (15.0f * 48.0f));
+    if(32767.0f < out) {
+        out = 32767.0f;
+    } else if(-32768.0f > out) {
+        out = -32768.0f;
+    }
+
+    return (int16_t)out;
+}
+
+void SID::synthesize(uint64_t untilCycle)
+{
+    size_t w = 0;
+    m_block.clear();
+    while((m_nextSample >> 16) <= untilCycle) {
+        const uint64_t sampleCycle = m_nextSample >> 16;
+        for(; w < m_writes.size() && m_writes[w].cycle <= sampleCycle; ++w) {
+            clockVoices(m_writes[w].cycle - m_clockedCycle);
+            m_clockedCycle = m_writes[w].cycle;
+            applyWrite(m_writes[w].reg, m_writes[w].data);
+        }
+
+        clockVoices(sampleCycle - m_clockedCycle);
+        m_clockedCycle = sampleCycle;
+        m_block.push_back(mix());
+        m_nextSample += m_sampleStep;
+    }
+
+    for(; w < m_writes.size(); ++w) {
+        clockVoices(m_writes[w].cycle - m_clockedCycle);
+        m_clockedCycle = m_writes[w].cycle;
+        applyWrite(m_writes[w].reg, m_writes[w].data);
+    }
+    m_writes.clear();
+
+    clockVoices(untilCycle - m_clockedCycle);
+    m_clockedCycle = untilCycle;
+
+    if(m_block.empty()) {
+        return;
+    }
+
+    for(size_t i = 0; i < m_audioSinks.size(); ++i) {
+        m_audioSinks[i]->onSamples(m_block.data(), m_block.size());
+    }
+}
+
+void SID::saveState(SIDState& state) const
+{
+    memcpy(state.registers, m_registers, sizeof(m_registers));
+    memcpy(state.voices, m_voices, sizeof(m_voices));
+    state.cycle = m_cycle;
+    state.clockedCycle = m_clockedCycle;
+    state.nextSample = m_nextSample;
+    state.filterLow = m_filterLow;
+    state.filterBand = m_filterBand;
+    state.writes = m_writes;
+}
+
+// the model and audio sinks belong to the host, not the snapshot
+void SID::loadState(const SIDState& state)
+{
+    memcpy(m_registers, state.registers, sizeof(m_registers));
+    memcpy(m_voices, state.voices, sizeof(m_voices));
+    m_cycle = state.cycle;
+    m_clockedCycle = state.clockedCycle;
+    m_nextSample = state.nextSample;
+    m_filterLow = state.filterLow;
+    m_filterBand = state.filterBand;
+    m_writes = state.writes;
+    updateFilter();
+}
+
+void SID::init()
+{
+    memset(m_registers, 0, sizeof(m_registers));
+    memset(m_voices, 0, sizeof(m_voices));
+    for(int i = 0; i < 3; ++i) {
+        m_voices[i].noise = 0x7FFFF8;
+        m_voices[i].envState = ENV_RELEASE;
+    }
+
+    m_cycle = 0;
+    m_clockedCycle = 0;
+    m_nextSample = 0;
+    m_sampleStep = ((uint64_t)m_clock << 16) / AUDIO_SAMPLE_RATE;
+    m_filterLow = 0.0f;
+    m_filterBand = 0.0f;
+    m_writes.reserve(1024);
+    m_block.reserve((BLOCK_CYCLES * AUDIO_SAMPLE_RATE / m_clock) + 16);
+    updateFilter();
+}
+
+}
@@ -0,0 +1,108 @@
+#ifndef INCLUDED_SID_H
+#define INCLUDED_SID_H
+
+#include <stdint.h>
+#include <vector>
+#include "audiosink.h"
+#include "machineconfig.h"
+
+namespace MOS6510 {
+
+class MemoryController;
+
+enum SidModel {
+    SID_6581,
+    SID_8580
+};
+
+enum EnvelopeState {
+    ENV_ATTACK,
+    ENV_DECAY_SUSTAIN,
+    ENV_RELEASE
+};
+
+struct SidVoice {
+    uint32_t        accumulator;    // 24-bit phase
+    uint32_t        noise;          // 23-bit LFSR
+    uint16_t        frequency;
+    uint16_t        pulseWidth;
+    uint8_t         control;
+    uint8_t         attackDecay;
+    uint8_t         sustainRelease;
+    uint8_t         envelope;
+    EnvelopeState   envState;
+    uint32_t        envCounter;
+    uint8_t         expCounter;
+    bool            msbRising;      // for hard sync of the next voice
+};
+
+struct SidRegisterWrite {
+    uint64_t    cycle;
+    uint8_t     reg;
+    uint8_t     data;
+};
+
+// the chip as of the last write, plus the writes not yet synthesized
+struct SIDState {
+    uint8_t                         registers[32];
+    SidVoice                        voices[3];
+    uint64_t                        cycle;
+    uint64_t                        clockedCycle;
+    uint64_t                        nextSample;
+    float                           filterLow;
+    float                           filterBand;
+    std::vector<SidRegisterWrite>   writes;
+};
+
+// Register writes are only queued with a cycle stamp; samples are produced
+// a block at a time, replaying the queue so every write lands on the right
+// output sample without clocking the chip on each CPU cycle.
+class SID {
+private:
+    MemoryController*           m_memory;
+    SidModel                    m_model;
+    uint32_t                    m_clock;        // system clock in Hz
+    uint8_t                     m_registers[32];
+    SidVoice                    m_voices[3];
+    uint64_t                    m_cycle;
+    uint64_t                    m_clockedCycle;
+    uint64_t                    m_nextSample;   // 16.16 fixed point cycle
+    uint64_t                    m_sampleStep;
+    float                       m_filterLow;
+    float                       m_filterBand;
+    float                       m_filterF;
+    float                       m_filterQ;
+    std::vector<SidRegisterWrite> m_writes;
+    std::vector<int16_t>        m_block;
+    std::vector<AudioSink*>     m_audioSinks;
+
+    void applyWrite(uint8_t reg, uint8_t data);
+    void updateFilter();
+    void clockVoices(uint32_t cycles);
+    void clockEnvelope(SidVoice& voice, uint32_t cycles);
+    uint16_t waveform(int idx) const;
+    int16_t mix();
+    void synthesize(uint64_t untilCycle);
+
+public:
+    SID(MemoryController *memPtr, VideoStandard standard);
+    ~SID();
+
+    uint8_t read(uint8_t addr);
+    uint8_t peek(uint8_t addr) const;   // OSC3 and ENV3 as last synthesized
+    void write(uint8_t addr, uint8_t data);
+
+    void setModel(SidModel model);
+    void addAudioSink(AudioSink *sink);
+
+    void saveState(SIDState& state) const;
+    void loadState(const SIDState& state);
+
+    void init();
+    void execute(uint32_t cycles);
+    void flush();
+};
+
+}
+
+#endif
@@ -0,0 +1,101 @@
+#include "threadpool.h"
+
+namespace MOS6510 {
+
+ThreadPool::ThreadPool(size_t threads)
+    : m_job(0)
+    , m_count(0)
+    , m_next(0)
+    , m_busy(0)
+    , m_generation(0)
+    , m_stopping(false)
+{
+    if(0 == threads) {
+        threads = std::thread::hardware_concurrency();
+    }
+
+    for(size_t i = 1; i < threads; ++i) {
+        m_workers.push_back(std::thread(&ThreadPool::workerLoop, this));
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_start.notify_all();
+    for(size_t i = 0; i < m_workers.size(); ++i) {
+        m_workers[i].join();
+    }
+}
+
+size_t ThreadPool::getThreads() const
+{
+    return m_workers.size() + 1;
+}
+
+// hands out indices until the batch is exhausted
+void ThreadPool::drain()
+{
+    for(;;) {
+        size_t index = m_next.fetch_add(1);
+        if(index >= m_count) {
+            return;
+        }
+        m_job->run(index);
+    }
+}
+
+void ThreadPool::workerLoop()
+{
+    uint64_t seen = 0;
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for(;;) {
+        while(!m_stopping && seen == m_generation) {
+            m_start.wait(lock);
+        }
+        if(m_stopping) {
+            return;
+        }
+
+        seen = m_generation;
+        lock.unlock();
+        drain();
+        lock.lock();
+        if(0 == --m_busy) {
+            m_done.notify_one();
+        }
+    }
+}
+
+void ThreadPool::run(ParallelJob& job, size_t count)
+{
+    if(m_workers.empty() || count <= 1) {
+        for(size_t i = 0; i < count; ++i) {
+            job.run(i);
+        }
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_job = &job;
+        m_count = count;
+        m_next = 0;
+        m_busy = m_workers.size();
+        ++m_generation;
+    }
+    m_start.notify_all();
+
+    drain();
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while(0 != m_busy) {
+        m_done.wait(lock);
+    }
+    m_job = 0;
+}
+
+}
@@ -0,0 +1,53 @@
+#ifndef INCLUDED_THREAD_POOL_H
+#define INCLUDED_THREAD_POOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+namespace MOS6510 {
+
+// One batch of independent work items, run(index) is called once for each
+// index below the count given to ThreadPool::run, from any thread.
+class ParallelJob {
+public:
+    virtual ~ParallelJob() {}
+    virtual void run(size_t index) = 0;
+};
+
+// Fixed set of workers for fork/join batches. The calling thread takes
+// part in every batch, so a pool of one thread starts no workers at all.
+class ThreadPool {
+private:
+    std::vector<std::thread>    m_workers;
+    std::mutex                  m_mutex;
+    std::condition_variable     m_start;
+    std::condition_variable     m_done;
+    ParallelJob*                m_job;
+    size_t                      m_count;
+    std::atomic<size_t>         m_next;
+    size_t                      m_busy;         // workers still inside the current batch
+    uint64_t                    m_generation;   // bumped for every batch
+    bool                        m_stopping;
+
+    ThreadPool(const ThreadPool& rhs);
+    ThreadPool& operator=(const ThreadPool& rhs);
+
+    void workerLoop();
+    void drain();
+
+public:
+    ThreadPool(size_t threads);    // including the caller, 0 picks one per core
+    ~ThreadPool();
+
+    size_t getThreads() const;
+    void run(ParallelJob& job, size_t count); // returns once every index is done
+};
+
+}
+
+#endif
@@ -0,0 +1,248 @@
+#include "via6522.h"
+
+namespace MOS6510 {
+
+enum ViaRegisters {
+    VIA_ORB     = 0x00,
+    VIA_ORA     = 0x01,
+    VIA_DDRB    = 0x02,
+    VIA_DDRA    = 0x03,
+    VIA_T1CL    = 0x04,
+    VIA_T1CH    = 0x05,
+    VIA_T1LL    = 0x06,
+    VIA_T1LH    = 0x07,
+    VIA_T2CL    = 0x08,
+    VIA_T2CH    = 0x09,
+    VIA_SR      = 0x0A,
+    VIA_ACR     = 0x0B,
+    VIA_PCR     = 0x0C,
+    VIA_IFR     = 0x0D,
+    VIA_IER     = 0x0E,
+    VIA_ORA_NH  = 0x0F
+};
+
+enum ViaControl {
+    ACR_LATCH_A     = 0x01,
+    ACR_T1_FREE     = 0x40,
+    PCR_CA1_RISING  = 0x01,
+    PCR_CA2_MODE    = 0x0E,
+    PCR_CA2_LOW     = 0x0C,
+    PCR_CB2_MODE    = 0xE0,
+    PCR_CB2_LOW     = 0xC0
+};
+
+Via6522::Via6522()
+{
+    reset();
+}
+
+// the timers and latches are not cleared by a real reset either
+void Via6522::reset()
+{
+    m_ora = 0;
+    m_orb = 0;
+    m_ddra = 0;
+    m_ddrb = 0;
+    m_pinsA = 0xFF;
+    m_pinsB = 0xFF;
+    m_latchA = 0xFF;
+    m_t1Counter = 0xFFFF;
+    m_t1Latch = 0xFFFF;
+    m_t2Counter = 0xFFFF;
+    m_t2LatchLo = 0xFF;
+    m_t1Armed = false;
+    m_t2Armed = false;
+    m_sr = 0;
+    m_acr = 0;
+    m_pcr = 0;
+    m_ifr = 0;
+    m_ier = 0;
+    m_ca1 = false;
+}
+
+uint8_t Via6522::read(uint8_t reg)
+{
+    switch(reg & 0x0F) {
+        case VIA_ORB:
+            return (m_orb & m_ddrb) | (m_pinsB & ~m_ddrb);
+        case VIA_ORA:
+            m_ifr &= ~(VIA_IRQ_CA1 | VIA_IRQ_CA2);
+            // fall through
+        case VIA_ORA_NH:
+            return (ACR_LATCH_A & m_acr) ? m_latchA : m_pinsA;
+        case VIA_DDRB:
+            return m_ddrb;
+        case VIA_DDRA:
+            return m_ddra;
+        case VIA_T1CL:
+            m_ifr &= ~VIA_IRQ_T1;
+            return m_t1Counter & 0xFF;
+        case VIA_T1CH:
+            return m_t1Counter >> 8;
+        case VIA_T1LL:
+            return m_t1Latch & 0xFF;
+        case VIA_T1LH:
+            return m_t1Latch >> 8;
+        case VIA_T2CL:
+            m_ifr &= ~VIA_IRQ_T2;
+            return m_t2Counter & 0xFF;
+        case VIA_T2CH:
+            return m_t2Counter >> 8;
+        case VIA_SR:
+            return m_sr;
+        case VIA_ACR:
+            return m_acr;
+        case VIA_PCR:
+            return m_pcr;
+        case VIA_IFR:
+            return m_ifr | (isIrq() ? 0x80 : 0x00);
+        case VIA_IER:
+            return m_ier | 0x80;
+    }
+
+    return 0xFF;
+}
+
+void Via6522::write(uint8_t reg, uint8_t data)
+{
+    switch(reg & 0x0F) {
+        case VIA_ORB:
+            m_orb = data;
+            break;
+        case VIA_ORA:
+            m_ifr &= ~(VIA_IRQ_CA1 | VIA_IRQ_CA2);
+            m_ora = data;
+            break;
+        case VIA_ORA_NH:
+            m_ora = data;
+            break;
+        case VIA_DDRB:
+            m_ddrb = data;
+            break;
+        case VIA_DDRA:
+            m_ddra = data;
+            break;
+        case VIA_T1CL:
+        case VIA_T1LL:
+            m_t1Latch = (m_t1Latch & 0xFF00) | data;
+            break;
+        case VIA_T1CH:
+            m_t1Latch = (m_t1Latch & 0x00FF) | (data << 8);
+            m_t1Counter = m_t1Latch;
+            m_t1Armed = true;
+            m_ifr &= ~VIA_IRQ_T1;
+            break;
+        case VIA_T1LH:
+            m_t1Latch = (m_t1Latch & 0x00FF) | (data << 8);
+            m_ifr &= ~VIA_IRQ_T1;
+            break;
+        case VIA_T2CL:
+            m_t2LatchLo = data;
+            break;
+        case VIA_T2CH:
+            m_t2Counter = (data << 8) | m_t2LatchLo;
+            m_t2Armed = true;
+            m_ifr &= ~VIA_IRQ_T2;
+            break;
+        case VIA_SR:
+            m_sr = data;
+            break;
+        case VIA_ACR:
+            m_acr = data;
+            break;
+        case VIA_PCR:
+            m_pcr = data;
+            break;
+        case VIA_IFR:
+            m_ifr &= ~(data & 0x7F);
+            break;
+        case VIA_IER:
+            if(0x80 & data) {
+                m_ier |= (data & 0x7F);
+            } else {
+                m_ier &= ~(data & 0x7F);
+            }
+            break;
+    }
+}
+
+// A free running T1 reloads from the latch every latch + 2 cycles. T2 is
+// always one-shot and keeps counting down through zero afterwards.
+void Via6522::tick(uint32_t cycles)
+{
+    if(cycles <= m_t1Counter) {
+        m_t1Counter -= cycles;
+    } else {
+        uint32_t over = cycles - m_t1Counter - 1;
+        if(m_t1Armed) {
+            m_ifr |= VIA_IRQ_T1;
+            m_t1Armed = (0 != (ACR_T1_FREE & m_acr));
+        }
+        if(ACR_T1_FREE & m_acr) {
+            over %= (uint32_t)m_t1Latch + 2;
+            m_t1Counter = (over <= m_t1Latch) ? (m_t1Latch - over) : 0xFFFF;
+        } else {
+            m_t1Counter = 0xFFFF - over;
+        }
+    }
+
+    if(cycles <= m_t2Counter) {
+        m_t2Counter -= cycles;
+    } else {
+        if(m_t2Armed) {
+            m_ifr |= VIA_IRQ_T2;
+            m_t2Armed = false;
+        }
+        m_t2Counter = 0xFFFF - (cycles - m_t2Counter - 1);
+    }
+}
+
+void Via6522::setPinsA(uint8_t pins)
+{
+    m_pinsA = pins;
+}
+
+void Via6522::setPinsB(uint8_t pins)
+{
+    m_pinsB = pins;
+}
+
+uint8_t Via6522::getPortA() const
+{
+    return m_ora | ~m_ddra;
+}
+
+uint8_t Via6522::getPortB() const
+{
+    return m_orb | ~m_ddrb;
+}
+
+void Via6522::setCA1(bool level)
+{
+    if(level == m_ca1) {
+        return;
+    }
+
+    m_ca1 = level;
+    if(level == (0 != (PCR_CA1_RISING & m_pcr))) {
+        m_latchA = m_pinsA;
+        m_ifr |= VIA_IRQ_CA1;
+    }
+}
+
+bool Via6522::getCA2() const
+{
+    return PCR_CA2_LOW != (PCR_CA2_MODE & m_pcr);
+}
+
+bool Via6522::getCB2() const
+{
+    return PCR_CB2_LOW != (PCR_CB2_MODE & m_pcr);
+}
+
+bool Via6522::isIrq() const
+{
+    return 0 != (m_ifr & m_ier & 0x7F);
+}
+
+}
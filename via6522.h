@@ -0,0 +1,64 @@
+#ifndef INCLUDED_VIA6522_H
+#define INCLUDED_VIA6522_H
+
+#include <stdint.h>
+
+namespace MOS6510 {
+
+enum ViaInterrupts {
+    VIA_IRQ_CA2     = 0x01,
+    VIA_IRQ_CA1     = 0x02,
+    VIA_IRQ_SR      = 0x04,
+    VIA_IRQ_CB2     = 0x08,
+    VIA_IRQ_CB1     = 0x10,
+    VIA_IRQ_T2      = 0x20,
+    VIA_IRQ_T1      = 0x40
+};
+
+// A 6522 as wired in the 1541: two ports, both timers and the CA1/CA2/CB2
+// control lines. Handshake modes and the shift register are not emulated,
+// neither drive VIA uses them. Timers are clocked a whole instruction at a
+// time by tick().
+class Via6522 {
+private:
+    uint8_t     m_ora;
+    uint8_t     m_orb;
+    uint8_t     m_ddra;
+    uint8_t     m_ddrb;
+    uint8_t     m_pinsA;        // levels driven from outside
+    uint8_t     m_pinsB;
+    uint8_t     m_latchA;       // port A as of the last active CA1 edge
+    uint16_t    m_t1Counter;
+    uint16_t    m_t1Latch;
+    uint16_t    m_t2Counter;
+    uint8_t     m_t2LatchLo;
+    bool        m_t1Armed;      // one-shot T1 and T2 only interrupt once per load
+    bool        m_t2Armed;
+    uint8_t     m_sr;
+    uint8_t     m_acr;
+    uint8_t     m_pcr;
+    uint8_t     m_ifr;
+    uint8_t     m_ier;
+    bool        m_ca1;
+
+public:
+    Via6522();
+
+    void    reset();
+    uint8_t read(uint8_t reg);
+    void    write(uint8_t reg, uint8_t data);
+    void    tick(uint32_t cycles);
+
+    void    setPinsA(uint8_t pins);
+    void    setPinsB(uint8_t pins);
+    uint8_t getPortA() const;       // output levels, input bits read high
+    uint8_t getPortB() const;
+    void    setCA1(bool level);
+    bool    getCA2() const;         // high unless PCR holds it low manually
+    bool    getCB2() const;
+    bool    isIrq() const;
+};
+
+}
+
+#endif
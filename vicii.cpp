@@ -1,29 +1,15 @@
 #include <assert.h>
+#include <string.h>
 #include <stdio.h>
-#include <iostream>
+#include <algorithm>
+#include <utility>
 #include "vicii.h"
 #include "memorycontroller.h"
+#include "framesink.h"
+#include "palette.h"
 
 namespace MOS6510 {
 
-const uint32_t colors[] =
-    { 0xFF000000,
-      0xFFFFFFFF,
-      0xFF880000,
-      0xFFAAFFEE,
-      0xFFCC44CC,
-      0xFF00CC55,
-      0xFF0000AA,
-      0xFFEEEE77,
-      0xFFDD88EE,
-      0xFF664400,
-      0xFFFF7777,
-      0xFF333333,
-      0xFF777777,
-      0xFFAAFF66,
-      0xFF0088FF,
-      0xFFBBBBBB };
-
 uint16_t VICII::getRasterLine()
 {
     uint16_t raster = (0x80 == (0x80 & m_registers.reg.ctrl1)) ? 0x100 : 0;
@@ -41,9 +27,18 @@ void VICII::setRasterLine(uint16_t rasterLine)
     }
 }
 
-VICII::VICII(MemoryController *memPtr, uint8_t *cgromPtr)
+VICII::VICII(MemoryController *memPtr, const uint8_t *cgromPtr, VideoStandard standard)
     : m_memory(memPtr)
+    , m_standard(standard)
     , m_cgromPtr(cgromPtr)
+    , m_frameCount(0)
+    , m_palette(defaultPalette())
+    , m_frameSkip(1)
+    , m_threaded(false)
+    , m_renderPending(false)
+    , m_front(0)
+    , m_renderJobs(1)
+    , m_renderDone(1)
 {
     assert(m_memory);
     init();
@@ -52,12 +47,30 @@ VICII::VICII(MemoryController *memPtr, uint8_t *cgromPtr)
 
 VICII::~VICII()
 {
-    SDL_DestroyWindow(m_window);
+    if(m_threaded) {
+        m_renderJobs.close();
+        m_renderThread.join();
+    }
 }
 
-uint8_t VICII::read(uint8_t addr)
+enum VICIIInterrupts {
+    VIC_IRQ_RASTER      = 0x01,
+    VIC_IRQ_SPRITE_BG   = 0x02, // no sprites yet, never raised
+    VIC_IRQ_SPRITE      = 0x04,
+    VIC_IRQ_LIGHTPEN    = 0x08
+};
+
+uint8_t VICII::read(uint8_t addr) const
 {
-    if(47 > addr) {
+    if(0x19 == addr) { // unused bits read as 1, bit 7 mirrors the IRQ line
+        uint8_t flags = m_registers.reg.interruptFlags | 0x70;
+        if(m_registers.reg.interruptFlags & m_registers.reg.interruptEnable) {
+            flags |= 0x80;
+        }
+        return flags;
+    } else if(0x1A == addr) {
+        return m_registers.reg.interruptEnable | 0xF0;
+    } else if(47 > addr) {
         return m_registers.all[addr];
     } else if(63 < addr) {
         return read(addr - 64);
@@ -68,181 +81,319 @@ uint8_t VICII::read(uint8_t addr)
 
 void VICII::write(uint8_t addr, uint8_t data)
 {
+    switch(addr) {
+        case 0x11: // bit 7 sets bit 8 of the raster compare, reads give the raster line
+            m_rasterTrigger = (m_rasterTrigger & 0xFF) | ((data & 0x80) << 1);
+            m_registers.reg.ctrl1 = (data & 0x7F) | (m_registers.reg.ctrl1 & 0x80);
+            scheduleRasterInterrupt();
+            return;
+        case 0x12:
+            m_rasterTrigger = (m_rasterTrigger & 0x100) | data;
+            scheduleRasterInterrupt();
+            return;
+        case 0x19: // writing a 1 acknowledges
+            m_registers.reg.interruptFlags &= ~(data & 0x0F);
+            updateInterrupt();
+            return;
+        case 0x1A:
+            m_registers.reg.interruptEnable = data & 0x0F;
+            updateInterrupt();
+            scheduleRasterInterrupt();
+            return;
+    }
+
     if(47 > addr) {
         m_registers.all[addr] = data;
+        logWrite(0xD000 | addr, data);
     } else if(63 < addr) {
         write(addr - 64, data);
     }
 }
 
-int mapKeyToC64(SDL_Keycode key)
-{
-    switch(key) {
-        case SDLK_BACKSPACE     : return 0;
-        case SDLK_RETURN        : return 1;
-        case SDLK_RIGHT         : return 2;
-        case SDLK_F7            : return 3;
-        case SDLK_F1            : return 4;
-        case SDLK_F3            : return 5;
-        case SDLK_F5            : return 6;
-        case SDLK_DOWN          : return 7;
-        case SDLK_3             : return 8;
-        case SDLK_w             : return 9;
-        case SDLK_a             : return 10;
-        case SDLK_4             : return 11;
-        case SDLK_z             : return 12;
-        case SDLK_s             : return 13;
-        case SDLK_e             : return 14;
-        case SDLK_LSHIFT        : return 15;
-        case SDLK_5             : return 16;
-        case SDLK_r             : return 17;
-        case SDLK_d             : return 18;
-        case SDLK_6             : return 19;
-        case SDLK_c             : return 20;
-        case SDLK_f             : return 21;
-        case SDLK_t             : return 22;
-        case SDLK_x             : return 23;
-        case SDLK_7             : return 24;
-        case SDLK_y             : return 25;
-        case SDLK_g             : return 26;
-        case SDLK_8             : return 27;
-        case SDLK_b             : return 28;
-        case SDLK_h             : return 29;
-        case SDLK_u             : return 30;
-        case SDLK_v             : return 31;
-        case SDLK_9             : return 32;
-        case SDLK_i             : return 33;
-        case SDLK_j             : return 34;
-        case SDLK_0             : return 35;
-        case SDLK_m             : return 36;
-        case SDLK_k             : return 37;
-        case SDLK_o             : return 38;
-        case SDLK_n             : return 39;
-        case SDLK_LEFTBRACKET   : return 40;
-        case SDLK_p             : return 41;
-        case SDLK_l             : return 42;
-        case SDLK_MINUS         : return 43;
-        case SDLK_PERIOD        : return 44;
-        case SDLK_QUOTE         : return 45;
-        case SDLK_AT            : return 46;
-        case SDLK_COMMA         : return 47;
-        case SDLK_BACKSLASH     : return 48;
-        case SDLK_RIGHTBRACKET  : return 49;
-        case SDLK_SEMICOLON     : return 50;
-        case SDLK_HOME          : return 51;
-        case SDLK_RSHIFT        : return 52;
-        case SDLK_EQUALS        : return 53;
-        case SDLK_CARET         : return 54;
-        case SDLK_SLASH         : return 55;
-        case SDLK_1             : return 56;
-        case SDLK_LEFT          : return 57;
-        case SDLK_LCTRL         : return 58;
-        case SDLK_2             : return 59;
-        case SDLK_SPACE         : return 60;
-        case SDLK_RCTRL         : return 61;
-        case SDLK_q             : return 62;
-        case SDLK_TAB           : return 63;
-    };
-
-    return -1;
+void VICII::logWrite(uint16_t addr, uint8_t data)
+{
+    VideoWrite write;
+    write.tick = m_frameTick;
+    write.addr = addr;
+    write.data = data;
+    m_logs[m_recording].writes.push_back(write);
 }
 
+template <class Config>
 void VICII::execute()
 {
     uint16_t raster = getRasterLine();
-    uint16_t xCoord = m_xCycle++ * 8;
-    uint32_t* pixelPtr = ((uint32_t*)m_surface->pixels);
-    uint32_t color = 0;
-    const uint32_t bdColor = colors[m_registers.reg.borderColor];
-    const uint32_t bgColor = colors[m_registers.reg.backgroundColor0];
-    for(int ix = 0; ix < 8; ++ix) {
-        if(13 < raster && 248 > raster) { // within the non-blanked portion
-            uint16_t x = xCoord + ix;
-            if(49 < x && 462 > x) {
-                if(30 < raster && 230 > raster) { // non-border
-                    if(95 < x && 416 > x) {
-                        uint8_t sx = (x - 96) / 8;
-                        uint8_t sy = (raster - 30) / 8;
-                        uint8_t sl = (raster - 30) % 8;
-                        uint16_t sxy = 0x0400 + ((40 * sy) + sx);
-                        uint16_t cxy = 0xD800 + ((40 * sy) + sx);
-                        uint8_t ch = m_memory->read(sxy);
-                        uint8_t pixels = m_cgromPtr[(ch * 8) + sl];
-                        uint8_t mask = (1 << (7 - ((x - 96) % 8)));
-                        if(mask == (mask & pixels)) {
-                            color = colors[m_memory->read(cxy)];
+    ++m_xCycle;
+    ++m_frameTick;
+    if(Config::LINE_TICKS <= m_xCycle) {
+        // next raster line
+        setRasterLine(++raster);
+        m_xCycle = 0;
+        if(raster == m_rasterTrigger && Config::LINES > raster) {
+            m_registers.reg.interruptFlags |= VIC_IRQ_RASTER;
+            updateInterrupt();
+            scheduleRasterInterrupt();
+        }
+    }
+
+    if(Config::LINES <= raster) { // crossed end of screen, hand the frame to the sinks
+        setRasterLine(0);
+        if(0 == m_rasterTrigger) {
+            m_registers.reg.interruptFlags |= VIC_IRQ_RASTER;
+            updateInterrupt();
+        }
+        m_memory->getScheduler().schedule(EVENT_VIC_FRAME, Config::FRAME_TICKS);
+        endFrame();
+    }
+}
+
+template void VICII::execute<PalConfig>();
+template void VICII::execute<PalDebugConfig>();
+template void VICII::execute<NtscConfig>();
+template void VICII::execute<NtscDebugConfig>();
+
+// Draws a whole frame the way the beam would have, applying each logged
+// write just before the first tick that could see it.
+void VICII::renderFrame(const VideoFrameLog& log, uint8_t *frameBuffer) const
+{
+    const int ticks = lineTicks(m_standard);
+    VICIIRegisterFile registers = log.registers;
+    uint8_t port = log.port;
+    uint8_t screen[VIDEO_MATRIX_SIZE];
+    uint8_t colors[VIDEO_MATRIX_SIZE];
+    memcpy(screen, log.screen, sizeof(screen));
+    memcpy(colors, log.color, sizeof(colors));
+
+    size_t w = 0;
+    for(int raster = 14; raster < 248; ++raster) { // the non-blanked portion
+        for(int xCycle = 6; xCycle < 58; ++xCycle) {
+            const uint32_t tick = (raster * ticks) + xCycle;
+            for(; w < log.writes.size() && log.writes[w].tick <= tick; ++w) {
+                const VideoWrite& vw = log.writes[w];
+                if(SCREEN_RAM == (vw.addr & 0xFC00)) {
+                    screen[vw.addr & 0x3FF] = vw.data;
+                } else if(COLOR_RAM == (vw.addr & 0xFC00)) {
+                    colors[vw.addr & 0x3FF] = vw.data;
+                } else if(0x0001 == vw.addr) {
+                    port = vw.data;
+                } else {
+                    registers.all[vw.addr & 0x3F] = vw.data;
+                }
+            }
+
+            // colour RAM reads back as open bus while the character ROM is banked in
+            const bool colorRam = (0 == port) || (CHAREN & port);
+            const uint16_t xCoord = xCycle * 8;
+            const uint8_t bdColor = registers.reg.borderColor & 0x0F;
+            const uint8_t bgColor = registers.reg.backgroundColor0 & 0x0F;
+            uint8_t color = 0;
+            for(int ix = 0; ix < 8; ++ix) {
+                uint16_t x = xCoord + ix;
+                if(49 < x && 462 > x) {
+                    if(30 < raster && 230 > raster) { // non-border
+                        if(95 < x && 416 > x) {
+                            uint8_t sx = (x - 96) / 8;
+                            uint8_t sy = (raster - 30) / 8;
+                            uint8_t sl = (raster - 30) % 8;
+                            uint16_t sxy = (40 * sy) + sx;
+                            uint8_t ch = screen[sxy];
+                            uint8_t pixels = m_cgromPtr[(ch * 8) + sl];
+                            uint8_t mask = (1 << (7 - ((x - 96) % 8)));
+                            if(mask == (mask & pixels)) {
+                                color = colorRam ? (colors[sxy] & 0x0F) : 0x0F;
+                            } else {
+                                color = bgColor;
+                            }
                         } else {
-                            color = bgColor;
+                            color = bdColor;
                         }
                     } else {
                         color = bdColor;
                     }
-                } else {
-                    color = bdColor;
-                }
 
-                uint32_t idx = (x - 50) + ((raster - 14) * 412);
-                pixelPtr[idx] = color;
+                    uint32_t idx = (x - 50) + ((raster - 14) * FRAME_WIDTH);
+                    frameBuffer[idx] = color;
+                }
             }
         }
     }
+}
 
-    if(64 <= m_xCycle) {
-        // next raster line
-        setRasterLine(++raster);
-        m_xCycle = 0;
+void VICII::renderLoop()
+{
+    int job;
+    while(m_renderJobs.pop(job)) {
+        renderFrame(m_logs[job], m_frameBuffers[1 - m_front]);
+        m_renderDone.push(std::move(job));
     }
+}
 
-    if(262 < raster) { // crossed end of screen, transfer SDL buffer to window now
-        SDL_Event evt;
-        while(SDL_PollEvent(&evt)) {
-            if(SDL_KEYDOWN == evt.type || SDL_KEYUP == evt.type) {
-                SDL_Keycode keycode = evt.key.keysym.sym;
-                int ckey = mapKeyToC64(keycode);
-                if(SDLK_ESCAPE == keycode) {
-                    exit(0);
-                } else if(-1 != ckey) {
-                    if(SDL_KEYDOWN == evt.type) {
-                        m_memory->setKeyDown(ckey);
-                    } else {
-                        m_memory->setKeyUp(ckey);
-                    }
-                }
-            }
+void VICII::setFrameSkip(uint32_t frames)
+{
+    assert(0 < frames);
+    m_frameSkip = frames;
+}
+
+void VICII::startRenderThread()
+{
+    if(!m_threaded) {
+        m_threaded = true;
+        m_renderThread = std::thread(&VICII::renderLoop, this);
+    }
+}
+
+// waits for the render thread and makes its frame the visible one
+void VICII::finishRendering()
+{
+    if(m_renderPending) {
+        int job;
+        m_renderDone.pop(job);
+        m_front = 1 - m_front;
+        m_renderPending = false;
+    }
+}
+
+void VICII::beginFrame()
+{
+    VideoFrameLog& log = m_logs[m_recording];
+    const uint8_t *ram = m_memory->getRam();
+    log.registers = m_registers;
+    log.port = ram[0x0001];
+    memcpy(log.screen, ram + SCREEN_RAM, VIDEO_MATRIX_SIZE);
+    memcpy(log.color, ram + COLOR_RAM, VIDEO_MATRIX_SIZE);
+    log.writes.clear();
+    m_frameTick = 0;
+}
+
+// Hands the finished log to the renderer. With the render thread the sinks
+// get the previous frame, drawn while this one was being emulated.
+void VICII::endFrame()
+{
+    if(1 < m_frameSkip && 0 != m_frameCount % m_frameSkip) { // the log is thrown away undrawn
+        ++m_frameCount;
+        beginFrame();
+        return;
+    }
+
+    uint32_t frame = m_frameCount;
+    m_logs[m_recording].frame = frame;
+    bool ready = true;
+    if(m_threaded) {
+        ready = m_renderPending;
+        finishRendering();
+        frame = m_logs[1 - m_recording].frame;
+        m_renderJobs.push(int(m_recording));
+        m_renderPending = true;
+        m_recording = 1 - m_recording;
+    } else {
+        renderFrame(m_logs[m_recording], m_frameBuffers[m_front]);
+    }
+
+    if(ready) {
+        for(size_t i = 0; i < m_frameSinks.size(); ++i) {
+            m_frameSinks[i]->onFrame(frame, m_frameBuffers[m_front], m_palette);
         }
-        setRasterLine(0);
-        SDL_Rect tgt; tgt.x = 0; tgt.y = 0; tgt.w = SCREEN_WIDTH, tgt.h = SCREEN_HEIGHT;
-        SDL_BlitScaled(m_surface, 0, SDL_GetWindowSurface(m_window), &tgt);
-        SDL_UpdateWindowSurface(m_window);
     }
+    ++m_frameCount;
+    beginFrame();
 }
 
-void VICII::init()
+void VICII::updateInterrupt()
 {
-    int rc = SDL_Init(SDL_INIT_VIDEO);
-    if (0 > rc) {
-        std::cerr << "Failed to start SDL, rc = " << rc << std::endl;
-        std::cerr << "SDL_Error = " << SDL_GetError() << std::endl;
-        exit(rc);
+    if(m_registers.reg.interruptFlags & m_registers.reg.interruptEnable) {
+        m_memory->getInterrupts().raise(IRQ_VIC);
+    } else {
+        m_memory->getInterrupts().release(IRQ_VIC);
     }
+}
 
-    if(SDL_IsTextInputActive()) {
-        printf("Stopping text input for performance reasons!\n");
-        SDL_StopTextInput();
+void VICII::scheduleRasterInterrupt()
+{
+    const int lines = frameLines(m_standard);
+    if(0 == (VIC_IRQ_RASTER & m_registers.reg.interruptEnable) || lines <= m_rasterTrigger) {
+        m_memory->getScheduler().cancel(EVENT_VIC_RASTER);
+        return;
     }
 
-    m_window = SDL_CreateWindow("C64",
-            SDL_WINDOWPOS_UNDEFINED,
-            SDL_WINDOWPOS_UNDEFINED,
-            SCREEN_WIDTH,
-            SCREEN_HEIGHT,
-            SDL_WINDOW_SHOWN);
-    m_surface = SDL_CreateRGBSurface(0, 412, 234, 32, 0, 0, 0, 0);
+    int distance = (m_rasterTrigger - getRasterLine() + lines) % lines;
+    if(0 == distance) {
+        distance = lines;
+    }
+    m_memory->getScheduler().schedule(EVENT_VIC_RASTER, (distance * lineTicks(m_standard)) - m_xCycle);
+}
+
+void VICII::addFrameSink(FrameSink *sink)
+{
+    m_frameSinks.push_back(sink);
+}
+
+void VICII::removeFrameSink(FrameSink *sink)
+{
+    m_frameSinks.erase(
+            std::remove(m_frameSinks.begin(), m_frameSinks.end(), sink),
+            m_frameSinks.end());
+}
+
+uint32_t VICII::getFrameCount() const
+{
+    return m_frameCount;
+}
+
+const uint32_t* VICII::getPalette() const
+{
+    return m_palette;
+}
+
+void VICII::setPalette(const uint32_t *palette)
+{
+    assert(palette);
+    m_palette = palette;
+}
+
+const uint8_t* VICII::getFrameBuffer() const
+{
+    return m_frameBuffers[m_front];
+}
+
+void VICII::saveState(VICIIState& state) const
+{
+    state.registers = m_registers;
+    state.rasterTrigger = m_rasterTrigger;
+    state.xCycle = m_xCycle;
+    state.frameTick = m_frameTick;
+    state.frameCount = m_frameCount;
+    state.log = m_logs[m_recording];
+    memcpy(state.frameBuffer, m_frameBuffers[m_front], sizeof(state.frameBuffer));
+}
+
+void VICII::loadState(const VICIIState& state)
+{
+    finishRendering(); // a frame from the old timeline, never shown
+    m_registers = state.registers;
+    m_rasterTrigger = state.rasterTrigger;
+    m_xCycle = state.xCycle;
+    m_frameTick = state.frameTick;
+    m_frameCount = state.frameCount;
+    m_logs[m_recording] = state.log;
+    memcpy(m_frameBuffers[m_front], state.frameBuffer, sizeof(state.frameBuffer));
+}
+
+void VICII::init()
+{
+    memset(m_frameBuffers, 0, sizeof(m_frameBuffers));
+    m_xCycle = 0;
+    m_recording = 0;
+    setRasterLine(0);
+    m_memory->getScheduler().schedule(EVENT_VIC_FRAME, lineTicks(m_standard) * frameLines(m_standard));
 
     // set default color registers
     //m_memory.write(646, 14);
     m_registers.reg.backgroundColor0 = 6;
     m_registers.reg.borderColor = 14;
+    m_registers.reg.interruptFlags = 0;
+    m_registers.reg.interruptEnable = 0;
+    m_rasterTrigger = 0;
+    beginFrame();
 }
 
 }
@@ -1,16 +1,21 @@
 #ifndef INCLUDED_VICII_H
 #define INCLUDED_VICII_H
 
-#include <SDL2/SDL.h>
 #include <stdint.h>
+#include <vector>
+#include <thread>
+#include "machineconfig.h"
+#include "boundedqueue.h"
 
 namespace MOS6510 {
-const int SCREEN_WIDTH  = 1030;
-const int SCREEN_HEIGHT = 585;
 const uint32_t BG_COLOR = 0xFF9083EC;
 const uint32_t FG_COLOR = 0xFFAAFFEE;
 
+const int FRAME_WIDTH   = 412;
+const int FRAME_HEIGHT  = 234;
+
 class MemoryController;
+class FrameSink;
 
 struct VICIIRegisterFile {
     union {
@@ -67,28 +72,105 @@ struct VICIIRegisterFile {
     };
 };
 
+const uint16_t SCREEN_RAM          = 0x0400;
+const uint16_t COLOR_RAM           = 0xD800;
+const uint16_t VIDEO_MATRIX_SIZE   = 1024;
+
+// the only RAM the renderer looks at, $0001 decides whether colour RAM is banked in
+inline bool isVideoRam(uint16_t addr)
+{
+    return SCREEN_RAM == (addr & 0xFC00) || COLOR_RAM == (addr & 0xFC00) || 0x0001 == addr;
+}
+
+// A register or video RAM write, 'tick' VIC ticks in to the frame. VIC
+// registers are logged as $D000-$D02E, which is never video RAM.
+struct VideoWrite {
+    uint32_t    tick;
+    uint16_t    addr;
+    uint8_t     data;
+};
+
+// Everything the renderer needs for one frame: the registers and video RAM
+// as the frame started, then every write made while it was emulated.
+struct VideoFrameLog {
+    uint32_t                frame;
+    VICIIRegisterFile       registers;
+    uint8_t                 port;
+    uint8_t                 screen[VIDEO_MATRIX_SIZE];
+    uint8_t                 color[VIDEO_MATRIX_SIZE];
+    std::vector<VideoWrite> writes;
+};
+
+struct VICIIState {
+    VICIIRegisterFile   registers;
+    uint16_t            rasterTrigger;
+    uint8_t             xCycle;
+    uint32_t            frameTick;
+    uint32_t            frameCount;
+    VideoFrameLog       log;        // the frame in progress
+    uint8_t             frameBuffer[FRAME_WIDTH * FRAME_HEIGHT];
+};
+
+// Each tick only advances the beam and raises raster interrupts. Pixels
+// are drawn once per frame from a VideoFrameLog, on the emulation thread
+// by default or, after startRenderThread(), on a worker while the next
+// frame is emulated.
 class VICII {
 private:
     VICIIRegisterFile   m_registers;
     MemoryController*   m_memory;
     uint16_t            m_rasterTrigger;
     uint8_t             m_xCycle;
-    SDL_Window *        m_window;
-    SDL_Surface *       m_surface;
-    uint8_t*            m_cgromPtr;
+    uint32_t            m_frameTick;        // ticks since the frame started
+    int                 m_recording;        // index of the log being written
+    VideoStandard       m_standard;
+    const uint8_t*      m_cgromPtr;
+    uint32_t            m_frameCount;
+    const uint32_t*     m_palette;
+    std::vector<FrameSink*> m_frameSinks;
+    uint32_t            m_frameSkip;        // only every n-th frame is drawn and passed on
+    VideoFrameLog       m_logs[2];
+    bool                m_threaded;
+    bool                m_renderPending;    // a log is with the render thread
+    int                 m_front;            // frame buffer the sinks see
+    BoundedQueue<int>   m_renderJobs;
+    BoundedQueue<int>   m_renderDone;
+    std::thread         m_renderThread;
+    uint8_t             m_frameBuffers[2][FRAME_WIDTH * FRAME_HEIGHT]; // palette indices
 
     uint16_t getRasterLine();
     void setRasterLine(uint16_t rasterLine);
+    void updateInterrupt();
+    void scheduleRasterInterrupt();
+    void beginFrame();
+    void endFrame();
+    void finishRendering();
+    void renderFrame(const VideoFrameLog& log, uint8_t *frameBuffer) const;
+    void renderLoop();
 
 public:
-    VICII(MemoryController *memPtr, uint8_t *cgromPtr);
+    VICII(MemoryController *memPtr, const uint8_t *cgromPtr, VideoStandard standard);
     ~VICII();
     
-    uint8_t read(uint8_t addr);
+    uint8_t read(uint8_t addr) const;
     void write(uint8_t addr, uint8_t data);
 
+    void addFrameSink(FrameSink *sink);
+    void removeFrameSink(FrameSink *sink);
+    uint32_t getFrameCount() const;
+    const uint32_t* getPalette() const;
+    void setPalette(const uint32_t *palette);
+    const uint8_t* getFrameBuffer() const;
+    void startRenderThread();   // sinks then see each frame once the next one is emulated
+    void setFrameSkip(uint32_t frames); // 1 draws every frame
+    void logWrite(uint16_t addr, uint8_t data);     // video RAM, see isVideoRam, or $D0xx
+
+    void saveState(VICIIState& state) const;
+    void loadState(const VICIIState& state);
+
     void init();
-    void execute();
+    template <class Config>
+    void execute();     // one tick, Config::STANDARD must match the constructor's
 };
 
 }
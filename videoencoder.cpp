@@ -0,0 +1,173 @@
+#include <assert.h>
+#include <stdio.h>
+#include <cstring>
+#include <iostream>
+#include "videoencoder.h"
+
+namespace MOS6510 {
+
+const size_t MAX_QUEUED_VIDEO_FRAMES = 64;
+
+static void putLE16(std::vector<uint8_t>& dst, uint16_t value)
+{
+    dst.push_back(value & 0xFF);
+    dst.push_back((value >> 8) & 0xFF);
+}
+
+static void putLE32(std::vector<uint8_t>& dst, uint32_t value)
+{
+    putLE16(dst, value & 0xFFFF);
+    putLE16(dst, (value >> 16) & 0xFFFF);
+}
+
+VideoEncoder::VideoEncoder(int width, int height, const uint32_t *palette)
+    : m_width(width)
+    , m_height(height)
+    , m_keyInterval(250)
+    , m_file(0)
+    , m_framesQueued(0)
+    , m_stalls(0)
+    , m_queue(MAX_QUEUED_VIDEO_FRAMES)
+    , m_framesWritten(0)
+{
+    assert(0 == (width % 2));
+    memcpy(m_palette, palette, sizeof(m_palette));
+}
+
+VideoEncoder::~VideoEncoder()
+{
+    if(!m_file) {
+        return;
+    }
+
+    m_queue.close();
+    m_worker.join();
+    fclose(m_file);
+    printf("Recorded %u frames, emulation waited on the encoder %u times\n",
+            m_framesWritten, m_stalls);
+}
+
+bool VideoEncoder::open(const std::string& path)
+{
+    assert(!m_file);
+    m_file = fopen(path.c_str(), "wb");
+    if(!m_file) {
+        std::cerr << "Failed to open video capture " << path << std::endl;
+        return false;
+    }
+
+    std::vector<uint8_t> header;
+    const char magic[8] = { 'C', '6', '4', 'V', 'I', 'D', '1', 0 };
+    header.insert(header.end(), magic, magic + sizeof(magic));
+    putLE16(header, m_width);
+    putLE16(header, m_height);
+    for(int i = 0; i < 16; ++i) {
+        putLE32(header, m_palette[i] & 0x00FFFFFF);
+    }
+    fwrite(header.data(), header.size(), 1, m_file);
+
+    m_worker = std::thread(&VideoEncoder::workerLoop, this);
+    return true;
+}
+
+void VideoEncoder::setKeyInterval(uint32_t interval)
+{
+    m_keyInterval = interval ? interval : 1;
+}
+
+// Indices are stored as they are; the palette they map to went in to the
+// header when the file was opened.
+void VideoEncoder::onFrame(uint32_t frame, const uint8_t *indices, const uint32_t *)
+{
+    if(!m_file) {
+        return;
+    }
+
+    // pack on this thread so only 4 bits per pixel cross the queue
+    const size_t count = (size_t)m_width * m_height;
+    Job job;
+    job.frame = frame;
+    job.packed.resize(count / 2);
+    for(size_t i = 0; i < count; i += 2) {
+        job.packed[i / 2] = ((indices[i] & 0x0F) << 4) | (indices[i + 1] & 0x0F);
+    }
+
+    if(m_queue.push(std::move(job))) {
+        ++m_stalls;
+    }
+    ++m_framesQueued;
+}
+
+void VideoEncoder::workerLoop()
+{
+    Job job;
+    while(m_queue.pop(job)) {
+        encodeFrame(job);
+    }
+}
+
+void VideoEncoder::encodeFrame(Job& job)
+{
+    bool key = m_previous.empty() || (0 == (m_framesWritten % m_keyInterval));
+    if(key) {
+        runLength(job.packed);
+    } else {
+        m_delta.resize(job.packed.size());
+        for(size_t i = 0; i < job.packed.size(); ++i) {
+            m_delta[i] = job.packed[i] ^ m_previous[i];
+        }
+        runLength(m_delta);
+    }
+
+    std::vector<uint8_t> header;
+    putLE32(header, job.frame);
+    header.push_back(key ? 0 : 1);
+    putLE32(header, m_encoded.size());
+    fwrite(header.data(), header.size(), 1, m_file);
+    fwrite(m_encoded.data(), m_encoded.size(), 1, m_file);
+
+    m_previous.swap(job.packed);
+    ++m_framesWritten;
+}
+
+void VideoEncoder::runLength(const std::vector<uint8_t>& src)
+{
+    m_encoded.clear();
+    size_t i = 0;
+    size_t literalStart = 0;
+    while(i < src.size()) {
+        size_t run = 1;
+        while((i + run < src.size()) && (src[i + run] == src[i]) && (130 > run)) {
+            ++run;
+        }
+
+        if(3 <= run || i + run == src.size()) {
+            // flush pending literals first
+            while(literalStart < i) {
+                size_t len = i - literalStart;
+                if(128 < len) {
+                    len = 128;
+                }
+                m_encoded.push_back(len - 1);
+                m_encoded.insert(m_encoded.end(), src.begin() + literalStart,
+                        src.begin() + literalStart + len);
+                literalStart += len;
+            }
+
+            if(3 <= run) {
+                m_encoded.push_back(0x7D + run);
+                m_encoded.push_back(src[i]);
+            } else {
+                m_encoded.push_back(run - 1);
+                m_encoded.insert(m_encoded.end(), src.begin() + i, src.begin() + i + run);
+            }
+
+            i += run;
+            literalStart = i;
+        } else {
+            i += run;
+        }
+    }
+}
+
+}
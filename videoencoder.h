@@ -0,0 +1,62 @@
+#ifndef INCLUDED_VIDEO_ENCODER_H
+#define INCLUDED_VIDEO_ENCODER_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <thread>
+#include "framesink.h"
+#include "boundedqueue.h"
+
+namespace MOS6510 {
+
+// Lossless capture in to a simple ".c64v" container:
+//
+//   header: "C64VID1\0", u16 width, u16 height, u32 palette[16]  (little endian)
+//   frame:  u32 frame number, u8 type (0 = key, 1 = delta), u32 length, payload
+//
+// Pixels are stored as 4-bit palette indices, two per byte with the left
+// pixel in the high nibble. A delta payload is XORed against the previous
+// frame. Both are then run-length coded: a control byte c < 0x80 is followed
+// by c + 1 literal bytes, c >= 0x80 repeats the next byte (c - 0x7D) times.
+class VideoEncoder : public FrameSink {
+private:
+    struct Job {
+        uint32_t                frame;
+        std::vector<uint8_t>    packed;
+    };
+
+    int                         m_width;
+    int                         m_height;
+    uint32_t                    m_palette[16];
+    uint32_t                    m_keyInterval;
+    FILE*                       m_file;
+    uint32_t                    m_framesQueued;
+    uint32_t                    m_stalls;
+
+    // encoder thread state
+    BoundedQueue<Job>           m_queue;
+    std::thread                 m_worker;
+    std::vector<uint8_t>        m_previous;
+    std::vector<uint8_t>        m_delta;
+    std::vector<uint8_t>        m_encoded;
+    uint32_t                    m_framesWritten;
+
+    void workerLoop();
+    void encodeFrame(Job& job);
+    void runLength(const std::vector<uint8_t>& src);
+
+public:
+    VideoEncoder(int width, int height, const uint32_t *palette);
+    virtual ~VideoEncoder();
+
+    bool open(const std::string& path);
+    void setKeyInterval(uint32_t interval);
+
+    virtual void onFrame(uint32_t frame, const uint8_t *indices, const uint32_t *palette);
+};
+
+}
+
+#endif
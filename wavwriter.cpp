@@ -0,0 +1,80 @@
+#include <iostream>
+#include "wavwriter.h"
+
+namespace MOS6510 {
+
+static void putLE(uint8_t *dst, uint32_t value, int bytes)
+{
+    for(int i = 0; i < bytes; ++i) {
+        dst[i] = (value >> (8 * i)) & 0xFF;
+    }
+}
+
+WavWriter::WavWriter()
+    : m_file(0)
+    , m_samples(0)
+{
+}
+
+WavWriter::~WavWriter()
+{
+    close();
+}
+
+bool WavWriter::open(const std::string& path)
+{
+    m_file = fopen(path.c_str(), "wb");
+    if(!m_file) {
+        std::cerr << "Failed to open WAV output " << path << std::endl;
+        return false;
+    }
+
+    m_samples = 0;
+    writeHeader();
+    return true;
+}
+
+void WavWriter::close()
+{
+    if(!m_file) {
+        return;
+    }
+
+    fseek(m_file, 0, SEEK_SET);
+    writeHeader();
+    fclose(m_file);
+    m_file = 0;
+}
+
+void WavWriter::writeHeader()
+{
+    const uint32_t dataBytes = m_samples * 2;
+    uint8_t header[44];
+    putLE(header,      0x46464952, 4);         // "RIFF"
+    putLE(header + 4,  36 + dataBytes, 4);
+    putLE(header + 8,  0x45564157, 4);         // "WAVE"
+    putLE(header + 12, 0x20746D66, 4);         // "fmt "
+    putLE(header + 16, 16, 4);
+    putLE(header + 20, 1, 2);                  // PCM
+    putLE(header + 22, 1, 2);                  // mono
+    putLE(header + 24, AUDIO_SAMPLE_RATE, 4);
+    putLE(header + 28, AUDIO_SAMPLE_RATE * 2, 4);
+    putLE(header + 32, 2, 2);
+    putLE(header + 34, 16, 2);
+    putLE(header + 36, 0x61746164, 4);         // "data"
+    putLE(header + 40, dataBytes, 4);
+    fwrite(header, sizeof(header), 1, m_file);
+}
+
+void WavWriter::onSamples(const int16_t *samples, size_t count)
+{
+    if(!m_file) {
+        return;
+    }
+
+    // .wav is little endian, as are the hosts we build for
+    fwrite(samples, sizeof(int16_t), count, m_file);
+    m_samples += count;
+}
+
+}
@@ -0,0 +1,30 @@
+#ifndef INCLUDED_WAV_WRITER_H
+#define INCLUDED_WAV_WRITER_H
+
+#include <stdio.h>
+#include <string>
+#include "audiosink.h"
+
+namespace MOS6510 {
+
+// Headless audio output: mono 16-bit PCM .wav, header patched on close.
+class WavWriter : public AudioSink {
+private:
+    FILE*       m_file;
+    uint32_t    m_samples;
+
+    void writeHeader();
+
+public:
+    WavWriter();
+    virtual ~WavWriter();
+
+    bool open(const std::string& path);
+    void close();
+
+    virtual void onSamples(const int16_t *samples, size_t count);
+};
+
+}
+
+#endif